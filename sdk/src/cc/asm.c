@@ -857,6 +857,7 @@ void asm_instr(void) {
   uint8_t clobber_regs[NB_ASM_REGS];
 
   next();
+  gnoregvars();
   // Since we always generate the asm() instruction, we can ignore volatile
   if (tok == TOK_VOLATILE1 || tok == TOK_VOLATILE2 || tok == TOK_VOLATILE3) {
     next();
@@ -980,6 +981,7 @@ void masm_instr(TCCState *s1) {
   int saved_parse_flags = parse_flags;
 
   parse_flags = PARSE_FLAG_MASM | PARSE_FLAG_PREPROCESS;
+  gnoregvars();
   next();
   if (tok == '{') {
     parse_flags |= PARSE_FLAG_LINEFEED;
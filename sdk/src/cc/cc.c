@@ -30,6 +30,9 @@ int verbose = 0;
 // Compile with debug symbol (and use them if error during execution)
 int do_debug = 0;
 
+// Optimize generated code (register variables and peephole optimizations)
+int do_optimize = 0;
+
 // Number of token types, including identifiers and strings
 int tok_ident;
 
@@ -60,6 +63,7 @@ static const FlagDef flag_defs[] = {
   { offsetof(TCCState, char_is_unsigned), FD_INVERT, "signed-char" },
   { offsetof(TCCState, nocommon), FD_INVERT, "common" },
   { offsetof(TCCState, leading_underscore), 0, "leading-underscore" },
+  { offsetof(TCCState, pch), 0, "pch" },
 };
 
 #define TCC_OPTION_HAS_ARG 0x0001
@@ -81,6 +85,7 @@ enum {
   TCC_OPTION_l,
   TCC_OPTION_bench,
   TCC_OPTION_g,
+  TCC_OPTION_O,
   TCC_OPTION_c,
   TCC_OPTION_static,
   TCC_OPTION_shared,
@@ -118,6 +123,7 @@ static const TCCOption tcc_options[] = {
   { "l", TCC_OPTION_l, TCC_OPTION_HAS_ARG | TCC_OPTION_NOSEP },
   { "bench", TCC_OPTION_bench, 0 },
   { "g", TCC_OPTION_g, TCC_OPTION_HAS_ARG | TCC_OPTION_NOSEP },
+  { "O", TCC_OPTION_O, TCC_OPTION_HAS_ARG | TCC_OPTION_NOSEP },
   { "c", TCC_OPTION_c, 0 },
   { "static", TCC_OPTION_static, 0 },
   { "shared", TCC_OPTION_shared, 0 },
@@ -209,7 +215,7 @@ static int64_t getclock_us(void) {
 void help(void) {
   printf("tcc version " TCC_VERSION " - Tiny C Compiler - Copyright (C) 2001-2006 Fabrice Bellard\n"
       "usage: cc [-v] [-c] [-o outfile] [-Bdir] [-bench] [-Idir] [-Dsym[=val]] [-Usym]\n"
-      "          [-Wwarn] [-g] [-Ldir] [-llib] [-shared] [-soname name]\n"
+      "          [-Wwarn] [-g] [-O] [-Ldir] [-llib] [-shared] [-soname name]\n"
       "          [-static] [infile1 infile2...]\n"
       "\n"
       "General options:\n"
@@ -222,6 +228,7 @@ void help(void) {
       "  -Wwarning    set or reset (with 'no-' prefix) 'warning' (see man page)\n"
       "  -w           disable all warnings\n"
       "  -g           generate runtime debug info\n"
+      "  -O           optimize generated code (-O0 to disable)\n"
       "Preprocessor options:\n"
       "  -E           preprocess only\n"
       "  -Idir        add include path 'dir'\n"
@@ -335,6 +342,9 @@ int parse_arguments(TCCState *s, int argc, char **argv) {
         case TCC_OPTION_g:
           do_debug = 1;
           break;
+        case TCC_OPTION_O:
+          do_optimize = *oarg != '0';
+          break;
         case TCC_OPTION_c:
           multiple_files = 1;
           output_type = TCC_OUTPUT_OBJ;
@@ -446,11 +446,19 @@ typedef struct {
   Sym *sym;
 } Branch;
 
+// Reference to a register variable candidate in the code buffer
+typedef struct {
+  int ind;
+  int var;
+} VarRef;
+
 typedef struct {
   unsigned char *code;
   int ind;
   Branch *branch;
   int br;
+  VarRef *varref;
+  int nvarref;
 } CodeBuffer;
 
 // Parsing state (used to save parser state to reparse part of the source several times)
@@ -527,6 +535,23 @@ typedef struct CachedInclude {
   char filename[1];               // Path specified in #include
 } CachedInclude;
 
+// Leading include files of a translation unit are kept parsed for the
+// following translation units compiled in the same invocation. Symbols
+// defined by kept include files are saved, so changes made to them by a
+// translation unit can be undone.
+typedef struct PchInclude {
+  Sym *define_top;                // Define stack after include
+  Sym *global_top;                // Global symbol stack after include
+  int nb_syms;                    // Number of saved symbols after include
+  char type;                      // '"' or '>' to give include type
+  char filename[1];               // Path specified in #include
+} PchInclude;
+
+typedef struct PchSym {
+  Sym *sym;                       // Symbol defined by kept include file
+  Sym saved;                      // Symbol after include
+} PchSym;
+
 typedef struct TCCState {
   int output_type;
  
@@ -541,6 +566,20 @@ typedef struct TCCState {
   CachedInclude **cached_includes;
   int nb_cached_includes;
 
+  // Include files kept parsed between translation units
+  PchInclude **pch_includes;
+  int nb_pch_includes;
+  PchInclude **pch_leading;       // Leading includes of current file
+  int nb_pch_leading;
+  PchSym *pch_syms;
+  int nb_pch_syms;
+  int pch_syms_size;
+  Sym *pch_define_base;           // Define stack before first kept include
+  int pch_index;                  // Includes done in current file
+  int pch_matched;                // Kept includes used by current file
+  int pch_active;                 // Leading includes are being kept
+  unsigned long pch_section_size; // Size of sections at start of file
+
   char **library_paths;
   int nb_library_paths;
 
@@ -582,6 +621,9 @@ typedef struct TCCState {
   // If true, do not use common symbols for .bss data
   int nocommon; 
 
+  // If true, leading include files are kept between translation units
+  int pch;
+
   // If true, static linking is performed
   int static_link;
 
@@ -689,6 +731,7 @@ extern int rsym;                  // return symbol
 extern int anon_sym;              // anonymous symbol index
 extern int ind;                   // output code index
 extern int loc;                   // local variable index
+extern int loop_depth;            // loop nesting level of current statement
 extern int func_naked;            // no generation of function prolog
 
 // Expression generation modifiers
@@ -714,6 +757,7 @@ extern SValue *vtop;
 extern TCCState *tcc_state;
 extern int verbose;
 extern int do_debug;
+extern int do_optimize;
 extern int tok_ident;
 
 // Parser state
@@ -808,6 +852,10 @@ Sym *define_find(int v);
 void define_push(int v, int macro_type, int *str, Sym *first_arg);
 void define_undef(Sym *s);
 void unget_tok(int last_tok);
+void pch_begin(TCCState *s1);
+void pch_include_done(TCCState *s1);
+void pch_end(TCCState *s1);
+void pch_reset(TCCState *s1);
 void save_parse_state(ParseState *s);
 void restore_parse_state(ParseState *s);
 
@@ -896,6 +944,8 @@ void gjmp_addr(int a);
 int glabel(void);
 void galign(int n, int v);
 void greloc(Sym *sym, int c, int rel);
+void gregvar(CType *type, int c);
+void gnoregvars(void);
 
 void store(int r, SValue *v);
 void load(int r, SValue *sv);
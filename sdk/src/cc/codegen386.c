@@ -38,6 +38,9 @@ int reg_classes[8] = {
   RC_INT | RC_SAVE | RC_PTR,  // edi
 };
 
+#define TREG_ESI 6
+#define TREG_EDI 7
+
 static unsigned char *code;
 static int code_size;
 static Branch *branch;
@@ -49,6 +52,55 @@ static int func_ret_sub;
 static int func_noargs;
 int func_naked;
 
+// Register variables. With -O, scalar locals and parameters whose address
+// is never taken are candidates for being kept in the callee-saved
+// registers that the register allocator does not use. All references to
+// the candidates are recorded while the function is generated, and the
+// most referenced variables get a register when the function is output.
+
+#define REGVAR_TAINTED 1          // Variable cannot be kept in a register
+
+typedef struct {
+  int c;                          // Frame offset
+  int refs;                       // References weighted by loop nesting
+  int flags;
+  int reg;                        // Assigned register or -1
+} RegVar;
+
+static RegVar *regvar;
+static int nregvar;
+static int regvar_size;
+static VarRef *varref;
+static int nvarref;
+static int varref_size;
+static int regvar_regs;
+static int noregvars;
+
+static int regvar_candidates[] = { TREG_EBX, TREG_ESI, TREG_EDI };
+
+// Register contents cache. With -O, load() and store() keep track of
+// registers that hold the value of a local variable or a constant, so
+// redundant loads and stores can be skipped. The cache is only valid as
+// long as nothing else has been emitted since the last load or store.
+
+#define RCACHE_LOCAL   1          // Register holds value of local variable
+#define RCACHE_CONST   2          // Register holds constant
+
+typedef struct {
+  int flags;
+  int local;
+  int value;
+} RegCache;
+
+static RegCache rcache[8];
+static int rcache_ind;
+static int rcache_br;
+
+// Register whose value the zero flag reflects after an arithmetic operation
+static int flags_reg;
+static int flags_ind;
+static int flags_br;
+
 void reset_code_buf(void) {
   code = NULL;
   code_size = 0;
@@ -56,11 +108,23 @@ void reset_code_buf(void) {
   branch_size = 0;
   ind = 0;
   br = 0;
+  regvar = NULL;
+  nregvar = 0;
+  regvar_size = 0;
+  varref = NULL;
+  nvarref = 0;
+  varref_size = 0;
+  regvar_regs = 0;
+  noregvars = 0;
+  rcache_ind = -1;
+  flags_ind = -1;
 }
 
 void clear_code_buf(void) {
   tcc_free(code);
   tcc_free(branch);
+  tcc_free(regvar);
+  tcc_free(varref);
   reset_code_buf();
 }
 
@@ -200,15 +264,173 @@ void gen_addr32(int r, Sym *sym, int c) {
   }
 }
 
+// Register local variable at frame offset 'c' as register variable candidate
+void gregvar(CType *type, int c) {
+  int bt = type->t & VT_BTYPE;
+  RegVar *v;
+
+  if (!do_optimize) return;
+  if (bt != VT_INT && bt != VT_PTR && bt != VT_ENUM) return;
+  if (type->t & (VT_ARRAY | VT_BITFIELD | VT_VOLATILE)) return;
+
+  if (nregvar == regvar_size) {
+    regvar_size *= 2;
+    if (regvar_size == 0) regvar_size = 32;
+    regvar = tcc_realloc(regvar, regvar_size * sizeof(RegVar));
+  }
+  v = regvar + nregvar++;
+  v->c = c;
+  v->refs = 0;
+  v->flags = 0;
+  v->reg = -1;
+}
+
+// Do not use register variables in current function
+void gnoregvars(void) {
+  noregvars = 1;
+}
+
+// Record reference to local variable at frame offset 'c'. The modrm byte
+// for the reference must be the next byte emitted. If the reference
+// cannot be turned into a register reference, the variable is tainted.
+static void gvarref(int c, int direct) {
+  int i;
+  VarRef *ref;
+
+  for (i = nregvar - 1; i >= 0; --i) {
+    if (regvar[i].c == c) break;
+  }
+  if (i < 0) return;
+
+  if (!direct) {
+    regvar[i].flags |= REGVAR_TAINTED;
+    return;
+  }
+  regvar[i].refs += loop_depth < 5 ? 1 << (2 * loop_depth) : 1024;
+
+  if (nvarref == varref_size) {
+    varref_size *= 2;
+    if (varref_size == 0) varref_size = 128;
+    varref = tcc_realloc(varref, varref_size * sizeof(VarRef));
+  }
+  ref = varref + nvarref++;
+  ref->ind = ind;
+  ref->var = i;
+}
+
+// Assign registers to the most referenced register variable candidates and
+// replace the frame references with register references in the code buffer
+static void assign_regvars(void) {
+  int i, j, r, best, n, len, shift, src, dst, b;
+  unsigned char *newcode;
+  RegVar *v;
+
+  if (noregvars || func_naked || do_debug || nvarref == 0) return;
+
+  for (j = 0; j < countof(regvar_candidates); ++j) {
+    r = regvar_candidates[j];
+    if (r < NB_REGS && reg_classes[r]) continue;
+
+    best = -1;
+    for (i = 0; i < nregvar; ++i) {
+      v = regvar + i;
+      if (v->reg >= 0 || (v->flags & REGVAR_TAINTED) || v->refs < 2) continue;
+      if (best < 0 || v->refs > regvar[best].refs) best = i;
+    }
+    if (best < 0) break;
+
+    regvar[best].reg = r;
+    regvar_regs |= 1 << r;
+  }
+  if (!regvar_regs) return;
+
+  // Rewrite [ebp+disp] operands as register operands and move branch
+  // points down to account for the removed displacements
+  newcode = tcc_malloc(code_size);
+  src = dst = shift = b = 0;
+  for (i = 0; i < nvarref; ++i) {
+    v = regvar + varref[i].var;
+    if (v->reg < 0) continue;
+
+    n = varref[i].ind;
+    while (b < br && branch[b].ind <= n) branch[b++].ind -= shift;
+    memcpy(newcode + dst, code + src, n - src);
+    dst += n - src;
+
+    len = (code[n] & 0xc0) == 0x40 ? 2 : 5;
+    newcode[dst++] = 0xc0 | (code[n] & 0x38) | v->reg;
+    src = n + len;
+    shift += len - 1;
+  }
+  while (b < br) branch[b++].ind -= shift;
+  memcpy(newcode + dst, code + src, ind - src);
+  ind = dst + ind - src;
+
+  tcc_free(code);
+  code = newcode;
+}
+
+// Clear register contents cache if code has been emitted since last update
+static void rcache_check(void) {
+  if (ind != rcache_ind || br != rcache_br) memset(rcache, 0, sizeof(rcache));
+}
+
+static void rcache_sync(void) {
+  rcache_ind = ind;
+  rcache_br = br;
+}
+
+// Forget registers holding local variables that overlap [c, c + size)
+static void rcache_kill(int c, int size) {
+  int r;
+
+  for (r = 0; r < 8; ++r) {
+    if ((rcache[r].flags & RCACHE_LOCAL) && rcache[r].local < c + size && rcache[r].local + 4 > c) {
+      rcache[r].flags &= ~RCACHE_LOCAL;
+    }
+  }
+}
+
+// Check if register holds local variable or constant
+static int rcache_holds(int r, int flags, int c) {
+  if ((rcache[r].flags & flags & RCACHE_LOCAL) && rcache[r].local == c) return 1;
+  if ((rcache[r].flags & flags & RCACHE_CONST) && rcache[r].value == c) return 1;
+  return 0;
+}
+
+// Forget all registers holding local variables
+static void rcache_kill_locals(void) {
+  int r;
+
+  for (r = 0; r < 8; ++r) rcache[r].flags &= ~RCACHE_LOCAL;
+}
+
+// Find register holding local variable or constant
+static int rcache_find(int flags, int c) {
+  int r;
+
+  for (r = 0; r < 8; ++r) {
+    if (rcache_holds(r, flags, c)) return r;
+  }
+  return -1;
+}
+
+static int is_word(int t) {
+  int bt = t & VT_BTYPE;
+  return bt == VT_INT || bt == VT_PTR || bt == VT_ENUM;
+}
+
 void mark_code_buffer(CodeBuffer *cb) {
   cb->code = NULL;
   cb->ind = ind;
   cb->branch = NULL;
   cb->br = br;
+  cb->varref = NULL;
+  cb->nvarref = nvarref;
 }
 
 void cut_code_buffer(CodeBuffer *cb) {
-  int i;
+  int i, n;
   int code_buffer_size = ind - cb->ind;
   int branch_buffer_size = br - cb->br;
   cb->code = (unsigned char *) tcc_malloc(code_buffer_size);
@@ -220,10 +442,21 @@ void cut_code_buffer(CodeBuffer *cb) {
     b->ind -= cb->ind;
     if (b->type == CodeJump) b->target -= cb->br;
   }
+  n = nvarref - cb->nvarref;
+  if (n > 0) {
+    cb->varref = (VarRef *) tcc_malloc(n * sizeof(VarRef));
+    memcpy(cb->varref, varref + cb->nvarref, n * sizeof(VarRef));
+    for (i = 0; i < n; ++i) cb->varref[i].ind -= cb->ind;
+  }
+  nvarref = cb->nvarref;
+  cb->nvarref = n;
+
   ind = cb->ind;
   br = cb->br;
   cb->ind = code_buffer_size;
   cb->br = branch_buffer_size;
+  rcache_ind = -1;
+  flags_ind = -1;
 }
 
 void paste_code_buffer(CodeBuffer *cb) {
@@ -239,8 +472,22 @@ void paste_code_buffer(CodeBuffer *cb) {
     if (b->type == CodeJump) b->target += br_ofs;
   }
 
+  for (i = 0; i < cb->nvarref; ++i) {
+    if (nvarref == varref_size) {
+      varref_size *= 2;
+      if (varref_size == 0) varref_size = 128;
+      varref = tcc_realloc(varref, varref_size * sizeof(VarRef));
+    }
+    varref[nvarref].ind = cb->varref[i].ind + ind_ofs;
+    varref[nvarref].var = cb->varref[i].var;
+    nvarref++;
+  }
+
   free(cb->code);
   free(cb->branch);
+  tcc_free(cb->varref);
+  rcache_ind = -1;
+  flags_ind = -1;
 }
 
 void gen(int c) {
@@ -277,8 +524,12 @@ int skip_nops(int b, int skip_labels) {
 }
 
 void gcode(void) {
-  int i, n, t, r, stacksize, addr, pc, disp, rel, errs, more, func_start;
+  int i, n, t, r, c, stacksize, addr, pc, disp, rel, errs, more, func_start;
   Branch *b, *bn;
+  RegVar *v;
+
+  // Put register variables in registers
+  if (do_optimize) assign_regvars();
 
   // Generate function prolog
   func_start = cur_text_section->data_offset;
@@ -319,6 +570,25 @@ void gcode(void) {
         gen(0x50 + r); // push r
       }
     }
+
+    // Save registers used for register variables and load parameters
+    for (r = 0; r < 8; ++r) {
+      if (regvar_regs & (1 << r)) gen(0x50 + r); // push r
+    }
+    for (i = 0; i < nregvar; ++i) {
+      v = regvar + i;
+      c = v->c;
+      if (v->reg >= 0 && c > 0) {
+        gen(0x8b); // mov c(%ebp), r
+        if (c == (char) c) {
+          gen(0x45 | (v->reg << 3));
+          gen(c);
+        } else {
+          gen(0x85 | (v->reg << 3));
+          genword(c);
+        }
+      }
+    }
   }
 
   // Optimize jumps
@@ -517,6 +787,11 @@ void gcode(void) {
 
   // Generate function epilog
   if (!func_naked) {
+    // Restore registers used for register variables
+    for (r = 7; r >= 0; --r) {
+      if (regvar_regs & (1 << r)) gen(0x58 + r); // pop r
+    }
+
     // Restore callee-saved registers used by function.
     for (r = NB_REGS; r >= 0; --r) {
       if ((reg_classes[r] & RC_SAVE) && (regs_used & (1 << r))) {
@@ -578,7 +853,7 @@ void gen_modrm(int op_reg, int r, Sym *sym, int c) {
 
 // Load 'r' from value 'sv'
 void load(int r, SValue *sv) {
-  int v, t, ft, fc, fr, a;
+  int v, t, ft, fc, fr, a, dr, b0, cached, direct, s;
   SValue v1;
 
   fr = sv->r;
@@ -586,6 +861,33 @@ void load(int r, SValue *sv) {
   fc = sv->c.ul;
   regs_used |= 1 << r;
 
+  cached = 0;
+  direct = 0;
+  dr = r;
+  b0 = br;
+  if (do_optimize) {
+    // Skip load if register already holds the value, or copy it from
+    // another register holding it
+    rcache_check();
+    b0 = br;
+    if ((fr & (VT_VALMASK | VT_LVAL | VT_LVAL_TYPE | VT_SYM)) == (VT_LOCAL | VT_LVAL) && is_word(ft)) {
+      cached = RCACHE_LOCAL;
+    } else if ((fr & (VT_VALMASK | VT_LVAL | VT_SYM)) == VT_CONST && !is_float(ft)) {
+      cached = RCACHE_CONST;
+    }
+    if (cached) {
+      if (rcache_holds(r, cached, fc)) return;
+      s = rcache_find(cached, fc);
+      if (s >= 0) {
+        o(0x89); // mov s, r
+        o(0xc0 + r + s * 8);
+        rcache[r] = rcache[s];
+        rcache_sync();
+        return;
+      }
+    }
+  }
+
   v = fr & VT_VALMASK;
   if (fr & VT_LVAL) {
     if (v == VT_LLOCAL) {
@@ -614,7 +916,9 @@ void load(int r, SValue *sv) {
       o(0xb70f);   // movzwl
     } else {
       o(0x8b);     // movl
+      direct = 1;
     }
+    if ((fr & VT_VALMASK) == VT_LOCAL) gvarref(fc, direct);
     gen_modrm(r, fr, sv->sym, fc);
   } else {
     if (v == VT_CONST) {
@@ -627,6 +931,7 @@ void load(int r, SValue *sv) {
       }
     } else if (v == VT_LOCAL) {
       o(0x8d); // lea xxx(%ebp), r
+      gvarref(fc, 0);
       gen_modrm(r, VT_LOCAL, sv->sym, fc);
     } else if (v == VT_CMP) {
       o(0x0f); // setxx br
@@ -647,11 +952,28 @@ void load(int r, SValue *sv) {
       o(0xc0 + r + v * 8); // mov v, r
     }
   }
+
+  if (do_optimize) {
+    // Update register contents cache
+    if (br != b0) memset(rcache, 0, sizeof(rcache));
+    if (cached == RCACHE_LOCAL) {
+      rcache[dr].flags = RCACHE_LOCAL;
+      rcache[dr].local = fc;
+    } else if (cached == RCACHE_CONST) {
+      rcache[dr].flags = RCACHE_CONST;
+      rcache[dr].value = fc;
+    } else if ((fr & VT_LVAL) || v >= VT_CONST) {
+      rcache[dr].flags = 0;
+    } else if (v != dr) {
+      rcache[dr] = rcache[v];
+    }
+    rcache_sync();
+  }
 }
 
 // Store register 'r' in lvalue 'v'
 void store(int r, SValue *v) {
-  int fr, bt, ft, fc;
+  int fr, bt, ft, fc, sr;
 
   ft = v->type.t;
   fc = v->c.ul;
@@ -659,6 +981,13 @@ void store(int r, SValue *v) {
   bt = ft & VT_BTYPE;
   regs_used |= 1 << r;
 
+  sr = r;
+  if (do_optimize) {
+    // Skip store if register was loaded from the same variable
+    rcache_check();
+    if (fr == VT_LOCAL && is_word(ft) && rcache_holds(r, RCACHE_LOCAL, fc)) return;
+  }
+
   // TODO: incorrect if float reg to reg
   if (bt == VT_FLOAT) {
     o(0xd9); // fsts
@@ -679,10 +1008,28 @@ void store(int r, SValue *v) {
     }
   }
   if (fr == VT_CONST || fr == VT_LOCAL || (v->r & VT_LVAL)) {
+    if (fr == VT_LOCAL) gvarref(fc, is_word(ft));
     gen_modrm(r, v->r, v->sym, fc);
   } else if (fr != r) {
     o(0xc0 + fr + r * 8); // mov r, fr
   }
+
+  if (do_optimize) {
+    // Update register contents cache
+    if (fr == VT_LOCAL) {
+      rcache_kill(fc, bt == VT_DOUBLE ? 8 : bt == VT_LDOUBLE ? 12 : 4);
+      if (is_word(ft)) {
+        rcache[sr].flags |= RCACHE_LOCAL;
+        rcache[sr].local = fc;
+      }
+    } else if (fr != VT_CONST && (v->r & VT_LVAL)) {
+      // Store through pointer may change any local variable
+      rcache_kill_locals();
+    } else if (fr < VT_CONST && fr != sr && !is_float(ft)) {
+      rcache[fr] = rcache[sr];
+    }
+    rcache_sync();
+  }
 }
 
 void gadd_sp(int val) {
@@ -698,6 +1045,7 @@ void gadd_sp(int val) {
 void gcall_or_jmp(int is_jmp) {
   int r;
   Sym *sym;
+  char *name;
 
   if ((vtop->r & (VT_VALMASK | VT_LVAL)) == VT_CONST) {
     // Constant case
@@ -705,6 +1053,14 @@ void gcall_or_jmp(int is_jmp) {
     sym = NULL;
     if (vtop->r & VT_SYM) sym = vtop->sym;
     greloc(sym, vtop->c.ul - 4, 1);
+
+    // Register variables are not preserved by longjmp() and _alloca() only
+    // moves the callee-saved registers pushed by the prolog
+    if (sym && do_optimize) {
+      name = get_tok_str(sym->v, NULL);
+      if (!strcmp(name, "setjmp") || !strcmp(name, "_setjmp") || !strcmp(name, "sigsetjmp")) gnoregvars();
+      if (!strcmp(name, "_alloca") || !strcmp(name, "alloca")) gnoregvars();
+    }
   } else {
     // Otherwise, indirect call
     r = gv(RC_INT);
@@ -874,13 +1230,16 @@ void gfunc_prolog(CType *func_type) {
       // Save FASTCALL register
       if (!func_naked) {
         loc -= 4;
+        gregvar(type, loc);
         o(0x89);     // movl
+        gvarref(loc, 1);
         gen_modrm(fastcall_regs_ptr[param_index], VT_LOCAL, NULL, loc);
         param_addr = loc;
       }
     } else {
       param_addr = addr;
       addr += size;
+      gregvar(type, param_addr);
     }
     sym_push(sym->v & ~SYM_FIELD, type, VT_LOCAL | VT_LVAL, param_addr);
     param_index++;
@@ -937,8 +1296,10 @@ int gtst(int inv, int t) {
       if ((vtop->c.i != 0) != inv) t = gjmp(t, 0);
     } else {
       r = gv(RC_INT);
-      o(0x85);  // test r,r
-      o(0xc0 + r * 9);
+      if (!do_optimize || r != flags_reg || ind != flags_ind || br != flags_br) {
+        o(0x85);  // test r,r
+        o(0xc0 + r * 9);
+      }
       t = gjmp(t, TOK_NE ^ inv); // jz/jnz t
     }
   }
@@ -967,6 +1328,9 @@ void gen_opi(int op) {
             o(0x40 | r);  // inc r
           } else if (op == '-' && c == 1 || op == '+' && c == -1) {
             o(0x48 | r);  // dec r
+          } else if (opc == 7 && c == 0 && do_optimize) {
+            o(0x85);  // test r, r
+            o(0xc0 + r * 9);
           } else {
             o(0x83);
             o(0xc0 | (opc << 3) | r);
@@ -987,6 +1351,11 @@ void gen_opi(int op) {
       if (op >= TOK_ULT && op <= TOK_GT) {
         vtop->r = VT_CMP;
         vtop->c.i = op;
+      } else if (op == '+' || op == '-' || op == '&' || op == '|' || op == '^') {
+        // Zero flag now reflects the result in r
+        flags_reg = r;
+        flags_ind = ind;
+        flags_br = br;
       }
       break;
     case '-':
@@ -1187,6 +1556,7 @@ void gen_opf(int op) {
       } else {
         o(0xd8);
       }
+      if ((r & VT_VALMASK) == VT_LOCAL) gvarref(fc, 0);
       gen_modrm(a, r, vtop->sym, fc);
     }
     vtop--;
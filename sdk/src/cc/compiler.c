@@ -23,6 +23,7 @@
 
 // Global variables
 int rsym, anon_sym, ind, loc;
+int loop_depth;
 SValue vstack[VSTACK_SIZE];
 SValue *vtop;
 
@@ -1659,6 +1660,7 @@ void block(int *bsym, int *csym, int *case_sym, int *def_sym, int case_reg, int
     }
   } else if (tok == TOK_WHILE) {
     next();
+    loop_depth++;
     d = glabel();
     skip('(');
     gexpr();
@@ -1667,6 +1669,7 @@ void block(int *bsym, int *csym, int *case_sym, int *def_sym, int case_reg, int
     b = 0;
     block(&a, &b, case_sym, def_sym, case_reg, 0);
     gjmp(d, 0);
+    loop_depth--;
     gsym(a);
     gsym_at(b, d);
   } else if (tok == '{') {
@@ -1750,6 +1753,7 @@ void block(int *bsym, int *csym, int *case_sym, int *def_sym, int case_reg, int
       vpop();
     }
     skip(';');
+    loop_depth++;
     a = glabel();
     b = 0;
     c = 0;
@@ -1772,11 +1776,13 @@ void block(int *bsym, int *csym, int *case_sym, int *def_sym, int case_reg, int
     save_regs(0);
     paste_code_buffer(&cb);
     gjmp(a, 0);
+    loop_depth--;
     gsym(b);
   } else if (tok == TOK_DO) {
     next();
     a = 0;
     b = 0;
+    loop_depth++;
     d = glabel();
     block(&a, &b, case_sym, def_sym, case_reg, 0);
     skip(TOK_WHILE);
@@ -1785,6 +1791,7 @@ void block(int *bsym, int *csym, int *case_sym, int *def_sym, int case_reg, int
     gexpr();
     c = gtst(0, 0);
     gsym_at(c, d);
+    loop_depth--;
     skip(')');
     gsym(a);
     skip(';');
@@ -2379,6 +2386,7 @@ void decl_initializer_alloc(CType *type, AttributeDef *ad, int r, int has_init,
     if (v) {
       // Local variable
       sym_push(v, type, r, addr);
+      gregvar(type, addr);
     } else {
       // Push local reference
       vset(type, r, addr);
@@ -2572,15 +2580,17 @@ void gen_function(Sym *sym) {
   nocode_wanted = saved_nocode_wanted;
 }
 
-void gen_inline_functions(void) {
+void gen_inline_functions(Sym *kept) {
   Sym *sym;
   CType *type;
-  int *str, inline_generated;
+  int *str, inline_generated, is_kept;
 
   // Iterate while inline function are referenced
   for (;;) {
     inline_generated = 0;
+    is_kept = 0;
     for (sym = global_stack; sym != NULL; sym = sym->prev) {
+      if (sym == kept) is_kept = 1;
       type = &sym->type;
       if (((type->t & VT_BTYPE) == VT_FUNC) &&
           (type->t & (VT_STATIC | VT_INLINE)) == (VT_STATIC | VT_INLINE) &&
@@ -2596,7 +2606,8 @@ void gen_inline_functions(void) {
         gen_function(sym);
         macro_ptr = NULL; // Fail safe
 
-        tok_str_free(str);
+        // Tokens from kept include files are used again by the next file
+        if (!is_kept) tok_str_free(str);
         inline_generated = 1;
       }
     }
@@ -2604,7 +2615,7 @@ void gen_inline_functions(void) {
   }
 
   // Free all remaining inline function tokens
-  for (sym = global_stack; sym != NULL; sym = sym->prev) {
+  for (sym = global_stack; sym != kept; sym = sym->prev) {
     type = &sym->type;
     if (((type->t & VT_BTYPE) == VT_FUNC) && (type->t & (VT_STATIC | VT_INLINE)) == (VT_STATIC | VT_INLINE)) {
       if (sym->r == (VT_SYM | VT_CONST)) continue;
@@ -2821,6 +2832,7 @@ void preprocess_init(TCCState *s1) {
 // Compile the C file opened in 'file'. Return non zero if errors.
 int tcc_compile(TCCState *s1) {
   Sym *define_start;
+  PchInclude *pch;
   char buf[512];
   volatile int section_sym;
 
@@ -2828,6 +2840,7 @@ int tcc_compile(TCCState *s1) {
   printf("%s: **** new file\n", file->filename);
 #endif
   preprocess_init(s1);
+  pch_begin(s1);
 
   func_name = "";
   anon_sym = SYM_FIRST_ANOM; 
@@ -2879,13 +2892,15 @@ int tcc_compile(TCCState *s1) {
   s1->error_set_jmp_enabled = 0;
 
   // Reset define stack, but leave -Dsymbols (may be incorrect if
-  // they are undefined)
-  free_defines(define_start); 
+  // they are undefined) and symbols from kept include files
+  pch = s1->nb_pch_includes > 0 ? s1->pch_includes[s1->nb_pch_includes - 1] : NULL;
+  free_defines(pch ? pch->define_top : define_start); 
 
   // Generate inline functions
-  gen_inline_functions();
+  gen_inline_functions(pch ? pch->global_top : NULL);
 
-  sym_pop(&global_stack, NULL);
+  sym_pop(&global_stack, pch ? pch->global_top : NULL);
+  pch_end(s1);
 
   return s1->nb_errors != 0 ? -1 : 0;
 }
@@ -3052,6 +3067,7 @@ TCCState *tcc_new(void) {
   // Private symbol table for dynamic symbols
   s->dynsymtab_section = new_symtab(s, ".dynsymtab", SHT_SYMTAB, SHF_PRIVATE, ".dynstrtab", ".dynhashtab", SHF_PRIVATE);
   s->alacarte_link = 1;
+  s->pch = 1;
   s->imagebase = 0xFFFFFFFF;
   s->filealign = 512;
 
@@ -3061,6 +3077,9 @@ TCCState *tcc_new(void) {
 void tcc_delete(TCCState *s1) {
   int i, n;
 
+  // Free kept include files
+  pch_reset(s1);
+
   // Free -D defines
   free_defines(NULL);
 
@@ -3135,9 +3154,11 @@ int tcc_add_file_ex(TCCState *s1, const char *filename, int flags) {
     ret = tcc_compile(s1);
   } else if (!strcmp(ext, "S")) {
     // Preprocessed assembler
+    pch_reset(s1);
     ret = tcc_assemble(s1, 1);
   } else if (!strcmp(ext, "s")) {
     // Non-preprocessed assembler
+    pch_reset(s1);
     ret = tcc_assemble(s1, 0);
   } else if (!strcmp(ext, "def")) {
     ret = pe_load_def_file(s1, file->fd);
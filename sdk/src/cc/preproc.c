@@ -1041,6 +1041,225 @@ void add_cached_include(TCCState *s1, int type, const char *filename, int ifndef
   s1->cached_includes_hash[h] = s1->nb_cached_includes;
 }
 
+// Check if include file is protected by an 'ifndef macro' that is defined
+static int pch_guarded(TCCState *s1, PchInclude *inc) {
+  CachedInclude *e;
+
+  e = search_cached_include(s1, inc->type, inc->filename);
+  return e && define_find(e->ifndef_macro);
+}
+
+// Return total size of allocated sections
+static unsigned long pch_section_size(TCCState *s1) {
+  unsigned long size;
+  Section *sec;
+  int i;
+
+  size = s1->nb_sections;
+  for (i = 1; i < s1->nb_sections; i++) {
+    sec = s1->sections[i];
+    if (sec->sh_flags & SHF_ALLOC) size += sec->data_offset;
+  }
+  return size;
+}
+
+// Save symbols from 'top' down to 'bottom'
+static void pch_save(TCCState *s1, Sym *top, Sym *bottom) {
+  Sym *s;
+  PchSym *p;
+
+  for (s = top; s != bottom; s = s->prev) {
+    if (s1->nb_pch_syms == s1->pch_syms_size) {
+      s1->pch_syms_size *= 2;
+      if (s1->pch_syms_size == 0) s1->pch_syms_size = 256;
+      s1->pch_syms = tcc_realloc(s1->pch_syms, s1->pch_syms_size * sizeof(PchSym));
+    }
+    p = s1->pch_syms + s1->nb_pch_syms++;
+    p->sym = s;
+    p->saved = *s;
+  }
+}
+
+// Make the topmost remaining definition of each macro visible again
+static void pch_relink(void) {
+  Sym *s;
+  TokenSym *ts;
+  int v;
+
+  for (s = define_stack; s != NULL; s = s->prev) {
+    v = s->v;
+    if (v >= TOK_IDENT && v < tok_ident) {
+      ts = table_ident[v - TOK_IDENT];
+      if (!ts->sym_define) ts->sym_define = s;
+    }
+  }
+}
+
+// Drop all but the first 'n' kept include files
+static void pch_cut(TCCState *s1, int n) {
+  PchInclude *inc;
+  Sym *s, *bottom;
+  CType *type;
+  int i;
+
+  if (n >= s1->nb_pch_includes) return;
+  inc = n > 0 ? s1->pch_includes[n - 1] : NULL;
+  bottom = inc ? inc->global_top : NULL;
+
+  // Free tokens of inline functions that were never generated
+  for (s = global_stack; s != bottom; s = s->prev) {
+    type = &s->type;
+    if (((type->t & VT_BTYPE) == VT_FUNC) && (type->t & (VT_STATIC | VT_INLINE)) == (VT_STATIC | VT_INLINE)) {
+      tok_str_free(INLINE_DEF(s->r));
+    }
+  }
+
+  free_defines(inc ? inc->define_top : s1->pch_define_base);
+  sym_pop(&global_stack, bottom);
+  pch_relink();
+
+  s1->nb_pch_syms = inc ? inc->nb_syms : 0;
+  for (i = n; i < s1->nb_pch_includes; i++) tcc_free(s1->pch_includes[i]);
+  s1->nb_pch_includes = n;
+}
+
+// Find the #include lines at the start of the file and reuse the kept
+// include files that match them
+void pch_begin(TCCState *s1) {
+  PchInclude *inc;
+  uint8_t *p, *q;
+  int n, c;
+
+  s1->pch_index = 0;
+  s1->pch_matched = 0;
+  s1->pch_active = 0;
+  if (!s1->pch || do_debug) {
+    pch_cut(s1, 0);
+    return;
+  }
+
+  handle_eob();
+  p = file->buf_ptr;
+  for (;;) {
+    // Skip white space and comments
+    while (p < file->buf_end) {
+      if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' || *p == '\f' || *p == '\v') {
+        p++;
+      } else if (p[0] == '/' && p[1] == '/') {
+        while (p < file->buf_end && *p != '\n') p++;
+      } else if (p[0] == '/' && p[1] == '*') {
+        for (p += 2; p < file->buf_end && !(p[0] == '*' && p[1] == '/'); p++);
+        p += 2;
+      } else {
+        break;
+      }
+    }
+    if (p >= file->buf_end || *p++ != '#') break;
+
+    // Only plain #include "file" and #include <file> lines are kept
+    while (*p == ' ' || *p == '\t') p++;
+    if (file->buf_end - p < 8 || memcmp(p, "include", 7) != 0) break;
+    p += 7;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p == '<') {
+      c = '>';
+    } else if (*p == '\"') {
+      c = '\"';
+    } else {
+      break;
+    }
+    q = ++p;
+    while (q < file->buf_end && *q != c && *q != '\n' && *q != '\\') q++;
+    if (q >= file->buf_end || *q != c) break;
+
+    inc = tcc_malloc(sizeof(PchInclude) + (q - p));
+    inc->type = c;
+    memcpy(inc->filename, p, q - p);
+    inc->filename[q - p] = '\0';
+    dynarray_add((void ***) &s1->pch_leading, &s1->nb_pch_leading, inc);
+    p = q + 1;
+  }
+
+  // Drop kept include files not included by this file
+  n = 0;
+  while (n < s1->nb_pch_includes && n < s1->nb_pch_leading) {
+    inc = s1->pch_includes[n];
+    if (inc->type != s1->pch_leading[n]->type) break;
+    if (strcmp(inc->filename, s1->pch_leading[n]->filename) != 0) break;
+    if (!pch_guarded(s1, inc)) break;
+    n++;
+  }
+  pch_cut(s1, n);
+  if (n == 0) s1->pch_define_base = define_stack;
+
+  s1->pch_matched = n;
+  s1->pch_active = s1->nb_pch_leading > n;
+  s1->pch_section_size = pch_section_size(s1);
+}
+
+// Called when an #include in the main file has been processed
+void pch_include_done(TCCState *s1) {
+  PchInclude *inc, *prev;
+  int idx;
+
+  if (!s1->pch_active) return;
+  idx = s1->pch_index++;
+  if (idx < s1->pch_matched) return;
+  if (idx >= s1->nb_pch_leading) {
+    s1->pch_active = 0;
+    return;
+  }
+
+  // Only keep include files with include guards that do not generate
+  // any code or data
+  inc = s1->pch_leading[idx];
+  if (!pch_guarded(s1, inc) ||
+      pch_section_size(s1) != s1->pch_section_size ||
+      s1->pack_stack_ptr != s1->pack_stack || s1->pack_stack[0] != 0) {
+    s1->pch_active = 0;
+    return;
+  }
+
+  // Save symbols defined by include file
+  prev = s1->nb_pch_includes > 0 ? s1->pch_includes[s1->nb_pch_includes - 1] : NULL;
+  pch_save(s1, define_stack, prev ? prev->define_top : s1->pch_define_base);
+  pch_save(s1, global_stack, prev ? prev->global_top : NULL);
+  inc->define_top = define_stack;
+  inc->global_top = global_stack;
+  inc->nb_syms = s1->nb_pch_syms;
+
+  s1->pch_leading[idx] = NULL;
+  dynarray_add((void ***) &s1->pch_includes, &s1->nb_pch_includes, inc);
+}
+
+// Undo changes made by the translation unit to symbols from kept include
+// files. The defines and global symbols of the translation unit must have
+// been popped.
+void pch_end(TCCState *s1) {
+  PchSym *p;
+  int i;
+
+  for (i = 0; i < s1->nb_pch_syms; i++) {
+    p = s1->pch_syms + i;
+    *p->sym = p->saved;
+  }
+  pch_relink();
+
+  dynarray_reset(&s1->pch_leading, &s1->nb_pch_leading);
+  s1->pch_active = 0;
+}
+
+// Drop all kept include files
+void pch_reset(TCCState *s1) {
+  pch_cut(s1, 0);
+  dynarray_reset(&s1->pch_includes, &s1->nb_pch_includes);
+  dynarray_reset(&s1->pch_leading, &s1->nb_pch_leading);
+  tcc_free(s1->pch_syms);
+  s1->pch_syms = NULL;
+  s1->nb_pch_syms = 0;
+  s1->pch_syms_size = 0;
+}
+
 void pragma_parse(TCCState *s1) {
   int val;
 
@@ -1162,6 +1381,7 @@ void preprocess(int is_bof) {
 #ifdef INC_DEBUG
         printf("%s: skipping %s\n", file->filename, buf);
 #endif
+        if (s1->include_stack_ptr == s1->include_stack) pch_include_done(s1);
       } else {
         if (s1->include_stack_ptr >= s1->include_stack + INCLUDE_STACK_SIZE) {
           error("#include recursion too deep");
@@ -1824,6 +2044,7 @@ void next_nomacro1(void) {
           tcc_close(file);
           s1->include_stack_ptr--;
           file = *s1->include_stack_ptr;
+          if (s1->include_stack_ptr == s1->include_stack) pch_include_done(s1);
           p = file->buf_ptr;
           goto redo_no_start;
         }
@@ -40,7 +40,7 @@
 #include <unistd.h>
 #include <sys/stat.h>
 
-#define MAXLINE 512
+#define BLKSIZE (64 * 1024)
 
 struct options {
   int extended;
@@ -54,60 +54,179 @@ struct options {
   regex_t re;
 };
 
-int search_file(FILE *f, char *filename, struct options *opts) {
-  int match;
-  int n;
+struct search {
+  char *filename;
   int linenum;
-  char line[MAXLINE];
-
-  // Handle simple match or no match case
-  if (opts->nolines || opts->matchcount) {
-    // Count number of matches
-    int matches = 0;
-    while (fgets(line, sizeof(line), f) != NULL) {
-      n = strlen(line);
-      if (n > 0 && line[n - 1] == '\n') line[--n] = 0;
-      if (n > 0 && line[n - 1] == '\r') line[--n] = 0;
-
-      match = regexec(&opts->re, line, 0, NULL, 0) != REG_NOMATCH;
-      if (opts->invert) match = !match;
-      if (match) {
-        matches++;
-        if (!opts->matchcount) break;
-      }
+  int matches;
+  struct options *opts;
+};
+
+static char *strip_cr(char *start, char *end, int eof) {
+  char *p;
+  char *q;
+
+  // Remove carriage returns before newlines
+  p = memchr(start, '\r', end - start);
+  if (!p) return end;
+  q = p;
+  while (p < end) {
+    if (*p == '\r' && ((p + 1 < end && p[1] == '\n') || (p + 1 == end && eof))) {
+      p++;
+    } else {
+      *q++ = *p++;
     }
+  }
+  return q;
+}
 
-    // Output filename (and matches) if any matches was found
-    if (opts->matchcount) {
-      if (opts->output_filename) printf("%s:", filename);
-      printf("%d\n", matches);
-    } else if (matches) {
-      printf("%s\n", filename);
+static void handle_line(struct search *s, char *line, char *end, int match) {
+  struct options *opts = s->opts;
+
+  if (opts->invert) match = !match;
+  if (match) {
+    s->matches++;
+    if (!opts->nolines && !opts->matchcount) {
+      if (opts->output_filename) printf("%s:", s->filename);
+      if (opts->output_linenum) printf("%d:", s->linenum);
+      fwrite(line, 1, end - line, stdout);
+      putchar('\n');
     }
-    return 0;
   }
+  s->linenum++;
+}
+
+static void skip_lines(struct search *s, char *start, char *end) {
+  char *p = start;
+  char *nl;
 
-  // Find matches in file
-  linenum = 1;
-  while (fgets(line, sizeof(line), f) != NULL) {
-    n = strlen(line);
-      if (n > 0 && line[n - 1] == '\n') line[--n] = 0;
-      if (n > 0 && line[n - 1] == '\r') line[--n] = 0;
+  // Lines before the next match do not match the pattern
+  while (p < end) {
+    nl = memchr(p, '\n', end - p);
+    if (!nl) nl = end;
+    if (s->opts->invert) {
+      handle_line(s, p, nl, 0);
+    } else {
+      s->linenum++;
+    }
+    p = nl + 1;
+  }
+}
 
-    match = regexec(&opts->re, line, 0, NULL, 0) != REG_NOMATCH;
-    if (opts->invert) match = !match;
+static int search_block(struct search *s, char *start, char *end) {
+  struct options *opts = s->opts;
+  regmatch_t pm[1];
+  char *p;
+  char *stop;
+  char *hit;
+  char *line;
+  char *eol;
+  int match;
 
-    if (match) {
-      if (opts->output_filename) printf("%s:", filename);
-      if (opts->output_linenum) printf("%d:", linenum);
-      printf("%s\n", line);
+  // The regex is compiled with REG_NEWLINE, so the first match in the
+  // block finds the first candidate line. Lines before it cannot match,
+  // and the candidate is checked on its own to get the same result as
+  // matching line by line.
+  p = start;
+  stop = end > start && end[-1] == '\n' ? end - 1 : end;
+  while (p < end) {
+    pm[0].rm_so = 0;
+    pm[0].rm_eo = stop - p;
+    if (regexec(&opts->re, p, 1, pm, REG_STARTEND) != 0) {
+      skip_lines(s, p, end);
+      break;
     }
 
-    linenum++;
+    hit = p + pm[0].rm_so;
+    line = hit;
+    while (line > p && line[-1] != '\n') line--;
+    eol = memchr(hit, '\n', end - hit);
+    if (!eol) eol = end;
+    skip_lines(s, p, line);
+
+    pm[0].rm_so = 0;
+    pm[0].rm_eo = eol - line;
+    match = regexec(&opts->re, line, 0, pm, REG_STARTEND) == 0;
+    handle_line(s, line, eol, match);
+    if (s->matches && opts->nolines && !opts->matchcount) return 1;
+    p = eol + 1;
   }
+
   return 0;
 }
 
+int search_file(FILE *f, char *filename, struct options *opts) {
+  struct search s;
+  char *buf;
+  char *end;
+  int size;
+  int len;
+  int n;
+  int eof;
+  int rc;
+
+  buf = malloc(BLKSIZE);
+  if (!buf) {
+    fprintf(stderr, "error: out of memory\n");
+    return 1;
+  }
+  size = BLKSIZE;
+  len = 0;
+  eof = 0;
+  rc = 0;
+  s.filename = filename;
+  s.linenum = 1;
+  s.matches = 0;
+  s.opts = opts;
+
+  // Read file in large blocks and search all complete lines in each block
+  while (!eof) {
+    n = read(fileno(f), buf + len, size - len);
+    if (n < 0) {
+      perror(filename);
+      rc = 1;
+      break;
+    }
+    if (n == 0) eof = 1;
+    len += n;
+
+    if (eof) {
+      end = buf + len;
+    } else {
+      end = buf + len;
+      while (end > buf && end[-1] != '\n') end--;
+      if (end == buf) {
+        // Line does not fit in buffer
+        if (len == size) {
+          char *newbuf = realloc(buf, size * 2);
+          if (!newbuf) {
+            fprintf(stderr, "error: out of memory\n");
+            rc = 1;
+            break;
+          }
+          buf = newbuf;
+          size *= 2;
+        }
+        continue;
+      }
+    }
+
+    n = buf + len - end;
+    if (search_block(&s, buf, strip_cr(buf, end, eof))) break;
+    memmove(buf, end, n);
+    len = n;
+  }
+  free(buf);
+
+  // Output filename (and matches) if any matches was found
+  if (opts->matchcount) {
+    if (opts->output_filename) printf("%s:", filename);
+    printf("%d\n", s.matches);
+  } else if (opts->nolines && s.matches) {
+    printf("%s\n", filename);
+  }
+  return rc;
+}
+
 int search_directory(char *path, struct options *opts) {
   struct dirent *dp;
   DIR *dirp;
@@ -219,6 +338,7 @@ shellcmd(grep) {
 
   // Convert patttern to regex
   reflags = opts.extended ? REG_EXTENDED : REG_BASIC;
+  reflags |= REG_NEWLINE;
   if (opts.nocase) reflags |= REG_ICASE;
   rc = regcomp(&opts.re, pattern, reflags);
   if (rc != 0) {
@@ -145,6 +145,8 @@
 #define ECHKSUM         87               // Checksum error
 #define EBADSLT         88               // Invalid slot
 #define EREMOTEIO       89               // Remote I/O error
+#define ECANCELED       90               // Operation canceled
+#define EPENDING        91               // I/O operation pending
 
 //
 // Error code aliases
@@ -96,6 +96,7 @@ struct httpd_context;
 struct httpd_request;
 struct httpd_response;
 struct httpd_connection;
+struct httpd_cache;
 
 typedef int (*httpd_handler)(struct httpd_connection *conn);
 
@@ -143,6 +144,7 @@ struct httpd_server {
   char *indexname;
   char *swname;
   int allowdirbrowse;
+  struct httpd_cache *cache;
 
   char *logdir;
   int nlogcolumns;
@@ -189,6 +191,7 @@ struct httpd_request {
   char *referer;
   char *user_agent;
   char *accept;
+  char *accept_encoding;
   char *cookie;
   char *authorization;
   char *content_type;
@@ -274,6 +277,16 @@ httpdapi int httpd_resource_handler(struct httpd_connection *conn);
 
 #ifdef HTTPD_LIB
 
+// hfile.c
+
+char *get_extension(char *path);
+
+// hcache.c
+
+struct httpd_cache *init_file_cache(struct section *cfg);
+int serve_cached_file(struct httpd_connection *conn);
+int cache_file(struct httpd_connection *conn, char *filename, struct stat64 *statbuf, int dirindex);
+
 // hlog.c
 
 int parse_log_columns(struct httpd_server *server, char *fields);
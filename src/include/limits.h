@@ -40,6 +40,7 @@
 
 #define PATH_MAX      255
 #define ARG_MAX       131072
+#define PIPE_BUF      4096              // Max size of atomic pipe write
 
 #define CHAR_BIT      8                 // Number of bits in a char
 #define SCHAR_MIN   (-128)              // Minimum signed char value
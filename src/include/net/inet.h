@@ -39,6 +39,12 @@
 unsigned short inet_chksum(void *data, int len);
 unsigned short inet_chksum_pbuf(struct pbuf *p);
 unsigned short inet_chksum_pseudo(struct pbuf *p, struct ip_addr *src, struct ip_addr *dest, unsigned char proto, unsigned short proto_len);
+unsigned short inet_chksum_pseudo_acc(unsigned long acc, struct ip_addr *src, struct ip_addr *dest, unsigned char proto, unsigned short proto_len);
+unsigned short inet_chksum_adjust(unsigned short chksum, unsigned short oldval, unsigned short newval);
+unsigned long inet_chksum_partial(void *data, int len);
+unsigned long inet_chksum_copy(void *dst, void *src, int len);
+unsigned long inet_chksum_add(unsigned long acc1, unsigned long acc2, int offset);
+void inet_init();
 
 #if BYTE_ORDER == BIG_ENDIAN
 
@@ -64,6 +64,10 @@
 //#define TCP_SND_QUEUELEN        (2 * TCP_SND_BUF / TCP_MSS)
 #define TCP_SND_QUEUELEN        (2 * TCP_SND_BUF / TCP_MIN_SEGLEN)
 
+#define UDP_RCVBUF              (64 * 1024)      // Default UDP receive queue limit
+#define UDP_MIN_RCVBUF          2048             // Minimum UDP receive queue limit
+#define UDP_MAX_RCVBUF          (1024 * 1024)    // Maximum UDP receive queue limit
+
 #define MEM_ALIGNMENT           4
 #define PBUF_POOL_SIZE          128
 #define PBUF_POOL_BUFSIZE       128
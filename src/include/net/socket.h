@@ -52,6 +52,13 @@
 #define SOCK_NODELAY          2
 #define SOCK_BCAST            4
 #define SOCK_LINGER           8
+#define SOCK_CORK             16
+
+//
+// Maximum number of messages in recvmmsg/sendmmsg
+//
+
+#define SOCK_MAXMMSG          1024
 
 //
 // Socket state
@@ -77,6 +84,7 @@
 #define SOCKREQ_SENDTO        5
 #define SOCKREQ_CLOSE         6
 #define SOCKREQ_WAITRECV      7
+#define SOCKREQ_RECVMMSG      8
 
 struct sockreq;
 
@@ -95,6 +103,7 @@ struct sockops {
   int (*setsockopt)(struct socket *s, int level, int optname, const void *optval, int optlen);
   int (*shutdown)(struct socket *s, int how);
   int (*socket)(struct socket *s, int domain, int type, int protocol);
+  int (*recvmmsg)(struct socket *s, struct mmsghdr *msgvec, unsigned int vlen, unsigned int flags);
 };
 
 struct tcpsocket {
@@ -113,6 +122,10 @@ struct udpsocket {
   struct udp_pcb *pcb;
   struct pbuf *recvhead;
   struct pbuf *recvtail;
+
+  unsigned int rcvbuf;          // Receive queue limit in bytes (SO_RCVBUF)
+  unsigned int rcvqueued;       // Bytes currently in receive queue
+  unsigned long rcvdrops;       // Datagrams dropped due to full receive queue
 };
 
 struct rawsocket {
@@ -150,10 +163,15 @@ struct sockreq {
   err_t rc;
   struct msghdr *msg;
   struct socket *newsock;
+
+  struct mmsghdr *msgvec;       // Message vector for SOCKREQ_RECVMMSG
+  unsigned int vlen;            // Number of entries in message vector
+  unsigned int count;           // Number of entries filled
 };
 
 err_t submit_socket_request(struct socket *s, struct sockreq *req, int type, struct msghdr *msg, unsigned int timeout);
 void release_socket_request(struct sockreq *req, int rc);
+void cancel_socket_request(struct sockreq *req);
 void socket_init();
 
 int accept(struct socket *s, struct sockaddr *addr, int *addrlen, struct socket **retval);
@@ -168,9 +186,11 @@ int listen(struct socket *s, int backlog);
 int recv(struct socket *s, void *data, int size, unsigned int flags);
 int recvfrom(struct socket *s, void *data, int size, unsigned int flags, struct sockaddr *from, int *fromlen);
 int recvmsg(struct socket *s, struct msghdr *msg, unsigned int flags);
+int recvmmsg(struct socket *s, struct mmsghdr *msgvec, unsigned int vlen, unsigned int flags);
 int recvv(struct socket *s, struct iovec *iov, int count);
 int send(struct socket *s, void *data, int size, unsigned int flags);
 int sendmsg(struct socket *s, struct msghdr *msg, unsigned int flags);
+int sendmmsg(struct socket *s, struct mmsghdr *msgvec, unsigned int vlen, unsigned int flags);
 int sendto(struct socket *s, void *data, int size, unsigned int flags, struct sockaddr *to, int tolen);
 int sendv(struct socket *s, struct iovec *iov, int count);
 int setsockopt(struct socket *s, int level, int optname, const void *optval, int optlen);
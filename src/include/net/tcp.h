@@ -247,6 +247,7 @@ struct tcp_seg {
   void *dataptr;           // Pointer to the TCP data in the pbuf
   int len;                 // TCP length of this segment
   struct tcp_hdr *tcphdr;  // TCP header
+  unsigned short chksum;   // Partial checksum of the TCP data
 };
 
 // Internal functions and global variables
@@ -304,6 +305,13 @@ extern struct tcp_pcb *tcp_tw_pcbs;             // List of all TCP PCBs in TIME-
 // Define two macros, TCP_REG and TCP_RMV that registers a TCP PCB
 // with a PCB list or removes a PCB from a list, respectively.
 
+// Set new TCP state for PCB and record the transition in the kernel trace.
+
+#define TCP_SET_STATE(pcb, newstate) do { \
+                            TRACE(TRACE_TCP_STATE, pcb, (pcb)->state << 16 | (newstate)); \
+                            (pcb)->state = (newstate); \
+                            } while (0)
+
 #define TCP_REG(pcbs, npcb) do { \
                             npcb->next = *pcbs; \
                             *pcbs = npcb; \
@@ -39,5 +39,6 @@
 #define NETINET_TCP_H
 
 #define TCP_NODELAY     0x0001
+#define TCP_CORK        0x0003
 
 #endif
@@ -169,6 +169,7 @@ struct tms {
 #define MEM_RELEASE             0x8000
 
 #define MEM_ALIGN64K            0x10000000
+#define MEM_LARGE_PAGES         0x20000000
 
 //
 // Thread priorities
@@ -372,6 +373,8 @@ struct tms {
 #define LOG_HEAP                (14<<3)
 #define LOG_APITRACE            (15<<3)
 
+#define LOGWRITE_RECORD         1     // Write record separately, e.g. to datagram socket
+
 #ifdef TRACEAPI
 #define TRACE(s) syslog(LOG_APITRACE, "%s called", s);
 #else
@@ -493,6 +496,8 @@ struct tms {
 #define ECHKSUM         87               // Checksum error
 #define EBADSLT         88               // Invalid slot
 #define EREMOTEIO       89               // Remote I/O error
+#define ECANCELED       90               // Operation canceled
+#define EPENDING        91               // I/O operation pending
 
 //
 // Error code aliases
@@ -643,10 +648,9 @@ struct sigaction {
 //
 
 struct critsect {
-  long count;
+  long lock;         // 0: free, 1: locked, 2: locked with waiters
   long recursion;
   tid_t owner;
-  handle_t event;
 };
 
 typedef struct critsect *critsect_t;
@@ -801,6 +805,14 @@ struct serial_status {
 #define IOCTL_SET_TTY            1033
 #define IOCTL_GET_TTY            1034
 
+//
+// Profiler
+//
+
+#define IOCTL_PROF_START         1024
+#define IOCTL_PROF_STOP          1025
+#define IOCTL_PROF_RESET         1026
+
 //
 // I/O control codes
 //
@@ -830,6 +842,12 @@ struct serial_status {
 
 #define SIOWAITRECV   _IOCW('s', 120, unsigned long)
 
+//
+// Splice flags
+//
+
+#define SPLICE_F_NONBLOCK 0x02          // Do not block on pipe
+
 #define SIOIFLIST     _IOCRW('i', 20, void *)           // Get netif list
 #define SIOIFCFG      _IOCRW('i', 21, void *)           // Configure netif
 
@@ -903,6 +921,17 @@ struct msghdr {
   int msg_namelen;
   struct iovec *msg_iov;
   int msg_iovlen;
+  int msg_flags;
+};
+
+#endif
+
+#ifndef _MMSGHDR_DEFINED
+#define _MMSGHDR_DEFINED
+
+struct mmsghdr {
+  struct msghdr msg_hdr;       // Message header
+  unsigned int msg_len;        // Number of bytes transferred
 };
 
 #endif
@@ -973,10 +1002,18 @@ struct servent {
 #define SO_SNDTIMEO     0x1005
 #define SO_RCVTIMEO     0x1006
 #define SO_LINGER       0x0080
+#define SO_SNDBUF       0x1001
+#define SO_RCVBUF       0x1002
+#define SO_RCVDROPS     0x1100
 
 #define SO_DONTLINGER   ((unsigned int) (~SO_LINGER))
 
+#define MSG_TRUNC       0x0020
+#define MSG_DONTWAIT    0x0040
+#define MSG_MORE        0x8000
+
 #define TCP_NODELAY     0x0001
+#define TCP_CORK        0x0003
 
 #define SHUT_RD         0x00
 #define SHUT_WR         0x01
@@ -1466,6 +1503,7 @@ osapi handle_t _opendir(const char *name);
 osapi int _readdir(handle_t f, struct direntry *dirp, int count);
 
 osapi int pipe(handle_t fildes[2]);
+osapi int splice(handle_t in, handle_t out, size_t size, int flags);
 
 osapi void *vmalloc(void *addr, unsigned long size, int type, int protect, unsigned long tag);
 osapi int vmfree(void *addr, unsigned long size, int type);
@@ -1488,11 +1526,15 @@ osapi int ereset(handle_t h);
 osapi handle_t mksem(int initial_count);
 osapi int semrel(handle_t h, int count);
 
+osapi int futex_wait(int *addr, int value, unsigned int timeout);
+osapi int futex_wake(int *addr, int count);
+
 osapi handle_t mkmutex(int owned);
 osapi int mutexrel(handle_t h);
 
 osapi handle_t mkiomux(int flags);
 osapi int dispatch(handle_t iomux, handle_t h, int events, int context);
+osapi int iopost(handle_t iomux, int context);
 osapi int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, const struct timeval *timeout);
 osapi int poll(struct pollfd fds[], unsigned int nfds, int timeout);
 
@@ -1579,6 +1621,8 @@ osapi void closelog();
 osapi int setlogmask(int mask);
 osapi void syslog(int pri, const char *fmt, ...);
 osapi void vsyslog(int pri, const char *fmt, va_list args);
+osapi int logwrite(handle_t f, const void *data, int size, int flags);
+osapi int logflush();
 
 osapi void panic(const char *msg);
 osapi int canonicalize(const char *filename, char *buffer, int size);
@@ -1610,6 +1654,13 @@ osapi void free(void *p);
 osapi struct mallinfo mallinfo();
 osapi int malloc_usable_size(void *p);
 
+osapi struct heap *mkheap(size_t reserve, size_t commit);
+osapi int rmheap(struct heap *heap);
+osapi void *halloc(struct heap *heap, size_t size);
+osapi void *hrealloc(struct heap *heap, void *mem, size_t size);
+osapi void *hcalloc(struct heap *heap, size_t num, size_t size);
+osapi void hfree(struct heap *heap, void *p);
+
 osapi hmodule_t dlopen(const char *name, int mode);
 osapi int dlclose(hmodule_t hmod);
 osapi void *dlsym(hmodule_t hmod, const char *procname);
@@ -1637,9 +1688,11 @@ osapi int listen(int s, int backlog);
 osapi int recv(int s, void *data, int size, unsigned int flags);
 osapi int recvfrom(int s, void *data, int size, unsigned int flags, struct sockaddr *from, int *fromlen);
 osapi int recvmsg(int s, struct msghdr *hdr, unsigned int flags);
+osapi int recvmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, unsigned int flags);
 osapi int send(int s, const void *data, int size, unsigned int flags);
 osapi int sendto(int s, const void *data, int size, unsigned int flags, const struct sockaddr *to, int tolen);
 osapi int sendmsg(int s, struct msghdr *hdr, unsigned int flags);
+osapi int sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, unsigned int flags);
 osapi int setsockopt(int s, int level, int optname, const void *optval, int optlen);
 osapi int shutdown(int s, int how);
 osapi int socket(int domain, int type, int protocol);
@@ -190,6 +190,20 @@ struct geometry {
   int sectors;
 };
 
+//
+// Disk partition
+//
+
+#define MAX_PARTITIONS 4
+
+struct partition {
+  dev_t dev;
+  unsigned int start;
+  unsigned int len;
+  unsigned short bootid;
+  unsigned short systid;
+};
+
 //
 // Board info
 //
@@ -243,6 +257,8 @@ krnlapi int dev_ioctl(dev_t devno, int cmd, void *args, size_t size);
 krnlapi int dev_read(dev_t devno, void *buffer, size_t count, blkno_t blkno, int flags);
 krnlapi int dev_write(dev_t devno, void *buffer, size_t count, blkno_t blkno, int flags);
 
+krnlapi int create_partitions(dev_t devno, struct partition *parts);
+
 krnlapi int dev_attach(dev_t dev, struct netif *netif, int (*receive)(struct netif *netif, struct pbuf *p));
 krnlapi int dev_detach(dev_t devno);
 krnlapi int dev_transmit(dev_t devno, struct pbuf *p);
@@ -61,6 +61,7 @@
 
 #include <os/kmem.h>
 #include <os/kmalloc.h>
+#include <os/vmregion.h>
 #include <os/vmm.h>
 
 #include <os/syspage.h>
@@ -72,6 +73,9 @@
 #include <os/timer.h>
 #include <os/user.h>
 #include <os/object.h>
+#include <os/futex.h>
+#include <os/trace.h>
+#include <os/prof.h>
 #include <os/queue.h>
 #include <os/sched.h>
 #include <os/trap.h>
@@ -137,6 +141,7 @@ void init_smbfs();
 
 void init_pipefs();
 int pipe(struct file **readpipe, struct file **writepipe);
+int splice(struct object *in, struct object *out, size_t size, int flags);
 
 // cdfs.c
 
@@ -168,6 +173,10 @@ void init_fd();
 
 void init_vblk();
 
+// ahci.c
+
+void init_ahci();
+
 // apm.c
 
 void apm_power_off();
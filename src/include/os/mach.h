@@ -212,6 +212,24 @@ unsigned long __inline get_cr2() {
   return val;
 }
 
+unsigned long __inline get_cr4() {
+  unsigned long val;
+
+  __asm {
+    mov eax, cr4
+    mov val, eax
+  }
+
+  return val;
+}
+
+void __inline set_cr4(unsigned long val) {
+  __asm {
+    mov eax, val
+    mov cr4, eax
+  }
+}
+
 __declspec(naked) unsigned __int64 __inline rdtsc() {
   __asm {
     rdtsc
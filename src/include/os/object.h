@@ -78,6 +78,13 @@
 
 #define THREAD_NAME_LEN          16
 
+#define CPU_MODE_USER            0
+#define CPU_MODE_KERNEL          1
+#define CPU_MODE_DPC             2
+#define CPU_MODE_IRQ             3
+
+#define CPU_MODES                4
+
 struct thread;
 struct waitblock;
 
@@ -122,6 +129,11 @@ struct ioobject {
   unsigned short events_monitored;
 };
 
+struct iopacket {
+  struct iopacket *next;
+  int context;
+};
+
 struct iomux {
   struct object object;
   int flags;
@@ -131,6 +143,9 @@ struct iomux {
 
   struct ioobject *waiting_head;
   struct ioobject *waiting_tail;
+
+  struct iopacket *posted_head;
+  struct iopacket *posted_tail;
 };
 
 struct event {
@@ -184,6 +199,7 @@ struct thread {
   struct timer alarm;
 
   struct tms tms;
+  unsigned __int64 cputime[CPU_MODES];
   unsigned long context_switches;
   unsigned long preempts;
 
@@ -275,6 +291,7 @@ krnlapi int wait_for_any_object(struct object **objs, int count, unsigned int ti
 krnlapi void init_iomux(struct iomux *iomux, int flags);
 int close_iomux(struct iomux *iomux);
 krnlapi int queue_ioobject(struct iomux *iomux, object_t hobj, int events, int context);
+krnlapi int post_iomux(struct iomux *iomux, int context);
 krnlapi void init_ioobject(struct ioobject *iob, int type);
 krnlapi void detach_ioobject(struct ioobject *iob);
 krnlapi void set_io_event(struct ioobject *iob, int events);
@@ -40,24 +40,30 @@ typedef unsigned long pte_t;
 #define PAGESHIFT      12
 #define PTES_PER_PAGE  (PAGESIZE / sizeof(pte_t))
 
+#define LARGEPAGESIZE  (4 * 1024 * 1024)
+
 #define PT_PRESENT   0x001
 #define PT_WRITABLE  0x002
 #define PT_USER      0x004
 #define PT_ACCESSED  0x020
 #define PT_DIRTY     0x040
+#define PT_LARGE     0x080
 
 #define PT_GUARD     0x200
 #define PT_FILE      0x400
+#define PT_DEMAND    0x800
 
 #define PT_USER_READ    (PT_PRESENT | PT_USER)
 #define PT_USER_WRITE   (PT_PRESENT | PT_USER | PT_WRITABLE)
 
-#define PT_FLAGMASK     (PT_PRESENT | PT_WRITABLE | PT_USER | PT_ACCESSED | PT_DIRTY | PT_GUARD | PT_FILE)
+#define PT_FLAGMASK     (PT_PRESENT | PT_WRITABLE | PT_USER | PT_ACCESSED | PT_DIRTY | PT_GUARD | PT_FILE | PT_DEMAND)
 #define PT_PROTECTMASK  (PT_WRITABLE | PT_USER | PT_GUARD)
 
 #define PT_PFNMASK   0xFFFFF000
 #define PT_PFNSHIFT  12
 
+#define PT_LARGEMASK 0xFFC00000
+
 #define PDEIDX(vaddr)  (((unsigned long) vaddr) >> 22)
 #define PTEIDX(vaddr)  ((((unsigned long) vaddr) >> 12) & 0x3FF)
 #define PGOFF(vaddr)   (((unsigned long) vaddr) & 0xFFF)
@@ -88,15 +94,19 @@ struct pdirstat {
 
 extern pte_t *pdir;
 extern pte_t *ptab;
+extern int large_pages;
 
 krnlapi void map_page(void *vaddr, unsigned long pfn, unsigned long flags);
 krnlapi void unmap_page(void *vaddr);
+krnlapi void map_large_page(void *vaddr, unsigned long pfn, unsigned long flags);
+krnlapi void unmap_large_page(void *vaddr);
 krnlapi unsigned long virt2phys(void *vaddr);
 krnlapi unsigned long virt2pfn(void *vaddr);
 krnlapi pte_t get_page_flags(void *vaddr);
 krnlapi void set_page_flags(void *vaddr, unsigned long flags);
 krnlapi int page_mapped(void *vaddr);
 krnlapi int page_directory_mapped(void *vaddr);
+krnlapi int page_large(void *vaddr);
 krnlapi void unguard_page(void *vaddr);
 krnlapi void clear_dirty(void *vaddr);
 
@@ -50,11 +50,14 @@ struct pageframe {
 extern struct pageframe *pfdb;
 
 extern unsigned long freemem;
+extern unsigned long zeromem;
 extern unsigned long totalmem;
 extern unsigned long maxmem;
 
 krnlapi unsigned long alloc_pageframe(unsigned long tag);
+krnlapi unsigned long alloc_zeroed_pageframe(unsigned long tag, int *zeroed);
 krnlapi unsigned long alloc_linear_pageframes(int pages, unsigned long tag);
+krnlapi unsigned long alloc_aligned_pageframes(int pages, int align, unsigned long tag);
 krnlapi void free_pageframe(unsigned long pfn);
 krnlapi void set_pageframe_tag(void *addr, unsigned int len, unsigned long tag);
 
@@ -65,5 +68,6 @@ int memstat_proc(struct proc_file *pf, void *arg);
 int physmem_proc(struct proc_file *pf, void *arg);
 
 void init_pfdb();
+void init_zeropool();
 
 #endif
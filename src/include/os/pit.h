@@ -49,14 +49,19 @@
 extern struct timeval systemclock;
 extern volatile unsigned int ticks;
 extern volatile unsigned int clocks;
+extern int timer_multiplier;
 
 krnlapi unsigned int get_ticks();
 
 krnlapi void udelay(unsigned long us);
 
+krnlapi unsigned __int64 cycles_to_usecs(unsigned __int64 cycles);
+krnlapi clock_t cycles_to_clocks(unsigned __int64 cycles);
+
 krnlapi unsigned char read_cmos_reg(int reg);
 krnlapi void write_cmos_reg(int reg, unsigned char val);
 
+void set_timer_multiplier(int mult);
 void init_pit();
 void calibrate_delay();
 
@@ -0,0 +1,54 @@
+//
+// prof.h
+//
+// Sampling CPU profiler
+//
+// Copyright (C) 2013 Michael Ringgaard. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 
+// 1. Redistributions of source code must retain the above copyright 
+//    notice, this list of conditions and the following disclaimer.  
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.  
+// 3. Neither the name of the project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission. 
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+
+#ifndef PROF_H
+#define PROF_H
+
+#define PROF_DEPTH              8         // Max. number of frames per sample
+#define PROF_SAMPLES            32768     // Size of sample buffer
+#define PROF_DEFAULT_RATE       1000      // Default sample rate (Hz)
+#define PROF_MAX_RATE           10000     // Max. sample rate (Hz)
+
+struct prof_sample {
+  int depth;                  // Number of valid return addresses
+  void *eip[PROF_DEPTH];      // Interrupted eip followed by callers
+};
+
+krnlapi extern int prof_enabled;
+
+krnlapi int prof_start(int rate);
+krnlapi int prof_stop();
+krnlapi int prof_reset();
+
+void prof_sample(struct context *ctxt);
+
+void init_prof();
+
+#endif
@@ -111,6 +111,9 @@ extern int in_dpc;
 extern int preempt;
 extern unsigned long dpc_time;
 
+extern int cpu_mode;
+extern unsigned __int64 cpu_mode_time[CPU_MODES];
+
 #if 0
 __inline __declspec(naked) struct thread *self() {
   __asm {
@@ -156,6 +159,7 @@ int get_thread_priority(struct thread *t);
 int set_thread_priority(struct thread *t, int priority);
 
 int get_thread_times(struct thread *t, struct tms *tms);
+int account_cpu_time(int mode);
 
 krnlapi int init_task_queue(struct task_queue *tq, int priority, int maxsize, char *name);
 krnlapi void init_task(struct task *task);
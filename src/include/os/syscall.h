@@ -146,7 +146,13 @@
 #define SYSCALL_VMMAP         109
 #define SYSCALL_VMSYNC        110
 #define SYSCALL_THREADTIMES   111
+#define SYSCALL_RECVMMSG      112
+#define SYSCALL_SENDMMSG      113
+#define SYSCALL_FUTEX_WAIT    114
+#define SYSCALL_FUTEX_WAKE    115
+#define SYSCALL_SPLICE        116
+#define SYSCALL_IOPOST        117
 
-#define SYSCALL_MAX           111
+#define SYSCALL_MAX           117
 
 #endif
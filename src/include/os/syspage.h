@@ -185,6 +185,7 @@ krnlapi extern struct syspage *syspage;
 #define OSVMAP_ADDRESS  (SYSBASE + 4 * PAGESIZE)
 #define KMODMAP_ADDRESS (SYSBASE + 5 * PAGESIZE)
 #define VIDBASE_ADDRESS (SYSBASE + 6 * PAGESIZE)
+#define ZEROPAGE_ADDRESS (SYSBASE + 7 * PAGESIZE)
 
 #define DMABUF_ADDRESS  (SYSBASE + 16 * PAGESIZE)  // 64K
 #define INITRD_ADDRESS  (SYSBASE + 32 * PAGESIZE)  // 512K
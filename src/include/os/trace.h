@@ -0,0 +1,93 @@
+//
+// trace.h
+//
+// Kernel event tracing
+//
+// Copyright (C) 2013 Michael Ringgaard. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 
+// 1. Redistributions of source code must retain the above copyright 
+//    notice, this list of conditions and the following disclaimer.  
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.  
+// 3. Neither the name of the project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission. 
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+// 
+
+#ifndef TRACE_H
+#define TRACE_H
+
+//
+// Trace events
+//
+
+#define TRACE_SWITCH            1     // Context switch (prev tid, next tid)
+#define TRACE_SYSCALL_ENTER     2     // System call entry (syscallno, 0)
+#define TRACE_SYSCALL_EXIT      3     // System call exit (syscallno, rc)
+#define TRACE_BUF_MISS          4     // Buffer cache miss (devno, blkno)
+#define TRACE_DEV_SUBMIT        5     // Device I/O submitted (devno << 1 | write, blkno)
+#define TRACE_DEV_COMPLETE      6     // Device I/O completed (devno << 1 | write, rc)
+#define TRACE_TCP_STATE         7     // TCP state change (pcb, old << 16 | new)
+#define TRACE_USER              16    // First event number for driver tracepoints
+
+#define TRACE_ALL               0xFFFFFFFF
+
+//
+// Trace buffer format as read from /proc/trace
+//
+
+#define TRACE_MAGIC             0x45435254  // "TRCE"
+#define TRACE_VERSION           1
+#define TRACE_RECORDS           16384       // Must be a power of two
+
+struct trace_record {
+  unsigned __int64 tsc;       // Time stamp counter
+  unsigned short event;       // Event type
+  unsigned short cpu;         // Processor
+  unsigned int tid;           // Current thread
+  unsigned int arg1;          // Event arguments
+  unsigned int arg2;
+};
+
+struct trace_header {
+  unsigned int magic;         // TRACE_MAGIC
+  unsigned int version;       // TRACE_VERSION
+  unsigned int cpu_mhz;       // Time stamp counter frequency
+  unsigned int mask;          // Enabled events
+  unsigned int records;       // Number of records following the header
+  unsigned int lost;          // Records overwritten before they could be read
+};
+
+//
+// Tracepoints compile to a single test of the event mask when tracing is off
+//
+
+#define TRACE(event, arg1, arg2) do { \
+                                 if (trace_mask & (1 << (event))) trace((event), (unsigned long) (arg1), (unsigned long) (arg2)); \
+                                 } while (0)
+
+krnlapi extern unsigned long trace_mask;
+
+krnlapi void trace(int event, unsigned long arg1, unsigned long arg2);
+krnlapi int trace_enable(unsigned long mask);
+
+void init_trace();
+
+#endif
@@ -34,7 +34,7 @@
 #ifndef VMM_H
 #define VMM_H
 
-extern struct rmap *vmap;
+extern struct vmspace vmspace;
 
 void init_vmm();
 
@@ -52,8 +52,10 @@ krnlapi void miounmap(void *addr, int size);
 
 int guard_page_handler(void *addr);
 int fetch_page(void *addr);
+int demand_page(void *addr);
 
 int vmem_proc(struct proc_file *pf, void *arg);
+int vmmaps_proc(struct proc_file *pf, void *arg);
 int mem_sysinfo(struct meminfo *info);
 
 #endif
@@ -0,0 +1,83 @@
+//
+// vmregion.h
+//
+// Virtual address space regions
+//
+// Copyright (C) 2013 Michael Ringgaard. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 
+// 1. Redistributions of source code must retain the above copyright 
+//    notice, this list of conditions and the following disclaimer.  
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.  
+// 3. Neither the name of the project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission. 
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+// 
+
+#ifndef VMREGION_H
+#define VMREGION_H
+
+#define VMREGION_FREE     0
+#define VMREGION_RESERVED 1
+
+struct rbnode {
+  struct rbnode *parent;
+  struct rbnode *left;
+  struct rbnode *right;
+  int red;
+};
+
+//
+// A virtual address space is tiled by regions, each of which is either
+// free or reserved. All regions are kept in a red-black tree ordered by
+// address, and free regions are also kept in a second tree ordered by
+// size, so allocation is a best-fit search in logarithmic time.
+//
+
+struct vmregion {
+  struct rbnode addrnode;         // Node in address tree
+  struct rbnode sizenode;         // Node in free size tree (free regions only)
+  unsigned long start;            // First page in region
+  unsigned long pages;            // Number of pages in region
+  int state;                      // VMREGION_FREE or VMREGION_RESERVED
+  int protect;                    // Protection at reservation (PAGE_XXX)
+  unsigned long tag;              // Allocation tag
+  struct filemap *filemap;        // Backing file mapping or NULL
+};
+
+struct vmspace {
+  struct rbnode *addrtree;        // All regions ordered by start page
+  struct rbnode *freetree;        // Free regions ordered by size and start page
+  unsigned long start;            // First page in address space
+  unsigned long pages;            // Number of pages in address space
+  unsigned long freepages;        // Number of pages in free regions
+  int regions;                    // Number of regions
+};
+
+int vmspace_init(struct vmspace *vms, unsigned long start, unsigned long pages);
+struct vmregion *vmspace_alloc(struct vmspace *vms, unsigned long pages, unsigned long align, unsigned long tag, int protect);
+struct vmregion *vmspace_reserve(struct vmspace *vms, unsigned long start, unsigned long pages, unsigned long tag, int protect);
+int vmspace_free(struct vmspace *vms, unsigned long start, unsigned long pages);
+int vmspace_status(struct vmspace *vms, unsigned long start, unsigned long pages);
+struct vmregion *vmspace_lookup(struct vmspace *vms, unsigned long page);
+struct vmregion *vmspace_first(struct vmspace *vms);
+struct vmregion *vmspace_next(struct vmregion *r);
+
+#endif
@@ -163,13 +163,12 @@ struct pthread_mutex {
                             // before the lock is released (recursive mutexes only)
   int kind;                 // Mutex type
   pthread_t owner;          // Thread owning the mutex
-  handle_t event;           // Mutex release notification to waiting threads
 };
 
 typedef struct pthread_mutex pthread_mutex_t;
 
-#define PTHREAD_MUTEX_INITIALIZER {0, 0, -1, -1, -1}
-#define PTHREAD_ERRORCHECK_MUTEX_INITIALIZER_NP {0, 0, -1, -1, -1}
+#define PTHREAD_MUTEX_INITIALIZER {0, 0, -1, -1}
+#define PTHREAD_ERRORCHECK_MUTEX_INITIALIZER_NP {0, 0, -1, -1}
 
 //
 // Condition variables
@@ -182,13 +181,13 @@ struct pthread_condattr {
 typedef struct pthread_condattr pthread_condattr_t;
 
 struct pthread_cond {
-  int waiting;
-  handle_t semaphore;
+  int waiting;              // Number of waiting threads
+  int sequence;             // Incremented on each signal (futex)
 };
 
 typedef struct pthread_cond pthread_cond_t;
 
-#define PTHREAD_COND_INITIALIZER ((pthread_cond_t) -1)
+#define PTHREAD_COND_INITIALIZER {0, 0}
 
 //
 // Barriers
@@ -206,8 +205,7 @@ struct pthread_barrier
 {
   unsigned int curr_height;
   unsigned int init_height;
-  int step;
-  handle_t breeched[2];
+  int step;                 // Incremented each time the barrier is breeched (futex)
 };
 
 typedef struct pthread_barrier pthread_barrier_t;
@@ -224,8 +222,8 @@ typedef struct pthread_rwlockattr pthread_rwlockattr_t;
 
 struct pthread_rwlock {
   pthread_mutex_t mutex;
-  handle_t shared_waiters;
-  handle_t exclusive_waiters;
+  int shared_waiters;       // Futex for releasing shared waiters
+  int exclusive_waiters;    // Futex for releasing exclusive waiters
   int num_shared_waiters;
   int num_exclusive_waiters;
   int num_active;
@@ -50,12 +50,18 @@ struct timespec {
 
 #ifndef _SEM_T_DEFINED
 #define _SEM_T_DEFINED
-typedef handle_t sem_t;
+struct semaphore {
+  int value;                // Semaphore count (futex)
+  int waiters;              // Number of threads waiting for semaphore
+};
+
+typedef struct semaphore sem_t;
 #endif
 
 #define _POSIX_SEMAPHORES
 
 #define SEM_FAILED (-1)
+#define SEM_VALUE_MAX 0x7FFFFFFF
 
 #ifdef  __cplusplus
 extern "C" {
@@ -178,4 +178,9 @@ FILE *__getstdfile(int n);
 #define getchar()        getc(stdin)
 #define putchar(c)       putc((c), stdout)
 
+#define getc_unlocked(stream)     getc(stream)
+#define putc_unlocked(c, stream)  putc((c), (stream))
+#define getchar_unlocked()        getc(stdin)
+#define putchar_unlocked(c)       putc((c), stdout)
+
 #endif
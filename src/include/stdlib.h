@@ -94,6 +94,7 @@ char *ecvt(double arg, int ndigits, int *decpt, int *sign);
 char *ecvtbuf(double arg, int ndigits, int *decpt, int *sign, char *buf);
 char *fcvt(double arg, int ndigits, int *decpt, int *sign);
 char *fcvtbuf(double arg, int ndigits, int *decpt, int *sign, char *buf);
+char *scvtbuf(double arg, int *decpt, int *sign, char *buf);
 
 #ifdef USE_LOCAL_HEAP
 osapi void *_lmalloc(size_t size);
@@ -69,6 +69,17 @@ struct msghdr {
   int msg_namelen;
   struct iovec *msg_iov;
   int msg_iovlen;
+  int msg_flags;
+};
+
+#endif
+
+#ifndef _MMSGHDR_DEFINED
+#define _MMSGHDR_DEFINED
+
+struct mmsghdr {
+  struct msghdr msg_hdr;       // Message header
+  unsigned int msg_len;        // Number of bytes transferred
 };
 
 #endif
@@ -100,6 +111,13 @@ typedef int socklen_t;
 #define SO_SNDTIMEO     0x1005
 #define SO_RCVTIMEO     0x1006
 #define SO_LINGER       0x0080
+#define SO_SNDBUF       0x1001
+#define SO_RCVBUF       0x1002
+#define SO_RCVDROPS     0x1100
+
+#define MSG_TRUNC       0x0020
+#define MSG_DONTWAIT    0x0040
+#define MSG_MORE        0x8000
 
 #define AF_UNSPEC       0
 #define AF_INET         2
@@ -122,9 +140,11 @@ osapi int listen(int s, int backlog);
 osapi int recv(int s, void *data, int size, unsigned int flags);
 osapi int recvfrom(int s, void *data, int size, unsigned int flags, struct sockaddr *from, int *fromlen);
 osapi int recvmsg(int s, struct msghdr *hdr, unsigned int flags);
+osapi int recvmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, unsigned int flags);
 osapi int send(int s, const void *data, int size, unsigned int flags);
 osapi int sendto(int s, const void *data, int size, unsigned int flags, const struct sockaddr *to, int tolen);
 osapi int sendmsg(int s, struct msghdr *hdr, unsigned int flags);
+osapi int sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, unsigned int flags);
 osapi int setsockopt(int s, int level, int optname, const void *optval, int optlen);
 osapi int shutdown(int s, int how);
 osapi int socket(int domain, int type, int protocol);
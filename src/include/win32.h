@@ -40,6 +40,9 @@
 
 #define ERROR_FILE_NOT_FOUND             2L
 #define ERROR_NO_MORE_FILES              18L
+#define ERROR_OPERATION_ABORTED          995L
+#define ERROR_IO_INCOMPLETE              996L
+#define ERROR_IO_PENDING                 997L
 
 #define MAX_PATH             260
 #define INVALID_HANDLE_VALUE ((HANDLE) -1)
@@ -80,6 +83,9 @@ typedef __int64 LONGLONG;
 
 typedef int BOOL;
 typedef unsigned int SIZE_T;
+typedef SIZE_T *PSIZE_T;
+typedef unsigned long ULONG_PTR;
+typedef ULONG_PTR *PULONG_PTR;
 
 typedef char *LPSTR;
 typedef char *LPTSTR;
@@ -114,7 +120,6 @@ typedef void *LPPROCESS_INFORMATION;
 typedef void *LPTIME_ZONE_INFORMATION;
 typedef void *PINPUT_RECORD;
 typedef void *PHANDLER_ROUTINE;
-typedef void *LPWSAOVERLAPPED;
 typedef void *LPWSAOVERLAPPED_COMPLETION_ROUTINE;
 typedef void *PSID;
 typedef void *PSID_IDENTIFIER_AUTHORITY;
@@ -123,7 +128,6 @@ typedef void *PSECURITY_DESCRIPTOR;
 typedef void *LPSERVICE_TABLE_ENTRY;
 typedef void *LPSERVICE_STATUS;
 typedef void *HCRYPTPROV;
-typedef void *LPOVERLAPPED;
 
 typedef int SERVICE_STATUS_HANDLE;
 
@@ -356,6 +360,16 @@ typedef struct _MEMORYSTATUS {
   SIZE_T dwAvailVirtual; 
 } MEMORYSTATUS, *LPMEMORYSTATUS; 
 
+#define HEAP_NO_SERIALIZE                   0x00000001
+#define HEAP_GENERATE_EXCEPTIONS            0x00000004
+#define HEAP_ZERO_MEMORY                    0x00000008
+#define HEAP_REALLOC_IN_PLACE_ONLY          0x00000010
+
+typedef enum _HEAP_INFORMATION_CLASS {
+  HeapCompatibilityInformation = 0,
+  HeapEnableTerminationOnCorruption = 1
+} HEAP_INFORMATION_CLASS;
+
 #define FILE_ATTRIBUTE_DIRECTORY            0x00000010
 #define FILE_ATTRIBUTE_NORMAL               0x00000080
 
@@ -424,6 +438,30 @@ typedef struct WIN32_FIND_DATAW {
 #define STD_OUTPUT_HANDLE                ((DWORD)-11)
 #define STD_ERROR_HANDLE                 ((DWORD)-12)
 
+#define STATUS_PENDING                   0x00000103L
+
+typedef struct _OVERLAPPED {
+  ULONG_PTR Internal;                  // Status, STATUS_PENDING until completed
+  ULONG_PTR InternalHigh;              // Number of bytes transferred
+  DWORD Offset;                        // File position for file I/O
+  DWORD OffsetHigh;
+  HANDLE hEvent;                       // Event signaled on completion
+} OVERLAPPED, *LPOVERLAPPED;
+
+typedef OVERLAPPED WSAOVERLAPPED;
+typedef OVERLAPPED *LPWSAOVERLAPPED;
+
+#define HasOverlappedIoCompleted(ov) ((ov)->Internal != STATUS_PENDING)
+
+//
+// Overlapped socket I/O, implemented in kernel32 and used by wsock32
+//
+
+#define AIO_RECV  0
+#define AIO_SEND  1
+
+int __stdcall submit_socket_io(HANDLE s, int op, struct iovec *bufs, int count, unsigned int flags, struct sockaddr *addr, int *addrlen, LPOVERLAPPED overlapped);
+
 typedef struct _KEY_EVENT_RECORD {
   BOOL bKeyDown; 
   WORD wRepeatCount; 
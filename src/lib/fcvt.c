@@ -33,6 +33,410 @@
 
 #include <os.h>
 #include <math.h>
+#include <float.h>
+#include <string.h>
+
+//
+// Shortest round-trip conversion using the Grisu2 algorithm by Florian
+// Loitsch. The digits are generated with 64-bit integer arithmetic from a
+// table of cached powers of ten, so no floating point multiplication or
+// division is needed per digit.
+//
+
+struct diyfp {
+  unsigned __int64 f;
+  int e;
+};
+
+struct cachedpow {
+  unsigned long hi;
+  unsigned long lo;
+  int e;
+};
+
+#define DP_SIGNIFICAND_MASK  0x000FFFFFFFFFFFFFui64
+#define DP_HIDDEN_BIT        0x0010000000000000ui64
+#define DP_EXPONENT_BIAS     (0x3FF + 52)
+#define DP_MIN_EXPONENT      (-DP_EXPONENT_BIAS)
+
+// Normalized 64-bit approximations of 10^k for k = -348, -340, ..., 340
+static struct cachedpow cachedpowers[] = {
+  {0xfa8fd5a0, 0x081c0288, -1220}, {0xbaaee17f, 0xa23ebf76, -1193}, {0x8b16fb20, 0x3055ac76, -1166},
+  {0xcf42894a, 0x5dce35ea, -1140}, {0x9a6bb0aa, 0x55653b2d, -1113}, {0xe61acf03, 0x3d1a45df, -1087},
+  {0xab70fe17, 0xc79ac6ca, -1060}, {0xff77b1fc, 0xbebcdc4f, -1034}, {0xbe5691ef, 0x416bd60c, -1007},
+  {0x8dd01fad, 0x907ffc3c, -980}, {0xd3515c28, 0x31559a83, -954}, {0x9d71ac8f, 0xada6c9b5, -927},
+  {0xea9c2277, 0x23ee8bcb, -901}, {0xaecc4991, 0x4078536d, -874}, {0x823c1279, 0x5db6ce57, -847},
+  {0xc2109436, 0x4dfb5637, -821}, {0x9096ea6f, 0x3848984f, -794}, {0xd77485cb, 0x25823ac7, -768},
+  {0xa086cfcd, 0x97bf97f4, -741}, {0xef340a98, 0x172aace5, -715}, {0xb23867fb, 0x2a35b28e, -688},
+  {0x84c8d4df, 0xd2c63f3b, -661}, {0xc5dd4427, 0x1ad3cdba, -635}, {0x936b9fce, 0xbb25c996, -608},
+  {0xdbac6c24, 0x7d62a584, -582}, {0xa3ab6658, 0x0d5fdaf6, -555}, {0xf3e2f893, 0xdec3f126, -529},
+  {0xb5b5ada8, 0xaaff80b8, -502}, {0x87625f05, 0x6c7c4a8b, -475}, {0xc9bcff60, 0x34c13053, -449},
+  {0x964e858c, 0x91ba2655, -422}, {0xdff97724, 0x70297ebd, -396}, {0xa6dfbd9f, 0xb8e5b88f, -369},
+  {0xf8a95fcf, 0x88747d94, -343}, {0xb9447093, 0x8fa89bcf, -316}, {0x8a08f0f8, 0xbf0f156b, -289},
+  {0xcdb02555, 0x653131b6, -263}, {0x993fe2c6, 0xd07b7fac, -236}, {0xe45c10c4, 0x2a2b3b06, -210},
+  {0xaa242499, 0x697392d3, -183}, {0xfd87b5f2, 0x8300ca0e, -157}, {0xbce50864, 0x92111aeb, -130},
+  {0x8cbccc09, 0x6f5088cc, -103}, {0xd1b71758, 0xe219652c, -77}, {0x9c400000, 0x00000000, -50},
+  {0xe8d4a510, 0x00000000, -24}, {0xad78ebc5, 0xac620000, 3}, {0x813f3978, 0xf8940984, 30},
+  {0xc097ce7b, 0xc90715b3, 56}, {0x8f7e32ce, 0x7bea5c70, 83}, {0xd5d238a4, 0xabe98068, 109},
+  {0x9f4f2726, 0x179a2245, 136}, {0xed63a231, 0xd4c4fb27, 162}, {0xb0de6538, 0x8cc8ada8, 189},
+  {0x83c7088e, 0x1aab65db, 216}, {0xc45d1df9, 0x42711d9a, 242}, {0x924d692c, 0xa61be758, 269},
+  {0xda01ee64, 0x1a708dea, 295}, {0xa26da399, 0x9aef774a, 322}, {0xf209787b, 0xb47d6b85, 348},
+  {0xb454e4a1, 0x79dd1877, 375}, {0x865b8692, 0x5b9bc5c2, 402}, {0xc83553c5, 0xc8965d3d, 428},
+  {0x952ab45c, 0xfa97a0b3, 455}, {0xde469fbd, 0x99a05fe3, 481}, {0xa59bc234, 0xdb398c25, 508},
+  {0xf6c69a72, 0xa3989f5c, 534}, {0xb7dcbf53, 0x54e9bece, 561}, {0x88fcf317, 0xf22241e2, 588},
+  {0xcc20ce9b, 0xd35c78a5, 614}, {0x98165af3, 0x7b2153df, 641}, {0xe2a0b5dc, 0x971f303a, 667},
+  {0xa8d9d153, 0x5ce3b396, 694}, {0xfb9b7cd9, 0xa4a7443c, 720}, {0xbb764c4c, 0xa7a44410, 747},
+  {0x8bab8eef, 0xb6409c1a, 774}, {0xd01fef10, 0xa657842c, 800}, {0x9b10a4e5, 0xe9913129, 827},
+  {0xe7109bfb, 0xa19c0c9d, 853}, {0xac2820d9, 0x623bf429, 880}, {0x80444b5e, 0x7aa7cf85, 907},
+  {0xbf21e440, 0x03acdd2d, 933}, {0x8e679c2f, 0x5e44ff8f, 960}, {0xd433179d, 0x9c8cb841, 986},
+  {0x9e19db92, 0xb4e31ba9, 1013}, {0xeb96bf6e, 0xbadf77d9, 1039}, {0xaf87023b, 0x9bf0ee6b, 1066},
+};
+
+static unsigned __int64 pow10tab[] = {
+  1ui64, 10ui64, 100ui64, 1000ui64, 10000ui64, 100000ui64, 1000000ui64, 10000000ui64,
+  100000000ui64, 1000000000ui64, 10000000000ui64, 100000000000ui64,
+  1000000000000ui64, 10000000000000ui64, 100000000000000ui64,
+  1000000000000000ui64, 10000000000000000ui64, 100000000000000000ui64,
+  1000000000000000000ui64, 10000000000000000000ui64
+};
+
+static struct diyfp diyfp_mul(struct diyfp x, struct diyfp y) {
+  struct diyfp r;
+  unsigned __int64 a = x.f >> 32;
+  unsigned __int64 b = x.f & 0xFFFFFFFF;
+  unsigned __int64 c = y.f >> 32;
+  unsigned __int64 d = y.f & 0xFFFFFFFF;
+  unsigned __int64 ac = a * c;
+  unsigned __int64 bc = b * c;
+  unsigned __int64 ad = a * d;
+  unsigned __int64 bd = b * d;
+  unsigned __int64 tmp = (bd >> 32) + (ad & 0xFFFFFFFF) + (bc & 0xFFFFFFFF);
+
+  tmp += 1U << 31;  // Round
+  r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+  r.e = x.e + y.e + 64;
+  return r;
+}
+
+static struct diyfp diyfp_normalize(struct diyfp x) {
+  while (!(x.f & 0xFFF0000000000000ui64)) {
+    x.f <<= 12;
+    x.e -= 12;
+  }
+  while (!(x.f & 0x8000000000000000ui64)) {
+    x.f <<= 1;
+    x.e--;
+  }
+  return x;
+}
+
+static struct diyfp cached_power(int e, int *k) {
+  struct diyfp r;
+  double dk;
+  int n, index;
+
+  // Find the power of ten that brings the exponent into [-60, -32]
+  dk = (-61 - e) * 0.30102999566398114 + 347;
+  n = (int) dk;
+  if (dk - n > 0.0) n++;
+
+  index = (n >> 3) + 1;
+  *k = -(-348 + index * 8);
+
+  r.f = ((unsigned __int64) cachedpowers[index].hi << 32) | cachedpowers[index].lo;
+  r.e = cachedpowers[index].e;
+  return r;
+}
+
+static void grisu_round(char *buf, int len, unsigned __int64 delta, unsigned __int64 rest, unsigned __int64 ten_kappa, unsigned __int64 wp_w) {
+  while (rest < wp_w && delta - rest >= ten_kappa &&
+         (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+    buf[len - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+static int digit_gen(struct diyfp w, struct diyfp mp, unsigned __int64 delta, char *buf, int *k) {
+  struct diyfp one;
+  unsigned __int64 wp_w, p2, tmp;
+  unsigned long p1, div;
+  int kappa, len, d;
+
+  one.f = 1ui64 << -mp.e;
+  one.e = mp.e;
+  wp_w = mp.f - w.f;
+  p1 = (unsigned long) (mp.f >> -one.e);
+  p2 = mp.f & (one.f - 1);
+
+  // Integral part
+  kappa = 10;
+  div = 1000000000;
+  while (kappa > 1 && p1 < div) {
+    kappa--;
+    div /= 10;
+  }
+
+  len = 0;
+  while (kappa > 0) {
+    d = p1 / div;
+    p1 %= div;
+    if (d || len) buf[len++] = '0' + d;
+    kappa--;
+    div /= 10;
+
+    tmp = ((unsigned __int64) p1 << -one.e) + p2;
+    if (tmp <= delta) {
+      *k += kappa;
+      grisu_round(buf, len, delta, tmp, pow10tab[kappa] << -one.e, wp_w);
+      return len;
+    }
+  }
+
+  // Fractional part
+  for (;;) {
+    p2 *= 10;
+    delta *= 10;
+    d = (int) (p2 >> -one.e);
+    if (d || len) buf[len++] = '0' + d;
+    p2 &= one.f - 1;
+    kappa--;
+    if (p2 < delta) {
+      *k += kappa;
+      grisu_round(buf, len, delta, p2, one.f, -kappa < 20 ? wp_w * pow10tab[-kappa] : 0);
+      return len;
+    }
+  }
+}
+
+static struct diyfp diyfp_from_double(double value) {
+  union { double d; unsigned __int64 u; } bits;
+  struct diyfp v;
+  int biased_e;
+
+  bits.d = value;
+  biased_e = (int) (bits.u >> 52) & 0x7FF;
+  if (biased_e) {
+    v.f = (bits.u & DP_SIGNIFICAND_MASK) + DP_HIDDEN_BIT;
+    v.e = biased_e - DP_EXPONENT_BIAS;
+  } else {
+    v.f = bits.u & DP_SIGNIFICAND_MASK;
+    v.e = DP_MIN_EXPONENT + 1;
+  }
+  return v;
+}
+
+static int grisu2(double value, char *buf, int *k) {
+  struct diyfp v, w, mp, mm, c;
+
+  // Decompose value into significand and exponent
+  v = diyfp_from_double(value);
+
+  // Compute boundaries m+ and m- with the same exponent
+  mp.f = (v.f << 1) + 1;
+  mp.e = v.e - 1;
+  mp = diyfp_normalize(mp);
+  if (v.f == DP_HIDDEN_BIT) {
+    mm.f = (v.f << 2) - 1;
+    mm.e = v.e - 2;
+  } else {
+    mm.f = (v.f << 1) - 1;
+    mm.e = v.e - 1;
+  }
+  mm.f <<= mm.e - mp.e;
+  mm.e = mp.e;
+
+  // Scale by a cached power of ten and generate digits
+  c = cached_power(mp.e, k);
+  w = diyfp_mul(diyfp_normalize(v), c);
+  mp = diyfp_mul(mp, c);
+  mm = diyfp_mul(mm, c);
+  mm.f++;
+  mp.f--;
+
+  return digit_gen(w, mp, mp.f - mm.f, buf, k);
+}
+
+//
+// Exact decimal expansion of a value using big integers. This is only
+// needed when the shortest digits are not enough to round correctly, i.e.
+// for more than 15 digits or when the value is close to halfway between
+// two decimal numbers.
+//
+
+#define BIGWORDS 84
+
+struct bignum {
+  int n;
+  unsigned int w[BIGWORDS];
+};
+
+static void big_mul(struct bignum *b, unsigned int m) {
+  unsigned __int64 carry = 0;
+  int i;
+
+  for (i = 0; i < b->n; i++) {
+    carry += (unsigned __int64) b->w[i] * m;
+    b->w[i] = (unsigned int) carry;
+    carry >>= 32;
+  }
+  if (carry && b->n < BIGWORDS) b->w[b->n++] = (unsigned int) carry;
+}
+
+static unsigned int big_div(struct bignum *b, unsigned int d) {
+  unsigned __int64 rem = 0;
+  int i;
+
+  for (i = b->n - 1; i >= 0; i--) {
+    rem = (rem << 32) | b->w[i];
+    b->w[i] = (unsigned int) (rem / d);
+    rem %= d;
+  }
+  while (b->n > 0 && b->w[b->n - 1] == 0) b->n--;
+  return (unsigned int) rem;
+}
+
+static int exactcvt(double value, char *buf, int size, int *decpt) {
+  struct bignum b;
+  struct diyfp v;
+  char tmp[BIGWORDS * 10];
+  unsigned int r;
+  int i, n, scale;
+
+  // Compute integer f * 2^e, or f * 5^-e with the decimal point moved -e places
+  v = diyfp_from_double(value);
+  b.w[0] = (unsigned int) v.f;
+  b.w[1] = (unsigned int) (v.f >> 32);
+  b.n = 2;
+  scale = 0;
+  if (v.e > 0) {
+    for (i = v.e; i >= 16; i -= 16) big_mul(&b, 1 << 16);
+    big_mul(&b, 1 << i);
+  } else {
+    scale = -v.e;
+    for (i = scale; i >= 13; i -= 13) big_mul(&b, 1220703125);
+    r = 1;
+    while (i-- > 0) r *= 5;
+    big_mul(&b, r);
+  }
+
+  // Convert to decimal digits, least significant first
+  n = 0;
+  while (b.n > 0 && (b.n > 1 || b.w[0] != 0)) {
+    r = big_div(&b, 1000000000);
+    for (i = 0; i < 9; i++) {
+      tmp[n++] = '0' + r % 10;
+      r /= 10;
+    }
+  }
+  while (n > 1 && tmp[n - 1] == '0') n--;
+
+  // Return most significant digits
+  *decpt = n - scale;
+  for (i = 0; i < n && i < size; i++) buf[i] = tmp[n - 1 - i];
+  return i;
+}
+
+static int isfinitedbl(double value) {
+  union { double d; unsigned __int64 u; } bits;
+
+  bits.d = value;
+  return ((int) (bits.u >> 52) & 0x7FF) != 0x7FF;
+}
+
+//
+// Convert a finite, positive value to ndigits significant digits (eflag) or
+// to ndigits digits after the decimal point.
+//
+
+static char *fastcvt(double arg, int ndigits, int *decpt, char *buf, int eflag) {
+  char shortest[20];
+  char exact[CVTBUFSIZE];
+  char *digits;
+  int len, k, n, i;
+
+  digits = shortest;
+  len = grisu2(arg, digits, &k);
+  *decpt = len + k;
+
+  n = eflag ? ndigits : *decpt + ndigits;
+  if (n >= CVTBUFSIZE - 1) n = CVTBUFSIZE - 2;
+
+  // The shortest digits padded with zeros are correctly rounded for up to
+  // 15 digits, except for denormals. Use the exact expansion for more digits,
+  // or when the first dropped digit is too close to halfway to decide the
+  // rounding.
+  if (n > 15 || arg < DBL_MIN) {
+    digits = exact;
+    len = exactcvt(arg, digits, CVTBUFSIZE, decpt);
+  } else if (n >= 0 && n < len) {
+    for (i = n + 1; i < len && digits[i] == '9'; i++);
+    if (digits[n] == '5' || (digits[n] == '4' && i == len && n + 1 < len)) {
+      digits = exact;
+      len = exactcvt(arg, digits, CVTBUFSIZE, decpt);
+    }
+  }
+
+  n = eflag ? ndigits : *decpt + ndigits;
+  if (n >= CVTBUFSIZE - 1) n = CVTBUFSIZE - 2;
+  if (n < 0) {
+    buf[0] = '\0';
+    return buf;
+  }
+
+  // Copy digits and pad with zeros up to the rounding position
+  for (i = 0; i < n; i++) buf[i] = i < len ? digits[i] : '0';
+  buf[n] = '\0';
+
+  // Round half up using the first dropped digit
+  if (n < len && digits[n] >= '5') {
+    i = n;
+    while (i > 0) {
+      if (++buf[--i] <= '9') return buf;
+      buf[i] = '0';
+    }
+
+    // Carry out of the first digit
+    (*decpt)++;
+    if (eflag) {
+      if (n > 0) buf[0] = '1';
+    } else {
+      buf[0] = '1';
+      if (n > 0) buf[n] = '0';
+      buf[n + 1] = '\0';
+    }
+  }
+
+  return buf;
+}
+
+//
+// Convert value to the shortest digit string that converts back to the same
+// value. The buffer must have room for at least 18 characters.
+//
+
+char *scvtbuf(double arg, int *decpt, int *sign, char *buf) {
+  union { double d; unsigned __int64 u; } bits;
+  int len, k;
+
+  bits.d = arg;
+  *sign = (int) (bits.u >> 63);
+  bits.u &= 0x7FFFFFFFFFFFFFFFui64;
+  if ((bits.u >> 52) == 0x7FF) {
+    *decpt = 0;
+    strcpy(buf, bits.u & DP_SIGNIFICAND_MASK ? "nan" : "inf");
+    return buf;
+  }
+  if (bits.u == 0) {
+    *decpt = 1;
+    strcpy(buf, "0");
+    return buf;
+  }
+
+  len = grisu2(bits.d, buf, &k);
+  buf[len] = '\0';
+  *decpt = len + k;
+  return buf;
+}
 
 //
 // cvt.c - IEEE floating point formatting routines for FreeBSD
@@ -53,6 +457,7 @@ static char *cvt(double arg, int ndigits, int *decpt, int *sign, char *buf, int
     *sign = 1;
     arg = -arg;
   }
+  if (arg != 0 && isfinitedbl(arg)) return fastcvt(arg, ndigits, decpt, buf, eflag);
   arg = modf(arg, &fi);
   p1 = &buf[CVTBUFSIZE];
 
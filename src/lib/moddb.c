@@ -59,6 +59,32 @@ struct stab {
 #define N_SLINE 0x44              // Line number in text segment
 #define N_FUN   0x24              // Function name or text-segment variable for C
 
+//
+// Bound import cache. The import address table of a module only depends
+// on the modules it imports from, so when a module is loaded again its
+// import bindings can be reused if the image and all exporting modules
+// are unchanged. The cache lives in memory for the lifetime of the module
+// database and is not saved across boots. Exporting modules are matched
+// by load address, which is only stable within one session.
+//
+
+struct bindexp {
+  hmodule_t hmod;                 // Exporting module
+  unsigned long timestamp;        // Time stamp of exporting module
+};
+
+struct bindcache {
+  struct bindcache *next;
+  char *path;                     // Path of importing module
+  unsigned long timestamp;        // Time stamp of importing module
+  unsigned long size;             // Image size of importing module
+  unsigned long hash;             // Hash of import lookup tables
+  int nimports;                   // Number of import descriptors
+  int nthunks;                    // Number of import address table entries
+  struct bindexp *exports;        // Exporting module for each import descriptor
+  unsigned long *thunks;          // Bound import address table
+};
+
 static void logmsg(struct moddb *db, const char *fmt, ...) {
   va_list args;
   char buffer[1024];
@@ -349,9 +375,18 @@ static struct module *get_module(struct moddb *db, char *name, int type) {
   return NULL;
 }
 
+static void *get_export(hmodule_t hmod, struct image_export_directory *exp, int i) {
+  unsigned short idx;
+
+  idx = *((unsigned short *) RVA(hmod, exp->address_of_name_ordinals) + i);
+  return RVA(hmod, *((unsigned long *) RVA(hmod, exp->address_of_functions) + idx));
+}
+
 static void *get_proc_by_name(hmodule_t hmod, int hint, char *procname) {
   struct image_export_directory *exp;
   unsigned int *names;
+  int lo, hi, mid;
+  int cmp;
   unsigned int i;
 
   exp = (struct image_export_directory *) get_image_directory(hmod, IMAGE_DIRECTORY_ENTRY_EXPORT);
@@ -360,22 +395,26 @@ static void *get_proc_by_name(hmodule_t hmod, int hint, char *procname) {
   names = (unsigned int *) RVA(hmod, exp->address_of_names);
 
   if (hint >= 0 && hint < (int) exp->number_of_names && strcmp(procname, RVA(hmod, names[hint])) == 0) {
-    unsigned short idx;
-
-    idx = *((unsigned short *) RVA(hmod, exp->address_of_name_ordinals) + hint);
-    return RVA(hmod, *((unsigned long *) RVA(hmod, exp->address_of_functions) + idx));
+    return get_export(hmod, exp, hint);
   }
 
-  for (i = 0; i < exp->number_of_names; i++) {
-    char *name = RVA(hmod,  *names);
-    if (strcmp(name, procname) == 0) {
-      unsigned short idx;
-      
-      idx = *((unsigned short *) RVA(hmod, exp->address_of_name_ordinals) + i);
-      return RVA(hmod, *((unsigned long *) RVA(hmod, exp->address_of_functions) + idx));
+  // The export name table is sorted, so use binary search
+  lo = 0;
+  hi = exp->number_of_names - 1;
+  while (lo <= hi) {
+    mid = (lo + hi) / 2;
+    cmp = strcmp(procname, RVA(hmod, names[mid]));
+    if (cmp == 0) return get_export(hmod, exp, mid);
+    if (cmp < 0) {
+      hi = mid - 1;
+    } else {
+      lo = mid + 1;
     }
+  }
 
-    names++;
+  // Fall back to linear search in case the table is not sorted
+  for (i = 0; i < exp->number_of_names; i++) {
+    if (strcmp(RVA(hmod, names[i]), procname) == 0) return get_export(hmod, exp, i);
   }
 
   return NULL;
@@ -441,8 +480,120 @@ static struct module *resolve_imports(struct module *mod) {
   return modlist;
 }
 
+static unsigned long get_import_hash(struct module *mod, struct image_import_descriptor *imp, int *nimports, int *nthunks) {
+  unsigned long hash = 0;
+  unsigned long *origthunks;
+
+  *nimports = 0;
+  *nthunks = 0;
+  while (imp->characteristics != 0) {
+    hash = hash * 31 + imp->name;
+    origthunks = (unsigned long *) RVA(mod->hmod, imp->original_first_thunk);
+    while (*origthunks) {
+      hash = hash * 31 + *origthunks++;
+      (*nthunks)++;
+    }
+    (*nimports)++;
+    imp++;
+  }
+
+  return hash;
+}
+
+static int use_cached_bindings(struct module *mod, struct image_import_descriptor *imp) {
+  struct image_header *imghdr = get_image_header(mod->hmod);
+  struct bindcache *bc;
+  struct module *expmod;
+  unsigned long hash;
+  unsigned long *thunks;
+  unsigned long *bound;
+  int nimports, nthunks;
+  int i;
+
+  // Find cached bindings for module
+  for (bc = mod->db->bindings; bc; bc = bc->next) {
+    if (strcmp(bc->path, mod->path) == 0) break;
+  }
+  if (!bc) return 0;
+  if (bc->timestamp != imghdr->header.timestamp || bc->size != imghdr->optional.size_of_image) return 0;
+  hash = get_import_hash(mod, imp, &nimports, &nthunks);
+  if (bc->hash != hash || bc->nimports != nimports || bc->nthunks != nthunks) return 0;
+
+  // Check that the exporting modules have not changed
+  for (i = 0; i < nimports; i++) {
+    expmod = get_module(mod->db, RVA(mod->hmod, imp[i].name), MODTYPE_DLL);
+    if (!expmod || expmod->hmod != bc->exports[i].hmod) return 0;
+    if (get_image_header(expmod->hmod)->header.timestamp != bc->exports[i].timestamp) return 0;
+  }
+
+  // Copy bindings to import address table
+  bound = bc->thunks;
+  while (imp->characteristics != 0) {
+    thunks = (unsigned long *) RVA(mod->hmod, imp->first_thunk);
+    while (*thunks) *thunks++ = *bound++;
+    imp++;
+  }
+
+  return 1;
+}
+
+static void save_bindings(struct module *mod, struct image_import_descriptor *imp) {
+  struct image_header *imghdr = get_image_header(mod->hmod);
+  struct bindcache *bc;
+  struct bindcache **link;
+  struct module *expmod;
+  unsigned long hash;
+  unsigned long *thunks;
+  unsigned long *bound;
+  int nimports, nthunks;
+  int i;
+
+  hash = get_import_hash(mod, imp, &nimports, &nthunks);
+  bc = (struct bindcache *) malloc(sizeof(struct bindcache) + nimports * sizeof(struct bindexp) + nthunks * sizeof(unsigned long));
+  if (!bc) return;
+  bc->path = strdup(mod->path);
+  if (!bc->path) {
+    free(bc);
+    return;
+  }
+  bc->timestamp = imghdr->header.timestamp;
+  bc->size = imghdr->optional.size_of_image;
+  bc->hash = hash;
+  bc->nimports = nimports;
+  bc->nthunks = nthunks;
+  bc->exports = (struct bindexp *) (bc + 1);
+  bc->thunks = (unsigned long *) (bc->exports + nimports);
+
+  bound = bc->thunks;
+  for (i = 0; i < nimports; i++) {
+    expmod = get_module(mod->db, RVA(mod->hmod, imp[i].name), MODTYPE_DLL);
+    bc->exports[i].hmod = expmod->hmod;
+    bc->exports[i].timestamp = get_image_header(expmod->hmod)->header.timestamp;
+
+    thunks = (unsigned long *) RVA(mod->hmod, imp[i].first_thunk);
+    while (*thunks) *bound++ = *thunks++;
+  }
+
+  // Replace old bindings for module
+  link = &mod->db->bindings;
+  while (*link) {
+    if (strcmp((*link)->path, mod->path) == 0) {
+      struct bindcache *old = *link;
+      *link = old->next;
+      free(old->path);
+      free(old);
+      break;
+    }
+    link = &(*link)->next;
+  }
+
+  bc->next = mod->db->bindings;
+  mod->db->bindings = bc;
+}
+
 static int bind_imports(struct module *mod) {
   struct image_import_descriptor *imp;
+  struct image_import_descriptor *firstimp;
   int errs = 0;
 
   // Find import directory in image
@@ -454,6 +605,13 @@ static int bind_imports(struct module *mod) {
     return -ENOSYS;
   }
 
+  // Reuse bindings from an earlier load of the module if possible
+  if (use_cached_bindings(mod, imp)) {
+    mod->flags |= MODULE_BOUND;
+    return 0;
+  }
+  firstimp = imp;
+
   // Update Import Address Table (IAT)
   while (imp->characteristics != 0) {
     unsigned long *thunks;
@@ -500,6 +658,7 @@ static int bind_imports(struct module *mod) {
 
   if (errs) return -ENOEXEC;
 
+  save_bindings(mod, firstimp);
   mod->flags |= MODULE_BOUND;
   return 0;
 }
@@ -920,13 +1079,73 @@ int get_resource_data(hmodule_t hmod, char *id1, char *id2, char *id3, void **da
   return dataentry->size;
 }
 
+static void lookup_symbol(struct module *mod, void *eip, struct stackframe *frame) {
+  struct stab *stab, *stab_end;
+  int stab_size;
+  char *stabstr;
+
+  frame->hmod = mod->hmod;
+  frame->modname = mod->name;
+  stab = (struct stab *) get_module_section(mod, ".stab", &stab_size);
+  stabstr = get_module_section(mod, ".stabstr", NULL);
+  if (stab && stabstr) {
+    int found = 0;
+    struct stab *source = NULL;
+    struct stab *func = NULL;
+    struct stab *line = NULL;
+    stab_end = (struct stab *) ((char *) stab + stab_size);
+    while (!found && stab < stab_end) {
+      switch (stab->n_type) {
+        case N_SLINE:
+          if (func && eip > (void *) (func->n_value + stab->n_value)) line = stab;
+          break;
+          
+        case N_FUN:
+          if (func) {
+            if (stab->n_strx == 0 && eip < (void *) (func->n_value + stab->n_value)) {
+              found = 1;
+            } else {
+              func = NULL;
+            }
+          } else if (eip > (void *) stab->n_value) {
+            func = stab;
+          }
+          break;
+
+        case N_SO:
+          source = stab;
+          break;
+      }
+      stab++;
+    }
+    if (found) {
+      if (func) {
+        frame->func = stabstr + func->n_strx;
+        frame->offset = (unsigned long) eip - func->n_value;
+        if (line) frame->line = line->n_desc;
+      }
+      if (source) frame->file = stabstr + source->n_strx;
+    }
+  }
+}
+
+int get_symbol_info(struct moddb *db, void *addr, struct stackframe *frame) {
+  struct module *mod;
+
+  memset(frame, 0, sizeof(struct stackframe));
+  frame->eip = addr;
+  frame->line = -1;
+
+  mod = get_module_for_address(db, addr);
+  if (!mod) return -ENOENT;
+  lookup_symbol(mod, addr, frame);
+  return 0;
+}
+
 int get_stack_trace(struct moddb *db, struct context *ctxt,
                     void *stktop, void *stklimit, 
                     struct stackframe *frames, int depth) {
   struct module *mod;
-  struct stab *stab, *stab_end;
-  int stab_size;
-  char *stabstr;
   void *eip = (void *) ctxt->eip;
   void *ebp = (void *) ctxt->ebp;
   int i = 0;
@@ -937,51 +1156,7 @@ int get_stack_trace(struct moddb *db, struct context *ctxt,
     frames[i].line = -1;
     
     mod = get_module_for_address(db, eip);
-    if (mod) {
-      frames[i].hmod = mod->hmod;
-      frames[i].modname = mod->name;
-      stab = (struct stab *) get_module_section(mod, ".stab", &stab_size);
-      stabstr = get_module_section(mod, ".stabstr", NULL);
-      if (stab && stabstr) {
-        int found = 0;
-        struct stab *source = NULL;
-        struct stab *func = NULL;
-        struct stab *line = NULL;
-        stab_end = (struct stab *) ((char *) stab + stab_size);
-        while (!found && stab < stab_end) {
-          switch (stab->n_type) {
-            case N_SLINE:
-              if (func && eip > (void *) (func->n_value + stab->n_value)) line = stab;
-              break;
-              
-            case N_FUN:
-              if (func) {
-                if (stab->n_strx == 0 && eip < (void *) (func->n_value + stab->n_value)) {
-                  found = 1;
-                } else {
-                  func = NULL;
-                }
-              } else if (eip > (void *) stab->n_value) {
-                func = stab;
-              }
-              break;
-
-            case N_SO:
-              source = stab;
-              break;
-          }
-          stab++;
-        }
-        if (found) {
-          if (func) {
-            frames[i].func = stabstr + func->n_strx;
-            frames[i].offset = (unsigned long) eip - func->n_value;
-            if (line) frames[i].line = line->n_desc;
-          }
-          if (source) frames[i].file = stabstr + source->n_strx;
-        }
-      }
-    }
+    if (mod) lookup_symbol(mod, eip, &frames[i]);
 
     eip = *((void **) ebp + 1);
     ebp = *(void **) ebp;
@@ -998,6 +1173,7 @@ int init_module_database(struct moddb *db, char *name, hmodule_t hmod, char *lib
 
   // Set flags
   db->flags = flags;
+  db->bindings = NULL;
 
   // Set library paths
   if (libpath) {
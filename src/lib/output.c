@@ -54,6 +54,48 @@
 #define FL_NEGATIVE   0x00100   // Value is negative
 #define FL_FORCEOCTAL 0x00200   // Force leading '0' for octals
 
+static const char digitpairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static char *decimal(char *end, unsigned int number) {
+  // Convert two digits at a time, writing backwards from end
+  while (number >= 100) {
+    const char *pair = digitpairs + (number % 100) * 2;
+    number /= 100;
+    *--end = pair[1];
+    *--end = pair[0];
+  }
+
+  if (number >= 10) {
+    *--end = digitpairs[number * 2 + 1];
+    *--end = digitpairs[number * 2];
+  } else {
+    *--end = '0' + number;
+  }
+
+  return end;
+}
+
+static void outtext(FILE *stream, const char *text, int len) {
+  if (stream->cnt >= len) {
+    // Copy directly into the stream buffer
+    memcpy(stream->ptr, text, len);
+    stream->ptr += len;
+    stream->cnt -= len;
+  } else {
+    while (len-- > 0) putc(*text++, stream);
+  }
+}
+
 static void cfltcvt(double value, char *buffer, char fmt, int precision, int capexp) {
   int decpt, sign, exp, pos;
   char *digits = NULL;
@@ -189,14 +231,34 @@ int _output(FILE *stream, const char *format, va_list args) {
     int capexp = 0;
 
     // Go forward until next format specifier or end of string
-    while (*fmt != 0 && *fmt != '%') {
-      //if ((stream->flag & _IOCRLF) && *fmt == '\n') putc('\r', stream);
-      putc(*fmt, stream);
-      fmt++;
-      cnt++;
+    text = fmt;
+    while (*fmt != 0 && *fmt != '%') fmt++;
+    if (fmt > text) {
+      outtext(stream, text, fmt - text);
+      cnt += fmt - text;
     }
     if (*fmt++ == 0) break;
 
+    // Fast path for plain %s and %d
+    if (*fmt == 's') {
+      text = va_arg(args, char *);
+      if (text == NULL) text = "(null)";
+      textlen = strlen(text);
+      outtext(stream, text, textlen);
+      cnt += textlen;
+      fmt++;
+      continue;
+    } else if (*fmt == 'd') {
+      int n = va_arg(args, int);
+      text = decimal(&buffer[MAXBUFFER], n < 0 ? -n : n);
+      if (n < 0) *--text = '-';
+      textlen = &buffer[MAXBUFFER] - text;
+      outtext(stream, text, textlen);
+      cnt += textlen;
+      fmt++;
+      continue;
+    }
+
     // Check for flags
     switch (*fmt++) {
       case '-': flags |= FL_LEFT;      break;  // '-' => Left justify
@@ -426,21 +488,49 @@ int _output(FILE *stream, const char *format, va_list args) {
           // Check if data is 0; if so, turn off hex prefix
           if (number64 == 0) prefixlen = 0;
 
-          while (precision-- > 0 || number64 != 0) {
-            digit = (int) (number64 % radix) + '0';
-            number64 /= radix; // Reduce number
-            if (digit > '9') digit += hexadd;
-            *text-- = digit;
+          // Reduce 64-bit decimal numbers until they fit in 32 bits
+          if (radix == 10) {
+            while (number64 > 0xFFFFFFFF) {
+              int pair = (int) (number64 % 100) * 2;
+              number64 /= 100;
+              *text-- = digitpairs[pair + 1];
+              *text-- = digitpairs[pair];
+              precision -= 2;
+            }
+            number = (unsigned int) number64;
+            if (number) {
+              char *start = decimal(text + 1, number);
+              precision -= text + 1 - start;
+              text = start - 1;
+            }
+            while (precision-- > 0) *text-- = '0';
+          } else {
+            while (precision-- > 0 || number64 != 0) {
+              digit = (int) (number64 % radix) + '0';
+              number64 /= radix; // Reduce number
+              if (digit > '9') digit += hexadd;
+              *text-- = digit;
+            }
           }
         } else {
           // Check if data is 0; if so, turn off hex prefix
           if (number == 0) prefixlen = 0;
 
-          while (precision-- > 0 || number != 0) {
-            digit = (int) (number % radix) + '0';
-            number /= radix; // Reduce number
-            if (digit > '9') digit += hexadd;
-            *text-- = digit;
+          if (radix == 10) {
+            if (number) {
+              char *start = decimal(text + 1, number);
+              precision -= text + 1 - start;
+              text = start - 1;
+            }
+            while (precision-- > 0) *text-- = '0';
+          } else {
+            int shift = radix == 16 ? 4 : 3;
+            while (precision-- > 0 || number != 0) {
+              digit = (int) (number & (radix - 1)) + '0';
+              number >>= shift; // Reduce number
+              if (digit > '9') digit += hexadd;
+              *text-- = digit;
+            }
           }
         }
 
@@ -562,11 +652,9 @@ int _output(FILE *stream, const char *format, va_list args) {
     }
 
     // Put out text
-    while (textlen > 0) {
-      putc(*text, stream);
-      text++;
-      textlen--;
-      cnt++;
+    if (textlen > 0) {
+      outtext(stream, text, textlen);
+      cnt += textlen;
     }
 
     // Put out trailling blanks
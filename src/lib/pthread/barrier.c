@@ -34,6 +34,7 @@
 #include <os.h>
 #include <pthread.h>
 #include <atomic.h>
+#include <limits.h>
 
 int pthread_barrierattr_init(pthread_barrierattr_t *attr) {
   if (!attr) return EINVAL;
@@ -64,49 +65,25 @@ int pthread_barrier_init(pthread_barrier_t *barrier, const pthread_barrierattr_t
 
   barrier->curr_height = barrier->init_height = count;
   barrier->step = 0;
-
-  barrier->breeched[0] = mksem(0);
-  if (barrier->breeched[0] < 0) return errno;
-
-  barrier->breeched[1] = mksem(0);
-  if (barrier->breeched[1] < 0) {
-    int rc = errno;
-    close(barrier->breeched[0]);
-    return rc;
-  }
-
   return 0;
 }
 
 int pthread_barrier_destroy(pthread_barrier_t *barrier) {
   if (!barrier) return EINVAL;
-  if (close(barrier->breeched[0]) < 0) return errno;
-  if (close(barrier->breeched[1]) < 0) return errno;
   return 0;
 }
 
 int pthread_barrier_wait(pthread_barrier_t *barrier) {
   int step = barrier->step;
-  int rc;
 
   if (atomic_decrement(&barrier->curr_height) == 0) {
+    // Last thread to arrive resets the barrier and releases the others
     barrier->curr_height = barrier->init_height;
-    if (barrier->init_height > 1) {
-      rc = semrel(barrier->breeched[step], barrier->init_height - 1);
-    } else {
-      rc = 0;
-    }
-  } else {
-    rc = waitone(barrier->breeched[step], INFINITE);
+    atomic_increment(&barrier->step);
+    if (barrier->init_height > 1) futex_wake(&barrier->step, INT_MAX);
+    return PTHREAD_BARRIER_SERIAL_THREAD;
   }
 
-  if (rc == 0) {
-    if (atomic_compare_and_exchange(&barrier->step, 1 - step, step) == step) {
-      rc = PTHREAD_BARRIER_SERIAL_THREAD;
-    } else {
-      rc = 0;
-    }
-  }
-
-  return rc;
+  while (barrier->step == step) futex_wait(&barrier->step, step, INFINITE);
+  return 0;
 }
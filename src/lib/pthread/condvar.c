@@ -34,6 +34,7 @@
 #include <os.h>
 #include <pthread.h>
 #include <atomic.h>
+#include <limits.h>
 
 int pthread_condattr_init(pthread_condattr_t *attr) {
   if (!attr) return EINVAL;
@@ -58,50 +59,60 @@ int pthread_condattr_setpshared(pthread_condattr_t *attr, int pshared) {
   return 0;
 }
 
+//
+// Condition variables use the sequence number as a futex. A waiting thread
+// samples the sequence number before releasing the mutex, so a signal sent
+// between the unlock and the wait makes the wait return immediately.
+//
+
+static int cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime) {
+  int sequence;
+  int rc = 0;
+
+  sequence = cond->sequence;
+  atomic_increment(&cond->waiting);
+  pthread_mutex_unlock(mutex);
+  if (futex_wait(&cond->sequence, sequence, __abstime2timeout(abstime)) < 0 && errno == ETIMEDOUT) rc = ETIMEDOUT;
+  atomic_decrement(&cond->waiting);
+  pthread_mutex_lock(mutex);
+  return rc;
+}
+
 int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr) {
   if (!cond) return EINVAL;
   if (attr && attr->pshared == PTHREAD_PROCESS_SHARED) return ENOSYS;
 
   cond->waiting = 0;
-  cond->semaphore = mksem(0);
-  if (cond->semaphore < 0) return ENOSPC;
+  cond->sequence = 0;
   return 0;
 }
 
 int pthread_cond_destroy(pthread_cond_t *cond) {
   if (!cond) return EINVAL;
-  if (close(cond->semaphore) < 0) return errno;
+  if (cond->waiting) return EBUSY;
   return 0;
 }
 
 int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
-  int rc = 0;
-
-  atomic_increment(&cond->waiting);
-  pthread_mutex_unlock(mutex);
-  if (waitone(cond->semaphore, INFINITE) < 0) rc = errno;
-  atomic_decrement(&cond->waiting);
-  pthread_mutex_lock(mutex);
-  return errno;
+  return cond_wait(cond, mutex, NULL);
 }
 
 int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime) {
-  int rc = 0;
-
-  atomic_increment(&cond->waiting);
-  pthread_mutex_unlock(mutex);
-  if (waitone(cond->semaphore, __abstime2timeout(abstime)) < 0) rc = errno;
-  atomic_decrement(&cond->waiting);
-  pthread_mutex_lock(mutex);
-  return rc;
+  return cond_wait(cond, mutex, abstime);
 }
 
 int pthread_cond_signal(pthread_cond_t *cond) {
-  if (cond->waiting) semrel(cond->semaphore, 1);
+  if (cond->waiting) {
+    atomic_increment(&cond->sequence);
+    futex_wake(&cond->sequence, 1);
+  }
   return 0;
 }
 
 int pthread_cond_broadcast(pthread_cond_t *cond) {
-  if (cond->waiting) semrel(cond->semaphore, cond->waiting);
+  if (cond->waiting) {
+    atomic_increment(&cond->sequence);
+    futex_wake(&cond->sequence, INT_MAX);
+  }
   return 0;
 }
@@ -76,6 +76,44 @@ int pthread_mutexattr_settype(pthread_mutexattr_t *attr, int kind) {
   return 0;
 }
 
+//
+// The mutex lock word is used as a futex. Threads only call the kernel
+// when the mutex is contended. A locked mutex with possible waiters has
+// the lock word set to -1, which tells the unlocking thread to wake up
+// one of the waiters.
+//
+
+static int mutex_acquire(pthread_mutex_t *mutex, const struct timespec *abstime) {
+  if (atomic_compare_and_exchange(&mutex->lock, 1, 0) == 0) return 0;
+
+  while (atomic_exchange(&mutex->lock, -1) != 0) {
+    if (futex_wait(&mutex->lock, -1, __abstime2timeout(abstime)) < 0 && errno == ETIMEDOUT) return ETIMEDOUT;
+  }
+
+  return 0;
+}
+
+static int mutex_lock(pthread_mutex_t *mutex, const struct timespec *abstime) {
+  pthread_t self;
+  int rc;
+
+  if (mutex->kind == PTHREAD_MUTEX_NORMAL) return mutex_acquire(mutex, abstime);
+
+  self = pthread_self();
+  if (mutex->lock != 0 && pthread_equal(mutex->owner, self)) {
+    if (mutex->kind != PTHREAD_MUTEX_RECURSIVE) return EDEADLK;
+    mutex->recursion++;
+    return 0;
+  }
+
+  rc = mutex_acquire(mutex, abstime);
+  if (rc != 0) return rc;
+
+  mutex->recursion = 1;
+  mutex->owner = self;
+  return 0;
+}
+
 int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr) {
   if (!mutex) return EINVAL;
   if (attr && attr->pshared == PTHREAD_PROCESS_SHARED) return ENOSYS;
@@ -84,81 +122,21 @@ int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr)
   mutex->recursion = 0;
   mutex->kind = attr ? attr->kind : PTHREAD_MUTEX_DEFAULT;
   mutex->owner = NOHANDLE;
-  mutex->event = mkevent(0, 0);
-  if (mutex->event < 0) return ENOSPC;
   return 0;
 }
 
 int pthread_mutex_destroy(pthread_mutex_t *mutex) {
   if (!mutex) return EINVAL;
-  if (close(mutex->event) < 0) return errno;
+  if (mutex->lock != 0) return EBUSY;
   return 0;
 }
 
 int pthread_mutex_lock(pthread_mutex_t *mutex) {
-  if (mutex->kind == PTHREAD_MUTEX_NORMAL){
-    if (atomic_exchange(&mutex->lock, 1) != 0) {
-      while (atomic_exchange(&mutex->lock, -1) != 0) {
-        if (waitone(mutex->event, INFINITE) != 0) return EINVAL;
-      }
-    }
-  } else {
-    pthread_t self = pthread_self();
-
-    if (atomic_exchange(&mutex->lock, 1) == 0) {
-      mutex->recursion = 1;
-      mutex->owner = self;
-    } else {
-      if (pthread_equal(mutex->owner, self)) {
-        if (mutex->kind == PTHREAD_MUTEX_RECURSIVE) {
-          mutex->recursion++;
-        } else {
-          return EDEADLK;
-        }
-      } else {
-        while (atomic_exchange(&mutex->lock, -1) != 0) {
-          if (waitone(mutex->event, INFINITE) != 0) return EINVAL;
-          mutex->recursion = 1;
-          mutex->owner = self;
-        }
-      }
-    }
-  }
-
-  return 0;
+  return mutex_lock(mutex, NULL);
 }
 
 int pthread_mutex_timedlock(pthread_mutex_t *mutex, const struct timespec *abstime) {
-  if (mutex->kind == PTHREAD_MUTEX_NORMAL) {
-    if (atomic_exchange(&mutex->lock, 1) != 0) {
-      while (atomic_exchange(&mutex->lock, -1) != 0) {
-        if (waitone(mutex->event, __abstime2timeout(abstime)) != 0) return EINVAL;
-      }
-    }
-  } else {
-    pthread_t self = pthread_self();
-
-    if (atomic_exchange(&mutex->lock, 1) == 0) {
-      mutex->recursion = 1;
-      mutex->owner = self;
-    } else {
-      if (pthread_equal(mutex->owner, self)) {
-        if (mutex->kind == PTHREAD_MUTEX_RECURSIVE) {
-          mutex->recursion++;
-        } else {
-          return EDEADLK;
-        }
-      } else {
-        while (atomic_exchange(&mutex->lock, -1) != 0) {
-          if (waitone(mutex->event, __abstime2timeout(abstime)) != 0) return EINVAL;
-          mutex->recursion = 1;
-          mutex->owner = self;
-        }
-      }
-    }
-  }
-
-  return 0;
+  return mutex_lock(mutex, abstime);
 }
 
 int pthread_mutex_trylock(pthread_mutex_t *mutex) {
@@ -184,9 +162,7 @@ int pthread_mutex_unlock(pthread_mutex_t *mutex) {
 
     idx = atomic_exchange(&mutex->lock, 0);
     if (idx != 0) {
-      if (idx < 0) {
-        if (eset(mutex->event) < 0) return EINVAL;
-      }
+      if (idx < 0) futex_wake(&mutex->lock, 1);
     } else {
       return EPERM;
     }
@@ -194,9 +170,7 @@ int pthread_mutex_unlock(pthread_mutex_t *mutex) {
     if (pthread_equal(mutex->owner, pthread_self())) {
       if (mutex->kind != PTHREAD_MUTEX_RECURSIVE || --mutex->recursion == 0) {
         mutex->owner = NOHANDLE;
-        if (atomic_exchange(&mutex->lock, 0) < 0) {
-          if (eset(mutex->event) < 0) return EINVAL;
-        }
+        if (atomic_exchange(&mutex->lock, 0) < 0) futex_wake(&mutex->lock, 1);
       }
     } else {
       return EPERM;
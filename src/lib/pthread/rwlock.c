@@ -33,6 +33,8 @@
 
 #include <os.h>
 #include <pthread.h>
+#include <atomic.h>
+#include <limits.h>
 
 int pthread_rwlockattr_init(pthread_rwlockattr_t *attr) {
   if (!attr) return EINVAL;
@@ -57,35 +59,49 @@ int pthread_rwlockattr_setpshared(pthread_rwlockattr_t *attr, int pshared) {
   return 0;
 }
 
+//
+// The lock state is protected by the mutex. Blocked readers and writers
+// wait on separate futexes which are incremented when the lock is released.
+//
+
+static int rwlock_wait(pthread_rwlock_t *lock, int *futex, const struct timespec *abstime) {
+  int value = *futex;
+  int rc = 0;
+
+  pthread_mutex_unlock(&lock->mutex);
+  if (futex_wait(futex, value, __abstime2timeout(abstime)) < 0 && errno == ETIMEDOUT) rc = ETIMEDOUT;
+  pthread_mutex_lock(&lock->mutex);
+  return rc;
+}
+
+static void rwlock_release(int *futex, int count) {
+  atomic_increment(futex);
+  futex_wake(futex, count);
+}
+
 int pthread_rwlock_init(pthread_rwlock_t *lock, const pthread_rwlockattr_t *attr) {
   int rc;
 
   if (!lock) return EINVAL;
   if (attr && attr->pshared == PTHREAD_PROCESS_SHARED) return ENOSYS;
 
-  lock->num_active = 0;
+  lock->shared_waiters = 0;
   lock->exclusive_waiters = 0;
   lock->num_shared_waiters = 0;
+  lock->num_exclusive_waiters = 0;
+  lock->num_active = 0;
   lock->owner = NOHANDLE;
   
   rc = pthread_mutex_init(&lock->mutex, NULL);
   if (rc != 0) return rc;
 
-  lock->exclusive_waiters = mksem(0);
-  if (lock->exclusive_waiters < 0) return errno;
-
-  lock->shared_waiters = mksem(0);
-  if (lock->shared_waiters < 0) return errno;
-
   return 0;
 }
 
 int pthread_rwlock_destroy(pthread_rwlock_t *lock) {
   if (!lock) return EINVAL;
-  pthread_mutex_destroy(&lock->mutex);
-  if (close(lock->exclusive_waiters) < 0) return errno;
-  if (close(lock->shared_waiters) < 0) return errno;
-  return 0;
+  if (lock->num_active != 0) return EBUSY;
+  return pthread_mutex_destroy(&lock->mutex);
 }
 
 int pthread_rwlock_tryrdlock(pthread_rwlock_t *lock) {
@@ -114,17 +130,15 @@ int pthread_rwlock_trywrlock(pthread_rwlock_t *lock) {
     // Lock is free
     lock->num_active = -1;
     lock->owner = pthread_self();
-  } else if (lock->num_active < 0) {
-    // Exclusive lock in progress
-    if (pthread_equal(lock->owner, pthread_self())) {
-      lock->num_active--;
-    } else {
-      rc = EBUSY;
-    }
+  } else if (lock->num_active < 0 && pthread_equal(lock->owner, pthread_self())) {
+    // Recursive exclusive lock
+    lock->num_active--;
+  } else {
+    rc = EBUSY;
   }
 
   pthread_mutex_unlock(&lock->mutex);
-  return 0;
+  return rc;
 }
 
 int pthread_rwlock_rdlock(pthread_rwlock_t *lock) {
@@ -132,6 +146,8 @@ int pthread_rwlock_rdlock(pthread_rwlock_t *lock) {
 }
 
 int pthread_rwlock_timedrdlock(pthread_rwlock_t *lock, const struct timespec *abstime) {
+  int rc = 0;
+
   pthread_mutex_lock(&lock->mutex);
 
   while (1) {
@@ -142,9 +158,9 @@ int pthread_rwlock_timedrdlock(pthread_rwlock_t *lock, const struct timespec *ab
       }
 
       lock->num_shared_waiters++;
-      pthread_mutex_unlock(&lock->mutex);
-      if (waitone(lock->shared_waiters, __abstime2timeout(abstime)) < 0) return errno;
-      pthread_mutex_lock(&lock->mutex);
+      rc = rwlock_wait(lock, &lock->shared_waiters, abstime);
+      lock->num_shared_waiters--;
+      if (rc != 0) break;
     } else {
       lock->num_active++;
       break;
@@ -152,7 +168,7 @@ int pthread_rwlock_timedrdlock(pthread_rwlock_t *lock, const struct timespec *ab
   }
 
   pthread_mutex_unlock(&lock->mutex);
-  return 0;
+  return rc;
 }
 
 int pthread_rwlock_wrlock(pthread_rwlock_t *lock) {
@@ -160,6 +176,8 @@ int pthread_rwlock_wrlock(pthread_rwlock_t *lock) {
 }
 
 int pthread_rwlock_timedwrlock(pthread_rwlock_t *lock, const struct timespec *abstime) {
+  int rc = 0;
+
   pthread_mutex_lock(&lock->mutex);
 
   while (1) {
@@ -177,14 +195,14 @@ int pthread_rwlock_timedwrlock(pthread_rwlock_t *lock, const struct timespec *ab
     }
 
     // Wait for lock to be released
-    lock->exclusive_waiters++;
-    pthread_mutex_unlock(&lock->mutex);
-    if (waitone(lock->exclusive_waiters, __abstime2timeout(abstime)) < 0) return errno;
-    pthread_mutex_lock(&lock->mutex);
+    lock->num_exclusive_waiters++;
+    rc = rwlock_wait(lock, &lock->exclusive_waiters, abstime);
+    lock->num_exclusive_waiters--;
+    if (rc != 0) break;
   }
 
   pthread_mutex_unlock(&lock->mutex);
-  return 0;
+  return rc;
 }
 
 int pthread_rwlock_unlock(pthread_rwlock_t *lock) {
@@ -193,23 +211,16 @@ int pthread_rwlock_unlock(pthread_rwlock_t *lock) {
   if (lock->num_active > 0) {
     // Have one or more readers
     if (--lock->num_active == 0) {
-      if (lock->num_exclusive_waiters > 0) {
-        lock->num_exclusive_waiters--;
-        semrel(lock->exclusive_waiters, 1);
-      }
+      if (lock->num_exclusive_waiters > 0) rwlock_release(&lock->exclusive_waiters, 1);
     }
   } else if (lock->num_active < 0) {
     // Have a writer, possibly recursive
     if (++lock->num_active == 0) {
       lock->owner = NOHANDLE;
       if (lock->num_exclusive_waiters > 0) {
-        lock->num_exclusive_waiters--;
-        semrel(lock->exclusive_waiters, 1);
+        rwlock_release(&lock->exclusive_waiters, 1);
       } else if (lock->num_shared_waiters > 0) {
-        int num = lock->num_shared_waiters;
-        lock->num_active = num;
-        lock->num_shared_waiters = 0;
-        semrel(lock->shared_waiters, num);
+        rwlock_release(&lock->shared_waiters, INT_MAX);
       }
     }
   }
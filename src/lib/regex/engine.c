@@ -134,12 +134,7 @@ static int matcher(struct re_guts *g, char *string, size_t nmatch, regmatch_t pm
   if (stop < start) return REG_INVARG;
 
   // Prescreening; this does wonders for this rather slow code
-  if (g->must != NULL) {
-    for (dp = start; dp < stop; dp++) {
-      if (*dp == g->must[0] && stop - dp >= g->mlen && memcmp(dp, g->must, (size_t) g->mlen) == 0) break;
-    }
-    if (dp == stop) return REG_NOMATCH;  // we didn't find g->must
-  }
+  if (g->must != NULL && mustscan(g, start, stop) == NULL) return REG_NOMATCH;
 
   // Match struct setup
   m->g = g;
@@ -158,7 +153,9 @@ static int matcher(struct re_guts *g, char *string, size_t nmatch, regmatch_t pm
 
   // This loop does only one repetition except for backrefs
   for (;;) {
-    endp = fast(m, start, stop, gf, gl);
+    if (g->backrefs || dfamatch(g, start, stop, eflags, &endp, &m->coldp) < 0) {
+      endp = fast(m, start, stop, gf, gl);
+    }
     if (endp == NULL) {
       // a miss
       STATETEARDOWN(m);
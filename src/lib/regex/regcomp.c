@@ -203,6 +203,8 @@ int regcomp(regex_t *preg, const char *pattern, int cflags) {
   g->neol = 0;
   g->must = NULL;
   g->mlen = 0;
+  g->mskip = NULL;
+  g->dfa = NULL;
   g->nsub = 0;
   g->ncategories = 1; // Category 0 is "everything else"
   g->categories = &g->catspace[-(CHAR_MIN)];
@@ -1434,6 +1436,13 @@ static void findmust(struct parse *p, struct re_guts *g) {
   }
   assert(cp == g->must + g->mlen);
   *cp++ = '\0';   // just on general principles
+
+  // Build skip table for Boyer-Moore-Horspool search for must
+  if (g->mlen < 2) return;
+  g->mskip = (int *) malloc(NC * sizeof(int));
+  if (g->mskip == NULL) return;
+  for (i = 0; i < NC; i++) g->mskip[i] = g->mlen;
+  for (i = 0; i < g->mlen - 1; i++) g->mskip[(uch) g->must[i]] = g->mlen - 1 - i;
 }
 
 //
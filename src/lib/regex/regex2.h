@@ -140,6 +140,8 @@ struct re_guts {
   cat_t *categories;     // ->catspace[-CHAR_MIN]
   char *must;            // match must contain this string
   int mlen;              // length of must
+  int *mskip;            // Boyer-Moore-Horspool skip table for must
+  struct dfa *dfa;       // lazy DFA cache for matching
   size_t nsub;           // copy of re_nsub
   int backrefs;          // does it use back references?
   sopno nplus;           // how deep does it nest +s?
@@ -147,6 +149,8 @@ struct re_guts {
   cat_t catspace[1];     // actually [NC]
 };
 
+void dfafree(struct dfa *dfa);
+
 #define MAGIC1 ((('r' ^ 0200) << 8) | 'e')
 #define MAGIC2 ((('R' ^ 0200) << 8) | 'E')
 
@@ -40,6 +40,7 @@
 #include <limits.h>
 #include <ctype.h>
 #include <regex.h>
+#include <atomic.h>
 
 #include "regex2.h"
 
@@ -49,6 +50,9 @@
 
 static int nope = 0;    // for use in asserts; shuts lint up
 
+static char *mustscan(struct re_guts *g, char *start, char *stop);
+static int dfamatch(struct re_guts *g, char *start, char *stop, int eflags, char **endp, char **coldp);
+
 // Macros for manipulating states, small version
 #define states  unsigned
 #define states1 unsigned  // for later use in regexec() decision
@@ -125,6 +129,284 @@ static int nope = 0;    // for use in asserts; shuts lint up
 
 #include "engine.c"
 
+//
+// mustscan - find the must string using Boyer-Moore-Horspool
+//
+static char *mustscan(struct re_guts *g, char *start, char *stop) {
+  int mlen = g->mlen;
+  int *skip = g->mskip;
+  char *must = g->must;
+  char *p;
+  char lastch;
+
+  if (stop - start < mlen) return NULL;
+  if (skip == NULL) {
+    // Single character or no skip table
+    for (p = start; p <= stop - mlen; p++) {
+      p = memchr(p, must[0], stop - mlen + 1 - p);
+      if (p == NULL) return NULL;
+      if (memcmp(p, must, mlen) == 0) return p;
+    }
+    return NULL;
+  }
+
+  lastch = must[mlen - 1];
+  p = start + mlen - 1;
+  while (p < stop) {
+    if (*p == lastch && memcmp(p - mlen + 1, must, mlen - 1) == 0) return p - mlen + 1;
+    p += skip[(uch) *p];
+  }
+  return NULL;
+}
+
+//
+// Lazy DFA
+//
+// For expressions without back references the state sets computed by
+// fast() only depend on the previous state set, the kind of the previous
+// character, and the category of the next character.  The DFA caches these
+// state sets as DFA states with a transition table indexed by character
+// class.  Transitions are computed with lstep() the first time they are
+// taken, so only the states reached by the input are ever built.  If the
+// cache grows too big it is flushed and rebuilt from the current state.
+//
+
+#define DFA_MAXSTATES 512
+#define DFA_HASHSIZE  257
+
+// Kind of previous character
+#define CTX_OUT       0
+#define CTX_NEWLINE   1
+#define CTX_WORD      2
+#define CTX_OTHER     3
+
+struct dfastate {
+  struct dfastate *next;      // next state in hash bucket
+  unsigned int hash;          // hash value for state set
+  int ctx;                    // kind of previous character
+  int fresh;                  // no match underway
+  char *set;                  // NFA states
+  struct dfastate *trans[1];  // transitions, actually [nclasses + 1]
+};
+
+struct dfa {
+  int eflags;                 // REG_NOTBOL and REG_NOTEOL flags for cache
+  int nclasses;               // number of character classes
+  int nstates;                // number of states in cache
+  int generation;             // incremented when cache is flushed
+  struct dfastate *start;     // start state
+  char *fresh;                // NFA states for a fresh start
+  char *st;                   // work state sets
+  char *tmp;
+  uch classes[NC];            // character class for each character
+  char rep[NC];               // representative character for each class
+  char kind[NC + 1];          // kind of characters in each class
+  struct dfastate *hash[DFA_HASHSIZE];
+};
+
+static struct dfastate dfaaccept;
+static struct dfastate dfareject;
+
+static void dfaflush(struct dfa *dfa) {
+  struct dfastate *s;
+  int i;
+
+  for (i = 0; i < DFA_HASHSIZE; i++) {
+    while ((s = dfa->hash[i]) != NULL) {
+      dfa->hash[i] = s->next;
+      free(s);
+    }
+  }
+  dfa->nstates = 0;
+  dfa->start = NULL;
+  dfa->generation++;
+}
+
+void dfafree(struct dfa *dfa) {
+  dfaflush(dfa);
+  free(dfa);
+}
+
+static struct dfa *dfaalloc(struct re_guts *g) {
+  struct dfa *dfa;
+  int c, k, kind;
+  char ch;
+
+  dfa = (struct dfa *) malloc(sizeof(struct dfa) + 3 * g->nstates);
+  if (dfa == NULL) return NULL;
+  memset(dfa, 0, sizeof(struct dfa));
+  dfa->fresh = (char *) (dfa + 1);
+  dfa->st = dfa->fresh + g->nstates;
+  dfa->tmp = dfa->st + g->nstates;
+
+  // Characters in the same category and of the same kind are equivalent
+  for (c = 0; c < NC; c++) {
+    ch = (char) c;
+    if (ch == '\n' && (g->cflags & REG_NEWLINE)) {
+      kind = CTX_NEWLINE;
+    } else if (ISWORD(ch)) {
+      kind = CTX_WORD;
+    } else {
+      kind = CTX_OTHER;
+    }
+    for (k = 0; k < dfa->nclasses; k++) {
+      if (g->categories[dfa->rep[k]] == g->categories[ch] && dfa->kind[k] == kind) break;
+    }
+    if (k == dfa->nclasses) {
+      dfa->rep[k] = ch;
+      dfa->kind[k] = kind;
+      dfa->nclasses++;
+    }
+    dfa->classes[c] = k;
+  }
+  dfa->kind[dfa->nclasses] = CTX_OUT;
+
+  // Compute states for a fresh start
+  memset(dfa->fresh, 0, g->nstates);
+  dfa->fresh[g->firststate + 1] = 1;
+  lstep(g, g->firststate + 1, g->laststate, dfa->fresh, NOTHING, dfa->fresh);
+
+  return dfa;
+}
+
+static struct dfastate *dfalookup(struct re_guts *g, struct dfa *dfa, char *set, int ctx) {
+  struct dfastate *s;
+  unsigned int h;
+  int i;
+
+  h = ctx;
+  for (i = 0; i < g->nstates; i++) h = h * 31 + set[i];
+  for (s = dfa->hash[h % DFA_HASHSIZE]; s; s = s->next) {
+    if (s->hash == h && s->ctx == ctx && memcmp(s->set, set, g->nstates) == 0) return s;
+  }
+
+  if (dfa->nstates >= DFA_MAXSTATES) dfaflush(dfa);
+  s = (struct dfastate *) malloc(sizeof(struct dfastate) + dfa->nclasses * sizeof(struct dfastate *) + g->nstates);
+  if (s == NULL) return NULL;
+  memset(s->trans, 0, (dfa->nclasses + 1) * sizeof(struct dfastate *));
+  s->set = (char *) &s->trans[dfa->nclasses + 1];
+  memcpy(s->set, set, g->nstates);
+  s->hash = h;
+  s->ctx = ctx;
+  s->fresh = memcmp(set, dfa->fresh, g->nstates) == 0;
+  s->next = dfa->hash[h % DFA_HASHSIZE];
+  dfa->hash[h % DFA_HASHSIZE] = s;
+  dfa->nstates++;
+  return s;
+}
+
+static struct dfastate *dfatrans(struct re_guts *g, struct dfa *dfa, struct dfastate *s, int k) {
+  const sopno gf = g->firststate + 1;
+  const sopno gl = g->laststate;
+  char *st = dfa->st;
+  int lastctx = s->ctx;
+  int ctx = dfa->kind[k];
+  int c = ctx == CTX_OUT ? OUT : dfa->rep[k];
+  int generation = dfa->generation;
+  struct dfastate *t;
+  int flagch;
+  int i;
+
+  // This mirrors the loop body in fast()
+  memcpy(st, s->set, g->nstates);
+  flagch = '\0';
+  i = 0;
+  if (lastctx == CTX_NEWLINE || (lastctx == CTX_OUT && !(dfa->eflags & REG_NOTBOL))) {
+    flagch = BOL;
+    i = g->nbol;
+  }
+  if (ctx == CTX_NEWLINE || (ctx == CTX_OUT && !(dfa->eflags & REG_NOTEOL))) {
+    flagch = (flagch == BOL) ? BOLEOL : EOL;
+    i += g->neol;
+  }
+  for (; i > 0; i--) lstep(g, gf, gl, st, flagch, st);
+
+  if ((flagch == BOL || (lastctx != CTX_OUT && lastctx != CTX_WORD)) && ctx == CTX_WORD) {
+    flagch = BOW;
+  }
+  if (lastctx == CTX_WORD && (flagch == EOL || (ctx != CTX_OUT && ctx != CTX_WORD))) {
+    flagch = EOW;
+  }
+  if (flagch == BOW || flagch == EOW) lstep(g, gf, gl, st, flagch, st);
+
+  if (st[gl]) {
+    t = &dfaaccept;
+  } else if (c == OUT) {
+    t = &dfareject;
+  } else {
+    memcpy(dfa->tmp, st, g->nstates);
+    memcpy(st, dfa->fresh, g->nstates);
+    lstep(g, gf, gl, dfa->tmp, c, st);
+    t = dfalookup(g, dfa, st, ctx);
+    if (t == NULL) return NULL;
+  }
+
+  // The source state is gone if the cache was flushed
+  if (dfa->generation == generation) s->trans[k] = t;
+  return t;
+}
+
+//
+// dfamatch - find end of match using the lazy DFA, like fast()
+//
+static int dfamatch(struct re_guts *g, char *start, char *stop, int eflags, char **endp, char **coldp) {
+  struct dfa *dfa;
+  struct dfastate *s;
+  struct dfastate *t;
+  char *p;
+  char *cold;
+  int k;
+  int rc;
+
+  if (eflags & (REG_LARGE | REG_BACKR | REG_TRACE)) return -1;
+
+  // Take the DFA from the regex, so concurrent matchers do not share it
+  dfa = (struct dfa *) atomic_exchange((int *) &g->dfa, 0);
+  if (dfa == NULL) {
+    dfa = dfaalloc(g);
+    if (dfa == NULL) return -1;
+  }
+  if ((eflags & (REG_NOTBOL | REG_NOTEOL)) != dfa->eflags) {
+    dfaflush(dfa);
+    dfa->eflags = eflags & (REG_NOTBOL | REG_NOTEOL);
+  }
+
+  rc = -1;
+  s = dfa->start;
+  if (s == NULL) s = dfa->start = dfalookup(g, dfa, dfa->fresh, CTX_OUT);
+  if (s != NULL) {
+    cold = NULL;
+    p = start;
+    for (;;) {
+      if (s->fresh) cold = p;
+      k = (p == stop) ? dfa->nclasses : dfa->classes[(uch) *p];
+      t = s->trans[k];
+      if (t == NULL) {
+        t = dfatrans(g, dfa, s, k);
+        if (t == NULL) break;
+      }
+      if (t == &dfaaccept) {
+        *endp = p + 1;
+        rc = 0;
+        break;
+      }
+      if (t == &dfareject) {
+        *endp = NULL;
+        rc = 0;
+        break;
+      }
+      s = t;
+      p++;
+    }
+    *coldp = cold;
+  }
+
+  // Give DFA back to the regex
+  dfa = (struct dfa *) atomic_exchange((int *) &g->dfa, (int) dfa);
+  if (dfa != NULL) dfafree(dfa);
+  return rc;
+}
+
 #ifdef REDEBUG
 #define GOODFLAGS(f) (f)
 #else
@@ -51,5 +51,7 @@ void regfree(regex_t *preg) {
   if (g->sets != NULL) free(g->sets);
   if (g->setbits != NULL) free(g->setbits);
   if (g->must != NULL) free(g->must);
+  if (g->mskip != NULL) free(g->mskip);
+  if (g->dfa != NULL) dfafree(g->dfa);
   free(g);
 }
@@ -33,6 +33,31 @@
 
 #include <os.h>
 #include <semaphore.h>
+#include <atomic.h>
+
+//
+// Semaphores are implemented using the semaphore count as a futex. Threads
+// only call the kernel when they need to wait for the semaphore, or when
+// posting to a semaphore with waiters.
+//
+
+static int sem_acquire(sem_t *sem, unsigned int timeout) {
+  int value;
+
+  while (1) {
+    value = sem->value;
+    if (value > 0) {
+      if (atomic_compare_and_exchange(&sem->value, value - 1, value) == value) return 0;
+    } else {
+      atomic_increment(&sem->waiters);
+      if (futex_wait(&sem->value, value, timeout) < 0 && errno != EAGAIN) {
+        atomic_decrement(&sem->waiters);
+        return -1;
+      }
+      atomic_decrement(&sem->waiters);
+    }
+  }
+}
 
 int sem_init(sem_t *sem, int pshared, unsigned int value) {
   if (pshared) {
@@ -40,59 +65,60 @@ int sem_init(sem_t *sem, int pshared, unsigned int value) {
     return -1;
   }
 
-  *sem = mksem(value);
-  if (*sem < 0) {
-    errno = ENOSPC;
+  if (!sem || value > SEM_VALUE_MAX) {
+    errno = EINVAL;
     return -1;
   }
 
+  sem->value = value;
+  sem->waiters = 0;
   return 0;
 }
 
 int sem_destroy(sem_t *sem) {
-  if (!sem || *sem == -1) {
+  if (!sem) {
     errno = EINVAL;
     return -1;
   }
 
-  if (close(*sem) < 0) {
-    errno = EINVAL;
+  if (sem->waiters) {
+    errno = EBUSY;
     return -1;
   }
 
-  *sem = -1;
   return 0;
 }
 
 int sem_trywait(sem_t *sem) {
-  if (!sem || *sem == -1) {
+  int value;
+
+  if (!sem) {
     errno = EINVAL;
     return -1;
   }
 
-  if (waitone(*sem, 0) < 0) {
-    errno = EAGAIN;
-    return -1;
+  while ((value = sem->value) > 0) {
+    if (atomic_compare_and_exchange(&sem->value, value - 1, value) == value) return 0;
   }
 
-  return 0;
+  errno = EAGAIN;
+  return -1;
 }
 
 int sem_wait(sem_t * sem) {
-  if (!sem || *sem == -1) {
+  if (!sem) {
     errno = EINVAL;
     return -1;
   }
 
-  if (waitone(*sem, INFINITE) < 0) return -1;
-  return 0;
+  return sem_acquire(sem, INFINITE);
 }
 
 int sem_timedwait(sem_t *sem, const struct timespec *abstime) {
   struct timeval curtime;
   long timeout;
 
-  if (!sem || *sem == -1) {
+  if (!sem) {
     errno = EINVAL;
     return -1;
   }
@@ -102,35 +128,21 @@ int sem_timedwait(sem_t *sem, const struct timespec *abstime) {
              (long)((abstime->tv_nsec / 1000) - curtime.tv_usec) / 1000L);
   if (timeout < 0) timeout = 0L;
 
-  if (waitone(*sem, timeout) < 0) return -1;
-  return 0;
+  return sem_acquire(sem, timeout);
 }
 
 int sem_post(sem_t *sem) {
-  if (!sem || *sem == -1) {
-    errno = EINVAL;
-    return -1;
-  }
-
-  if (semrel(*sem, 1) < 0) {
-    errno = EINVAL;
-    return -1;
-  }
-
-  return 0;
+  return sem_post_multiple(sem, 1);
 }
 
 int sem_post_multiple(sem_t *sem, int count) {
-  if (!sem || *sem == -1) {
-    errno = EINVAL;
-    return -1;
-  }
-
-  if (semrel(*sem, count) < 0) {
+  if (!sem || count <= 0) {
     errno = EINVAL;
     return -1;
   }
 
+  atomic_add(&sem->value, count);
+  if (sem->waiters) futex_wake(&sem->value, count);
   return 0;
 }
 
@@ -150,6 +162,11 @@ int sem_unlink(const char *name) {
 }
 
 int sem_getvalue(sem_t *sem, int *sval) {
-  errno = ENOSYS;
-  return -1;
+  if (!sem || !sval) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *sval = sem->value;
+  return 0;
 }
@@ -44,6 +44,9 @@
 #define anybuf(s) ((s)->flag & (_IOOWNBUF | _IOEXTBUF | _IOTMPBUF | _IONBF))
 #define inuse(s)  ((s)->flag & (_IORD |_IOWR |_IORW))
 
+#define FILEBUFSIZ  (64 * 1024)   // Buffer size for regular files
+#define CRLFBUFSIZ  2048          // Chunk size for newline translation
+
 static void exit_stdio(void) {
   // Flush stdout and stderr
   fflush(stdout);
@@ -85,12 +88,39 @@ FILE *__getstdfile(int n) {
   return &crtbase->iob[n];
 }
 
+static int bufsize(FILE *stream) {
+  struct stat st;
+  int size;
+
+  // Devices, pipes and sockets use small buffers. Regular files get a
+  // large buffer so sequential access needs fewer system calls.
+  if (fstat(fileno(stream), &st) < 0 || !S_ISREG(st.st_mode)) return BUFSIZ;
+  size = FILEBUFSIZ;
+
+  // Do not allocate more than needed for small read-only files
+  if ((stream->flag & (_IORD | _IOWR | _IORW)) == _IORD && st.st_size < size) {
+    size = (int) st.st_size + 1;
+    if (size < BUFSIZ) size = BUFSIZ;
+  }
+
+  return size;
+}
+
 static void getbuf(FILE *stream) {
+  int size;
+
   // Try to get a buffer
-  if (stream->base = malloc(BUFSIZ)) {
+  size = bufsize(stream);
+  stream->base = malloc(size);
+  if (!stream->base && size > BUFSIZ) {
+    size = BUFSIZ;
+    stream->base = malloc(size);
+  }
+
+  if (stream->base) {
     // Got a buffer
     stream->flag |= _IOOWNBUF;
-    stream->bufsiz = BUFSIZ;
+    stream->bufsiz = size;
   } else {
     // Did NOT get a buffer - use single char buffering.
     stream->flag |= _IONBF;
@@ -131,34 +161,50 @@ void _ftbuf(FILE *stream) {
 }
 
 static int write_translated(int fh, char *buf, int len) {
-  char *ptr = buf;
+  char chunk[CRLFBUFSIZ];
   char *end = buf + len;
-  int written = 0;
+  char *limit = chunk + CRLFBUFSIZ - 1;
+  char *nl;
+  char *q;
+  int n;
   int rc;
 
-  while (ptr < end) {
-    if (*ptr == '\n') {
-      if (buf < ptr) {
-        rc = write(fh, buf, ptr - buf);
-        if (rc < 0) return rc;
-        written += rc;
-      }
-
-      rc = write(fh, "\r", 1);
-      if (rc < 0) return -1;
+  while (buf < end) {
+    // Write text without newlines directly from the caller's buffer
+    nl = memchr(buf, '\n', end - buf);
+    if (!nl) nl = end;
+    if (nl - buf >= CRLFBUFSIZ) {
+      rc = write(fh, buf, nl - buf);
+      if (rc < 0) return rc;
+      buf = nl;
+      continue;
+    }
 
-      buf = ptr;
+    // Expand lines into the chunk buffer and write them in one call
+    q = chunk;
+    while (buf < end && q < limit) {
+      n = end - buf;
+      if (n > limit - q) n = limit - q;
+      nl = memchr(buf, '\n', n);
+      if (nl) {
+        n = nl - buf;
+        memcpy(q, buf, n);
+        q += n;
+        *q++ = '\r';
+        *q++ = '\n';
+        buf = nl + 1;
+      } else {
+        memcpy(q, buf, n);
+        q += n;
+        buf += n;
+      }
     }
-    ptr++;
-  }
 
-  if (buf < end) {
-    rc = write(fh, buf, end - buf);
+    rc = write(fh, chunk, q - chunk);
     if (rc < 0) return rc;
-    written += rc;
   }
 
-  return written;
+  return len;
 }
 
 int filbuf(FILE *stream) {
@@ -485,11 +531,27 @@ int fputc(int c, FILE *stream) {
 
 char *fgets(char *string, int n, FILE *stream) {
   char *ptr = string;
+  char *nl;
+  int len;
   int ch;
 
   if (n <= 0) return NULL;
 
   while (--n) {
+    // Copy directly from the stream buffer up to the next newline
+    if (stream->cnt > 0) {
+      len = stream->cnt < n ? stream->cnt : n;
+      nl = memchr(stream->ptr, '\n', len);
+      if (nl) len = nl - stream->ptr + 1;
+      memcpy(ptr, stream->ptr, len);
+      ptr += len;
+      stream->ptr += len;
+      stream->cnt -= len;
+      n -= len - 1;
+      if (nl) break;
+      continue;
+    }
+
     if ((ch = getc(stream)) == EOF) {
       if (ptr == string) return NULL;
       break;
@@ -600,13 +662,9 @@ size_t fread(void *buffer, size_t size, size_t num, FILE *stream) {
 
   if ((count = total = size * num) == 0) return 0;
 
-  if (anybuf(stream)) {
-    // Already has buffer, use its size
-    bufsize = stream->bufsiz;
-  } else {
-    // Assume will get BUFSIZ buffer
-    bufsize = BUFSIZ;
-  }
+  // Get a buffer for this stream, if necessary, and use its size
+  if (!anybuf(stream)) getbuf(stream);
+  bufsize = stream->bufsiz;
 
   // Here is the main loop -- we go through here until we're done
   while (count != 0) {
@@ -622,12 +680,9 @@ size_t fread(void *buffer, size_t size, size_t num, FILE *stream) {
       stream->ptr += nbytes;
       data += nbytes;
     } else if (count >= bufsize) {
-      // If we have more than bufsize chars to read, get data
-      // by calling read with an integral number of bufsiz
-      // blocks.
-
-      // Calc chars to read -- (count / bufsize) * bufsize
-      nbytes = bufsize ? count - count % bufsize : count;
+      // If we have at least bufsize chars to read, bypass the
+      // buffer and read the rest directly into the user buffer.
+      nbytes = count;
 
       nread = read(fileno(stream), data, nbytes);
       if (nread == 0) {
@@ -670,6 +725,8 @@ size_t fwrite(const void *buffer, size_t size, size_t num, FILE *stream) {
   unsigned bufsize;               // Size of stream buffer
   unsigned nbytes;                // Number of bytes to write now
   unsigned nwritten;              // Number of bytes written
+  unsigned pending;               // Number of bytes in stream buffer
+  struct iovec iov[2];            // Buffered and user data for writev
   int c;                          // A temp char
 
   // Initialize local vars
@@ -677,33 +734,39 @@ size_t fwrite(const void *buffer, size_t size, size_t num, FILE *stream) {
   count = total = size * num;
   if (count == 0) return 0;
 
-  if (anybuf(stream)) {
-    // Already has buffer, use its size
-    bufsize = stream->bufsiz;
-  } else {
-    // Assume will get BUFSIZ buffer
-    bufsize = BUFSIZ;
-  }
+  // Get a buffer for this stream, if necessary, and use its size
+  if (!anybuf(stream)) getbuf(stream);
+  bufsize = stream->bufsiz;
 
   // Here is the main loop -- we go through here until we're done
   while (count != 0) {
-    // If the buffer is big and has room, copy data to buffer
-    if (bigbuf(stream) && stream->cnt != 0) {
-      // How much do we want?
-      nbytes = (count < (unsigned) stream->cnt) ? count : stream->cnt;
-      memcpy(stream->ptr, data, nbytes);
+    if (count >= bufsize && bigbuf(stream) &&
+        (stream->flag & (_IORD | _IOWR | _IOCRLF)) == _IOWR &&
+        (pending = stream->ptr - stream->base) > 0) {
+      // Large write with data in the buffer. Write the buffered data
+      // and the user data in one call instead of filling the buffer.
+      iov[0].iov_base = stream->base;
+      iov[0].iov_len = pending;
+      iov[1].iov_base = (void *) data;
+      iov[1].iov_len = count;
+      nwritten = writev(fileno(stream), iov, 2);
 
-      // Update stream and amount of data written
-      count -= nbytes;
-      stream->cnt -= nbytes;
-      stream->ptr += nbytes;
-      data += nbytes;
-    } else if (count >= bufsize) {
-      // If we have more than bufsize chars to write, write
-      // data by calling write with an integral number of
-      // bufsiz blocks.  If we reach here and we have a big
-      // buffer, it must be full so flush it.
+      stream->ptr = stream->base;
+      stream->cnt = 0;
+
+      if (nwritten != pending + count) {
+        // Error -- out of here
+        stream->flag |= _IOERR;
+        if ((int) nwritten > (int) pending) count -= nwritten - pending;
+        return (total - count) / size;
+      }
 
+      // If this is a read/write file, clear _IOWR so that next operation can be a read
+      if (stream->flag & _IORW) stream->flag &= ~_IOWR;
+      count = 0;
+    } else if (count >= bufsize) {
+      // If we have at least bufsize chars to write, bypass the buffer
+      // and write the rest directly. Flush buffered data first.
       if (bigbuf(stream)) {
         if (fflush(stream)) {
           // Error, stream flags set -- we're out of here
@@ -711,8 +774,7 @@ size_t fwrite(const void *buffer, size_t size, size_t num, FILE *stream) {
         }
       }
 
-      // Calc chars to write -- (count / bufsize) * bufsize
-      nbytes = bufsize ? (count - count % bufsize) : count;
+      nbytes = count;
 
       if (stream->flag & _IOCRLF) {
         nwritten = write_translated(fileno(stream), (char *) data, nbytes);
@@ -735,6 +797,16 @@ size_t fwrite(const void *buffer, size_t size, size_t num, FILE *stream) {
         stream->flag |= _IOERR;
         return (total - count) / size;
       }
+    } else if (bigbuf(stream) && stream->cnt != 0) {
+      // If the buffer is big and has room, copy data to buffer
+      nbytes = (count < (unsigned) stream->cnt) ? count : stream->cnt;
+      memcpy(stream->ptr, data, nbytes);
+
+      // Update stream and amount of data written
+      count -= nbytes;
+      stream->cnt -= nbytes;
+      stream->ptr += nbytes;
+      data += nbytes;
     } else {
       // Buffer full and not enough chars to do direct write, so do a flsbuf.
       c = *data;  
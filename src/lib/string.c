@@ -250,12 +250,36 @@ void *memmove(void *dst, const void *src, size_t n) {
 }
 
 void *memchr(const void *buf, int ch, size_t n) {
-  while (n && (*(unsigned char *) buf != (unsigned char) ch)) {
-    buf = (unsigned char *) buf + 1;
+  unsigned char *p = (unsigned char *) buf;
+  unsigned char c = (unsigned char) ch;
+  unsigned int mask;
+  unsigned int w;
+
+  // Scan bytes until the pointer is word aligned
+  while (n && ((unsigned long) p & (sizeof(unsigned int) - 1))) {
+    if (*p == c) return p;
+    p++;
+    n--;
+  }
+
+  // Scan a word at a time, stopping at the first word containing a match
+  mask = c | (c << 8);
+  mask |= mask << 16;
+  while (n >= sizeof(unsigned int)) {
+    w = *(unsigned int *) p ^ mask;
+    if ((w - 0x01010101) & ~w & 0x80808080) break;
+    p += sizeof(unsigned int);
+    n -= sizeof(unsigned int);
+  }
+
+  // Locate the match within the last word, or scan the tail
+  while (n) {
+    if (*p == c) return p;
+    p++;
     n--;
   }
 
-  return (n ? (void *) buf : NULL);
+  return NULL;
 }
 
 #ifndef KERNEL
@@ -56,6 +56,18 @@
 static char *digits = "0123456789abcdefghijklmnopqrstuvwxyz";
 static char *upper_digits = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
 
+static const char digitpairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
 static size_t strnlen(const char *s, size_t count) {
   const char *sc;
   for (sc = s; *sc != '\0' && count--; ++sc);
@@ -68,6 +80,27 @@ static int skip_atoi(const char **s) {
   return i;
 }
 
+static int decimal(char *tmp, unsigned long num) {
+  int i = 0;
+
+  // Convert two digits at a time, least significant digits first
+  while (num >= 100) {
+    const char *pair = digitpairs + (num % 100) * 2;
+    num /= 100;
+    tmp[i++] = pair[1];
+    tmp[i++] = pair[0];
+  }
+
+  if (num >= 10) {
+    tmp[i++] = digitpairs[num * 2 + 1];
+    tmp[i++] = digitpairs[num * 2];
+  } else {
+    tmp[i++] = '0' + (char) num;
+  }
+
+  return i;
+}
+
 static char *number(char *str, long num, int base, int size, int precision, int type) {
   char c, sign, tmp[66];
   char *dig = digits;
@@ -103,8 +136,16 @@ static char *number(char *str, long num, int base, int size, int precision, int
 
   i = 0;
 
-  if (num == 0) {
+  if (base == 10) {
+    i = decimal(tmp, (unsigned long) num);
+  } else if (num == 0) {
     tmp[i++] = '0';
+  } else if (base == 16 || base == 8) {
+    int shift = base == 16 ? 4 : 3;
+    while (num != 0) {
+      tmp[i++] = dig[((unsigned long) num) & (base - 1)];
+      num = ((unsigned long) num) >> shift;
+    }
   } else {
     while (num != 0) {
       tmp[i++] = dig[((unsigned long) num) % (unsigned) base];
@@ -385,6 +426,24 @@ int vsprintf(char *buf, const char *fmt, va_list args) {
       *str++ = *fmt;
       continue;
     }
+
+    // Fast path for plain %s and %d
+    if (fmt[1] == 's') {
+      s = va_arg(args, char *);
+      if (!s) s = "<NULL>";
+      while (*s) *str++ = *s++;
+      fmt++;
+      continue;
+    } else if (fmt[1] == 'd') {
+      char tmp[12];
+
+      i = va_arg(args, int);
+      if (i < 0) *str++ = '-';
+      len = decimal(tmp, i < 0 ? -i : i);
+      while (len-- > 0) *str++ = tmp[len];
+      fmt++;
+      continue;
+    }
                   
     // Process flags
     flags = 0;
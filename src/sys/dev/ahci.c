@@ -0,0 +1,856 @@
+//
+// ahci.c
+//
+// AHCI SATA disk driver
+//
+// Copyright (C) 2013 Michael Ringgaard. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+// 3. Neither the name of the project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+//
+
+#include <os/krnl.h>
+
+#define AHCI_MAX_PORTS          32
+#define AHCI_MAX_SLOTS          32
+#define AHCI_MAX_PRDS           56
+
+#define AHCI_MAX_XFER           ((AHCI_MAX_PRDS - 1) * PAGESIZE)
+#define AHCI_MAX_XFER_LBA28     (256 * SECTORSIZE)
+
+#define AHCI_TIMEOUT_CMD        10000
+#define AHCI_TIMEOUT_STOP       500
+#define AHCI_TIMEOUT_READY      1000
+
+//
+// HBA registers
+//
+
+#define AHCI_CAP                0x00    // Host capabilities
+#define AHCI_GHC                0x04    // Global host control
+#define AHCI_IS                 0x08    // Interrupt status
+#define AHCI_PI                 0x0C    // Ports implemented
+#define AHCI_VS                 0x10    // Version
+
+#define AHCI_CAP_NP             0x0000001F  // Number of ports
+#define AHCI_CAP_NCS            0x00001F00  // Number of command slots
+#define AHCI_CAP_SNCQ           0x40000000  // Supports native command queuing
+
+#define AHCI_GHC_HR             0x00000001  // HBA reset
+#define AHCI_GHC_IE             0x00000002  // Interrupt enable
+#define AHCI_GHC_AE             0x80000000  // AHCI enable
+
+//
+// Port registers
+//
+
+#define AHCI_PORT(n)            (0x100 + (n) * 0x80)
+
+#define AHCI_PxCLB              0x00    // Command list base address
+#define AHCI_PxCLBU             0x04    // Command list base address upper 32 bits
+#define AHCI_PxFB               0x08    // FIS base address
+#define AHCI_PxFBU              0x0C    // FIS base address upper 32 bits
+#define AHCI_PxIS               0x10    // Interrupt status
+#define AHCI_PxIE               0x14    // Interrupt enable
+#define AHCI_PxCMD              0x18    // Command and status
+#define AHCI_PxTFD              0x20    // Task file data
+#define AHCI_PxSIG              0x24    // Signature
+#define AHCI_PxSSTS             0x28    // SATA status
+#define AHCI_PxSCTL             0x2C    // SATA control
+#define AHCI_PxSERR             0x30    // SATA error
+#define AHCI_PxSACT             0x34    // SATA active (NCQ tags outstanding)
+#define AHCI_PxCI               0x38    // Command issue
+
+#define AHCI_PxCMD_ST           0x00000001  // Start
+#define AHCI_PxCMD_SUD          0x00000002  // Spin-up device
+#define AHCI_PxCMD_POD          0x00000004  // Power on device
+#define AHCI_PxCMD_FRE          0x00000010  // FIS receive enable
+#define AHCI_PxCMD_FR           0x00004000  // FIS receive running
+#define AHCI_PxCMD_CR           0x00008000  // Command list running
+
+#define AHCI_PxIS_DHRS          0x00000001  // Device to host register FIS
+#define AHCI_PxIS_PSS           0x00000002  // PIO setup FIS
+#define AHCI_PxIS_DSS           0x00000004  // DMA setup FIS
+#define AHCI_PxIS_SDBS          0x00000008  // Set device bits FIS
+#define AHCI_PxIS_DPS           0x00000020  // Descriptor processed
+#define AHCI_PxIS_IFS           0x08000000  // Interface fatal error
+#define AHCI_PxIS_HBDS          0x10000000  // Host bus data error
+#define AHCI_PxIS_HBFS          0x20000000  // Host bus fatal error
+#define AHCI_PxIS_TFES          0x40000000  // Task file error
+#define AHCI_PxIS_OFS           0x01000000  // Overflow
+
+#define AHCI_PxIS_ERROR         (AHCI_PxIS_TFES | AHCI_PxIS_HBFS | AHCI_PxIS_HBDS | AHCI_PxIS_IFS | AHCI_PxIS_OFS)
+#define AHCI_PxIE_DEFAULT       (AHCI_PxIS_DHRS | AHCI_PxIS_PSS | AHCI_PxIS_DSS | AHCI_PxIS_SDBS | AHCI_PxIS_ERROR)
+
+#define AHCI_PxTFD_ERR          0x01
+#define AHCI_PxTFD_DRQ          0x08
+#define AHCI_PxTFD_BSY          0x80
+
+#define AHCI_SSTS_DET           0x0000000F
+#define AHCI_SSTS_DET_PRESENT   3
+
+#define AHCI_SIG_ATA            0x00000101
+#define AHCI_SIG_ATAPI          0xEB140101
+
+//
+// ATA commands
+//
+
+#define ATA_CMD_READ_DMA        0xC8
+#define ATA_CMD_WRITE_DMA       0xCA
+#define ATA_CMD_READ_DMA_EXT    0x25
+#define ATA_CMD_WRITE_DMA_EXT   0x35
+#define ATA_CMD_READ_FPDMA      0x60
+#define ATA_CMD_WRITE_FPDMA     0x61
+#define ATA_CMD_IDENTIFY        0xEC
+
+#define ATA_DEV_LBA             0x40
+
+#define FIS_TYPE_REG_H2D        0x27
+#define FIS_H2D_CMD             0x80
+
+//
+// Identify device data word offsets
+//
+
+#define ATA_ID_MODEL            27
+#define ATA_ID_LBA_CAPACITY     60
+#define ATA_ID_QUEUE_DEPTH      75
+#define ATA_ID_SATA_CAP         76
+#define ATA_ID_COMMAND_SET_2    83
+#define ATA_ID_LBA48_CAPACITY   100
+
+#define ATA_ID_SATA_CAP_NCQ     0x0100
+#define ATA_ID_CMDSET2_LBA48    0x0400
+
+//
+// Command list header
+//
+
+#define AHCI_CMD_CFL            5       // Command FIS length in dwords
+#define AHCI_CMD_WRITE          0x40
+#define AHCI_CMD_PREFETCH       0x80
+
+#pragma pack(push, 1)
+
+struct ahci_cmdhdr {
+  unsigned short flags;                 // Command FIS length and flags
+  unsigned short prdtl;                 // Physical region descriptor table length
+  unsigned long prdbc;                  // Physical region descriptor byte count
+  unsigned long ctba;                   // Command table base address
+  unsigned long ctbau;                  // Command table base address upper 32 bits
+  unsigned long reserved[4];
+};
+
+struct ahci_prd {
+  unsigned long dba;                    // Data base address
+  unsigned long dbau;                   // Data base address upper 32 bits
+  unsigned long reserved;
+  unsigned long dbc;                    // Byte count - 1 (bit 31 is interrupt on completion)
+};
+
+struct ahci_cmdtbl {
+  unsigned char cfis[64];               // Command FIS
+  unsigned char acmd[16];               // ATAPI command
+  unsigned char reserved[48];
+  struct ahci_prd prdt[AHCI_MAX_PRDS];  // Physical region descriptor table
+};
+
+#pragma pack(pop)
+
+#define AHCI_CMDTBLS_PER_PAGE   (PAGESIZE / sizeof(struct ahci_cmdtbl))
+
+struct ahci;
+
+struct ahci_port {
+  struct ahci *ahci;                    // Host bus adapter
+  int portno;                           // Port number on HBA
+  unsigned char *regs;                  // Port registers
+
+  struct ahci_cmdhdr *cmdlist;          // Command list
+  unsigned char *rfis;                  // Received FIS area
+  struct ahci_cmdtbl *cmdtbl[AHCI_MAX_SLOTS]; // Command tables
+
+  struct sem slots;                     // Free command slots
+  struct event done[AHCI_MAX_SLOTS];    // Command completion events
+  int result[AHCI_MAX_SLOTS];           // Command completion status
+  unsigned long busy;                   // Allocated command slots
+  unsigned long active;                 // Issued command slots
+  unsigned long intstatus;              // Interrupt status pending for DPC
+  unsigned long errstatus;              // Interrupt status that triggered recovery
+  int recovering;                       // Error recovery in progress
+  struct event ready;                   // Signaled when port accepts new commands
+  struct task errtask;                  // Task for error recovery
+  int nslots;                           // Number of usable command slots
+  int ncq;                              // Native command queuing enabled
+  int lba48;                            // 48-bit LBA addressing supported
+
+  dev_t devno;                          // Device number
+  unsigned int capacity;                // Capacity in sectors
+  char model[41];                       // Model name
+  struct partition parts[MAX_PARTITIONS]; // Partition info
+};
+
+struct ahci {
+  struct unit *unit;                    // PCI unit for HBA
+  unsigned char *regs;                  // Memory mapped HBA registers
+  int irq;                              // Interrupt request line
+  unsigned long cap;                    // Host capabilities
+  int nslots;                           // Command slots supported by HBA
+  struct interrupt intr;                // Interrupt handler
+  struct dpc dpc;                       // DPC for command completion
+  struct ahci_port *ports[AHCI_MAX_PORTS]; // Ports with attached disks
+};
+
+#define hba_read(ahci, reg) (*(volatile unsigned long *) ((ahci)->regs + (reg)))
+#define hba_write(ahci, reg, val) (*(volatile unsigned long *) ((ahci)->regs + (reg)) = (val))
+
+#define port_read(port, reg) (*(volatile unsigned long *) ((port)->regs + (reg)))
+#define port_write(port, reg, val) (*(volatile unsigned long *) ((port)->regs + (reg)) = (val))
+
+static void ahci_fixstring(unsigned char *s, int len) {
+  unsigned char *p = s;
+  unsigned char *end = s + len;
+
+  // Convert from big-endian to host byte order
+  for (p = end ; p != s;) {
+     unsigned short *pp = (unsigned short *) (p -= 2);
+    *pp = ((*pp & 0x00FF) << 8) | ((*pp & 0xFF00) >> 8);
+  }
+
+  // Strip leading blanks
+  while (s != end && *s == ' ') ++s;
+
+  // Compress internal blanks and strip trailing blanks
+  while (s != end && *s) {
+    if (*s++ != ' ' || (s != end && *s && *s != ' ')) *p++ = *(s - 1);
+  }
+
+  // Wipe out trailing garbage
+  while (p != end) *p++ = '\0';
+}
+
+static int ahci_wait(struct ahci_port *port, int reg, unsigned long mask, unsigned long value, int timeout) {
+  while ((port_read(port, reg) & mask) != value) {
+    if (timeout-- <= 0) return -ETIMEOUT;
+    udelay(1000);
+  }
+  return 0;
+}
+
+static int ahci_stop_port(struct ahci_port *port) {
+  unsigned long cmd = port_read(port, AHCI_PxCMD);
+
+  // Stop command list processing and wait for the DMA engine to go idle
+  if (cmd & (AHCI_PxCMD_ST | AHCI_PxCMD_CR)) {
+    port_write(port, AHCI_PxCMD, cmd & ~AHCI_PxCMD_ST);
+    if (ahci_wait(port, AHCI_PxCMD, AHCI_PxCMD_CR, 0, AHCI_TIMEOUT_STOP) < 0) return -ETIMEOUT;
+  }
+
+  // Stop receiving FISes
+  cmd = port_read(port, AHCI_PxCMD);
+  if (cmd & (AHCI_PxCMD_FRE | AHCI_PxCMD_FR)) {
+    port_write(port, AHCI_PxCMD, cmd & ~AHCI_PxCMD_FRE);
+    if (ahci_wait(port, AHCI_PxCMD, AHCI_PxCMD_FR, 0, AHCI_TIMEOUT_STOP) < 0) return -ETIMEOUT;
+  }
+
+  return 0;
+}
+
+static int ahci_start_port(struct ahci_port *port) {
+  unsigned long cmd;
+
+  // Enable FIS reception and wait for the device to become ready
+  cmd = port_read(port, AHCI_PxCMD);
+  port_write(port, AHCI_PxCMD, cmd | AHCI_PxCMD_FRE | AHCI_PxCMD_SUD | AHCI_PxCMD_POD);
+  if (ahci_wait(port, AHCI_PxTFD, AHCI_PxTFD_BSY | AHCI_PxTFD_DRQ, 0, AHCI_TIMEOUT_READY) < 0) return -ETIMEOUT;
+
+  // Clear errors and start processing the command list
+  port_write(port, AHCI_PxSERR, 0xFFFFFFFF);
+  port_write(port, AHCI_PxIS, 0xFFFFFFFF);
+  cmd = port_read(port, AHCI_PxCMD);
+  port_write(port, AHCI_PxCMD, cmd | AHCI_PxCMD_ST);
+
+  return 0;
+}
+
+static void ahci_reset_port(struct ahci_port *port) {
+  unsigned long sctl;
+
+  // Issue COMRESET to the device
+  sctl = port_read(port, AHCI_PxSCTL);
+  port_write(port, AHCI_PxSCTL, (sctl & ~0x0F) | 1);
+  udelay(1000);
+  port_write(port, AHCI_PxSCTL, sctl & ~0x0F);
+
+  // Wait for link to come back up
+  ahci_wait(port, AHCI_PxSSTS, AHCI_SSTS_DET, AHCI_SSTS_DET_PRESENT, AHCI_TIMEOUT_READY);
+  port_write(port, AHCI_PxSERR, 0xFFFFFFFF);
+}
+
+static void ahci_complete(struct ahci_port *port, unsigned long done, int result) {
+  int slot;
+
+  port->active &= ~done;
+  for (slot = 0; done; slot++, done >>= 1) {
+    if (done & 1) {
+      port->result[slot] = result;
+      set_event(&port->done[slot]);
+    }
+  }
+}
+
+static void ahci_recover(void *arg) {
+  struct ahci_port *port = (struct ahci_port *) arg;
+  unsigned long tfd = port_read(port, AHCI_PxTFD);
+  unsigned long serr = port_read(port, AHCI_PxSERR);
+
+  kprintf(KERN_ERR "ahci: port %d error, is=%08x tfd=%08x serr=%08x\n", port->portno, port->errstatus, tfd, serr);
+
+  // Restart the port. This runs as a task with interrupts enabled, since
+  // stopping and resetting the port can take up to a second. No new
+  // commands are issued while recovery is in progress.
+  ahci_stop_port(port);
+  port_write(port, AHCI_PxSERR, 0xFFFFFFFF);
+  port_write(port, AHCI_PxIS, 0xFFFFFFFF);
+  if (tfd & (AHCI_PxTFD_BSY | AHCI_PxTFD_DRQ)) ahci_reset_port(port);
+  ahci_start_port(port);
+
+  // A queued command failure aborts all outstanding commands on the
+  // device, so every active command is failed and left to the caller
+  // to retry.
+  cli();
+  ahci_complete(port, port->active, -EIO);
+  port->intstatus = 0;
+  port->recovering = 0;
+  set_event(&port->ready);
+  sti();
+}
+
+static void ahci_port_error(struct ahci_port *port, unsigned long intstatus) {
+  // Must be called with interrupts disabled
+  if (port->recovering) return;
+  port->recovering = 1;
+  port->errstatus = intstatus;
+  reset_event(&port->ready);
+  queue_task(&sys_task_queue, &port->errtask, ahci_recover, port);
+}
+
+static void ahci_dpc(void *arg) {
+  struct ahci *ahci = (struct ahci *) arg;
+  struct ahci_port *port;
+  unsigned long intstatus;
+  unsigned long pending;
+  int i;
+
+  for (i = 0; i < AHCI_MAX_PORTS; i++) {
+    port = ahci->ports[i];
+    if (!port) continue;
+
+    cli();
+    intstatus = port->intstatus;
+    port->intstatus = 0;
+
+    // Command status is not reliable while the port is being restarted
+    if (port->active && !port->recovering) {
+      // Complete all commands that are no longer outstanding on the port
+      pending = port_read(port, AHCI_PxSACT) | port_read(port, AHCI_PxCI);
+      ahci_complete(port, port->active & ~pending, 0);
+
+      // Schedule port restart to fail the remaining commands on errors
+      if (intstatus & AHCI_PxIS_ERROR) ahci_port_error(port, intstatus);
+    }
+    sti();
+  }
+}
+
+static int ahci_handler(struct context *ctxt, void *arg) {
+  struct ahci *ahci = (struct ahci *) arg;
+  struct ahci_port *port;
+  unsigned long status;
+  unsigned long intstatus;
+  int i;
+
+  // Check if any ports need attention
+  status = hba_read(ahci, AHCI_IS);
+  if (!status) return 0;
+
+  // Acknowledge port interrupts and save status for the DPC
+  for (i = 0; i < AHCI_MAX_PORTS; i++) {
+    if (!(status & (1 << i))) continue;
+    port = ahci->ports[i];
+    if (port) {
+      intstatus = port_read(port, AHCI_PxIS);
+      port_write(port, AHCI_PxIS, intstatus);
+      port->intstatus |= intstatus;
+    } else {
+      hba_write(ahci, AHCI_PORT(i) + AHCI_PxIS, hba_read(ahci, AHCI_PORT(i) + AHCI_PxIS));
+    }
+  }
+  hba_write(ahci, AHCI_IS, status);
+
+  queue_irq_dpc(&ahci->dpc, ahci_dpc, ahci);
+  eoi(ahci->irq);
+  return 1;
+}
+
+static int ahci_setup_prdt(struct ahci_cmdtbl *tbl, char *buffer, int count) {
+  int n;
+  int len;
+  unsigned long addr;
+  char *next;
+
+  // Build scatter/gather list directly from the caller's buffer, merging
+  // physically contiguous pages into one descriptor. Fails if the buffer
+  // needs more descriptors than the command table holds.
+  n = 0;
+  next = (char *) ((unsigned long) buffer & ~(PAGESIZE - 1)) + PAGESIZE;
+  while (count > 0) {
+    addr = virt2phys(buffer);
+    len = next - buffer;
+    if (len > count) len = count;
+
+    if (n > 0 && tbl->prdt[n - 1].dba + tbl->prdt[n - 1].dbc + 1 == addr) {
+      tbl->prdt[n - 1].dbc += len;
+    } else {
+      if (n == AHCI_MAX_PRDS) return -EINVAL;
+      tbl->prdt[n].dba = addr;
+      tbl->prdt[n].dbau = 0;
+      tbl->prdt[n].reserved = 0;
+      tbl->prdt[n].dbc = len - 1;
+      n++;
+    }
+
+    count -= len;
+    buffer = next;
+    next += PAGESIZE;
+  }
+
+  return n;
+}
+
+static void ahci_setup_fis(struct ahci_port *port, unsigned char *fis, int cmd, blkno_t blkno, int sectors, int slot) {
+  memset(fis, 0, 20);
+  fis[0] = FIS_TYPE_REG_H2D;
+  fis[1] = FIS_H2D_CMD;
+  fis[2] = cmd;
+
+  if (cmd == ATA_CMD_IDENTIFY) return;
+
+  fis[4] = (unsigned char) blkno;
+  fis[5] = (unsigned char) (blkno >> 8);
+  fis[6] = (unsigned char) (blkno >> 16);
+  fis[7] = ATA_DEV_LBA;
+
+  if (cmd == ATA_CMD_READ_DMA || cmd == ATA_CMD_WRITE_DMA) {
+    fis[7] |= (unsigned char) ((blkno >> 24) & 0x0F);
+    fis[12] = (unsigned char) sectors;
+  } else {
+    fis[8] = (unsigned char) (blkno >> 24);
+    if (cmd == ATA_CMD_READ_FPDMA || cmd == ATA_CMD_WRITE_FPDMA) {
+      // Queued commands carry the sector count in the features field and
+      // the tag in the count field
+      fis[3] = (unsigned char) sectors;
+      fis[11] = (unsigned char) (sectors >> 8);
+      fis[12] = (unsigned char) (slot << 3);
+    } else {
+      fis[12] = (unsigned char) sectors;
+      fis[13] = (unsigned char) (sectors >> 8);
+    }
+  }
+}
+
+static int ahci_exec(struct ahci_port *port, int cmd, blkno_t blkno, void *buffer, int count, int write) {
+  struct ahci_cmdhdr *hdr;
+  struct ahci_cmdtbl *tbl;
+  unsigned long mask;
+  int slot;
+  int prds;
+  int rc;
+
+  // Allocate command slot
+  if (wait_for_object(&port->slots, INFINITE) < 0) return -EINTR;
+  cli();
+  for (slot = 0; slot < port->nslots; slot++) {
+    if (!(port->busy & (1 << slot))) break;
+  }
+  mask = 1 << slot;
+  port->busy |= mask;
+  sti();
+
+  // Build command table and command header
+  hdr = &port->cmdlist[slot];
+  tbl = port->cmdtbl[slot];
+  ahci_setup_fis(port, tbl->cfis, cmd, blkno, count / SECTORSIZE, slot);
+  prds = ahci_setup_prdt(tbl, buffer, count);
+  if (prds < 0) {
+    kprintf(KERN_ERR "ahci: port %d dma transfer of %d bytes too large\n", port->portno, count);
+    cli();
+    port->busy &= ~mask;
+    sti();
+    release_sem(&port->slots, 1);
+    return prds;
+  }
+  hdr->prdtl = prds;
+  hdr->flags = AHCI_CMD_CFL | (write ? AHCI_CMD_WRITE : AHCI_CMD_PREFETCH);
+  hdr->prdbc = 0;
+
+  // Issue command once any pending error recovery has finished
+  reset_event(&port->done[slot]);
+  while (1) {
+    if (wait_for_object(&port->ready, INFINITE) < 0) {
+      cli();
+      port->busy &= ~mask;
+      sti();
+      release_sem(&port->slots, 1);
+      return -EINTR;
+    }
+    cli();
+    if (!port->recovering) break;
+    sti();
+  }
+  port->active |= mask;
+  if (port->ncq && cmd != ATA_CMD_IDENTIFY) port_write(port, AHCI_PxSACT, mask);
+  port_write(port, AHCI_PxCI, mask);
+  sti();
+
+  // Wait for command to complete
+  rc = wait_for_object(&port->done[slot], AHCI_TIMEOUT_CMD);
+  if (rc < 0) {
+    cli();
+    if (port->active & mask) {
+      // Restart the port and wait for recovery to fail the command
+      kprintf(KERN_ERR "ahci: port %d command %02x timeout\n", port->portno, cmd);
+      ahci_port_error(port, 0);
+      sti();
+      while (port->active & mask) wait_for_object(&port->done[slot], INFINITE);
+      port->result[slot] = -ETIMEOUT;
+    } else {
+      sti();
+    }
+  }
+  cli();
+  rc = port->result[slot];
+  if (rc == 0) rc = count;
+
+  // Release command slot
+  port->busy &= ~mask;
+  sti();
+  release_sem(&port->slots, 1);
+
+  return rc;
+}
+
+static int ahci_rw(struct ahci_port *port, char *buffer, size_t count, blkno_t blkno, int write) {
+  int cmd;
+  int maxxfer;
+  int len;
+  int rc;
+  int done;
+
+  if (count == 0) return 0;
+  if (blkno + count / SECTORSIZE > port->capacity) return -EFAULT;
+
+  if (port->ncq) {
+    cmd = write ? ATA_CMD_WRITE_FPDMA : ATA_CMD_READ_FPDMA;
+    maxxfer = AHCI_MAX_XFER;
+  } else if (port->lba48) {
+    cmd = write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+    maxxfer = AHCI_MAX_XFER;
+  } else {
+    cmd = write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA;
+    maxxfer = AHCI_MAX_XFER_LBA28;
+  }
+
+  done = 0;
+  while (count > 0) {
+    len = count > maxxfer ? maxxfer : count;
+    rc = ahci_exec(port, cmd, blkno, buffer, len, write);
+    if (rc < 0) return rc;
+
+    buffer += len;
+    blkno += len / SECTORSIZE;
+    count -= len;
+    done += len;
+  }
+
+  return done;
+}
+
+static int ahci_ioctl(struct dev *dev, int cmd, void *args, size_t size) {
+  struct ahci_port *port = (struct ahci_port *) dev->privdata;
+  struct geometry *geom;
+
+  switch (cmd) {
+    case IOCTL_GETDEVSIZE:
+      return port->capacity;
+
+    case IOCTL_GETBLKSIZE:
+      return SECTORSIZE;
+
+    case IOCTL_GETGEOMETRY:
+      if (!args || size != sizeof(struct geometry)) return -EINVAL;
+      geom = (struct geometry *) args;
+      geom->cyls = port->capacity / (255 * 63);
+      geom->heads = 255;
+      geom->spt = 63;
+      geom->sectorsize = SECTORSIZE;
+      geom->sectors = port->capacity;
+      return 0;
+
+    case IOCTL_REVALIDATE:
+      return create_partitions(port->devno, port->parts);
+  }
+
+  return -ENOSYS;
+}
+
+static int ahci_read(struct dev *dev, void *buffer, size_t count, blkno_t blkno, int flags) {
+  struct ahci_port *port = (struct ahci_port *) dev->privdata;
+  return ahci_rw(port, buffer, count, blkno, 0);
+}
+
+static int ahci_write(struct dev *dev, void *buffer, size_t count, blkno_t blkno, int flags) {
+  struct ahci_port *port = (struct ahci_port *) dev->privdata;
+  return ahci_rw(port, buffer, count, blkno, 1);
+}
+
+struct driver ahci_driver = {
+  "ahci",
+  DEV_TYPE_BLOCK,
+  ahci_ioctl,
+  ahci_read,
+  ahci_write
+};
+
+static int ahci_identify(struct ahci_port *port) {
+  unsigned short *id;
+  unsigned __int64 capacity;
+  int depth;
+  int rc;
+
+  id = (unsigned short *) kmalloc(SECTORSIZE);
+  if (!id) return -ENOMEM;
+  memset(id, 0, SECTORSIZE);
+
+  rc = ahci_exec(port, ATA_CMD_IDENTIFY, 0, id, SECTORSIZE, 0);
+  if (rc < 0) {
+    kfree(id);
+    return rc;
+  }
+
+  // Get model name
+  memcpy(port->model, id + ATA_ID_MODEL, 40);
+  ahci_fixstring((unsigned char *) port->model, 40);
+  port->model[40] = 0;
+
+  // Get capacity
+  if (id[ATA_ID_COMMAND_SET_2] & ATA_ID_CMDSET2_LBA48) {
+    port->lba48 = 1;
+    capacity = *(unsigned __int64 *) (id + ATA_ID_LBA48_CAPACITY);
+  } else {
+    capacity = *(unsigned long *) (id + ATA_ID_LBA_CAPACITY);
+  }
+  port->capacity = capacity > 0xFFFFFFFF ? 0xFFFFFFFF : (unsigned int) capacity;
+
+  // Enable native command queuing if both the HBA and the device support it
+  if ((port->ahci->cap & AHCI_CAP_SNCQ) && port->lba48 && (id[ATA_ID_SATA_CAP] & ATA_ID_SATA_CAP_NCQ)) {
+    depth = (id[ATA_ID_QUEUE_DEPTH] & 0x1F) + 1;
+    if (depth > port->nslots) depth = port->nslots;
+    port->ncq = 1;
+    port->nslots = depth;
+  } else {
+    port->nslots = 1;
+  }
+  init_sem(&port->slots, port->nslots);
+
+  kfree(id);
+  return 0;
+}
+
+static void ahci_free_port(struct ahci_port *port) {
+  int i;
+
+  // Let a pending recovery task finish before releasing the port
+  while (port->errtask.flags & (TASK_QUEUED | TASK_EXECUTING)) yield();
+
+  for (i = 0; i < port->nslots; i += AHCI_CMDTBLS_PER_PAGE) {
+    if (port->cmdtbl[i]) free_pages(port->cmdtbl[i], 1);
+  }
+  if (port->cmdlist) free_pages(port->cmdlist, 1);
+  kfree(port);
+}
+
+static int ahci_init_port(struct ahci *ahci, int portno) {
+  struct ahci_port *port;
+  unsigned long ssts;
+  unsigned long sig;
+  unsigned long phys;
+  char *page;
+  int i;
+  int rc;
+
+  // Check for attached ATA device
+  ssts = hba_read(ahci, AHCI_PORT(portno) + AHCI_PxSSTS);
+  if ((ssts & AHCI_SSTS_DET) != AHCI_SSTS_DET_PRESENT) return -ENODEV;
+  sig = hba_read(ahci, AHCI_PORT(portno) + AHCI_PxSIG);
+  if (sig != AHCI_SIG_ATA) return -ENODEV;
+
+  // Allocate port
+  port = (struct ahci_port *) kmalloc(sizeof(struct ahci_port));
+  if (!port) return -ENOMEM;
+  memset(port, 0, sizeof(struct ahci_port));
+  port->ahci = ahci;
+  port->portno = portno;
+  port->regs = ahci->regs + AHCI_PORT(portno);
+  port->nslots = ahci->nslots;
+  port->devno = NODEV;
+  init_sem(&port->slots, 1);
+  init_event(&port->ready, 1, 1);
+  init_task(&port->errtask);
+  for (i = 0; i < AHCI_MAX_SLOTS; i++) init_event(&port->done[i], 0, 0);
+
+  // Allocate command list and received FIS area in one page
+  page = alloc_pages(1, 'AHCI');
+  if (!page) {
+    ahci_free_port(port);
+    return -ENOMEM;
+  }
+  memset(page, 0, PAGESIZE);
+  port->cmdlist = (struct ahci_cmdhdr *) page;
+  port->rfis = page + 1024;
+
+  // Allocate command tables
+  for (i = 0; i < port->nslots; i++) {
+    if (i % AHCI_CMDTBLS_PER_PAGE == 0) {
+      page = alloc_pages(1, 'AHCI');
+      if (!page) {
+        ahci_free_port(port);
+        return -ENOMEM;
+      }
+      memset(page, 0, PAGESIZE);
+    }
+    port->cmdtbl[i] = (struct ahci_cmdtbl *) (page + (i % AHCI_CMDTBLS_PER_PAGE) * sizeof(struct ahci_cmdtbl));
+    port->cmdlist[i].ctba = virt2phys(port->cmdtbl[i]);
+    port->cmdlist[i].ctbau = 0;
+  }
+
+  // Setup port
+  ahci_stop_port(port);
+  phys = virt2phys(port->cmdlist);
+  port_write(port, AHCI_PxCLB, phys);
+  port_write(port, AHCI_PxCLBU, 0);
+  port_write(port, AHCI_PxFB, phys + 1024);
+  port_write(port, AHCI_PxFBU, 0);
+  rc = ahci_start_port(port);
+  if (rc < 0) {
+    kprintf(KERN_WARNING "ahci: port %d not ready\n", portno);
+    ahci_stop_port(port);
+    ahci_free_port(port);
+    return rc;
+  }
+  ahci->ports[portno] = port;
+  port_write(port, AHCI_PxIE, AHCI_PxIE_DEFAULT);
+
+  // Identify device
+  rc = ahci_identify(port);
+  if (rc < 0) {
+    kprintf(KERN_ERR "ahci: error %d identifying device on port %d\n", rc, portno);
+    port_write(port, AHCI_PxIE, 0);
+    ahci->ports[portno] = NULL;
+    ahci_stop_port(port);
+    ahci_free_port(port);
+    return rc;
+  }
+
+  // Make new device
+  port->devno = dev_make("sd#", &ahci_driver, ahci->unit, port);
+  kprintf(KERN_INFO "%s: %s (%d MB), SATA port %d", device(port->devno)->name, port->model, port->capacity / (1024 * 1024 / SECTORSIZE), portno);
+  if (port->lba48) kprintf(", LBA48");
+  if (port->ncq) kprintf(", NCQ depth %d", port->nslots);
+  kprintf("\n");
+
+  create_partitions(port->devno, port->parts);
+  return 0;
+}
+
+static int install_ahci(struct unit *unit) {
+  struct ahci *ahci;
+  unsigned long abar;
+  unsigned long pi;
+  int i;
+
+  // Allocate memory for host bus adapter
+  ahci = (struct ahci *) kmalloc(sizeof(struct ahci));
+  if (!ahci) return -ENOMEM;
+  memset(ahci, 0, sizeof(struct ahci));
+  ahci->unit = unit;
+
+  // Map HBA registers
+  abar = pci_read_config_dword(unit, PCI_CONFIG_BASE_ADDR_5) & ~0xF;
+  if (!abar) {
+    kfree(ahci);
+    return -ENODEV;
+  }
+  ahci->regs = iomap(abar, AHCI_PORT(AHCI_MAX_PORTS));
+  if (!ahci->regs) {
+    kfree(ahci);
+    return -ENOMEM;
+  }
+  ahci->irq = get_unit_irq(unit);
+  pci_enable_busmastering(unit);
+
+  // Switch controller to AHCI mode
+  hba_write(ahci, AHCI_GHC, hba_read(ahci, AHCI_GHC) | AHCI_GHC_AE);
+  ahci->cap = hba_read(ahci, AHCI_CAP);
+  ahci->nslots = ((ahci->cap & AHCI_CAP_NCS) >> 8) + 1;
+  pi = hba_read(ahci, AHCI_PI);
+  kprintf(KERN_INFO "ahci: AHCI %x.%x controller, %d ports, %d slots%s, irq %d\n",
+          hba_read(ahci, AHCI_VS) >> 16, (hba_read(ahci, AHCI_VS) >> 8) & 0xFF,
+          (ahci->cap & AHCI_CAP_NP) + 1, ahci->nslots,
+          (ahci->cap & AHCI_CAP_SNCQ) ? ", NCQ" : "", ahci->irq);
+
+  // Install interrupt handler
+  init_dpc(&ahci->dpc);
+  register_interrupt(&ahci->intr, IRQ2INTR(ahci->irq), ahci_handler, ahci);
+  enable_irq(ahci->irq);
+  hba_write(ahci, AHCI_IS, 0xFFFFFFFF);
+  hba_write(ahci, AHCI_GHC, hba_read(ahci, AHCI_GHC) | AHCI_GHC_IE);
+
+  // Initialize ports with attached disks
+  for (i = 0; i < AHCI_MAX_PORTS; i++) {
+    if (pi & (1 << i)) ahci_init_port(ahci, i);
+  }
+
+  return 0;
+}
+
+void init_ahci() {
+  struct unit *unit = NULL;
+
+  while ((unit = lookup_unit_by_class(unit, PCI_CLASS_STORAGE_AHCI, 0xFFFFFF)) != NULL) {
+    install_ahci(unit);
+  }
+}
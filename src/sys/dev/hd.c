@@ -37,7 +37,6 @@
 
 #define HD_CONTROLLERS          2
 #define HD_DRIVES               4
-#define HD_PARTITIONS           4
 
 #define MAX_PRDS                (PAGESIZE / 8)
 #define MAX_DMA_XFER_SIZE       ((MAX_PRDS - 1) * PAGESIZE)
@@ -337,14 +336,6 @@ struct hdc  {
   unsigned long prds_phys;             // Physical address of PRD list
 };
 
-struct partition {
-  dev_t dev;
-  unsigned int start;
-  unsigned int len;
-  unsigned short bootid;
-  unsigned short systid;
-};
-
 struct hd {
   struct hdc *hdc;                      // Controller
   struct hdparam param;                 // Drive parameter block
@@ -366,15 +357,13 @@ struct hd {
   unsigned int heads;                   // Number of heads
   unsigned int sectors;                 // Sectors per track
 
-  struct partition parts[HD_PARTITIONS]; // Partition info
+  struct partition parts[MAX_PARTITIONS]; // Partition info
 };
 
 int ideprobe = 0;
 static struct hdc hdctab[HD_CONTROLLERS];
 static struct hd hdtab[HD_DRIVES];
 
-static int create_partitions(struct hd *hd);
-
 static void hd_fixstring(unsigned char *s, int len) {
   unsigned char *p = s;
   unsigned char *end = s + len;
@@ -767,7 +756,7 @@ static int hd_ioctl(struct dev *dev, int cmd, void *args, size_t size) {
       return 0;
 
     case IOCTL_REVALIDATE:
-      return create_partitions(hd);
+      return create_partitions(hd->devno, hd->parts);
   }
 
   return -ENOSYS;
@@ -1265,32 +1254,6 @@ int hdc_handler(struct context *ctxt, void *arg) {
   return 0;
 }
 
-static int part_ioctl(struct dev *dev, int cmd, void *args, size_t size) {
-  struct partition *part = (struct partition *) dev->privdata;
-
-  switch (cmd) {
-    case IOCTL_GETDEVSIZE:
-      return part->len;
-
-    case IOCTL_GETBLKSIZE:
-      return dev_ioctl(part->dev, IOCTL_GETBLKSIZE, NULL, 0);
-  }
-
-  return -ENOSYS;
-}
-
-static int part_read(struct dev *dev, void *buffer, size_t count, blkno_t blkno, int flags) {
-  struct partition *part = (struct partition *) dev->privdata;
-  if (blkno + count / SECTORSIZE > part->len) return -EFAULT;
-  return dev_read(part->dev, buffer, count, blkno + part->start, 0);
-}
-
-static int part_write(struct dev *dev, void *buffer, size_t count, blkno_t blkno, int flags) {
-  struct partition *part = (struct partition *) dev->privdata;
-  if (blkno + count / SECTORSIZE > part->len) return -EFAULT;
-  return dev_write(part->dev, buffer, count, blkno + part->start, 0);
-}
-
 struct driver harddisk_udma_driver = {
   "idedisk/udma",
   DEV_TYPE_BLOCK,
@@ -1315,57 +1278,6 @@ struct driver cdrom_pio_driver = {
   cd_write
 };
 
-struct driver partition_driver = {
-  "partition", 
-  DEV_TYPE_BLOCK,
-  part_ioctl,
-  part_read,
-  part_write
-};
-
-static int create_partitions(struct hd *hd) {
-  struct master_boot_record mbrdata;
-  struct master_boot_record *mbr = &mbrdata;
-  dev_t devno;
-  int rc;
-  int i;
-  char devname[DEVNAMELEN];
-
-  // Read partition table
-  rc = dev_read(hd->devno, mbr, SECTORSIZE, 0, 0);
-  if (rc < 0) {
-    kprintf(KERN_ERR "%s: error %d reading partition table\n", device(hd->devno)->name, rc);
-    return rc;
-  }
-
-  // Create partition devices
-  if (mbr->signature != MBR_SIGNATURE) {
-    kprintf(KERN_ERR "%s: illegal boot sector signature\n", device(hd->devno)->name);
-    return -EIO;
-  }
-
-  for (i = 0; i < HD_PARTITIONS; i++) {
-    hd->parts[i].dev = hd->devno;
-    hd->parts[i].bootid = mbr->parttab[i].bootid;
-    hd->parts[i].systid = mbr->parttab[i].systid;
-    hd->parts[i].start = mbr->parttab[i].relsect;
-    hd->parts[i].len = mbr->parttab[i].numsect;
-
-    if (mbr->parttab[i].systid != 0) {
-      sprintf(devname, "%s%c", device(hd->devno)->name, 'a' + i);
-      devno = dev_open(devname);
-      if (devno == NODEV) {
-        devno = dev_make(devname, &partition_driver, NULL, &hd->parts[i]);
-        kprintf(KERN_INFO "%s: partition %d on %s, %dMB (type %02x)\n", devname, i, device(hd->devno)->name, mbr->parttab[i].numsect / ((1024 * 1024) / SECTORSIZE), mbr->parttab[i].systid);
-      } else {
-        dev_close(devno);
-      }
-    }
-  }
-
-  return 0;
-}
-
 static int probe_device(struct hdc *hdc, int drvsel) {
   unsigned char sc, sn;
 
@@ -1599,7 +1511,7 @@ static void setup_hd(struct hd *hd, struct hdc *hdc, char *devname, int drvsel,
   //if (hd->hdc->bmregbase) kprintf(", bmregbase=0x%x", hd->hdc->bmregbase);
   kprintf("\n");
 
-  if (hd->media == IDE_DISK) create_partitions(hd);
+  if (hd->media == IDE_DISK) create_partitions(hd->devno, hd->parts);
 }
 
 void init_hd() {
@@ -32,6 +32,7 @@
 // 
 
 #include <os/krnl.h>
+#include <limits.h>
 
 int pipefs_mount(struct fs *fs, char *opts);
 int pipefs_close(struct file *filp);
@@ -89,12 +90,18 @@ struct fsops pipefsops = {
   NULL
 };
 
+#define PIPE_BUFSIZE (16 * 1024)
+
+//
+// Each pipe end has a pipe structure. Data written to the pipe is kept in
+// a ring buffer owned by the read end. Threads blocked on a pipe end are
+// queued on its wait list and are woken up whenever the state of the pipe
+// changes, after which they recheck the pipe.
+//
+
 struct pipereq {
   struct pipereq *next;
-  struct pipe *pipe;
   struct thread *thread;
-  char *buffer;
-  size_t size;
   int rc;
 };
 
@@ -103,6 +110,13 @@ struct pipe {
   struct pipe *peer;
   struct pipereq *waithead;
   struct pipereq *waittail;
+
+  // Ring buffer (read end only)
+  char *buffer;
+  size_t head;
+  size_t count;
+  int rdbusy;
+  int wrbusy;
 };
 
 struct fs *pipefs;
@@ -138,6 +152,78 @@ static void cancel_request(struct pipe *pipe, struct pipereq *req) {
   }
 }
 
+static int wait_for_pipe(struct pipe *pipe) {
+  struct pipereq req;
+  int rc;
+
+  req.thread = self();
+  req.rc = 0;
+  req.next = NULL;
+
+  if (pipe->waittail) { 
+    pipe->waittail->next = &req;
+  } else {
+    pipe->waithead = &req;
+  }
+  pipe->waittail = &req;
+
+  rc = enter_alertable_wait(THREAD_WAIT_PIPE);
+  if (rc < 0) {
+    cancel_request(pipe, &req);
+    return rc;
+  }
+
+  return req.rc;
+}
+
+static void update_pipe_events(struct pipe *rd) {
+  struct pipe *wr = rd->peer;
+
+  // The read end is readable when there is data or the writer has gone
+  if (rd->count > 0 || !wr) {
+    set_io_event(&rd->filp->iob, IOEVT_READ);
+  } else {
+    clear_io_event(&rd->filp->iob, IOEVT_READ);
+  }
+
+  // The write end is writable when there is room in the ring buffer
+  if (wr) {
+    if (rd->count < PIPE_BUFSIZE) {
+      set_io_event(&wr->filp->iob, IOEVT_WRITE);
+    } else {
+      clear_io_event(&wr->filp->iob, IOEVT_WRITE);
+    }
+  }
+}
+
+static void ring_get(struct pipe *rd, char *data, size_t size) {
+  size_t n;
+
+  n = PIPE_BUFSIZE - rd->head;
+  if (n > size) n = size;
+  memcpy(data, rd->buffer + rd->head, n);
+  if (size > n) memcpy(data + n, rd->buffer, size - n);
+
+  rd->head = (rd->head + size) % PIPE_BUFSIZE;
+  rd->count -= size;
+
+  // Rewind an empty ring, unless a splice is filling it at the old tail
+  if (rd->count == 0 && !rd->wrbusy) rd->head = 0;
+}
+
+static void ring_put(struct pipe *rd, char *data, size_t size) {
+  size_t tail;
+  size_t n;
+
+  tail = (rd->head + rd->count) % PIPE_BUFSIZE;
+  n = PIPE_BUFSIZE - tail;
+  if (n > size) n = size;
+  memcpy(rd->buffer + tail, data, n);
+  if (size > n) memcpy(rd->buffer, data + n, size - n);
+
+  rd->count += size;
+}
+
 void init_pipefs() {
   register_filesystem("pipefs", &pipefsops);
   mount("pipefs", "", "", NULL, &pipefs);
@@ -148,6 +234,7 @@ int pipe(struct file **readpipe, struct file **writepipe) {
   struct file *wr;
   struct pipe *rdp;
   struct pipe *wrp;
+  char *buffer;
 
   if (!pipefs) return -ENOENT;
 
@@ -155,23 +242,28 @@ int pipe(struct file **readpipe, struct file **writepipe) {
   wr = newfile(pipefs, NULL, O_WRONLY, S_IWRITE);
   rdp = kmalloc(sizeof(struct pipe));
   wrp = kmalloc(sizeof(struct pipe));
-  if (!rd || !wr || !rdp || !wrp) {
+  buffer = kmalloc(PIPE_BUFSIZE);
+  if (!rd || !wr || !rdp || !wrp || !buffer) {
     kfree(rd);
     kfree(wr);
     kfree(rdp);
     kfree(wrp);
+    kfree(buffer);
     return -EMFILE;
   }
 
+  memset(rdp, 0, sizeof(struct pipe));
   rd->data = rdp;
   rdp->filp = rd;
   rdp->peer = wrp;
-  rdp->waithead = rdp->waittail = NULL;
+  rdp->buffer = buffer;
 
+  memset(wrp, 0, sizeof(struct pipe));
   wr->data = wrp;
   wrp->filp = wr;
   wrp->peer = rdp;
-  wrp->waithead = wrp->waittail = NULL;
+
+  update_pipe_events(rdp);
 
   *readpipe = rd;
   *writepipe = wr;
@@ -187,22 +279,30 @@ int pipefs_mount(struct fs *fs, char *opts) {
 
 int pipefs_close(struct file *filp) {
   struct pipe *pipe = (struct pipe *) filp->data;
+  struct pipe *peer = pipe->peer;
 
   set_io_event(&filp->iob, IOEVT_CLOSE);
   release_all_waiters(pipe, -EINTR);
 
-  if (pipe->peer) {
+  if (peer) {
+    pipe->peer = NULL;
+    peer->peer = NULL;
     if (filp->flags & O_WRONLY) {
-      set_io_event(&pipe->peer->filp->iob, IOEVT_READ);
-      release_all_waiters(pipe->peer, 0);
+      // Reader gets the remaining data followed by end of file
+      update_pipe_events(peer);
     } else {
-      set_io_event(&pipe->peer->filp->iob, IOEVT_WRITE);
-      release_all_waiters(pipe->peer, -EPIPE);
+      // Writers get EPIPE
+      set_io_event(&peer->filp->iob, IOEVT_WRITE);
     }
-    pipe->peer->peer = NULL;
-    pipe->peer = NULL;
+    release_all_waiters(peer, 0);
   }
 
+  // A splice into the pipe may still be filling the ring buffer; in
+  // that case the splice frees the read end when it completes.
+  pipe->filp = NULL;
+  if (pipe->wrbusy) return 0;
+
+  kfree(pipe->buffer);
   kfree(pipe);
 
   return 0;
@@ -214,148 +314,230 @@ int pipefs_fsync(struct file *filp) {
 
 int pipefs_read(struct file *filp, void *data, size_t size, off64_t pos) {
   struct pipe *pipe = (struct pipe *) filp->data;
+  size_t count;
+  int rc;
+
+  if (size == 0) return 0;
+
+  // Wait for data
+  while (pipe->count == 0 || pipe->rdbusy) {
+    if (pipe->count == 0 && !pipe->peer) return 0;
+    if (filp->flags & O_NONBLOCK) return -EAGAIN;
+
+    rc = wait_for_pipe(pipe);
+    if (rc < 0) return rc;
+  }
+
+  // Copy data from ring buffer
+  count = pipe->count;
+  if (count > size) count = size;
+  ring_get(pipe, (char *) data, count);
+
+  // Wake up blocked writers
+  if (pipe->peer) release_all_waiters(pipe->peer, 0);
+  update_pipe_events(pipe);
+
+  return count;
+}
+
+int pipefs_write(struct file *filp, void *data, size_t size, off64_t pos) {
+  struct pipe *pipe = (struct pipe *) filp->data;
+  struct pipe *rd;
   char *p;
   size_t left;
-  size_t count;
+  size_t room;
+  int rc;
 
   if (size == 0) return 0;
-  if (!pipe->peer) return 0;
 
   p = (char *) data;
   left = size;
-  count = 0;
-  while (pipe->peer->waithead && left > 0) {
-    struct pipereq *req = pipe->peer->waithead;
-    size_t bytes = req->size;
-    
-    if (bytes > left) bytes = left;
-
-    memcpy(p, req->buffer, bytes);
-    req->buffer += bytes;
-    req->size -= bytes;
-
-    p += bytes;
-    left -= bytes;
-    count += bytes;
-
-    if (req->size == 0) {
-      pipe->peer->waithead = req->next;
-      if (pipe->peer->waithead == NULL) pipe->peer->waittail = NULL;
-      req->rc = 0;
-      mark_thread_ready(req->thread, 1, 2);
+  while (left > 0) {
+    rd = pipe->peer;
+    if (!rd) return left == size ? -EPIPE : size - left;
+
+    // Writes of at most PIPE_BUF bytes are not interleaved with other
+    // writes, so wait until there is room for all of the data
+    room = PIPE_BUFSIZE - rd->count;
+    if (room == 0 || rd->wrbusy || (size <= PIPE_BUF && room < left)) {
+      if (filp->flags & O_NONBLOCK) return left == size ? -EAGAIN : size - left;
+
+      rc = wait_for_pipe(pipe);
+      if (rc < 0) return left == size ? rc : size - left;
+      continue;
     }
+
+    // Copy data into ring buffer
+    if (room > left) room = left;
+    ring_put(rd, p, room);
+    p += room;
+    left -= room;
+
+    // Wake up blocked readers
+    release_all_waiters(rd, 0);
+    update_pipe_events(rd);
   }
 
-  if (pipe->peer->waithead == NULL) clear_io_event(&filp->iob, IOEVT_READ);
+  return size;
+}
 
-  if (count == 0) {
-    struct pipereq req;
-    int rc;
+int pipefs_ioctl(struct file *filp, int cmd, void *data, size_t size) {
+  struct pipe *pipe = (struct pipe *) filp->data;
 
-    set_io_event(&pipe->peer->filp->iob, IOEVT_WRITE);
-    if (filp->flags & O_NONBLOCK) return -EAGAIN;
+  switch (cmd) {
+    case FIONBIO:
+      return 0;
 
-    req.pipe = pipe;
-    req.thread = self();
-    req.buffer = p;
-    req.size = left;
-    req.rc = -EINTR;
-    req.next = NULL;
+    case FIONREAD:
+      if (!data || size != 4) return -EFAULT;
+      if (filp->flags & O_WRONLY) return -EBADF;
+      *(int *) data = pipe->count;
+      return 0;
+  }
 
-    if (pipe->waittail) { 
-      pipe->waittail->next = &req;
-    } else {
-      pipe->waittail = &req;
-    }
+  return -ENOSYS;
+}
 
-    if (!pipe->waithead) pipe->waithead = &req;
+off64_t pipefs_lseek(struct file *filp, off64_t offset, int origin) {
+  return -ESPIPE;
+}
 
-    rc = enter_alertable_wait(THREAD_WAIT_PIPE);
-    if (rc < 0) {
-      cancel_request(pipe, &req);
-      req.rc = rc;
-    }
+int pipefs_fstat(struct file *filp, struct stat64 *buffer) {
+  // TODO: implement timestamps on create, read and write
+  return -ENOSYS;
+}
 
-    if (req.rc < 0) return req.rc;
-    count += req.rc;
-  }
+//
+// Splice moves data between a pipe and a file, socket or another pipe
+// without copying it through user space. Data is transferred directly
+// between the pipe ring buffer and the other object.
+//
 
-  return count;
+static int is_pipe(struct object *o) {
+  return o->type == OBJECT_FILE && ((struct file *) o)->fs == pipefs;
 }
 
-int pipefs_write(struct file *filp, void *data, size_t size, off64_t pos) {
+static int splice_read(struct object *o, char *data, int size) {
+  if (o->type == OBJECT_FILE) return read((struct file *) o, data, size);
+  if (o->type == OBJECT_SOCKET) return recv((struct socket *) o, data, size, 0);
+  return -EBADF;
+}
+
+static int splice_write(struct object *o, char *data, int size) {
+  if (o->type == OBJECT_FILE) return write((struct file *) o, data, size);
+  if (o->type == OBJECT_SOCKET) return send((struct socket *) o, data, size, 0);
+  return -EBADF;
+}
+
+static int splice_from_pipe(struct file *filp, struct object *out, size_t size, int flags) {
   struct pipe *pipe = (struct pipe *) filp->data;
-  char *p;
-  size_t left;
+  size_t total;
+  size_t n;
+  int rc;
 
-  if (size == 0) return 0;
-  if (!pipe->peer) return -EPIPE;
+  if (filp->flags & O_WRONLY) return -EBADF;
 
-  p = (char *) data;
-  left = size;
-  while (pipe->peer->waithead && left > 0) {
-    struct pipereq *req = pipe->peer->waithead;
-    size_t bytes = req->size;
-    
-    if (bytes > left) bytes = left;
+  // Wait for data and exclusive access to the ring buffer
+  while (pipe->count == 0 || pipe->rdbusy) {
+    if (pipe->count == 0 && !pipe->peer) return 0;
+    if ((flags & SPLICE_F_NONBLOCK) || (filp->flags & O_NONBLOCK)) return -EAGAIN;
+
+    rc = wait_for_pipe(pipe);
+    if (rc < 0) return rc;
+  }
 
-    memcpy(req->buffer, p, bytes);
-    req->rc = bytes;
+  // Write data directly from the ring buffer
+  pipe->rdbusy = 1;
+  total = 0;
+  rc = 0;
+  while (total < size && pipe->count > 0) {
+    n = PIPE_BUFSIZE - pipe->head;
+    if (n > pipe->count) n = pipe->count;
+    if (n > size - total) n = size - total;
 
-    p += bytes;
-    left -= bytes;
+    rc = splice_write(out, pipe->buffer + pipe->head, n);
+    if (rc <= 0) break;
 
-    pipe->peer->waithead = req->next;
-    if (pipe->peer->waithead == NULL) pipe->peer->waittail = NULL;
-    mark_thread_ready(req->thread, 1, 2);
+    pipe->head = (pipe->head + rc) % PIPE_BUFSIZE;
+    pipe->count -= rc;
+    if (pipe->count == 0 && !pipe->wrbusy) pipe->head = 0;
+    total += rc;
+
+    if (pipe->peer) release_all_waiters(pipe->peer, 0);
+    update_pipe_events(pipe);
+
+    if ((size_t) rc < n) break;
   }
+  pipe->rdbusy = 0;
 
-  if (pipe->peer->waithead == NULL) clear_io_event(&filp->iob, IOEVT_WRITE);
+  // Let other readers in
+  release_all_waiters(pipe, 0);
 
-  if (left > 0) {
-    struct pipereq req;
-    int rc;
+  if (total == 0 && rc < 0) return rc;
+  return total;
+}
 
-    set_io_event(&pipe->peer->filp->iob, IOEVT_READ);
-    if (filp->flags & O_NONBLOCK) return size - left;
+static int splice_to_pipe(struct object *in, struct file *filp, size_t size, int flags) {
+  struct pipe *pipe = (struct pipe *) filp->data;
+  struct pipe *rd;
+  size_t tail;
+  size_t n;
+  int rc;
 
-    req.pipe = pipe;
-    req.thread = self();
-    req.buffer = p;
-    req.size = left;
-    req.rc = -EINTR;
-    req.next = NULL;
+  if (!(filp->flags & O_WRONLY)) return -EBADF;
 
-    if (pipe->waittail) { 
-      pipe->waittail->next = &req;
-    } else {
-      pipe->waittail = &req;
-    }
+  // Wait for room in the ring buffer and exclusive write access
+  while (1) {
+    rd = pipe->peer;
+    if (!rd) return -EPIPE;
+    if (rd->count < PIPE_BUFSIZE && !rd->wrbusy) break;
+    if ((flags & SPLICE_F_NONBLOCK) || (filp->flags & O_NONBLOCK)) return -EAGAIN;
 
-    if (!pipe->waithead) pipe->waithead = &req;
+    rc = wait_for_pipe(pipe);
+    if (rc < 0) return rc;
+  }
 
-    rc = enter_alertable_wait(THREAD_WAIT_PIPE);
-    if (rc < 0) {
-      cancel_request(pipe, &req);
-      req.rc = rc;
-    }
+  // Read data directly into the free part of the ring buffer
+  tail = (rd->head + rd->count) % PIPE_BUFSIZE;
+  if (rd->head + rd->count < PIPE_BUFSIZE) {
+    n = PIPE_BUFSIZE - tail;
+  } else {
+    n = rd->head - tail;
+  }
+  if (n > size) n = size;
+
+  rd->wrbusy = 1;
+  rc = splice_read(in, rd->buffer + tail, n);
+  rd->wrbusy = 0;
 
-    if (req.rc < 0) return req.rc;
+  if (!rd->filp) {
+    // Read end was closed while we were reading
+    kfree(rd->buffer);
+    kfree(rd);
+    return -EPIPE;
   }
 
-  return size;
-}
+  if (rc > 0) {
+    rd->count += rc;
+    release_all_waiters(rd, 0);
+    update_pipe_events(rd);
+  }
 
-int pipefs_ioctl(struct file *filp, int cmd, void *data, size_t size) {
-  if (cmd == FIONBIO) return 0;
-  return -ENOSYS;
-}
+  // Let other writers in
+  release_all_waiters(pipe, 0);
 
-off64_t pipefs_lseek(struct file *filp, off64_t offset, int origin) {
-  return -ESPIPE;
+  return rc;
 }
 
-int pipefs_fstat(struct file *filp, struct stat64 *buffer) {
-  // TODO: implement timestamps on create, read and write
-  return -ENOSYS;
+int splice(struct object *in, struct object *out, size_t size, int flags) {
+  if (size == 0) return 0;
+
+  if (is_pipe(in)) {
+    if (is_pipe(out) && ((struct pipe *) ((struct file *) in)->data)->peer == ((struct file *) out)->data) return -EINVAL;
+    return splice_from_pipe((struct file *) in, out, size, flags);
+  } else if (is_pipe(out)) {
+    return splice_to_pipe(in, (struct file *) out, size, flags);
+  } else {
+    return -EINVAL;
+  }
 }
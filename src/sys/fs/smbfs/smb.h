@@ -40,8 +40,9 @@
 #define SMB_DENTRY_CACHESIZE    16
 #define SMB_DIRBUF_SIZE         4096
 
-#define SMB_RAW_CHUNKSIZE       (32 * 1024)
-#define SMB_NORMAL_CHUNKSIZE    (4 * 1024)
+#define SMB_LARGE_CHUNKSIZE     (60 * 1024)    // Chunk size for large READ/WRITE_ANDX
+#define SMB_MAX_PIPELINE        8              // Max outstanding requests per connection
+#define SMB_CACHE_SIZE          (64 * 1024)    // Size of per-file read cache window
 
 #define EPOC                    116444736000000000     // 00:00:00 GMT on January 1, 1970
 #define SECTIMESCALE            10000000               // 1 sec resolution
@@ -174,6 +175,22 @@
 #define SMB_CAP_NT_FIND                 0x0200
 #define SMB_CAP_DFS                     0x1000
 #define SMB_CAP_LARGE_READX             0x4000
+#define SMB_CAP_LARGE_WRITEX            0x8000
+
+//
+// SMB oplock levels
+//
+
+#define SMB_OPLOCK_NONE                 0
+#define SMB_OPLOCK_EXCLUSIVE            1
+#define SMB_OPLOCK_BATCH                2
+#define SMB_OPLOCK_LEVEL_II             3
+
+#define SMB_CREATE_REQUEST_OPLOCK       0x02
+#define SMB_CREATE_REQUEST_BATCH_OPLOCK 0x04
+
+#define SMB_LOCKING_OPLOCK_RELEASE      0x02
+#define SMB_OPLOCK_BREAK_MID            0xFFFF
 
 //
 // SMB file attributes and flags
@@ -599,6 +616,21 @@ struct smb_write_file_response {
   unsigned short reserved;              // Reserved (must be 0)
 };
 
+//
+// SMB LOCKING request parameters
+//
+
+struct smb_locking_request {
+  struct smb_andx andx;
+  unsigned short fid;                   // File handle
+  unsigned char lock_type;              // Lock type flags:
+                                        //   0x02 - Oplock break notification/release
+  unsigned char oplock_level;           // New oplock level (0 = none, 1 = level II)
+  unsigned long timeout;                // Lock timeout in milliseconds
+  unsigned short num_unlocks;           // Number of unlock range structures
+  unsigned short num_locks;             // Number of lock range structures
+};
+
 //
 // SMB RENAME request parameters
 //
@@ -723,6 +755,7 @@ struct smb {
       struct smb_read_file_request read;
       struct smb_read_raw_request readraw;
       struct smb_write_file_request write;
+      struct smb_locking_request lock;
       struct smb_trans_request trans;
       struct smb_rename_request rename;
       struct smb_delete_request del;
@@ -905,6 +938,13 @@ struct smb_file {
   unsigned short fid;
   unsigned long attrs;
   struct stat64 statbuf;
+  struct smb_file *next;                // Next open file on share
+  int oplock;                           // Oplock level held on file
+  int error;                            // Deferred write-behind error
+  char *cache;                          // Read cache buffer (valid while oplocked)
+  off64_t cache_pos;                    // File position of read cache
+  int cache_len;                        // Number of valid bytes in read cache
+  off64_t next_pos;                     // Position following last read
 };
 
 //
@@ -920,6 +960,16 @@ struct smb_directory {
   char buffer[SMB_DIRBUF_SIZE];
 };
 
+//
+// SMB outstanding write request
+//
+
+struct smb_writebehind {
+  unsigned short mid;
+  int size;
+  struct smb_file *file;
+};
+
 //
 // SMB server
 //
@@ -939,6 +989,12 @@ struct smb_server {
   int tzofs;
   unsigned long server_caps;
   unsigned long max_buffer_size;
+  int max_mpx;                          // Max outstanding requests
+  int max_read;                         // Max data bytes per READ_ANDX
+  int max_write;                        // Max data bytes per WRITE_ANDX
+  unsigned short next_mid;              // Next multiplex id
+  int nwb;                              // Number of outstanding writes
+  struct smb_writebehind wb[SMB_MAX_PIPELINE];
   char buffer[SMB_MAX_BUFFER + 4];
   char auxbuf[SMB_MAX_BUFFER + 4];
 };
@@ -954,6 +1010,7 @@ struct smb_share {
   char sharename[SMB_NAMELEN];
   time_t mounttime;
   int next_cacheidx;
+  struct smb_file *files;
   struct smb_dentry dircache[SMB_DENTRY_CACHESIZE];
 };
 
@@ -974,6 +1031,11 @@ void smb_add_to_cache(struct smb_share *share, char *path, char *filename, struc
 struct smb_dentry *smb_find_in_cache(struct smb_share *share, char *path);
 void smb_clear_cache(struct smb_share *share);
 
+int smb_cache_read(struct smb_file *file, char *data, int size, off64_t pos);
+int smb_fill_cache(struct smb_share *share, struct smb_file *file, off64_t pos, int size);
+void smb_update_cache(struct smb_file *file, char *data, int size, off64_t pos);
+void smb_invalidate_cache(struct smb_file *file);
+
 // smbproto.c
 
 struct smb *smb_init(struct smb_share *share, int aux);
@@ -982,6 +1044,11 @@ int smb_send(struct smb_share *share, struct smb *smb, unsigned char cmd, int pa
 int smb_recv(struct smb_share *share, struct smb *smb);
 int smb_request(struct smb_share *share, struct smb *smb, unsigned char cmd, int params, char *data, int datasize, int retry);
 
+int smb_read_pipelined(struct smb_share *share, struct smb_file *file, char *data, int size, off64_t pos);
+int smb_write_pipelined(struct smb_share *share, struct smb_file *file, char *data, int size, off64_t pos, int async);
+int smb_drain(struct smb_share *share);
+int smb_poll(struct smb_share *share);
+
 int smb_trans(struct smb_share *share,
               unsigned short cmd, 
               void *reqparams, int reqparamlen,
@@ -65,3 +65,61 @@ void smb_clear_cache(struct smb_share *share) {
 
   for (idx = 0; idx < SMB_DENTRY_CACHESIZE; idx++) share->dircache[idx].path[0] = 0;
 }
+
+//
+// Per-file read cache. The cache holds a window of file data and is only
+// used while the client holds an oplock on the file, so the server will
+// tell us before another client changes the data.
+//
+
+int smb_cache_read(struct smb_file *file, char *data, int size, off64_t pos) {
+  int ofs;
+  int count;
+
+  if (file->cache_len == 0) return 0;
+  if (pos < file->cache_pos || pos >= file->cache_pos + file->cache_len) return 0;
+
+  ofs = (int) (pos - file->cache_pos);
+  count = file->cache_len - ofs;
+  if (count > size) count = size;
+  memcpy(data, file->cache + ofs, count);
+
+  return count;
+}
+
+int smb_fill_cache(struct smb_share *share, struct smb_file *file, off64_t pos, int size) {
+  int rc;
+
+  if (!file->cache) {
+    file->cache = (char *) kmalloc(SMB_CACHE_SIZE);
+    if (!file->cache) return -ENOMEM;
+  }
+
+  if (size > SMB_CACHE_SIZE) size = SMB_CACHE_SIZE;
+  file->cache_len = 0;
+
+  rc = smb_read_pipelined(share, file, file->cache, size, pos);
+  if (rc < 0) return rc;
+
+  file->cache_pos = pos;
+  file->cache_len = rc;
+  return rc;
+}
+
+void smb_update_cache(struct smb_file *file, char *data, int size, off64_t pos) {
+  off64_t start;
+  off64_t end;
+
+  if (file->cache_len == 0) return;
+
+  // Copy written data into the overlapping part of the cache window
+  start = pos > file->cache_pos ? pos : file->cache_pos;
+  end = pos + size < file->cache_pos + file->cache_len ? pos + size : file->cache_pos + file->cache_len;
+  if (start >= end) return;
+
+  memcpy(file->cache + (int) (start - file->cache_pos), data + (int) (start - pos), (int) (end - start));
+}
+
+void smb_invalidate_cache(struct smb_file *file) {
+  file->cache_len = 0;
+}
@@ -268,6 +268,7 @@ int smb_open(struct file *filp, char *name) {
   smb->params.req.create.share_access = sharing;
   smb->params.req.create.create_disposition = mode;
   smb->params.req.create.impersonation_level = 0x02;
+  if (!(filp->flags & O_DIRECT)) smb->params.req.create.flags = SMB_CREATE_REQUEST_OPLOCK;
 
   rc = smb_request(share, smb, SMB_COM_NT_CREATE_ANDX, 24, name, strlen(name) + 1, 1);
   if (rc < 0) {
@@ -277,6 +278,7 @@ int smb_open(struct file *filp, char *name) {
 
   file->fid = smb->params.rsp.create.fid;
   file->attrs = (unsigned short) smb->params.rsp.create.ext_file_attributes;
+  file->oplock = smb->params.rsp.create.oplock_level;
 
   if (file->attrs & SMB_FILE_ATTR_DIRECTORY) {
     file->statbuf.st_mode = S_IFDIR;
@@ -304,11 +306,30 @@ int smb_open(struct file *filp, char *name) {
     filp->pos = 0;
   }
 
+  // Add file to list of open files on share for oplock breaks
+  file->next = share->files;
+  share->files = file;
+
   filp->data = file;
 
   return 0;
 }
 
+static void smb_remove_file(struct smb_share *share, struct smb_file *file) {
+  struct smb_file *f;
+
+  if (share->files == file) {
+    share->files = file->next;
+  } else {
+    for (f = share->files; f != NULL; f = f->next) {
+      if (f->next == file) {
+        f->next = file->next;
+        break;
+      }
+    }
+  }
+}
+
 int smb_close(struct file *filp) {
   struct smb_share *share = (struct smb_share *) filp->fs->data;
   struct smb *smb;
@@ -329,6 +350,12 @@ int smb_close(struct file *filp) {
     filp->data = NULL;
   } else {
     struct smb_file *file = (struct smb_file *) filp->data;
+    int err;
+
+    // Wait for write-behind to complete before closing
+    rc = smb_drain(share);
+    if (rc < 0) return rc;
+    err = file->error;
 
     smb = smb_init(share, 0);
     smb->params.req.close.fid = file->fid;
@@ -336,8 +363,15 @@ int smb_close(struct file *filp) {
     rc = smb_request(share, smb, SMB_COM_CLOSE, 3, NULL, 0, 0);
     if (rc < 0) return rc;
 
+    smb_remove_file(share, file);
+    if (file->cache) kfree(file->cache);
     kfree(file);
     filp->data = NULL;
+
+    if (err < 0) {
+      smb_clear_cache(share);
+      return err;
+    }
   }
 
   smb_clear_cache(share);
@@ -357,6 +391,15 @@ int smb_fsync(struct file *filp) {
 
   if (filp->flags & F_DIR) return -EBADF;
 
+  // Wait for write-behind and report any deferred write errors
+  rc = smb_drain(share);
+  if (rc < 0) return rc;
+  if (file->error) {
+    rc = file->error;
+    file->error = 0;
+    return rc;
+  }
+
   smb = smb_init(share, 0);
   smb->params.req.flush.fid = file->fid;
 
@@ -366,152 +409,98 @@ int smb_fsync(struct file *filp) {
   return 0;
 }
 
-static int smb_read_raw(struct smb_share *share, struct smb_file *file, void *data, size_t size, unsigned long pos) {
-  struct smb *smb;
-  unsigned char hdr[4];
-  int len;
-  int rc;
-
-  smb = smb_init(share, 0);
-  smb->params.req.readraw.fid = file->fid;
-  smb->params.req.readraw.offset = pos;
-  smb->params.req.readraw.max_count = size;
-
-  rc = smb_send(share, smb, SMB_COM_READ_RAW, 8, NULL, 0);
-  if (rc < 0) return rc;
-  
-  rc = recv_fully(share->server->sock, (char *) &hdr, 4, 0);
-  if (rc < 0) return rc;
-
-  len = hdr[3] | (hdr[2] << 8) | (hdr[1] << 16) | (hdr[0] << 24);
-  if (len == 0) return 0;
-
-  rc = recv_fully(share->server->sock, data, len, 0);
-  if (rc < 0) return rc;
-
-  return rc;
-}
-
-static int smb_read_normal(struct smb_share *share, struct smb_file *file, void *data, size_t size, off64_t pos) {
-  struct smb *smb;
-  int len;
-  int rc;
-
-  // Read from file
-  smb = smb_init(share, 0);
-  smb->params.req.read.andx.cmd = 0xFF;
-  smb->params.req.read.fid = file->fid;
-  smb->params.req.read.offset = ((struct smb_pos *) &pos)->low_part;
-  smb->params.req.read.max_count = size;
-  smb->params.req.read.offset_high = ((struct smb_pos *) &pos)->high_part;
-
-  rc = smb_request(share, smb, SMB_COM_READ_ANDX, 12, NULL, 0, 0);
-  if (rc < 0) return rc;
-
-  len = smb->params.rsp.read.data_length;
-  if (len) memcpy(data, (char *) smb + smb->params.rsp.read.data_offset + 4, len);
-
-  return len;
-}
-
 int smb_read(struct file *filp, void *data, size_t size, off64_t pos) {
   struct smb_share *share = (struct smb_share *) filp->fs->data;
   struct smb_file *file = (struct smb_file *) filp->data;
   char *p;
-  size_t left;
-  size_t count;
+  int left;
+  int count;
   int rc;
 
   if (filp->flags & F_DIR) return -EBADF;
   if (size == 0) return 0;
 
-  left = size;
-  p = (char *) data;
-
-  if (filp->pos < file->statbuf.st_size && pos < 0x80000000) {
-    // Read data using raw mode
-    while (1) {
-      count = left;
-      if (count > SMB_RAW_CHUNKSIZE) count = SMB_RAW_CHUNKSIZE;
+  // Handle pending oplock breaks before trusting cached data
+  if (file->cache_len > 0) {
+    rc = smb_poll(share);
+    if (rc < 0) return rc;
+  }
 
-      rc = smb_read_raw(share, file, p, count, (unsigned long) pos);
-      if (rc < 0) return rc;
-      if (rc == 0) break;
+  if (pos >= file->statbuf.st_size) return 0;
+  if ((off64_t) size > file->statbuf.st_size - pos) size = (size_t) (file->statbuf.st_size - pos);
 
-      pos += rc;
-      left -= rc;
-      p += rc;
+  left = size;
+  p = (char *) data;
 
-      if (left == 0) return size;
+  // Copy data from read cache
+  rc = smb_cache_read(file, p, left, pos);
+  pos += rc;
+  left -= rc;
+  p += rc;
+
+  if (left > 0 && file->oplock != SMB_OPLOCK_NONE && left < SMB_CACHE_SIZE) {
+    // Fill read cache. Read ahead a full cache window for sequential
+    // access, otherwise only read the blocks needed.
+    if (pos == file->next_pos) {
+      count = SMB_CACHE_SIZE;
+    } else {
+      count = (left + SMB_BLK_SIZE - 1) & ~(SMB_BLK_SIZE - 1);
     }
-  }
+    if (count > file->statbuf.st_size - pos) count = (int) (file->statbuf.st_size - pos);
 
-  // Read rest using normal mode
-  while (pos < file->statbuf.st_size && left > 0) {
-    count = left;
-    if (count > SMB_NORMAL_CHUNKSIZE) count = SMB_NORMAL_CHUNKSIZE;
-
-    rc = smb_read_normal(share, file, p, count, pos);
+    rc = smb_fill_cache(share, file, pos, count);
     if (rc < 0) return rc;
-    if (rc == 0) return size - left;
 
+    rc = smb_cache_read(file, p, left, pos);
     pos += rc;
     left -= rc;
     p += rc;
-  }
-
-  return size - left;
-}
 
-static int smb_write_normal(struct smb_share *share, struct smb_file *file, void *data, size_t size, off64_t pos) {
-  struct smb *smb;
-  int rc;
+    // Data read while the oplock was being broken must not be kept
+    if (file->oplock == SMB_OPLOCK_NONE) smb_invalidate_cache(file);
+  } else if (left > 0) {
+    // Read directly into the caller's buffer
+    rc = smb_read_pipelined(share, file, p, left, pos);
+    if (rc < 0) return rc;
 
-  // Write to file
-  smb = smb_init(share, 0);
-  smb->params.req.write.andx.cmd = 0xFF;
-  smb->params.req.write.fid = file->fid;
-  smb->params.req.write.offset = ((struct smb_pos *) &pos)->low_part;
-  smb->params.req.write.data_length = size;
-  smb->params.req.write.data_offset = SMB_HEADER_LEN + 14 * 2;
-  smb->params.req.write.offset_high = ((struct smb_pos *) &pos)->high_part;
-
-  rc = smb_request(share, smb, SMB_COM_WRITE_ANDX, 14, data, size, 0);
-  if (rc < 0) return rc;
+    pos += rc;
+    left -= rc;
+  }
 
-  return smb->params.rsp.write.count;
+  file->next_pos = pos;
+  return size - left;
 }
 
 int smb_write(struct file *filp, void *data, size_t size, off64_t pos) {
   struct smb_share *share = (struct smb_share *) filp->fs->data;
   struct smb_file *file = (struct smb_file *) filp->data;
-  char *p;
-  size_t left;
-  size_t count;
+  int async;
   int rc;
 
   if (filp->flags & F_DIR) return -EBADF;
   if (size == 0) return 0;
 
-  if (filp->flags & O_APPEND) pos = file->statbuf.st_size;
+  // Report errors from earlier write-behind
+  if (file->error) {
+    rc = file->error;
+    file->error = 0;
+    return rc;
+  }
 
-  left = size;
-  p = (char *) data;
+  if (filp->flags & O_APPEND) pos = file->statbuf.st_size;
 
-  while (left > 0) {
-    count = left;
-    if (count > SMB_NORMAL_CHUNKSIZE) count = SMB_NORMAL_CHUNKSIZE;
+  // With an exclusive oplock no other client can see the file, so the
+  // write can complete before the server has acknowledged it
+  async = (file->oplock == SMB_OPLOCK_EXCLUSIVE || file->oplock == SMB_OPLOCK_BATCH) && !(filp->flags & O_DIRECT);
 
-    rc = smb_write_normal(share, file, p, count, pos);
-    if (rc < 0) return rc;
+  rc = smb_write_pipelined(share, file, (char *) data, size, pos, async);
+  if (rc < 0) return rc;
 
-    pos += rc;
-    filp->flags |= F_MODIFIED;
-    left -= rc;
-    p += rc;
+  filp->flags |= F_MODIFIED;
+  smb_update_cache(file, (char *) data, size, pos);
 
-    if (pos > file->statbuf.st_size) file->statbuf.st_size = pos;
-  }
+  pos += size;
+  if (pos > file->statbuf.st_size) file->statbuf.st_size = pos;
 
   return size;
 }
@@ -555,6 +544,10 @@ int smb_ftruncate(struct file *filp, off64_t size) {
   int rc;
   int rsplen;
 
+  rc = smb_drain(share);
+  if (rc < 0) return rc;
+  smb_invalidate_cache(file);
+
   memset(&req, 0, sizeof(req));
   req.fid = file->fid;
   req.infolevel = 0x104;
@@ -565,6 +558,7 @@ int smb_ftruncate(struct file *filp, off64_t size) {
   rc = smb_trans(share, TRANS2_SET_FILE_INFORMATION, &req, sizeof(req), &info, sizeof(info), &rsp, &rsplen, NULL, NULL);
   if (rc < 0) return rc;
 
+  file->statbuf.st_size = size;
   if (filp->pos > size) filp->pos = size;
 
   return 0;
@@ -49,12 +49,27 @@ struct smb *smb_init(struct smb_share *share, int aux) {
   return smb;
 }
 
+static unsigned short smb_next_mid(struct smb_server *server) {
+  unsigned short mid;
+
+  // Multiplex ids 0 and 0xFFFF are never used for requests, the latter
+  // being reserved for oplock break notifications from the server
+  mid = server->next_mid++;
+  if (mid == 0 || mid == SMB_OPLOCK_BREAK_MID) {
+    server->next_mid = 2;
+    mid = 1;
+  }
+
+  return mid;
+}
+
 int smb_send(struct smb_share *share, struct smb *smb, unsigned char cmd, int params, char *data, int datasize) {
+  struct iovec iov[2];
   int len;
   int rc;
   char *p;
 
-  len = SMB_HEADER_LEN + params * 2 + 2 + datasize;
+  len = SMB_HEADER_LEN + params * 2 + datasize;
 
   smb->type = SMB_SESSION_MESSAGE;
   smb->len[0] = (len & 0xFF0000) >> 16;
@@ -69,29 +84,55 @@ int smb_send(struct smb_share *share, struct smb *smb, unsigned char cmd, int pa
   smb->cmd = cmd;
   smb->tid = share->tid;
   smb->uid = share->server->uid;
+  smb->mid = smb_next_mid(share->server);
   smb->wordcount = (unsigned char) params;
   smb->flags = (1 << 3);
   smb->flags2 = 1;
 
   p = (char *) smb->params.words + params * 2;
   *((unsigned short *) p) = (unsigned short) datasize;
-  if (datasize) memcpy(p + 2, data, datasize);
 
-  rc = send(share->server->sock, (char *) smb, len + 4, 0);
+  // Send header and data directly from the caller's buffer
+  if (datasize) {
+    iov[0].iov_base = smb;
+    iov[0].iov_len = len + 4 - datasize;
+    iov[1].iov_base = data;
+    iov[1].iov_len = datasize;
+    rc = sendv(share->server->sock, iov, 2);
+  } else {
+    rc = send(share->server->sock, (char *) smb, len + 4, 0);
+  }
   if (rc < 0) return rc;
   if (rc != len + 4) return -EIO;
 
   return 0;
 }
 
-int smb_recv(struct smb_share *share, struct smb *smb) {
+//
+// Receive the NetBIOS header and the fixed part of the next SMB. Up to
+// SMB_PEEK_LEN bytes of the SMB are read into the buffer and the number
+// of bytes left in the message is returned in left. With MSG_DONTWAIT
+// -EAGAIN is returned if no message is pending.
+//
+
+#define SMB_PEEK_LEN (SMB_HEADER_LEN + 12 * 2)
+
+static int smb_recv_header(struct smb_server *server, struct smb *smb, int flags, int *left) {
   int len;
+  int hdrlen;
   int rc;
 
   while (1) {
-    rc = recv_fully(share->server->sock, (char *) smb, 4, 0);
+    rc = recv(server->sock, (char *) smb, 4, flags);
     if (rc < 0) return rc;
-    if (rc != 4) return -EIO;
+    if (rc == 0) return -EIO;
+    if (rc < 4) {
+      // Once a message has started the rest must be read
+      len = rc;
+      rc = recv_fully(server->sock, (char *) smb + len, 4 - len, 0);
+      if (rc < 0) return rc;
+      if (rc != 4 - len) return -EIO;
+    }
 
     if (smb->type == SMB_SESSION_MESSAGE) {
       break;
@@ -101,12 +142,164 @@ int smb_recv(struct smb_share *share, struct smb *smb) {
   }
 
   len = smb->len[2] | (smb->len[1] << 8) | (smb->len[0] << 16);
-  if (len < 4 || len > SMB_MAX_BUFFER) return -EMSGSIZE;
-    
-  rc = recv_fully(share->server->sock, (char *) &smb->protocol, len, 0);
+  if (len < 4) return -EMSGSIZE;
+
+  hdrlen = len < SMB_PEEK_LEN ? len : SMB_PEEK_LEN;
+  rc = recv_fully(server->sock, (char *) &smb->protocol, hdrlen, 0);
   if (rc < 0) return rc;
-  if (rc != len) return -EIO;
+  if (rc != hdrlen) return -EIO;
   if (smb->protocol[0] != 0xFF || smb->protocol[1] != 'S' || smb->protocol[2] != 'M' || smb->protocol[3] != 'B') return -EPROTO;
+
+  *left = len - hdrlen;
+  return hdrlen;
+}
+
+static int smb_discard(struct smb_server *server, int len) {
+  char buf[256];
+  int n;
+  int rc;
+
+  while (len > 0) {
+    n = len < sizeof(buf) ? len : sizeof(buf);
+    rc = recv_fully(server->sock, buf, n, 0);
+    if (rc < 0) return rc;
+    if (rc != n) return -EIO;
+    len -= n;
+  }
+
+  return 0;
+}
+
+static int smb_recv_rest(struct smb_server *server, struct smb *smb, int hdrlen, int left) {
+  int rc;
+
+  if (left == 0) return 0;
+
+  if (hdrlen + left > SMB_MAX_BUFFER) {
+    // Skip the message to keep the stream in sync
+    rc = smb_discard(server, left);
+    if (rc < 0) return rc;
+    return -EMSGSIZE;
+  }
+
+  rc = recv_fully(server->sock, (char *) &smb->protocol + hdrlen, left, 0);
+  if (rc < 0) return rc;
+  if (rc != left) return -EIO;
+
+  return 0;
+}
+
+static void smb_oplock_break(struct smb_server *server, unsigned short fid, int level) {
+  struct smb_share *share;
+  struct smb_file *file;
+  struct smb ack;
+  int oldlevel;
+
+  for (share = server->shares; share; share = share->next) {
+    for (file = share->files; file; file = file->next) {
+      if (file->fid == fid) break;
+    }
+    if (file) break;
+  }
+  if (!file) return;
+
+  // Drop cached data unless we are allowed to keep a read-only copy
+  oldlevel = file->oplock;
+  file->oplock = level ? SMB_OPLOCK_LEVEL_II : SMB_OPLOCK_NONE;
+  if (file->oplock == SMB_OPLOCK_NONE) smb_invalidate_cache(file);
+
+  // Exclusive and batch oplock breaks must be acknowledged. Outstanding
+  // writes have already been sent, so the server sees them before the ack.
+  if (oldlevel == SMB_OPLOCK_EXCLUSIVE || oldlevel == SMB_OPLOCK_BATCH) {
+    memset(&ack, 0, sizeof(struct smb));
+    ack.params.req.lock.andx.cmd = 0xFF;
+    ack.params.req.lock.fid = fid;
+    ack.params.req.lock.lock_type = SMB_LOCKING_OPLOCK_RELEASE;
+    ack.params.req.lock.oplock_level = level ? 1 : 0;
+    smb_send(share, &ack, SMB_COM_LOCKING_ANDX, 8, NULL, 0);
+  }
+}
+
+static void smb_complete_write(struct smb_server *server, struct smb *smb, int n) {
+  struct smb_writebehind *wb = &server->wb[n];
+  struct smb_file *file = wb->file;
+
+  if (smb->error_class != SMB_SUCCESS) {
+    if (!file->error) file->error = smb_errno(smb);
+  } else if (smb->params.rsp.write.count != wb->size) {
+    if (!file->error) file->error = -EIO;
+  }
+
+  server->wb[n] = server->wb[--server->nwb];
+}
+
+static void smb_abort_writes(struct smb_server *server) {
+  int n;
+
+  // Replies to outstanding writes are lost with the connection
+  for (n = 0; n < server->nwb; n++) {
+    if (!server->wb[n].file->error) server->wb[n].file->error = -EIO;
+  }
+  server->nwb = 0;
+}
+
+//
+// Handle messages that are not replies to the current request, i.e.
+// oplock break notifications and replies to outstanding writes.
+// Returns 1 if the message was consumed.
+//
+
+static int smb_dispatch(struct smb_server *server, struct smb *smb) {
+  int n;
+
+  if (smb->cmd == SMB_COM_LOCKING_ANDX && smb->mid == SMB_OPLOCK_BREAK_MID) {
+    smb_oplock_break(server, smb->params.req.lock.fid, smb->params.req.lock.oplock_level);
+    return 1;
+  }
+
+  if (smb->cmd == SMB_COM_WRITE_ANDX) {
+    for (n = 0; n < server->nwb; n++) {
+      if (server->wb[n].mid == smb->mid) {
+        smb_complete_write(server, smb, n);
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+static int smb_recv_dispatch(struct smb_server *server, struct smb *smb, int flags) {
+  int hdrlen;
+  int left;
+  int rc;
+
+  hdrlen = smb_recv_header(server, smb, flags, &left);
+  if (hdrlen < 0) return hdrlen;
+
+  rc = smb_recv_rest(server, smb, hdrlen, left);
+  if (rc < 0) return rc;
+
+  if (!smb_dispatch(server, smb)) return -EPROTO;
+  return 0;
+}
+
+int smb_recv(struct smb_share *share, struct smb *smb) {
+  struct smb_server *server = share->server;
+  int hdrlen;
+  int left;
+  int rc;
+
+  while (1) {
+    hdrlen = smb_recv_header(server, smb, 0, &left);
+    if (hdrlen < 0) return hdrlen;
+
+    rc = smb_recv_rest(server, smb, hdrlen, left);
+    if (rc < 0) return rc;
+
+    if (!smb_dispatch(server, smb)) break;
+  }
+
   if (smb->error_class != SMB_SUCCESS) return smb_errno(smb);
 
   return 0;
@@ -137,6 +330,220 @@ int smb_request(struct smb_share *share, struct smb *smb, unsigned char cmd, int
   return 0;
 }
 
+//
+// Read file data with up to max_mpx READ_ANDX requests outstanding. The
+// payload of each reply is received directly into the caller's buffer.
+//
+
+struct smb_readreq {
+  unsigned short mid;
+  int size;
+  int ofs;
+};
+
+int smb_read_pipelined(struct smb_share *share, struct smb_file *file, char *data, int size, off64_t pos) {
+  struct smb_server *server = share->server;
+  struct smb_readreq reqs[SMB_MAX_PIPELINE];
+  struct smb req;
+  struct smb *smb;
+  int outstanding;
+  int sent;
+  int count;
+  int eof;
+  int err;
+  int hdrlen;
+  int left;
+  int skip;
+  int len;
+  int n;
+  int rc;
+  off64_t ofs;
+
+  rc = smb_check_connection(share);
+  if (rc < 0) return rc;
+
+  outstanding = 0;
+  sent = 0;
+  eof = size;
+  err = 0;
+  while ((sent < eof && !err) || outstanding > 0) {
+    if (sent < eof && !err && outstanding < server->max_mpx) {
+      // Send next read request
+      count = eof - sent;
+      if (count > server->max_read) count = server->max_read;
+      ofs = pos + sent;
+
+      memset(&req, 0, sizeof(struct smb));
+      req.params.req.read.andx.cmd = 0xFF;
+      req.params.req.read.fid = file->fid;
+      req.params.req.read.offset = ((struct smb_pos *) &ofs)->low_part;
+      req.params.req.read.max_count = count;
+      req.params.req.read.offset_high = ((struct smb_pos *) &ofs)->high_part;
+
+      rc = smb_send(share, &req, SMB_COM_READ_ANDX, 12, NULL, 0);
+      if (rc < 0) return rc;
+
+      reqs[outstanding].mid = req.mid;
+      reqs[outstanding].size = count;
+      reqs[outstanding].ofs = sent;
+      outstanding++;
+      sent += count;
+      continue;
+    }
+
+    // Receive next reply
+    smb = (struct smb *) server->buffer;
+    hdrlen = smb_recv_header(server, smb, 0, &left);
+    if (hdrlen < 0) return hdrlen;
+
+    n = -1;
+    if (smb->cmd == SMB_COM_READ_ANDX) {
+      for (n = 0; n < outstanding; n++) {
+        if (reqs[n].mid == smb->mid) break;
+      }
+      if (n == outstanding) n = -1;
+    }
+
+    if (n < 0) {
+      // Not one of ours; must be a write reply or an oplock break
+      rc = smb_recv_rest(server, smb, hdrlen, left);
+      if (rc < 0) return rc;
+      if (!smb_dispatch(server, smb)) return -EPROTO;
+      continue;
+    }
+
+    if (smb->error_class != SMB_SUCCESS || hdrlen < SMB_PEEK_LEN) {
+      rc = smb_discard(server, left);
+      if (rc < 0) return rc;
+      if (!err) err = smb->error_class != SMB_SUCCESS ? smb_errno(smb) : -EPROTO;
+    } else {
+      len = smb->params.rsp.read.data_length;
+      skip = smb->params.rsp.read.data_offset - hdrlen;
+      if (skip < 0 || len > reqs[n].size || skip + len > left) {
+        rc = smb_discard(server, left);
+        if (rc < 0) return rc;
+        if (!err) err = -EPROTO;
+      } else {
+        rc = smb_discard(server, skip);
+        if (rc < 0) return rc;
+
+        rc = recv_fully(server->sock, data + reqs[n].ofs, len, 0);
+        if (rc < 0) return rc;
+        if (rc != len) return -EIO;
+
+        rc = smb_discard(server, left - skip - len);
+        if (rc < 0) return rc;
+
+        // A short read marks end of file; stop issuing requests beyond it
+        if (len < reqs[n].size && reqs[n].ofs + len < eof) eof = reqs[n].ofs + len;
+      }
+    }
+
+    reqs[n] = reqs[--outstanding];
+  }
+
+  if (err) return err;
+  return eof < sent ? eof : sent;
+}
+
+//
+// Write file data with up to max_mpx WRITE_ANDX requests outstanding. If
+// async is set the function returns as soon as the data has been sent
+// and errors are reported later through file->error.
+//
+
+int smb_write_pipelined(struct smb_share *share, struct smb_file *file, char *data, int size, off64_t pos, int async) {
+  struct smb_server *server = share->server;
+  struct smb req;
+  int count;
+  int done;
+  int rc;
+  off64_t ofs;
+
+  rc = smb_check_connection(share);
+  if (rc < 0) return rc;
+
+  done = 0;
+  while (done < size) {
+    // Wait for a free slot
+    while (server->nwb >= server->max_mpx) {
+      rc = smb_recv_dispatch(server, (struct smb *) server->buffer, 0);
+      if (rc < 0) return rc;
+    }
+
+    count = size - done;
+    if (count > server->max_write) count = server->max_write;
+    ofs = pos + done;
+
+    memset(&req, 0, sizeof(struct smb));
+    req.params.req.write.andx.cmd = 0xFF;
+    req.params.req.write.fid = file->fid;
+    req.params.req.write.offset = ((struct smb_pos *) &ofs)->low_part;
+    req.params.req.write.data_length = count;
+    req.params.req.write.data_offset = SMB_HEADER_LEN + 14 * 2;
+    req.params.req.write.offset_high = ((struct smb_pos *) &ofs)->high_part;
+
+    rc = smb_send(share, &req, SMB_COM_WRITE_ANDX, 14, data + done, count);
+    if (rc < 0) return rc;
+
+    server->wb[server->nwb].mid = req.mid;
+    server->wb[server->nwb].size = count;
+    server->wb[server->nwb].file = file;
+    server->nwb++;
+
+    done += count;
+  }
+
+  if (!async) {
+    rc = smb_drain(share);
+    if (rc < 0) return rc;
+
+    if (file->error) {
+      rc = file->error;
+      file->error = 0;
+      return rc;
+    }
+  }
+
+  return size;
+}
+
+//
+// Wait for all outstanding writes to complete
+//
+
+int smb_drain(struct smb_share *share) {
+  struct smb_server *server = share->server;
+  int rc;
+
+  while (server->nwb > 0) {
+    rc = smb_recv_dispatch(server, (struct smb *) server->buffer, 0);
+    if (rc < 0) {
+      smb_abort_writes(server);
+      return rc;
+    }
+  }
+
+  return 0;
+}
+
+//
+// Process pending oplock breaks and write replies without blocking
+//
+
+int smb_poll(struct smb_share *share) {
+  struct smb_server *server = share->server;
+  int rc;
+
+  if (!server->sock) return 0;
+
+  while (1) {
+    rc = smb_recv_dispatch(server, (struct smb *) server->buffer, MSG_DONTWAIT);
+    if (rc == -EAGAIN) return 0;
+    if (rc < 0) return rc;
+  }
+}
+
 int smb_trans_send(struct smb_share *share, unsigned short cmd, 
                    void *params, int paramlen,
                    void *data, int datalen,
@@ -169,6 +576,7 @@ int smb_trans_send(struct smb_share *share, unsigned short cmd,
   smb->cmd = SMB_COM_TRANSACTION2;
   smb->tid = share->tid;
   smb->uid = share->server->uid;
+  smb->mid = smb_next_mid(share->server);
   smb->wordcount = wordcount;
   smb->flags = (1 << 3);
   smb->flags2 = 1;
@@ -362,6 +770,26 @@ int smb_connect(struct smb_share *share) {
   server->max_buffer_size = smb->params.rsp.negotiate.max_buffer_size;
   max_mpx_count = smb->params.rsp.negotiate.max_mpx_count;
 
+  // Determine how many requests can be in flight and how much data each
+  // READ/WRITE_ANDX can carry. Without the large read/write capabilities
+  // the data must fit in the negotiated buffer sizes.
+  server->max_mpx = max_mpx_count;
+  if (server->max_mpx > SMB_MAX_PIPELINE) server->max_mpx = SMB_MAX_PIPELINE;
+  if (server->max_mpx < 1) server->max_mpx = 1;
+
+  if (server->server_caps & SMB_CAP_LARGE_READX) {
+    server->max_read = SMB_LARGE_CHUNKSIZE;
+  } else {
+    server->max_read = (SMB_MAX_BUFFER - SMB_PEEK_LEN - 1) & ~1023;
+  }
+
+  if (server->server_caps & SMB_CAP_LARGE_WRITEX) {
+    server->max_write = SMB_LARGE_CHUNKSIZE;
+  } else {
+    server->max_write = ((int) server->max_buffer_size - (SMB_HEADER_LEN + 14 * 2)) & ~1023;
+    if (server->max_write < 512) server->max_write = 512;
+  }
+
   // Setup session
   smb = smb_init(share, 1);
   smb->params.req.setup.andx.cmd = 0xFF;
@@ -369,7 +797,7 @@ int smb_connect(struct smb_share *share) {
   smb->params.req.setup.max_mpx_count = max_mpx_count;
   smb->params.req.setup.ansi_password_length = strlen(server->password);
   smb->params.req.setup.unicode_password_length = 0;
-  smb->params.req.setup.capabilities = SMB_CAP_NT_SMBS;
+  smb->params.req.setup.capabilities = SMB_CAP_NT_SMBS | (server->server_caps & (SMB_CAP_LARGE_READX | SMB_CAP_LARGE_WRITEX));
 
   p = buf;
   p = addstr(p, server->password);
@@ -408,6 +836,7 @@ int smb_disconnect(struct smb_share *share) {
     }
 
     // Close socket
+    smb_abort_writes(server);
     closesocket(server->sock);
     server->sock = NULL;
   }
@@ -565,6 +565,7 @@ struct buf *get_buffer(struct bufpool *pool, blkno_t blkno) {
   }
 
   // Buffer not cached, get new buffer from buffer pool
+  TRACE(TRACE_BUF_MISS, pool->devno, blkno);
   buf = get_new_buffer(pool);
   if (!buf) return NULL;
 
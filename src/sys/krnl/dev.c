@@ -627,6 +627,7 @@ int dev_ioctl(dev_t devno, int cmd, void *args, size_t size) {
 
 int dev_read(dev_t devno, void *buffer, size_t count, blkno_t blkno, int flags) {
   struct dev *dev;
+  int rc;
 
   if (devno < 0 || devno >= num_devs) return -ENODEV;
   dev = devtab[devno];
@@ -634,11 +635,15 @@ int dev_read(dev_t devno, void *buffer, size_t count, blkno_t blkno, int flags)
   dev->reads++;
   dev->input += count;
 
-  return dev->driver->read(dev, buffer, count, blkno, flags);
+  TRACE(TRACE_DEV_SUBMIT, devno << 1, blkno);
+  rc = dev->driver->read(dev, buffer, count, blkno, flags);
+  TRACE(TRACE_DEV_COMPLETE, devno << 1, rc);
+  return rc;
 }
 
 int dev_write(dev_t devno, void *buffer, size_t count, blkno_t blkno, int flags) {
   struct dev *dev;
+  int rc;
 
   if (devno < 0 || devno >= num_devs) return -ENODEV;
   dev = devtab[devno];
@@ -646,7 +651,87 @@ int dev_write(dev_t devno, void *buffer, size_t count, blkno_t blkno, int flags)
   dev->writes++;
   dev->output += count;
 
-  return dev->driver->write(dev, buffer, count, blkno, flags);
+  TRACE(TRACE_DEV_SUBMIT, devno << 1 | 1, blkno);
+  rc = dev->driver->write(dev, buffer, count, blkno, flags);
+  TRACE(TRACE_DEV_COMPLETE, devno << 1 | 1, rc);
+  return rc;
+}
+
+static int part_ioctl(struct dev *dev, int cmd, void *args, size_t size) {
+  struct partition *part = (struct partition *) dev->privdata;
+
+  switch (cmd) {
+    case IOCTL_GETDEVSIZE:
+      return part->len;
+
+    case IOCTL_GETBLKSIZE:
+      return dev_ioctl(part->dev, IOCTL_GETBLKSIZE, NULL, 0);
+  }
+
+  return -ENOSYS;
+}
+
+static int part_read(struct dev *dev, void *buffer, size_t count, blkno_t blkno, int flags) {
+  struct partition *part = (struct partition *) dev->privdata;
+  if (blkno + count / SECTORSIZE > part->len) return -EFAULT;
+  return dev_read(part->dev, buffer, count, blkno + part->start, 0);
+}
+
+static int part_write(struct dev *dev, void *buffer, size_t count, blkno_t blkno, int flags) {
+  struct partition *part = (struct partition *) dev->privdata;
+  if (blkno + count / SECTORSIZE > part->len) return -EFAULT;
+  return dev_write(part->dev, buffer, count, blkno + part->start, 0);
+}
+
+struct driver partition_driver = {
+  "partition", 
+  DEV_TYPE_BLOCK,
+  part_ioctl,
+  part_read,
+  part_write
+};
+
+int create_partitions(dev_t devno, struct partition *parts) {
+  struct master_boot_record mbrdata;
+  struct master_boot_record *mbr = &mbrdata;
+  dev_t partdevno;
+  int rc;
+  int i;
+  char devname[DEVNAMELEN];
+
+  // Read partition table
+  rc = dev_read(devno, mbr, SECTORSIZE, 0, 0);
+  if (rc < 0) {
+    kprintf(KERN_ERR "%s: error %d reading partition table\n", device(devno)->name, rc);
+    return rc;
+  }
+
+  // Create partition devices
+  if (mbr->signature != MBR_SIGNATURE) {
+    kprintf(KERN_ERR "%s: illegal boot sector signature\n", device(devno)->name);
+    return -EIO;
+  }
+
+  for (i = 0; i < MAX_PARTITIONS; i++) {
+    parts[i].dev = devno;
+    parts[i].bootid = mbr->parttab[i].bootid;
+    parts[i].systid = mbr->parttab[i].systid;
+    parts[i].start = mbr->parttab[i].relsect;
+    parts[i].len = mbr->parttab[i].numsect;
+
+    if (mbr->parttab[i].systid != 0) {
+      sprintf(devname, "%s%c", device(devno)->name, 'a' + i);
+      partdevno = dev_open(devname);
+      if (partdevno == NODEV) {
+        partdevno = dev_make(devname, &partition_driver, NULL, &parts[i]);
+        kprintf(KERN_INFO "%s: partition %d on %s, %dMB (type %02x)\n", devname, i, device(devno)->name, mbr->parttab[i].numsect / ((1024 * 1024) / SECTORSIZE), mbr->parttab[i].systid);
+      } else {
+        dev_close(partdevno);
+      }
+    }
+  }
+
+  return 0;
 }
 
 int dev_attach(dev_t devno, struct netif *netif, int (*receive)(struct netif *netif, struct pbuf *p)) {
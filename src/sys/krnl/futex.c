@@ -0,0 +1,162 @@
+//
+// futex.c
+//
+// Fast user-mode synchronization
+//
+// Copyright (C) 2013 Michael Ringgaard. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 
+// 1. Redistributions of source code must retain the above copyright 
+//    notice, this list of conditions and the following disclaimer.  
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.  
+// 3. Neither the name of the project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission. 
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+// 
+
+#include <os/krnl.h>
+
+//
+// A futex is an integer in user memory used as a lock word. User mode
+// code manipulates the word with atomic instructions and only calls into
+// the kernel to block when the lock is contended, and to wake up blocked
+// threads when a contended lock is released. The kernel keeps no state for
+// a futex except the threads waiting on it. Waiting threads are kept in a
+// hash table keyed by the address of the futex word.
+//
+
+static struct futex_bucket futex_hash[FUTEX_HASH_SIZE];
+
+static unsigned long futex_waits;
+static unsigned long futex_wakeups;
+static unsigned long futex_timeouts;
+
+static __inline struct futex_bucket *futex_bucket(int *addr) {
+  unsigned long key = (unsigned long) addr;
+
+  return &futex_hash[((key >> 2) ^ (key >> 12)) & (FUTEX_HASH_SIZE - 1)];
+}
+
+static void remove_waiter(struct futex_bucket *b, struct futex_waiter *w) {
+  if (w->next) w->next->prev = w->prev;
+  if (w->prev) w->prev->next = w->next;
+  if (w == b->head) b->head = w->next;
+  if (w == b->tail) b->tail = w->prev;
+  w->next = w->prev = NULL;
+}
+
+//
+// futex_wait
+//
+// Blocks the current thread if the futex word still contains the expected
+// value. The value check and the insertion in the wait queue cannot be
+// interrupted by another thread, so a wakeup cannot be lost between the
+// user mode test and the wait.
+//
+
+int futex_wait(int *addr, int value, unsigned int timeout) {
+  struct futex_bucket *b;
+  struct futex_waiter w;
+  int rc;
+
+  if (*addr != value) return -EAGAIN;
+  if (timeout == 0) return -ETIMEOUT;
+
+  // Insert waiter in hash bucket
+  b = futex_bucket(addr);
+  init_event(&w.event, 0, 0);
+  w.addr = addr;
+  w.woken = 0;
+  w.next = NULL;
+  w.prev = b->tail;
+  if (b->tail) b->tail->next = &w;
+  b->tail = &w;
+  if (!b->head) b->head = &w;
+  futex_waits++;
+
+  // Wait for wakeup, timeout, or signal
+  rc = wait_for_one_object(&w.event, timeout, 1);
+
+  // A waiter that has been woken up has already been removed from the
+  // wait queue. If a timeout or signal raced with the wakeup, the wakeup
+  // takes precedence so it is not lost.
+  if (w.woken) {
+    rc = 0;
+  } else {
+    remove_waiter(b, &w);
+    if (rc == -ETIMEOUT) futex_timeouts++;
+  }
+
+  return rc;
+}
+
+//
+// futex_wake
+//
+// Wakes up to count threads waiting on the futex. Returns the number of
+// threads woken up.
+//
+
+int futex_wake(int *addr, int count) {
+  struct futex_bucket *b;
+  struct futex_waiter *w;
+  struct futex_waiter *next;
+  int n;
+
+  b = futex_bucket(addr);
+  n = 0;
+  w = b->head;
+  while (w && n < count) {
+    next = w->next;
+    if (w->addr == addr) {
+      remove_waiter(b, w);
+      w->woken = 1;
+      set_event(&w->event);
+      n++;
+    }
+    w = next;
+  }
+
+  futex_wakeups += n;
+  return n;
+}
+
+static int futexes_proc(struct proc_file *pf, void *arg) {
+  struct futex_waiter *w;
+  int i;
+
+  pprintf(pf, "waits: %lu wakeups: %lu timeouts: %lu\n\n", futex_waits, futex_wakeups, futex_timeouts);
+  pprintf(pf, "address  tid  thread\n");
+  pprintf(pf, "-------- ---- ----------------\n");
+  for (i = 0; i < FUTEX_HASH_SIZE; i++) {
+    for (w = futex_hash[i].head; w; w = w->next) {
+      struct waitblock *wb = w->event.object.waitlist_head;
+      struct thread *t = wb ? wb->thread : NULL;
+
+      pprintf(pf, "%p %4d %s\n", w->addr, t ? t->id : -1, t ? t->name : "");
+    }
+  }
+
+  return 0;
+}
+
+void init_futex() {
+  register_proc_inode("futexes", futexes_proc, NULL);
+}
@@ -57,11 +57,36 @@ static void dump_iomux(struct iomux *iomux) {
   kprintf("\n");
 }
 
+static int dequeue_packet(struct iomux *iomux) {
+  struct iopacket *pkt = iomux->posted_head;
+  int context = pkt->context;
+
+  iomux->posted_head = pkt->next;
+  if (!iomux->posted_head) iomux->posted_tail = NULL;
+  if (!iomux->posted_head && !iomux->ready_head) iomux->object.signaled = 0;
+  kfree(pkt);
+
+  return context;
+}
+
 static void release_waiting_threads(struct iomux *iomux) {
   struct waitblock *wb;
   struct waitblock *wb_next;
   struct ioobject *iob;
 
+  // Hand out posted packets before ready I/O objects
+  wb = iomux->object.waitlist_head;
+  while (iomux->posted_head && wb) {
+    wb_next = wb->next_wait;
+
+    if (thread_ready_to_run(wb->thread)) {
+      wb->thread->waitkey = dequeue_packet(iomux);
+      release_thread(wb->thread);
+    }
+
+    wb = wb_next;
+  }
+
   // Dispatch all ready I/O objects to all ready waiting threads
   wb = iomux->object.waitlist_head;
   iob = iomux->ready_head;
@@ -90,11 +115,21 @@ void init_iomux(struct iomux *iomux, int flags) {
   iomux->flags = flags;
   iomux->ready_head = iomux->ready_tail = NULL;
   iomux->waiting_head = iomux->waiting_tail = NULL;
+  iomux->posted_head = iomux->posted_tail = NULL;
 }
 
 int close_iomux(struct iomux *iomux) {
   struct ioobject *iob;
   struct ioobject *next;
+  struct iopacket *pkt;
+
+  // Discard posted packets
+  while (iomux->posted_head) {
+    pkt = iomux->posted_head;
+    iomux->posted_head = pkt->next;
+    kfree(pkt);
+  }
+  iomux->posted_tail = NULL;
 
   // Remove all objects from ready queue
   iob = iomux->ready_head;
@@ -165,6 +200,32 @@ int queue_ioobject(struct iomux *iomux, object_t hobj, int events, int context)
   return 0;
 }
 
+//
+// post_iomux
+//
+// Queues a completion packet on the iomux. Waiting threads receive the
+// packet context as the wait result, just like the context of a ready
+// I/O object, so an iomux can serve as an I/O completion port.
+//
+
+int post_iomux(struct iomux *iomux, int context) {
+  struct iopacket *pkt;
+
+  pkt = (struct iopacket *) kmalloc(sizeof(struct iopacket));
+  if (!pkt) return -ENOMEM;
+  pkt->next = NULL;
+  pkt->context = context;
+
+  if (iomux->posted_tail) iomux->posted_tail->next = pkt;
+  iomux->posted_tail = pkt;
+  if (!iomux->posted_head) iomux->posted_head = pkt;
+
+  iomux->object.signaled = 1;
+  release_waiting_threads(iomux);
+
+  return 0;
+}
+
 void init_ioobject(struct ioobject *iob, int type) {
   init_object(&iob->object, type);
   iob->iomux = NULL;
@@ -184,7 +245,7 @@ void detach_ioobject(struct ioobject *iob) {
       if (iob->iomux->ready_tail == iob) iob->iomux->ready_tail = iob->prev; 
 
       // If ready queue is empty the iomux is no longer signaled
-      if (!iob->iomux->ready_head) iob->iomux->object.signaled = 0;
+      if (!iob->iomux->ready_head && !iob->iomux->posted_head) iob->iomux->object.signaled = 0;
     } else {
       // Remove object from waiting queue
       if (iob->iomux->waiting_head == iob) iob->iomux->waiting_head = iob->next; 
@@ -248,6 +309,9 @@ void clear_io_event(struct ioobject *iob, int events) {
 int dequeue_event_from_iomux(struct iomux *iomux) {
   struct ioobject *iob;
 
+  // Posted packets are delivered first
+  if (iomux->posted_head) return dequeue_packet(iomux);
+
   // Get first ready object, return error if no objects are ready
   iob = iomux->ready_head;
   if (!iob) return -ENOENT;
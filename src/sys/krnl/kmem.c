@@ -48,6 +48,29 @@ void *alloc_pages(int pages, unsigned long tag) {
   unsigned long pfn;
 
   if (tag == 0) tag = 'KMEM';
+
+  // Map large allocations with 4MB pages where possible
+  if (large_pages && pages >= PTES_PER_PAGE) {
+    vaddr = (char *) PTOB(rmap_alloc_align(osvmap, pages, PTES_PER_PAGE));
+    if (vaddr) {
+      for (i = 0; i < pages; i++) {
+        if (i + PTES_PER_PAGE <= pages && PTEIDX(vaddr + PTOB(i)) == 0) {
+          pfn = alloc_aligned_pageframes(PTES_PER_PAGE, PTES_PER_PAGE, tag);
+          if (pfn != 0xFFFFFFFF) {
+            map_large_page(vaddr + PTOB(i), pfn, PT_WRITABLE | PT_PRESENT);
+            i += PTES_PER_PAGE - 1;
+            continue;
+          }
+        }
+
+        pfn = alloc_pageframe(tag);
+        map_page(vaddr + PTOB(i), pfn, PT_WRITABLE | PT_PRESENT);
+      }
+
+      return vaddr;
+    }
+  }
+
   vaddr = (char *) PTOB(rmap_alloc(osvmap, pages));
   for (i = 0; i < pages; i++) {
     pfn = alloc_pageframe(tag);
@@ -104,8 +127,16 @@ void free_pages(void *addr, int pages)
 
   for (i = 0; i < pages; i++) {
     pfn = BTOP(virt2phys((char *) addr + PTOB(i)));
-    free_pageframe(pfn);
-    unmap_page((char *) addr + PTOB(i));
+    if (page_large((char *) addr + PTOB(i))) {
+      int n;
+
+      for (n = 0; n < PTES_PER_PAGE; n++) free_pageframe(pfn + n);
+      unmap_large_page((char *) addr + PTOB(i));
+      i += PTES_PER_PAGE - 1;
+    } else {
+      free_pageframe(pfn);
+      unmap_page((char *) addr + PTOB(i));
+    }
   }
 
   rmap_free(osvmap, BTOP(addr), pages);
@@ -35,6 +35,7 @@
 
 pte_t *pdir = (pte_t *) PAGEDIR_ADDRESS; // Page directory
 pte_t *ptab = (pte_t *) PTBASE;          // Page tables
+int large_pages = 0;                     // 4MB pages supported
 
 void map_page(void *vaddr, unsigned long pfn, unsigned long flags) {
   // Allocate page table if not already done
@@ -61,25 +62,65 @@ void unmap_page(void *vaddr) {
   invlpage(vaddr);
 }
 
+//
+// A large page maps 4MB directly from the page directory entry. Any page
+// table for the 4MB range must be empty, and is released. The recursive
+// page table window for the range is invalidated, because it now points
+// to the large page instead of the page table.
+//
+
+void map_large_page(void *vaddr, unsigned long pfn, unsigned long flags) {
+  pte_t pde = GET_PDE(vaddr);
+
+  if ((pde & (PT_PRESENT | PT_LARGE)) == PT_PRESENT) free_pageframe(BTOP(pde & PT_PFNMASK));
+  SET_PDE(vaddr, PTOB(pfn) | flags | PT_LARGE);
+  invlpage(ptab + PDEIDX(vaddr) * PTES_PER_PAGE);
+  invlpage(vaddr);
+}
+
+void unmap_large_page(void *vaddr) {
+  SET_PDE(vaddr, 0);
+  invlpage(ptab + PDEIDX(vaddr) * PTES_PER_PAGE);
+  invlpage(vaddr);
+}
+
 unsigned long virt2phys(void *vaddr) {
+  pte_t pde = GET_PDE(vaddr);
+
+  if (pde & PT_LARGE) return (pde & PT_LARGEMASK) + ((unsigned long) vaddr & (LARGEPAGESIZE - 1));
   return ((GET_PTE(vaddr) & PT_PFNMASK) + PGOFF(vaddr));
 }
 
 unsigned long virt2pfn(void *vaddr) {
+  pte_t pde = GET_PDE(vaddr);
+
+  if (pde & PT_LARGE) return BTOP(pde & PT_LARGEMASK) + PTEIDX(vaddr);
   return BTOP(GET_PTE(vaddr) & PT_PFNMASK);
 }
 
 pte_t get_page_flags(void *vaddr) {
+  pte_t pde = GET_PDE(vaddr);
+
+  if (pde & PT_LARGE) return (pde & PT_FLAGMASK) | PT_LARGE;
   return GET_PTE(vaddr) & PT_FLAGMASK;
 }
 
 void set_page_flags(void *vaddr, unsigned long flags) {
-  SET_PTE(vaddr, (GET_PTE(vaddr) & PT_PFNMASK) | flags);
+  pte_t pde = GET_PDE(vaddr);
+
+  if (pde & PT_LARGE) {
+    SET_PDE(vaddr, (pde & PT_LARGEMASK) | flags | PT_LARGE);
+  } else {
+    SET_PTE(vaddr, (GET_PTE(vaddr) & PT_PFNMASK) | flags);
+  }
   invlpage(vaddr);
 }
 
 int page_mapped(void *vaddr) {
-  if ((GET_PDE(vaddr) & PT_PRESENT) == 0) return 0;
+  pte_t pde = GET_PDE(vaddr);
+
+  if ((pde & PT_PRESENT) == 0) return 0;
+  if (pde & PT_LARGE) return 1;
   if ((GET_PTE(vaddr) & PT_PRESENT) == 0) return 0;
   return 1;
 }
@@ -88,63 +129,94 @@ int page_directory_mapped(void *vaddr) {
   return (GET_PDE(vaddr) & PT_PRESENT) != 0;
 }
 
+int page_large(void *vaddr) {
+  return (GET_PDE(vaddr) & (PT_PRESENT | PT_LARGE)) == (PT_PRESENT | PT_LARGE);
+}
+
 void unguard_page(void *vaddr) {
   SET_PTE(vaddr, (GET_PTE(vaddr) & ~PT_GUARD) | PT_USER);
   invlpage(vaddr);
 }
 
 void clear_dirty(void *vaddr) {
-  SET_PTE(vaddr, GET_PTE(vaddr) & ~PT_DIRTY);
+  pte_t pde = GET_PDE(vaddr);
+
+  if (pde & PT_LARGE) {
+    SET_PDE(vaddr, pde & ~PT_DIRTY);
+  } else {
+    SET_PTE(vaddr, GET_PTE(vaddr) & ~PT_DIRTY);
+  }
   invlpage(vaddr);
 }
 
 int mem_access(void *vaddr, int size, pte_t access) {
   unsigned long addr;
   unsigned long next;
+  pte_t pde;
   pte_t pte;
   
   addr = (unsigned long) vaddr;
-  next = (addr & ~PAGESIZE) + PAGESIZE;
   while (1) {
-    if ((GET_PDE(addr) & PT_PRESENT) == 0) return 0;
-    pte = GET_PTE(addr);
-    if ((pte & access) != access) {
-      if (pte & PT_FILE) {
-        if (fetch_page((void *) PAGEADDR(addr)) < 0) return 0;
-        if ((GET_PTE(addr) & access) != access) return 0;
-      } else {
-        return 0;
+    pde = GET_PDE(addr);
+    if ((pde & PT_PRESENT) == 0) return 0;
+    if (pde & PT_LARGE) {
+      if ((pde & access) != access) return 0;
+      next = (addr & ~(LARGEPAGESIZE - 1)) + LARGEPAGESIZE;
+    } else {
+      pte = GET_PTE(addr);
+      if ((pte & access) != access) {
+        if (pte & PT_FILE) {
+          if (fetch_page((void *) PAGEADDR(addr)) < 0) return 0;
+          if ((GET_PTE(addr) & access) != access) return 0;
+        } else if (pte & PT_DEMAND) {
+          if (demand_page((void *) PAGEADDR(addr)) < 0) return 0;
+          if ((GET_PTE(addr) & access) != access) return 0;
+        } else {
+          return 0;
+        }
       }
+      next = PAGEADDR(addr) + PAGESIZE;
     }
 
     size -= next - addr;
     if (size <= 0) break;
     addr = next;
-    next += PAGESIZE;
   }
 
   return 1;
 }
 
 int str_access(char *s, pte_t access) {
+  pte_t pde;
   pte_t pte;
+  unsigned long mask;
 
   while (1) {
-    if ((GET_PDE(s) & PT_PRESENT) == 0) return 0;
-    pte = GET_PTE(s);
-    if ((pte & access) != access) {
-      if (pte & PT_FILE) {
-        if (fetch_page((void *) PAGEADDR(s)) < 0) return 0;
-        if ((GET_PTE(s) & access) != access) return 0;
-      } else {
-        return 0;
+    pde = GET_PDE(s);
+    if ((pde & PT_PRESENT) == 0) return 0;
+    if (pde & PT_LARGE) {
+      if ((pde & access) != access) return 0;
+      mask = LARGEPAGESIZE - 1;
+    } else {
+      pte = GET_PTE(s);
+      if ((pte & access) != access) {
+        if (pte & PT_FILE) {
+          if (fetch_page((void *) PAGEADDR(s)) < 0) return 0;
+          if ((GET_PTE(s) & access) != access) return 0;
+        } else if (pte & PT_DEMAND) {
+          if (demand_page((void *) PAGEADDR(s)) < 0) return 0;
+          if ((GET_PTE(s) & access) != access) return 0;
+        } else {
+          return 0;
+        }
       }
+      mask = PAGESIZE - 1;
     }
 
     while (1) {
       if (!*s) return 1;
       s++;
-      if (PGOFF(s) == 0) break;
+      if (((unsigned long) s & mask) == 0) break;
     }
   }
 }
@@ -154,6 +226,14 @@ void init_pdir() {
 
   // Clear identity mapping of the first 4 MB made by the os loader
   for (i = 0; i < PTES_PER_PAGE; i++) SET_PTE(PTOB(i), 0);
+
+#ifndef VMACH
+  // Enable 4MB pages if the processor supports page size extensions
+  if (cpu.features & CPU_FEATURE_PSE) {
+    set_cr4(get_cr4() | CR4_PSE);
+    large_pages = 1;
+  }
+#endif
 }
 
 int pdir_proc(struct proc_file *pf, void *arg) {
@@ -170,14 +250,40 @@ int pdir_proc(struct proc_file *pf, void *arg) {
   int dt = 0;
   int gd = 0;
   int fi = 0;
+  int lg = 0;
 
   pprintf(pf, "virtaddr physaddr flags\n");
-  pprintf(pf, "-------- -------- ------\n");
+  pprintf(pf, "-------- -------- -------\n");
 
   vaddr = NULL;
   while (1) {
-    if ((GET_PDE(vaddr) & PT_PRESENT) == 0) {
+    pte = GET_PDE(vaddr);
+    if ((pte & PT_PRESENT) == 0) {
       vaddr += PTES_PER_PAGE * PAGESIZE;
+    } else if (pte & PT_LARGE) {
+      ma += PTES_PER_PAGE;
+      lg++;
+
+      if (pte & PT_WRITABLE) {
+        rw += PTES_PER_PAGE;
+      } else {
+        ro += PTES_PER_PAGE;
+      }
+
+      if (pte & PT_USER) {
+        us += PTES_PER_PAGE;
+      } else {
+        su += PTES_PER_PAGE;
+      }
+
+      pprintf(pf, "%08x %08x %c%c%c%c  L\n", 
+              vaddr, pte & PT_LARGEMASK, 
+              (pte & PT_WRITABLE) ? 'w' : 'r',
+              (pte & PT_USER) ? 'u' : 's',
+              (pte & PT_ACCESSED) ? 'a' : ' ',
+              (pte & PT_DIRTY) ? 'd' : ' ');
+
+      vaddr += LARGEPAGESIZE;
     } else {
       pte = GET_PTE(vaddr);
       if (pte & PT_PRESENT) {
@@ -216,7 +322,7 @@ int pdir_proc(struct proc_file *pf, void *arg) {
     if (!vaddr) break;
   }
 
-  pprintf(pf, "\ntotal:%d usr:%d sys:%d rw: %d ro: %d acc: %d dirty: %d guard:%d file:%d\n", ma, us, su, rw, ro, ac, dt, gd, fi);
+  pprintf(pf, "\ntotal:%d usr:%d sys:%d rw: %d ro: %d acc: %d dirty: %d guard:%d file:%d large:%d\n", ma, us, su, rw, ro, ac, dt, gd, fi, lg);
   return 0;
 }
 
@@ -239,13 +345,29 @@ int virtmem_proc(struct proc_file *pf, void *arg) {
   start = vaddr = NULL;
   curtag = 0;
   while (1) {
-    if ((GET_PDE(vaddr) & PT_PRESENT) == 0) {
+    pte_t pde = GET_PDE(vaddr);
+
+    if ((pde & PT_PRESENT) == 0) {
       if (start != NULL) {
         print_virtmem(pf, start, vaddr, curtag);
         start = NULL;
       }
 
       vaddr += PTES_PER_PAGE * PAGESIZE;
+    } else if (pde & PT_LARGE) {
+      unsigned long tag = pfdb[BTOP(pde & PT_LARGEMASK)].tag;
+
+      if (start == NULL)  {
+        start = vaddr;
+        curtag = tag;
+      } else if (tag != curtag) {
+        print_virtmem(pf, start, vaddr, curtag);
+        start = vaddr;
+        curtag = tag;
+      }
+
+      total += LARGEPAGESIZE;
+      vaddr += LARGEPAGESIZE;
     } else {
       pte_t pte = GET_PTE(vaddr);
       unsigned long tag = pfdb[pte >> PT_PFNSHIFT].tag;
@@ -284,14 +406,36 @@ int pdir_stat(void *addr, int len, struct pdirstat *buf) {
   char *vaddr;
   char *end;
   pte_t pte;
+  int n;
 
   memset(buf, 0, sizeof(struct pdirstat));
   vaddr = (char *) addr;
   end = vaddr + len;
   while (vaddr < end) {
-    if ((GET_PDE(vaddr) & PT_PRESENT) == 0) {
+    pte = GET_PDE(vaddr);
+    if ((pte & PT_PRESENT) == 0) {
       vaddr += PTES_PER_PAGE * PAGESIZE;
       vaddr = (char *) ((unsigned long) vaddr & ~(PTES_PER_PAGE * PAGESIZE - 1));
+    } else if (pte & PT_LARGE) {
+      // Count the part of the large page inside the range
+      n = PTES_PER_PAGE - PTEIDX(vaddr);
+      if (n > (end - vaddr + PAGESIZE - 1) / PAGESIZE) n = (end - vaddr + PAGESIZE - 1) / PAGESIZE;
+
+      buf->present += n;
+      if (pte & PT_WRITABLE) {
+        buf->readwrite += n;
+      } else {
+        buf->readonly += n;
+      }
+      if (pte & PT_USER) {
+        buf->user += n;
+      } else {
+        buf->kernel += n;
+      }
+      if (pte & PT_ACCESSED) buf->accessed += n;
+      if (pte & PT_DIRTY) buf->dirty += n;
+
+      vaddr += PTOB(n);
     } else {
       pte = GET_PTE(vaddr);
       if (pte & PT_PRESENT) {
@@ -35,11 +35,18 @@
 
 #define MAX_MEMTAGS           128
 
+#define ZEROPOOL_PAGES        1024
+#define ZEROPOOL_BATCH        16
+
 unsigned long freemem;        // Number of pages free memory
+unsigned long zeromem;        // Number of free pages that have been zeroed
 unsigned long totalmem;       // Total number of pages of memory (bad pages excluded)
 unsigned long maxmem;         // First unavailable memory page
 struct pageframe *pfdb;       // Page frame database      
 struct pageframe *freelist;   // List of free pages
+struct pageframe *zerolist;   // List of free zeroed pages
+
+static struct task zero_task;
 
 void panic(char *msg);
 
@@ -48,13 +55,41 @@ unsigned long alloc_pageframe(unsigned long tag) {
 
   if (freemem == 0) panic("out of memory");
 
-  pf = freelist;
-  freelist = pf->next;
+  if (freelist) {
+    pf = freelist;
+    freelist = pf->next;
+  } else {
+    pf = zerolist;
+    zerolist = pf->next;
+    zeromem--;
+  }
+  freemem--;
+
+  pf->tag = tag;
+  pf->next = NULL;
+
+  return pf - pfdb;
+}
+
+unsigned long alloc_zeroed_pageframe(unsigned long tag, int *zeroed) {
+  struct pageframe *pf;
+
+  // Use a page from the zero pool if possible, otherwise the caller
+  // must clear the page
+  if (!zerolist) {
+    *zeroed = 0;
+    return alloc_pageframe(tag);
+  }
+
+  pf = zerolist;
+  zerolist = pf->next;
+  zeromem--;
   freemem--;
 
   pf->tag = tag;
   pf->next = NULL;
 
+  *zeroed = 1;
   return pf - pfdb;
 }
 
@@ -102,6 +137,57 @@ unsigned long alloc_linear_pageframes(int pages, unsigned long tag) {
   return 0xFFFFFFFF;
 }
 
+//
+// Allocate a run of free page frames starting at a multiple of align,
+// e.g. for a large page. The free and zero lists are not ordered, so
+// the run is found by scanning the page frame database and the frames
+// are then removed from the lists in one pass.
+//
+
+unsigned long alloc_aligned_pageframes(int pages, int align, unsigned long tag) {
+  struct pageframe **link;
+  struct pageframe *pf;
+  unsigned long pfn;
+  int n;
+
+  if ((int) freemem < pages) return 0xFFFFFFFF;
+
+  for (pfn = 0; pfn + pages <= maxmem; pfn += align) {
+    for (n = 0; n < pages; n++) {
+      if (pfdb[pfn + n].tag != 'FREE' && pfdb[pfn + n].tag != 'ZERO') break;
+    }
+    if (n == pages) break;
+  }
+  if (pfn + pages > maxmem) return 0xFFFFFFFF;
+
+  link = &freelist;
+  while ((pf = *link) != NULL) {
+    if (pf >= pfdb + pfn && pf < pfdb + pfn + pages) {
+      *link = pf->next;
+    } else {
+      link = &pf->next;
+    }
+  }
+
+  link = &zerolist;
+  while ((pf = *link) != NULL) {
+    if (pf >= pfdb + pfn && pf < pfdb + pfn + pages) {
+      *link = pf->next;
+      zeromem--;
+    } else {
+      link = &pf->next;
+    }
+  }
+
+  for (n = 0; n < pages; n++) {
+    pfdb[pfn + n].tag = tag;
+    pfdb[pfn + n].next = NULL;
+  }
+  freemem -= pages;
+
+  return pfn;
+}
+
 void free_pageframe(unsigned long pfn) {
   struct pageframe *pf;
 
@@ -112,6 +198,28 @@ void free_pageframe(unsigned long pfn) {
   freemem++;
 }
 
+static void zero_pageframes(void *arg) {
+  struct pageframe *pf;
+  int n;
+
+  // Move free pages to the zero pool while there is nothing else to do
+  n = 0;
+  while (freelist && zeromem < ZEROPOOL_PAGES && n < ZEROPOOL_BATCH && system_idle()) {
+    pf = freelist;
+    freelist = pf->next;
+
+    map_page((void *) ZEROPAGE_ADDRESS, pf - pfdb, PT_WRITABLE | PT_PRESENT);
+    memset((void *) ZEROPAGE_ADDRESS, 0, PAGESIZE);
+    unmap_page((void *) ZEROPAGE_ADDRESS);
+
+    pf->tag = 'ZERO';
+    pf->next = zerolist;
+    zerolist = pf;
+    zeromem++;
+    n++;
+  }
+}
+
 void set_pageframe_tag(void *addr, unsigned int len, unsigned long tag) {
   char *vaddr = (char *) addr;
   char *vend = vaddr + len;
@@ -188,10 +296,11 @@ int memusage_proc(struct proc_file *pf, void *arg) {
 }
 
 int memstat_proc(struct proc_file *pf, void *arg) {
-  pprintf(pf, "Memory %dMB total, %dKB used, %dKB free, %dKB reserved\n", 
+  pprintf(pf, "Memory %dMB total, %dKB used, %dKB free, %dKB zeroed, %dKB reserved\n", 
           maxmem * PAGESIZE / (1024 * 1024), 
           (totalmem - freemem) * PAGESIZE / 1024, 
-          freemem * PAGESIZE / 1024, (maxmem - totalmem) * PAGESIZE / 1024);
+          freemem * PAGESIZE / 1024, zeromem * PAGESIZE / 1024,
+          (maxmem - totalmem) * PAGESIZE / 1024);
   
   return 0;
 }
@@ -205,7 +314,7 @@ int physmem_proc(struct proc_file *pf, void *arg) {
       pprintf(pf, "%08X ", PTOB(n));
     }
 
-    if (pfdb[n].tag == 'FREE') {
+    if (pfdb[n].tag == 'FREE' || pfdb[n].tag == 'ZERO') {
       pprintf(pf, ".");
     } else if (pfdb[n].tag == 'RESV') {
       pprintf(pf, "-");
@@ -309,3 +418,8 @@ void init_pfdb() {
     }
   } while (pf > pfdb);
 }
+
+void init_zeropool() {
+  init_task(&zero_task);
+  add_idle_task(&zero_task, zero_pageframes, NULL);
+}
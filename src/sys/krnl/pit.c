@@ -85,6 +85,12 @@ time_t upsince;
 unsigned long cycles_per_tick;
 unsigned long loops_per_tick;
 
+#define TICK_COUNT      (PIT_CLOCK / TIMER_FREQ)
+
+int timer_multiplier = 1;
+static unsigned int pit_count = TICK_COUNT; // PIT input clocks per timer interrupt
+static unsigned int subticks = 0;           // PIT input clocks since last clock tick
+
 unsigned char loadtab[LOADTAB_SIZE];
 unsigned char *loadptr;
 unsigned char *loadend;
@@ -99,6 +105,22 @@ void timer_dpc(void *arg) {
 int timer_handler(struct context *ctxt, void *arg) {
   struct thread *t;
 
+  // Take profiling sample
+  if (prof_enabled) prof_sample(ctxt);
+
+  // When the timer runs faster for profiling, count a clock tick each
+  // time a full tick period of PIT input clocks has elapsed. The PIT
+  // divisor is rounded, so the interrupt period does not divide the tick
+  // period exactly, and the remainder is carried over to the next tick.
+  if (timer_multiplier > 1) {
+    subticks += pit_count;
+    if (subticks < TICK_COUNT) {
+      eoi(IRQ_TMR);
+      return 0;
+    }
+    subticks -= TICK_COUNT;
+  }
+
   // Update timer clock
   clocks += CLOCKS_PER_TICK;
 
@@ -335,13 +357,29 @@ static int loadavg_proc(struct proc_file *pf, void *arg) {
   return 0;
 }
 
-void init_pit() {
-  struct tm tm;
-
-  unsigned int cnt = PIT_CLOCK / TIMER_FREQ;
+static void program_pit(unsigned int freq) {
+  unsigned int cnt = PIT_CLOCK / freq;
   outp(TMR_CTRL, TMR_CH0 + TMR_BOTH + TMR_MD3);
   outp(TMR_CNT0, (unsigned char) (cnt & 0xFF));
   outp(TMR_CNT0, (unsigned char) (cnt >> 8));
+  pit_count = cnt;
+}
+
+void set_timer_multiplier(int mult) {
+  // Run the timer interrupt mult times per clock tick. The extra
+  // interrupts are only used for sampling by the profiler.
+  if (mult < 1) mult = 1;
+  cli();
+  program_pit(TIMER_FREQ * mult);
+  timer_multiplier = mult;
+  subticks = 0;
+  sti();
+}
+
+void init_pit() {
+  struct tm tm;
+
+  program_pit(TIMER_FREQ);
 
   loadptr = loadtab;
   loadend = loadtab + LOADTAB_SIZE;
@@ -367,6 +405,18 @@ void udelay(unsigned long us) {
   }
 }
 
+unsigned __int64 cycles_to_usecs(unsigned __int64 cycles) {
+  unsigned long cycles_per_usec = cycles_per_tick / USECS_PER_TICK;
+  if (cycles_per_usec == 0) return 0;
+  return cycles / cycles_per_usec;
+}
+
+clock_t cycles_to_clocks(unsigned __int64 cycles) {
+  unsigned long cycles_per_clock = cycles_per_tick / CLOCKS_PER_TICK;
+  if (cycles_per_clock == 0) return 0;
+  return (clock_t) (cycles / cycles_per_clock);
+}
+
 unsigned int get_ticks() {
   return ticks;
 }
@@ -0,0 +1,482 @@
+//
+// prof.c
+//
+// Sampling CPU profiler
+//
+// Copyright (C) 2013 Michael Ringgaard. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 
+// 1. Redistributions of source code must retain the above copyright 
+//    notice, this list of conditions and the following disclaimer.  
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.  
+// 3. Neither the name of the project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission. 
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+// 
+
+
+#include <os/krnl.h>
+
+#define PROF_HASH 1024
+
+int prof_enabled = 0;
+
+static struct prof_sample *profbuf;
+static int prof_count;
+static int prof_lost;
+static int prof_rate;
+
+struct prof_func {
+  struct prof_func *next;       // Next function in hash bucket
+  struct prof_func *link;       // Next function in symbol table
+  void *entry;                  // Function entry point or module handle
+  char *name;                   // Symbolic name
+  int self;                     // Samples in function
+  int total;                    // Samples in function or its callees
+  int stamp;                    // Last sample counted in total
+};
+
+struct prof_addr {
+  struct prof_addr *next;
+  void *addr;
+  struct prof_func *func;
+};
+
+struct prof_stack {
+  struct prof_stack *next;
+  int count;
+  int depth;
+  struct prof_func *funcs[PROF_DEPTH];
+};
+
+struct prof_symtab {
+  struct prof_addr *addrs[PROF_HASH];
+  struct prof_func *funcs[PROF_HASH];
+  struct prof_stack *stacks[PROF_HASH];
+  struct prof_func *funclist;
+  int nfuncs;
+  struct moddb *usermods;
+};
+
+#define PROF_HASHVAL(addr) ((((unsigned long) (addr)) >> 2) & (PROF_HASH - 1))
+
+//
+// prof_sample
+//
+// Called from the timer interrupt to record the interrupted eip and the
+// return addresses found by following the frame pointer chain. The walk
+// is confined to the kernel stack of the current thread or the committed
+// part of its user stack, and stops at the first unmapped frame.
+//
+
+void prof_sample(struct context *ctxt) {
+  struct thread *t = self();
+  struct prof_sample *sample;
+  void **ebp, **next;
+  void *stktop, *stklimit;
+  int n;
+
+  if (!profbuf) return;
+  if (prof_count == PROF_SAMPLES) {
+    prof_lost++;
+    return;
+  }
+
+  if (USERSPACE(ctxt->eip)) {
+    if (t->tib && page_mapped(t->tib)) {
+      stktop = t->tib->stacktop;
+      stklimit = t->tib->stacklimit;
+    } else {
+      stktop = stklimit = NULL;
+    }
+  } else {
+    stktop = (char *) t + TCBSIZE;
+    stklimit = t;
+  }
+
+  sample = &profbuf[prof_count];
+  sample->eip[0] = (void *) ctxt->eip;
+  n = 1;
+  ebp = (void **) ctxt->ebp;
+  while (n < PROF_DEPTH && (void *) ebp > stklimit && (void *) (ebp + 2) <= stktop) {
+    if (!page_mapped(ebp) || !page_mapped(ebp + 1)) break;
+    if (!ebp[1]) break;
+    sample->eip[n++] = ebp[1];
+    next = (void **) ebp[0];
+    if (next <= ebp) break;
+    ebp = next;
+  }
+  sample->depth = n;
+  prof_count++;
+}
+
+//
+// prof_start
+//
+// Starts sampling at the requested rate. The rate is rounded down to a
+// multiple of the timer frequency, since the samples are taken from the
+// timer interrupt.
+//
+
+int prof_start(int rate) {
+  int mult;
+
+  if (rate <= 0) rate = PROF_DEFAULT_RATE;
+  if (rate > PROF_MAX_RATE) rate = PROF_MAX_RATE;
+  mult = rate / TIMER_FREQ;
+  if (mult < 1) mult = 1;
+
+  if (!profbuf) {
+    profbuf = (struct prof_sample *) kmalloc_tag(PROF_SAMPLES * sizeof(struct prof_sample), 'PROF');
+    if (!profbuf) return -ENOMEM;
+  }
+
+  prof_rate = mult * TIMER_FREQ;
+  prof_enabled = 1;
+  set_timer_multiplier(mult);
+  return 0;
+}
+
+int prof_stop() {
+  prof_enabled = 0;
+  set_timer_multiplier(1);
+  return 0;
+}
+
+int prof_reset() {
+  cli();
+  prof_count = 0;
+  prof_lost = 0;
+  sti();
+  return 0;
+}
+
+//
+// Symbol resolution
+//
+
+static struct prof_symtab *alloc_symtab() {
+  struct prof_symtab *symtab;
+  struct peb *peb = (struct peb *) PEB_ADDRESS;
+
+  symtab = (struct prof_symtab *) kmalloc(sizeof(struct prof_symtab));
+  if (!symtab) return NULL;
+  memset(symtab, 0, sizeof(struct prof_symtab));
+  if (page_mapped(peb)) symtab->usermods = peb->usermods;
+  return symtab;
+}
+
+static void free_symtab(struct prof_symtab *symtab) {
+  struct prof_func *func;
+  struct prof_addr *addr;
+  struct prof_stack *stack;
+  int i;
+
+  for (i = 0; i < PROF_HASH; i++) {
+    while (symtab->stacks[i]) {
+      stack = symtab->stacks[i];
+      symtab->stacks[i] = stack->next;
+      kfree(stack);
+    }
+    while (symtab->addrs[i]) {
+      addr = symtab->addrs[i];
+      symtab->addrs[i] = addr->next;
+      kfree(addr);
+    }
+  }
+
+  while (symtab->funclist) {
+    func = symtab->funclist;
+    symtab->funclist = func->link;
+    kfree(func->name);
+    kfree(func);
+  }
+
+  kfree(symtab);
+}
+
+static char *symbol_name(struct stackframe *frame) {
+  char *name;
+  int modlen, funclen;
+
+  if (!frame->modname) frame->modname = "unknown";
+  modlen = strlen(frame->modname);
+  funclen = 0;
+  if (frame->func) {
+    while (frame->func[funclen] && frame->func[funclen] != ':') funclen++;
+  }
+
+  name = (char *) kmalloc(modlen + funclen + 2);
+  if (!name) return NULL;
+  memcpy(name, frame->modname, modlen);
+  if (funclen > 0) {
+    name[modlen] = '!';
+    memcpy(name + modlen + 1, frame->func, funclen);
+    name[modlen + funclen + 1] = 0;
+  } else {
+    name[modlen] = 0;
+  }
+
+  return name;
+}
+
+static struct prof_func *resolve_symbol(struct prof_symtab *symtab, void *eip) {
+  struct prof_addr *addr;
+  struct prof_func *func;
+  struct moddb *db;
+  struct stackframe frame;
+  void *entry;
+  int h;
+
+  h = PROF_HASHVAL(eip);
+  for (addr = symtab->addrs[h]; addr; addr = addr->next) {
+    if (addr->addr == eip) return addr->func;
+  }
+
+  // Functions are identified by their entry point. Addresses in modules
+  // without debug information are attributed to the module as a whole.
+  db = USERSPACE(eip) ? symtab->usermods : &kmods;
+  if (db && get_symbol_info(db, eip, &frame) == 0) {
+    entry = frame.func ? (char *) eip - frame.offset : (void *) frame.hmod;
+  } else {
+    memset(&frame, 0, sizeof(struct stackframe));
+    entry = NULL;
+  }
+
+  h = PROF_HASHVAL(entry);
+  for (func = symtab->funcs[h]; func; func = func->next) {
+    if (func->entry == entry) break;
+  }
+
+  if (!func) {
+    func = (struct prof_func *) kmalloc(sizeof(struct prof_func));
+    if (!func) return NULL;
+    memset(func, 0, sizeof(struct prof_func));
+    func->entry = entry;
+    func->name = symbol_name(&frame);
+    if (!func->name) {
+      kfree(func);
+      return NULL;
+    }
+    func->next = symtab->funcs[h];
+    symtab->funcs[h] = func;
+    func->link = symtab->funclist;
+    symtab->funclist = func;
+    symtab->nfuncs++;
+  }
+
+  addr = (struct prof_addr *) kmalloc(sizeof(struct prof_addr));
+  if (!addr) return NULL;
+  addr->addr = eip;
+  addr->func = func;
+  h = PROF_HASHVAL(eip);
+  addr->next = symtab->addrs[h];
+  symtab->addrs[h] = addr;
+
+  return func;
+}
+
+static void print_percent(struct proc_file *pf, int n, int total) {
+  int permille = total ? (int) ((unsigned __int64) n * 1000 / total) : 0;
+  pprintf(pf, "%4d.%d%%", permille / 10, permille % 10);
+}
+
+//
+// profile_proc
+//
+// Flat profile with one line per function sorted by the number of samples
+// where the function was executing. The total column also counts samples
+// where the function was found further up the call stack.
+//
+
+static int profile_proc(struct proc_file *pf, void *arg) {
+  struct prof_symtab *symtab;
+  struct prof_func **funcs;
+  struct prof_func *func;
+  struct prof_sample *sample;
+  int count, i, j, n;
+
+  count = prof_count;
+  pprintf(pf, "profiling %s, %d Hz, %d samples, %d lost\n\n",
+          prof_enabled ? "on" : "off", prof_rate, count, prof_lost);
+  if (count == 0) return 0;
+
+  symtab = alloc_symtab();
+  if (!symtab) return -ENOMEM;
+
+  for (i = 0; i < count; i++) {
+    sample = &profbuf[i];
+    for (j = 0; j < sample->depth; j++) {
+      func = resolve_symbol(symtab, sample->eip[j]);
+      if (!func) {
+        free_symtab(symtab);
+        return -ENOMEM;
+      }
+      if (j == 0) func->self++;
+      if (func->stamp != i + 1) {
+        func->total++;
+        func->stamp = i + 1;
+      }
+    }
+  }
+
+  funcs = (struct prof_func **) kmalloc(symtab->nfuncs * sizeof(struct prof_func *));
+  if (!funcs) {
+    free_symtab(symtab);
+    return -ENOMEM;
+  }
+
+  n = 0;
+  for (func = symtab->funclist; func; func = func->link) {
+    for (j = n; j > 0 && funcs[j - 1]->self < func->self; j--) funcs[j] = funcs[j - 1];
+    funcs[j] = func;
+    n++;
+  }
+
+  pprintf(pf, "   self   total  samples  function\n");
+  pprintf(pf, "------- ------- -------- ---------------------------------------------\n");
+  for (i = 0; i < n; i++) {
+    func = funcs[i];
+    print_percent(pf, func->self, count);
+    pprintf(pf, " ");
+    print_percent(pf, func->total, count);
+    pprintf(pf, " %8d  %s\n", func->self, func->name);
+  }
+
+  kfree(funcs);
+  free_symtab(symtab);
+  return 0;
+}
+
+//
+// callgraph_proc
+//
+// Call graph profile in folded stack format. Each line holds a call stack,
+// outermost caller first, followed by the number of samples with that stack.
+//
+
+static int callgraph_proc(struct proc_file *pf, void *arg) {
+  struct prof_symtab *symtab;
+  struct prof_stack *stack;
+  struct prof_func *funcs[PROF_DEPTH];
+  struct prof_sample *sample;
+  unsigned long h;
+  int count, i, j, rc;
+
+  count = prof_count;
+  if (count == 0) return 0;
+
+  symtab = alloc_symtab();
+  if (!symtab) return -ENOMEM;
+
+  rc = 0;
+  for (i = 0; i < count && rc == 0; i++) {
+    sample = &profbuf[i];
+    h = 0;
+    for (j = 0; j < sample->depth; j++) {
+      funcs[j] = resolve_symbol(symtab, sample->eip[j]);
+      if (!funcs[j]) {
+        rc = -ENOMEM;
+        break;
+      }
+      h = h * 31 + (unsigned long) funcs[j];
+    }
+    if (rc < 0) break;
+    h = PROF_HASHVAL(h);
+
+    for (stack = symtab->stacks[h]; stack; stack = stack->next) {
+      if (stack->depth == sample->depth && memcmp(stack->funcs, funcs, sample->depth * sizeof(struct prof_func *)) == 0) break;
+    }
+
+    if (!stack) {
+      stack = (struct prof_stack *) kmalloc(sizeof(struct prof_stack));
+      if (!stack) {
+        rc = -ENOMEM;
+        break;
+      }
+      stack->count = 0;
+      stack->depth = sample->depth;
+      memcpy(stack->funcs, funcs, sample->depth * sizeof(struct prof_func *));
+      stack->next = symtab->stacks[h];
+      symtab->stacks[h] = stack;
+    }
+    stack->count++;
+  }
+
+  if (rc == 0) {
+    for (i = 0; i < PROF_HASH; i++) {
+      for (stack = symtab->stacks[i]; stack; stack = stack->next) {
+        for (j = stack->depth - 1; j >= 0; j--) {
+          pprintf(pf, j > 0 ? "%s;" : "%s", stack->funcs[j]->name);
+        }
+        pprintf(pf, " %d\n", stack->count);
+      }
+    }
+  }
+
+  free_symtab(symtab);
+  return rc;
+}
+
+//
+// Profiler device
+//
+
+static int prof_ioctl(struct dev *dev, int cmd, void *args, size_t size) {
+  switch (cmd) {
+    case IOCTL_PROF_START:
+      if (args && size != 4) return -EINVAL;
+      return prof_start(args ? *(int *) args : 0);
+
+    case IOCTL_PROF_STOP:
+      return prof_stop();
+
+    case IOCTL_PROF_RESET:
+      return prof_reset();
+  }
+
+  return -ENOSYS;
+}
+
+static int prof_read(struct dev *dev, void *buffer, size_t count, blkno_t blkno, int flags) {
+  return 0;
+}
+
+static int prof_write(struct dev *dev, void *buffer, size_t count, blkno_t blkno, int flags) {
+  return -EROFS;
+}
+
+struct driver prof_driver = {
+  "prof",
+  DEV_TYPE_STREAM,
+  prof_ioctl,
+  prof_read,
+  prof_write
+};
+
+int __declspec(dllexport) prof(struct unit *unit, char *opts) {
+  dev_make("prof", &prof_driver, NULL, NULL);
+  return 0;
+}
+
+void init_prof() {
+  register_proc_inode("profile", profile_proc, NULL);
+  register_proc_inode("callgraph", callgraph_proc, NULL);
+}
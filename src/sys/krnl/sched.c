@@ -39,6 +39,10 @@
 int preempt = 0;
 int in_dpc = 0;
 unsigned long dpc_time = 0;
+
+int cpu_mode = CPU_MODE_KERNEL;
+unsigned __int64 cpu_mode_time[CPU_MODES];
+static unsigned __int64 cpu_mode_start;
 unsigned long dpc_total = 0;
 unsigned long dpc_lost = 0;
 unsigned long thread_ready_summary = 0;
@@ -332,6 +336,7 @@ void user_thread_start(void *arg) {
   *(--stacktop) = 0;
 
   // Switch to usermode and start excuting thread routine
+  account_cpu_time(CPU_MODE_USER);
   entrypoint = t->entrypoint;
   __asm {
     mov eax, stacktop
@@ -493,6 +498,7 @@ static void destroy_tcb(void *arg) {
 
 int destroy_thread(struct thread *t) {
   struct task *task;
+  struct tms tms;
 
   // We can only remove terminated threads
   if (t->state != THREAD_STATE_TERMINATED) panic("thread terminated in invalid state");
@@ -517,8 +523,9 @@ int destroy_thread(struct thread *t) {
   remove(t);
   
   // Update the accumulated child thread times
-  t->parent->tms.tms_cutime += t->tms.tms_utime + t->tms.tms_cutime;
-  t->parent->tms.tms_cstime += t->tms.tms_stime + t->tms.tms_cstime;
+  get_thread_times(t, &tms);
+  t->parent->tms.tms_cutime += tms.tms_utime + tms.tms_cutime;
+  t->parent->tms.tms_cstime += tms.tms_stime + tms.tms_cstime;
 
   // Remove thread from parent
   if (t->next_sibling) t->next_sibling->prev_sibling = t->prev_sibling;
@@ -658,10 +665,63 @@ int set_thread_priority(struct thread *t, int priority) {
 }
 
 int get_thread_times(struct thread *t, struct tms *tms) {
-  if (tms) memcpy(tms, &t->tms, sizeof(struct tms));
+  if (tms) {
+    memcpy(tms, &t->tms, sizeof(struct tms));
+
+    // Use the cycle counts if available. The tick based times only see
+    // the thread if it happened to be running when the timer fired.
+    if (cpu.features & CPU_FEATURE_TSC) {
+      unsigned __int64 utime, stime;
+      int intrs = eflags() & EFLAG_IF;
+
+      cli();
+      if (t == self()) account_cpu_time(cpu_mode);
+      utime = t->cputime[CPU_MODE_USER];
+      stime = t->cputime[CPU_MODE_KERNEL];
+      if (intrs) sti();
+
+      tms->tms_utime = cycles_to_clocks(utime);
+      tms->tms_stime = cycles_to_clocks(stime);
+    }
+  }
   return clocks;
 }
 
+//
+// account_cpu_time
+//
+// Charges the cycles since the last mode change to the current thread
+// and switches to a new processor mode. Called on all transitions between
+// user mode, kernel mode, DPCs, and interrupt handlers, and before each
+// context switch. Returns the previous mode. Interrupt handlers also
+// update the counters, so interrupts are disabled during the update.
+//
+
+int account_cpu_time(int mode) {
+  struct thread *t;
+  unsigned __int64 now;
+  unsigned __int64 elapsed;
+  int intrs;
+  int prev;
+
+  intrs = eflags() & EFLAG_IF;
+  cli();
+  prev = cpu_mode;
+  if (cpu.features & CPU_FEATURE_TSC) {
+    t = self();
+    now = rdtsc();
+    elapsed = now - cpu_mode_start;
+    t->cputime[prev] += elapsed;
+    cpu_mode_time[prev] += elapsed;
+    cpu_mode_start = now;
+  }
+
+  cpu_mode = mode;
+  if (intrs) sti();
+
+  return prev;
+}
+
 static void task_queue_task(void *tqarg) {
   struct task_queue *tq = tqarg;
   struct task *task;
@@ -787,9 +847,11 @@ void dispatch_dpc_queue() {
   struct dpc *dpc;
   dpcproc_t proc;
   void *arg;
+  int mode;
 
   if (in_dpc) panic("sched: nested execution of dpc queue");
   in_dpc = 1;
+  mode = account_cpu_time(CPU_MODE_DPC);
 
   while (1) {
     // Get next deferred procedure call
@@ -814,6 +876,7 @@ void dispatch_dpc_queue() {
 #endif
   }
 
+  account_cpu_time(mode);
   in_dpc = 0;
 }
 
@@ -867,7 +930,9 @@ void dispatch() {
     t->flags &= ~THREAD_FPU_ENABLED;
   }
 
-  // Switch to new thread
+  // Charge the outgoing thread and switch to new thread
+  account_cpu_time(cpu_mode);
+  TRACE(TRACE_SWITCH, curthread->id, t->id);
   switch_context(t);
 
 #ifdef VMACH
@@ -935,15 +1000,31 @@ void idle_task() {
   }
 }
 
+static char *format_cpu_time(char *buf, unsigned __int64 cycles, clock_t clocks) {
+  unsigned __int64 us;
+
+  if (cpu.features & CPU_FEATURE_TSC) {
+    us = cycles_to_usecs(cycles);
+    sprintf(buf, "%6u.%03d", (unsigned long) (us / 1000), (int) (us % 1000));
+  } else {
+    sprintf(buf, "%10d", clocks);
+  }
+  return buf;
+}
+
 static int threads_proc(struct proc_file *pf, void *arg) {
   static char *threadstatename[] = {"init", "ready", "run", "wait", "term", "susp", "trans"};
   static char *waitreasonname[] = {"wait", "fileio", "taskq", "sockio", "sleep", "pipe", "devio"};
   struct thread *t = threadlist;
   char *state;
   unsigned long stksiz;
+  char utime[16], stime[16], dtime[16], itime[16];
 
-  pprintf(pf, " tid tcb      hndl state  prio s #h   user kernel ctxtsw stksiz name\n");
-  pprintf(pf, "---- -------- ---- ------ ---- - -- ------ ------ ------ ------ --------------\n");
+  // Bring the time of the current thread up to date
+  account_cpu_time(cpu_mode);
+
+  pprintf(pf, " tid tcb      hndl state  prio s #h    user ms  kernel ms     dpc ms     irq ms ctxtsw stksiz name\n");
+  pprintf(pf, "---- -------- ---- ------ ---- - -- ---------- ---------- ---------- ---------- ------ ------ --------------\n");
   while (1) {
     if (t->state == THREAD_STATE_WAITING) {
       state = waitreasonname[t->wait_reason];
@@ -957,10 +1038,14 @@ static int threads_proc(struct proc_file *pf, void *arg) {
       stksiz = 0;
     }
 
-    pprintf(pf,"%4d %p %4d %-6s %2d%+2d %1d %2d%7d%7d%7d%6dK %s\n",
+    pprintf(pf,"%4d %p %4d %-6s %2d%+2d %1d %2d %s %s %s %s%7d%6dK %s\n",
             t->id, t, t->hndl, state, t->base_priority, t->priority - t->base_priority, 
             t->suspend_count, t->object.handle_count, 
-            t->tms.tms_utime, t->tms.tms_stime, t->context_switches,
+            format_cpu_time(utime, t->cputime[CPU_MODE_USER], t->tms.tms_utime),
+            format_cpu_time(stime, t->cputime[CPU_MODE_KERNEL], t->tms.tms_stime),
+            format_cpu_time(dtime, t->cputime[CPU_MODE_DPC], 0),
+            format_cpu_time(itime, t->cputime[CPU_MODE_IRQ], 0),
+            t->context_switches,
             stksiz / 1024,
             t->name);
 
@@ -975,6 +1060,11 @@ static int dpcs_proc(struct proc_file *pf, void *arg) {
   pprintf(pf, "dpc time   : %8d\n", dpc_time);
   pprintf(pf, "total dpcs : %8d\n", dpc_total);
   pprintf(pf, "lost dpcs  : %8d\n", dpc_lost);
+  if (cpu.features & CPU_FEATURE_TSC) {
+    account_cpu_time(cpu_mode);
+    pprintf(pf, "dpc ms     : %8u\n", (unsigned long) (cycles_to_usecs(cpu_mode_time[CPU_MODE_DPC]) / 1000));
+    pprintf(pf, "irq ms     : %8u\n", (unsigned long) (cycles_to_usecs(cpu_mode_time[CPU_MODE_IRQ]) / 1000));
+  }
 
   return 0;
 }
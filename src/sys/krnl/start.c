@@ -337,6 +337,7 @@ void __stdcall start(void *hmod, char *opts, int reserved2) {
   register_proc_inode("kmodmem", kmodmem_proc, NULL);
   register_proc_inode("kheap", kheapstat_proc, NULL);
   register_proc_inode("vmem", vmem_proc, NULL);
+  register_proc_inode("vmmaps", vmmaps_proc, NULL);
 
   register_proc_inode("cpu", cpu_proc, NULL);
 
@@ -351,6 +352,12 @@ void __stdcall start(void *hmod, char *opts, int reserved2) {
   init_sched();
   init_handles();
   init_syscall();
+  init_futex();
+  init_trace();
+  init_prof();
+
+  // Zero free page frames when idle
+  init_zeropool();
 
   // Enable interrupts and calibrate delay
   sti();
@@ -364,6 +371,7 @@ void __stdcall start(void *hmod, char *opts, int reserved2) {
 
 void init_net() {
   stats_init();
+  inet_init();
   netif_init();
   ether_init();
   pbuf_init();
@@ -407,6 +415,7 @@ void main(void *arg) {
   init_hd();
   init_fd();
   init_vblk();
+  init_ahci();
 
   // Initialize file systems
   init_filesystem();
@@ -433,6 +442,14 @@ void main(void *arg) {
   t->curdir[1] = 0;
   peb->pathsep = pathsep;
 
+  // Enable kernel event tracing
+  rc = get_numeric_property(krnlcfg, "kernel", "trace", 0);
+  if (rc) trace_enable(rc);
+
+  // Start sampling profiler
+  rc = get_numeric_property(krnlcfg, "kernel", "profile", 0);
+  if (rc) prof_start(rc);
+
   // Initialize module loader
   init_kernel_modules();
 
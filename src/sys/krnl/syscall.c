@@ -49,9 +49,14 @@ struct syscall_entry {
   int (*func)(char *); 
 };
 
+#define SYSCALL_LATENCY_BUCKETS 24
+
 #ifdef SYSCALL_PROFILE
 static unsigned long sccnt[SYSCALL_MAX  + 1];
 static unsigned long scerr[SYSCALL_MAX  + 1];
+static unsigned __int64 sctime[SYSCALL_MAX  + 1];
+static unsigned __int64 scmax[SYSCALL_MAX  + 1];
+static unsigned long sclat[SYSCALL_MAX  + 1][SYSCALL_LATENCY_BUCKETS];
 #endif
 
 static __inline int lock_buffer(void *buffer, int size, int modify) {
@@ -95,6 +100,25 @@ static __inline int lock_iovec(struct iovec *iov, int count, int modify) {
 static __inline void unlock_iovec(struct iovec *iov, int count) {
 }
 
+static __inline int lock_mmsg(struct mmsghdr *msgvec, unsigned int vlen, int modify) {
+#ifdef SYSCALL_CHECKBUFFER
+  unsigned int i;
+  struct msghdr *msg;
+
+  if (!mem_access(msgvec, vlen * sizeof(struct mmsghdr), PT_USER_WRITE)) return -EFAULT;
+  for (i = 0; i < vlen; i++) {
+    msg = &msgvec[i].msg_hdr;
+    if (check_iovec(msg->msg_iov, msg->msg_iovlen, modify) < 0) return -EFAULT;
+    if (lock_buffer(msg->msg_name, msg->msg_namelen, modify) < 0) return -EFAULT;
+  }
+#endif
+
+  return 0;
+}
+
+static __inline void unlock_mmsg(struct mmsghdr *msgvec, unsigned int vlen) {
+}
+
 static __inline int lock_fdset(fd_set *fds, int modify) {
 #ifdef SYSCALL_CHECKBUFFER
   if (fds) {
@@ -1388,6 +1412,38 @@ static int sys_semrel(char *params) {
   return rc;
 }
 
+static int sys_futex_wait(char *params) {
+  int *addr;
+  int value;
+  unsigned int timeout;
+  int rc;
+
+  addr = *(int **) params;
+  value = *(int *) (params + 4);
+  timeout = *(unsigned int *) (params + 8);
+
+  if ((unsigned long) addr & 3) return -EINVAL;
+  if (lock_buffer(addr, sizeof(int), 0) < 0) return -EFAULT;
+
+  rc = futex_wait(addr, value, timeout);
+
+  unlock_buffer(addr, sizeof(int));
+  return rc;
+}
+
+static int sys_futex_wake(char *params) {
+  int *addr;
+  int count;
+
+  addr = *(int **) params;
+  count = *(int *) (params + 4);
+
+  if ((unsigned long) addr & 3) return -EINVAL;
+  if (count < 0) return -EINVAL;
+
+  return futex_wake(addr, count);
+}
+
 static int sys_accept(char *params) {
   handle_t h;
   struct socket *s;
@@ -1956,6 +2012,24 @@ static int sys_dispatch(char *params) {
   return rc;
 }
 
+static int sys_iopost(char *params) {
+  handle_t ioh;
+  int context;
+  struct iomux *iomux;
+  int rc;
+
+  ioh = *(handle_t *) params;
+  context = *(int *) (params + 4);
+
+  iomux = (struct iomux *) olock(ioh, OBJECT_IOMUX);
+  if (!iomux) return -EBADF;
+
+  rc = post_iomux(iomux, context);
+
+  orel(iomux);
+  return rc;
+}
+
 static int sys_recvmsg(char *params) {
   handle_t h;
   struct msghdr *msg;
@@ -2038,6 +2112,68 @@ static int sys_sendmsg(char *params) {
   return rc;
 }
 
+static int sys_recvmmsg(char *params) {
+  handle_t h;
+  struct mmsghdr *msgvec;
+  unsigned int vlen;
+  unsigned int flags;
+  struct socket *s;
+  int rc;
+
+  h = *(handle_t *) params;
+  msgvec = *(struct mmsghdr **) (params + 4);
+  vlen = *(unsigned int *) (params + 8);
+  flags = *(unsigned int *) (params + 12);
+
+  if (vlen > SOCK_MAXMMSG) vlen = SOCK_MAXMMSG;
+
+  s = (struct socket *) olock(h, OBJECT_SOCKET);
+  if (!s) return -EBADF;
+
+  if (lock_mmsg(msgvec, vlen, 1) < 0) {
+    orel(s);
+    return -EFAULT;
+  }
+
+  rc = recvmmsg(s, msgvec, vlen, flags);
+
+  unlock_mmsg(msgvec, vlen);
+  orel(s);
+
+  return rc;
+}
+
+static int sys_sendmmsg(char *params) {
+  handle_t h;
+  struct mmsghdr *msgvec;
+  unsigned int vlen;
+  unsigned int flags;
+  struct socket *s;
+  int rc;
+
+  h = *(handle_t *) params;
+  msgvec = *(struct mmsghdr **) (params + 4);
+  vlen = *(unsigned int *) (params + 8);
+  flags = *(unsigned int *) (params + 12);
+
+  if (vlen > SOCK_MAXMMSG) vlen = SOCK_MAXMMSG;
+
+  s = (struct socket *) olock(h, OBJECT_SOCKET);
+  if (!s) return -EBADF;
+
+  if (lock_mmsg(msgvec, vlen, 0) < 0) {
+    orel(s);
+    return -EFAULT;
+  }
+
+  rc = sendmmsg(s, msgvec, vlen, flags);
+
+  unlock_mmsg(msgvec, vlen);
+  orel(s);
+
+  return rc;
+}
+
 static int sys_select(char *params) {
   int nfds;
   fd_set *readfds;
@@ -2113,6 +2249,37 @@ static int sys_pipe(char *params) {
   return rc;
 }
 
+static int sys_splice(char *params) {
+  handle_t hin;
+  handle_t hout;
+  size_t size;
+  int flags;
+  struct object *in;
+  struct object *out;
+  int rc;
+
+  hin = *(handle_t *) params;
+  hout = *(handle_t *) (params + 4);
+  size = *(size_t *) (params + 8);
+  flags = *(int *) (params + 12);
+
+  in = olock(hin, OBJECT_ANY);
+  if (!in) return -EBADF;
+
+  out = olock(hout, OBJECT_ANY);
+  if (!out) {
+    orel(in);
+    return -EBADF;
+  }
+
+  rc = splice(in, out, size, flags);
+
+  orel(out);
+  orel(in);
+
+  return rc;
+}
+
 static int sys_setmode(char *params) {
   handle_t h;
   struct file *f;
@@ -2666,18 +2833,44 @@ struct syscall_entry syscalltab[] = {
   {"vmmap", 24, "%p,%d,%x,%d,%d-%d", sys_vmmap},
   {"vmsync", 8, "%p,%d", sys_vmsync},
   {"threadtimes", 8, "%d,%p", sys_threadtimes},
+  {"recvmmsg", 16, "%d,%p,%d,%d", sys_recvmmsg},
+  {"sendmmsg", 16, "%d,%p,%d,%d", sys_sendmmsg},
+  {"futex_wait", 12, "%p,%d,%d", sys_futex_wait},
+  {"futex_wake", 8, "%p,%d", sys_futex_wake},
+  {"splice", 16, "%d,%d,%d,%x", sys_splice},
+  {"iopost", 8, "%d,%d", sys_iopost},
 };
 
+#ifdef SYSCALL_PROFILE
+static void syscall_latency(int syscallno, unsigned __int64 start) {
+  unsigned __int64 elapsed = rdtsc() - start;
+  unsigned long us = (unsigned long) cycles_to_usecs(elapsed);
+  int bucket;
+
+  // Bucket 0 is below 1 us, bucket n holds latencies in [2^(n-1), 2^n) us
+  bucket = us ? find_highest_bit(us) + 1 : 0;
+  if (bucket >= SYSCALL_LATENCY_BUCKETS) bucket = SYSCALL_LATENCY_BUCKETS - 1;
+  sclat[syscallno][bucket]++;
+
+  sctime[syscallno] += elapsed;
+  if (elapsed > scmax[syscallno]) scmax[syscallno] = elapsed;
+}
+#endif
+
 int syscall(int syscallno, char *params, struct context *ctxt) {
   int rc;
   struct thread *t = self();
+#ifdef SYSCALL_PROFILE
+  unsigned __int64 start;
+#endif
 
   t->ctxt = ctxt;
   if (syscallno < 0 || syscallno > SYSCALL_MAX) return -ENOSYS;
+  account_cpu_time(CPU_MODE_KERNEL);
 
 #ifdef SYSCALL_LOGENTER
 #ifndef SYSCALL_LOGWAIT
-  if (syscallno != SYSCALL_WAITONE && syscallno != SYSCALL_WAITALL && syscallno != SYSCALL_WAITANY)
+  if (syscallno != SYSCALL_WAITONE && syscallno != SYSCALL_WAITALL && syscallno != SYSCALL_WAITANY && syscallno != SYSCALL_FUTEX_WAIT)
 #endif
   {
     char buf[1024];
@@ -2693,14 +2886,23 @@ int syscall(int syscallno, char *params, struct context *ctxt) {
 
 #ifdef SYSCALL_PROFILE
   sccnt[syscallno]++;
+  if (cpu.features & CPU_FEATURE_TSC) start = rdtsc();
 #endif
 
+  TRACE(TRACE_SYSCALL_ENTER, syscallno, 0);
+
   rc = lock_buffer(params, syscalltab[syscallno].paramsize, 0);
   if (rc >= 0) {
     rc = syscalltab[syscallno].func(params);
     unlock_buffer(params, syscalltab[syscallno].paramsize);
   }
 
+  TRACE(TRACE_SYSCALL_EXIT, syscallno, rc);
+
+#ifdef SYSCALL_PROFILE
+  if (cpu.features & CPU_FEATURE_TSC) syscall_latency(syscallno, start);
+#endif
+
   if (rc < 0) {
     struct tib *tib = t->tib;
     if (tib) tib->errnum = -rc;
@@ -2746,6 +2948,7 @@ int syscall(int syscallno, char *params, struct context *ctxt) {
   if (signals_ready(t)) deliver_pending_signals(rc);
 
   t->ctxt = NULL;
+  account_cpu_time(CPU_MODE_USER);
 
   if (rc < 0) return -1;
   return rc;
@@ -2754,12 +2957,35 @@ int syscall(int syscallno, char *params, struct context *ctxt) {
 #ifdef SYSCALL_PROFILE
 static int syscalls_proc(struct proc_file *pf, void *arg) {
   int i = 0;
+  int j;
+  char range[32];
 
-  pprintf(pf, "syscall               calls     errors\n");
-  pprintf(pf, "---------------- ---------- ----------\n");
+  pprintf(pf, "syscall               calls     errors     avg us     max us\n");
+  pprintf(pf, "---------------- ---------- ---------- ---------- ----------\n");
   for (i = 0; i < SYSCALL_MAX  + 1; i++) {
     if (sccnt[i] != 0) {
-      pprintf(pf, "%-16s %10d %10d\n", syscalltab[i].name, sccnt[i], scerr[i]);
+      pprintf(pf, "%-16s %10d %10d %10u %10u\n", syscalltab[i].name, sccnt[i], scerr[i], 
+              (unsigned long) cycles_to_usecs(sctime[i] / sccnt[i]), (unsigned long) cycles_to_usecs(scmax[i]));
+    }
+  }
+
+  if (!(cpu.features & CPU_FEATURE_TSC)) return 0;
+
+  // Latency histograms in power-of-two microsecond buckets
+  pprintf(pf, "\nsyscall          latency us     calls\n");
+  pprintf(pf, "---------------- ------------- ----------\n");
+  for (i = 0; i < SYSCALL_MAX  + 1; i++) {
+    if (sccnt[i] == 0) continue;
+    for (j = 0; j < SYSCALL_LATENCY_BUCKETS; j++) {
+      if (sclat[i][j] == 0) continue;
+      if (j == 0) {
+        strcpy(range, "0");
+      } else if (j == SYSCALL_LATENCY_BUCKETS - 1) {
+        sprintf(range, "%u-", 1 << (j - 1));
+      } else {
+        sprintf(range, "%u-%u", 1 << (j - 1), (1 << j) - 1);
+      }
+      pprintf(pf, "%-16s %13s %10u\n", syscalltab[i].name, range, sclat[i][j]);
     }
   }
 
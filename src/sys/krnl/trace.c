@@ -0,0 +1,132 @@
+//
+// trace.c
+//
+// Kernel event tracing
+//
+// Copyright (C) 2013 Michael Ringgaard. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 
+// 1. Redistributions of source code must retain the above copyright 
+//    notice, this list of conditions and the following disclaimer.  
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.  
+// 3. Neither the name of the project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission. 
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+// 
+
+
+#include <os/krnl.h>
+#include <atomic.h>
+
+unsigned long trace_mask = 0;
+
+static struct trace_record *tracebuf;
+static unsigned long trace_head;
+
+//
+// trace
+//
+// Appends a record to the trace ring buffer. A slot is reserved with a
+// single xadd on the head index, so tracepoints need no locks and can be
+// hit from interrupt handlers and DPCs. Old records are overwritten when
+// the ring wraps.
+//
+
+void trace(int event, unsigned long arg1, unsigned long arg2) {
+  struct trace_record *rec;
+  unsigned long slot;
+
+  if (!tracebuf) return;
+  slot = atomic_add((int *) &trace_head, 1) - 1;
+  rec = &tracebuf[slot & (TRACE_RECORDS - 1)];
+
+  rec->tsc = rdtsc();
+  rec->event = (unsigned short) event;
+  rec->cpu = 0;
+  rec->tid = self()->id;
+  rec->arg1 = arg1;
+  rec->arg2 = arg2;
+}
+
+//
+// trace_enable
+//
+// Sets the mask of enabled trace events.
+// The trace buffer is allocated the first time tracing is enabled.
+//
+
+int trace_enable(unsigned long mask) {
+  if (mask && !tracebuf) {
+    if (!(cpu.features & CPU_FEATURE_TSC)) return -ENOSYS;
+    tracebuf = (struct trace_record *) kmalloc_tag(TRACE_RECORDS * sizeof(struct trace_record), 'TRCE');
+    if (!tracebuf) return -ENOMEM;
+    memset(tracebuf, 0, TRACE_RECORDS * sizeof(struct trace_record));
+  }
+
+  trace_mask = mask;
+  return 0;
+}
+
+//
+// trace_proc
+//
+// Returns a binary snapshot of the trace buffer, oldest record first.
+// The ring is copied without stopping the writers; records that may
+// have been overwritten while copying are dropped from the snapshot.
+//
+
+static int trace_proc(struct proc_file *pf, void *arg) {
+  struct trace_header hdr;
+  struct trace_record *snapshot;
+  unsigned long start, end, head, n, i;
+
+  memset(&hdr, 0, sizeof(struct trace_header));
+  hdr.magic = TRACE_MAGIC;
+  hdr.version = TRACE_VERSION;
+  hdr.cpu_mhz = cpu.mhz;
+  hdr.mask = trace_mask;
+  if (!tracebuf) return proc_write(pf, &hdr, sizeof(struct trace_header));
+
+  snapshot = (struct trace_record *) kmalloc_tag(TRACE_RECORDS * sizeof(struct trace_record), 'TRCE');
+  if (!snapshot) return -ENOMEM;
+
+  end = trace_head;
+  memcpy(snapshot, tracebuf, TRACE_RECORDS * sizeof(struct trace_record));
+  head = trace_head;
+
+  start = head > TRACE_RECORDS ? head - TRACE_RECORDS : 0;
+  if (end < start) end = start;
+  hdr.records = end - start;
+  hdr.lost = start;
+  proc_write(pf, &hdr, sizeof(struct trace_header));
+
+  for (i = start; i < end; i += n) {
+    n = TRACE_RECORDS - (i & (TRACE_RECORDS - 1));
+    if (n > end - i) n = end - i;
+    proc_write(pf, &snapshot[i & (TRACE_RECORDS - 1)], n * sizeof(struct trace_record));
+  }
+
+  kfree(snapshot);
+  return 0;
+}
+
+void init_trace() {
+  register_proc_inode("trace", trace_proc, NULL);
+}
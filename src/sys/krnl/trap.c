@@ -726,10 +726,17 @@ static int pagefault_handler(struct context *ctxt, void *arg) {
           sti();
           if (fetch_page(pageaddr) == 0) signal = 0;
         }
+      } else if (flags & PT_DEMAND) {
+        if (demand_page(pageaddr) == 0) signal = 0;
       }
     }
     if (signal != 0) send_signal(ctxt, signal, addr);
   } else {
+    // The kernel can touch demand-zero pages in user space directly
+    if (USERSPACE(pageaddr) && page_directory_mapped(pageaddr) && (get_page_flags(pageaddr) & PT_DEMAND)) {
+      if (demand_page(pageaddr) == 0) return 0;
+    }
+
     kprintf(KERN_CRIT "trap: page fault in kernel mode\n");
     dbg_enter(ctxt, addr);
   }
@@ -889,6 +896,7 @@ static void trap(unsigned long args) {
   struct thread *t = self();
   struct context *prevctxt;
   struct interrupt *intr;
+  int mode;
   int rc;
 
   // Save context
@@ -897,6 +905,13 @@ static void trap(unsigned long args) {
 
   // Statistics
   intrcount[ctxt->traptype]++;
+  if (ctxt->traptype >= IRQBASE && ctxt->traptype < IRQBASE + 16) {
+    mode = account_cpu_time(CPU_MODE_IRQ);
+  } else if (usermode(ctxt)) {
+    mode = account_cpu_time(CPU_MODE_KERNEL);
+  } else {
+    mode = cpu_mode;
+  }
 
   // Call interrupt handlers
   intr = intrhndlr[ctxt->traptype];
@@ -909,10 +924,12 @@ static void trap(unsigned long args) {
   // If we interrupted a user mode context, dispatch DPCs,
   // check for quantum expiry, and deliver signals.
   if (usermode(ctxt)) {
+    account_cpu_time(CPU_MODE_KERNEL);
     check_dpc_queue();
     check_preempt();
     if (signals_ready(t)) deliver_pending_signals(0);
   }
+  if (cpu_mode != mode) account_cpu_time(mode);
 
   // Restore context
   t->ctxt = prevctxt;
@@ -33,17 +33,23 @@
 
 #include <os/krnl.h>
 
-#define VMAP_ENTRIES 1024
 #define VMEM_START (64 * 1024)
 
-struct rmap *vmap;
+#define DEMAND_TAGS 64
+
+struct vmspace vmspace;
+
+// Demand-zero pages keep an index into this table in the page frame
+// number field of the page table entry until they are allocated
+static unsigned long demand_tags[DEMAND_TAGS];
+static int num_demand_tags;
 
 static int valid_range(void *addr, int size) {
   int pages = PAGES(size);
 
   if ((unsigned long) addr < VMEM_START) return 0;
   if (KERNELSPACE((unsigned long) addr + pages * PAGESIZE)) return 0;
-  if (rmap_status(vmap, BTOP(addr), pages) != 1) return 0;
+  if (vmspace_status(&vmspace, BTOP(addr), pages) != 1) return 0;
   return 1;
 }
 
@@ -74,6 +80,78 @@ static unsigned long pte_flags_from_protect(int protect) {
   return 0xFFFFFFFF;
 }
 
+static unsigned long demand_tag_index(unsigned long tag) {
+  int i;
+
+  for (i = 0; i < num_demand_tags; i++) {
+    if (demand_tags[i] == tag) return i;
+  }
+  if (num_demand_tags == DEMAND_TAGS) return 0;
+  demand_tags[num_demand_tags] = tag;
+  return num_demand_tags++;
+}
+
+static int demand_mapped(void *vaddr) {
+  if (!page_directory_mapped(vaddr)) return 0;
+  return (get_page_flags(vaddr) & (PT_DEMAND | PT_PRESENT)) == PT_DEMAND;
+}
+
+static int alloc_zeroed_page(void *vaddr, unsigned long flags, unsigned long tag) {
+  unsigned long pfn;
+  int zeroed;
+
+  pfn = alloc_zeroed_pageframe(tag, &zeroed);
+  if (pfn == 0xFFFFFFFF) return -ENOMEM;
+
+  if (zeroed) {
+    map_page(vaddr, pfn, flags | PT_PRESENT);
+  } else {
+    map_page(vaddr, pfn, PT_WRITABLE | PT_PRESENT);
+    memset(vaddr, 0, PAGESIZE);
+    set_page_flags(vaddr, flags | PT_PRESENT);
+  }
+
+  return 0;
+}
+
+static int alloc_large_page(void *vaddr, unsigned long flags, unsigned long tag) {
+  unsigned long pfn;
+
+  pfn = alloc_aligned_pageframes(PTES_PER_PAGE, PTES_PER_PAGE, tag);
+  if (pfn == 0xFFFFFFFF) return -ENOMEM;
+
+  map_large_page(vaddr, pfn, PT_WRITABLE | PT_PRESENT);
+  memset(vaddr, 0, LARGEPAGESIZE);
+  set_page_flags(vaddr, flags | PT_PRESENT);
+
+  return 0;
+}
+
+static void free_large_page(void *vaddr) {
+  unsigned long pfn = virt2pfn(vaddr);
+  int i;
+
+  unmap_large_page(vaddr);
+  for (i = 0; i < PTES_PER_PAGE; i++) free_pageframe(pfn + i);
+}
+
+static int splits_large_page(void *vaddr) {
+  if (((unsigned long) vaddr & (LARGEPAGESIZE - 1)) == 0) return 0;
+  return page_large(vaddr);
+}
+
+static int round_large_pages(void *addr, int pages) {
+  unsigned long end = (unsigned long) addr + PTOB(pages);
+
+  // Extend range to the end of a large page it ends in
+  if (splits_large_page((void *) end)) {
+    end = (end + LARGEPAGESIZE - 1) & ~(LARGEPAGESIZE - 1);
+    pages = BTOP(end - (unsigned long) addr);
+  }
+
+  return pages;
+}
+
 static int free_filemap(struct filemap *fm) {
   int rc;
 
@@ -81,7 +159,7 @@ static int free_filemap(struct filemap *fm) {
   rc = hfree(fm->file);
   if (rc < 0) return rc;
   
-  rmap_free(vmap, BTOP(fm->addr), PAGES(fm->size));
+  vmspace_free(&vmspace, BTOP(fm->addr), PAGES(fm->size));
 
   hunprotect(fm->self);
   rc = hfree(fm->self);
@@ -145,9 +223,8 @@ static int save_file_page(struct filemap *fm, void *addr) {
 }
 
 void init_vmm() {
-  vmap = (struct rmap *) kmalloc(VMAP_ENTRIES * sizeof(struct rmap));
-  rmap_init(vmap, VMAP_ENTRIES);
-  rmap_free(vmap, BTOP(VMEM_START), BTOP(OSBASE - VMEM_START));
+  if (vmspace_init(&vmspace, BTOP(VMEM_START), BTOP(OSBASE - VMEM_START)) < 0) panic("unable to initialize virtual memory");
+  demand_tags[num_demand_tags++] = 'VM';
 }
 
 void *vmalloc(void *addr, unsigned long size, int type, int protect, unsigned long tag, int *rc) {
@@ -168,24 +245,39 @@ void *vmalloc(void *addr, unsigned long size, int type, int protect, unsigned lo
   if (!addr && (type & MEM_COMMIT) != 0) type |= MEM_RESERVE;
   if (!tag) tag = 'VM';
 
+  // Large pages are reserved and committed in one go, in whole 4MB
+  // pages, and cannot be used for guard or no-access pages
+  if (type & MEM_LARGE_PAGES) {
+    if ((type & (MEM_RESERVE | MEM_COMMIT)) != (MEM_RESERVE | MEM_COMMIT) ||
+        (flags & (PT_USER | PT_GUARD)) != PT_USER ||
+        ((unsigned long) addr & (LARGEPAGESIZE - 1)) != 0) {
+      if (rc) *rc = -EINVAL;
+      return NULL;
+    }
+    pages = (pages + PTES_PER_PAGE - 1) & ~(PTES_PER_PAGE - 1);
+  }
+
   if (type & MEM_RESERVE) {
+    struct vmregion *region;
+
     if (addr == NULL) {
-      if (type & MEM_ALIGN64K) {
-        addr = (void *) PTOB(rmap_alloc_align(vmap, pages, 64 * 1024 / PAGESIZE));
-      } else {
-        addr = (void *) PTOB(rmap_alloc(vmap, pages));
-      }
+      unsigned long align = 1;
 
-      if (addr == NULL) {
-        if (rc) *rc = -ENOMEM;
-        return NULL;
+      if (type & MEM_LARGE_PAGES) {
+        align = PTES_PER_PAGE;
+      } else if (type & MEM_ALIGN64K) {
+        align = 64 * 1024 / PAGESIZE;
       }
+      region = vmspace_alloc(&vmspace, pages, align, tag, protect);
     } else {
-      if (rmap_reserve(vmap, BTOP(addr), pages)) {
-        if (rc) *rc = -ENOMEM;
-        return NULL;
-      }
+      region = vmspace_reserve(&vmspace, BTOP(addr), pages, tag, protect);
+    }
+
+    if (!region) {
+      if (rc) *rc = -ENOMEM;
+      return NULL;
     }
+    addr = (void *) PTOB(region->start);
   } else {
     if (!valid_range(addr, size)) {
       if (rc) *rc = -EFAULT;
@@ -195,21 +287,32 @@ void *vmalloc(void *addr, unsigned long size, int type, int protect, unsigned lo
 
   if (type & MEM_COMMIT) {
     char *vaddr;
-    unsigned long pfn;
+    unsigned long tagidx = demand_tag_index(tag);
+    int err;
 
+    // Accessible pages are allocated and zeroed on first access. Large
+    // pages are allocated at once, falling back to small pages when
+    // there is no free aligned 4MB run of page frames.
     vaddr = (char *) addr;
     for (i = 0; i < pages; i++) {
+      if ((type & MEM_LARGE_PAGES) && large_pages && PTEIDX(vaddr) == 0 && i + PTES_PER_PAGE <= pages) {
+        if (alloc_large_page(vaddr, flags, tag) == 0) {
+          vaddr += LARGEPAGESIZE;
+          i += PTES_PER_PAGE - 1;
+          continue;
+        }
+      }
+
       if (page_mapped(vaddr)) {
         set_page_flags(vaddr, flags | PT_PRESENT);
+      } else if (flags & PT_USER) {
+        map_page(vaddr, tagidx, flags | PT_DEMAND);
       } else {
-        pfn = alloc_pageframe(tag);
-        if (pfn == 0xFFFFFFFF) {
-          if (rc) *rc = -ENOMEM;
+        err = alloc_zeroed_page(vaddr, flags, tag);
+        if (err < 0) {
+          if (rc) *rc = err;
           return NULL;
         }
-
-        map_page(vaddr, pfn, flags | PT_PRESENT);
-        memset(vaddr, 0, PAGESIZE);
       }
       vaddr += PAGESIZE;
     }
@@ -221,6 +324,7 @@ void *vmalloc(void *addr, unsigned long size, int type, int protect, unsigned lo
 void *vmmap(void *addr, unsigned long size, int protect, struct file *filp, off64_t offset, int *rc) {
   int pages = PAGES(size);
   unsigned long flags = pte_flags_from_protect(protect);
+  struct vmregion *region;
   struct filemap *fm;
   int i;
   char *vaddr;
@@ -232,21 +336,19 @@ void *vmmap(void *addr, unsigned long size, int protect, struct file *filp, off6
   }
   addr = (void *) PAGEADDR(addr);
   if (addr == NULL) {
-    addr = (void *) PTOB(rmap_alloc(vmap, pages));
-    if (addr == NULL) {
-      if (rc) *rc = -ENOMEM;
-      return NULL;
-    }
+    region = vmspace_alloc(&vmspace, pages, 1, 'FMAP', protect);
   } else {
-    if (rmap_reserve(vmap, BTOP(addr), pages)) {
-      if (rc) *rc = -ENOMEM;
-      return NULL;
-    }
+    region = vmspace_reserve(&vmspace, BTOP(addr), pages, 'FMAP', protect);
   }
+  if (!region) {
+    if (rc) *rc = -ENOMEM;
+    return NULL;
+  }
+  addr = (void *) PTOB(region->start);
 
   fm = (struct filemap *) kmalloc(sizeof(struct filemap));
   if (!fm) {
-    rmap_free(vmap, BTOP(addr), pages);
+    vmspace_free(&vmspace, BTOP(addr), pages);
     if (rc) *rc = -ENOMEM;
     return NULL;
   }
@@ -265,6 +367,7 @@ void *vmmap(void *addr, unsigned long size, int protect, struct file *filp, off6
   fm->addr = addr;
   fm->size = size;
   fm->protect = flags | PT_FILE;
+  region->filemap = fm;
 
   vaddr = (char *) addr;
   flags = (flags & ~PT_USER) | PT_FILE;
@@ -328,9 +431,21 @@ int vmfree(void *addr, unsigned long size, int type) {
   addr = (void *) PAGEADDR(addr);
   if (!valid_range(addr, size)) return -EINVAL;
 
+  // Large pages can only be freed as a whole
+  if (splits_large_page(addr)) return -EINVAL;
+  pages = round_large_pages(addr, pages);
+
   if (type & (MEM_DECOMMIT | MEM_RELEASE)) {
+
     vaddr = (char *) addr;
     for (i = 0; i < pages; i++) {
+      if (page_large(vaddr)) {
+        free_large_page(vaddr);
+        vaddr += LARGEPAGESIZE;
+        i += PTES_PER_PAGE - 1;
+        continue;
+      }
+
       if (page_directory_mapped(vaddr)) {
         pte_t flags = get_page_flags(vaddr);
         unsigned long pfn = BTOP(virt2phys(vaddr));
@@ -357,6 +472,8 @@ int vmfree(void *addr, unsigned long size, int type) {
         } else  if (flags & PT_PRESENT) {
           unmap_page(vaddr);
           free_pageframe(pfn);
+        } else if (flags & PT_DEMAND) {
+          unmap_page(vaddr);
         }
       }
 
@@ -372,7 +489,7 @@ int vmfree(void *addr, unsigned long size, int type) {
     }
     if (rc < 0) return rc;
   } else if (type & MEM_RELEASE) {
-    rmap_free(vmap, BTOP(addr), pages);
+    vmspace_free(&vmspace, BTOP(addr), pages);
   }
 
   return 0;
@@ -393,10 +510,31 @@ int vmprotect(void *addr, unsigned long size, int protect) {
   if (!valid_range(addr, size)) return -EINVAL;
   flags = pte_flags_from_protect(protect);
   if (flags == 0xFFFFFFFF) return -EINVAL;
+  if (splits_large_page(addr)) return -EINVAL;
+  pages = round_large_pages(addr, pages);
+
+  // Large pages cannot be guard pages
+  if (flags & PT_GUARD) {
+    for (vaddr = (char *) addr; vaddr < (char *) addr + PTOB(pages); vaddr += PAGESIZE) {
+      if (page_large(vaddr)) return -EINVAL;
+    }
+  }
 
   vaddr = (char *) addr;
   for (i = 0; i < pages; i++) {
-    if (page_mapped(vaddr)) {
+    if (page_large(vaddr)) {
+      set_page_flags(vaddr, (get_page_flags(vaddr) & ~(PT_PROTECTMASK | PT_LARGE)) | flags);
+      vaddr += LARGEPAGESIZE;
+      i += PTES_PER_PAGE - 1;
+      continue;
+    }
+
+    if (demand_mapped(vaddr) && !(flags & PT_USER)) {
+      // Guard and no-access pages are not demand-zero
+      int rc = demand_page(vaddr);
+      if (rc < 0) return rc;
+    }
+    if (page_mapped(vaddr) || demand_mapped(vaddr)) {
       set_page_flags(vaddr, (get_page_flags(vaddr) & ~PT_PROTECTMASK) | flags);
     }
     vaddr += PAGESIZE;
@@ -418,9 +556,11 @@ void *miomap(unsigned long addr, int size, int protect) {
   int i;
   unsigned long flags = pte_flags_from_protect(protect);
   int pages = PAGES(size);
+  struct vmregion *region;
 
-  vaddr = (char *) PTOB(rmap_alloc(vmap, pages));
-  if (vaddr == NULL) return NULL;
+  region = vmspace_alloc(&vmspace, pages, 1, 'MIO', protect);
+  if (!region) return NULL;
+  vaddr = (char *) PTOB(region->start);
   
   for (i = 0; i < pages; i++) {
     map_page(vaddr + PTOB(i), BTOP(addr) + i, flags | PT_PRESENT);
@@ -434,28 +574,37 @@ void miounmap(void *addr, int size) {
   int pages = PAGES(size);
 
   for (i = 0; i < pages; i++) unmap_page((char *) addr + PTOB(i));
-  rmap_free(vmap, BTOP(addr), pages);
+  vmspace_free(&vmspace, BTOP(addr), pages);
 }
 
 int guard_page_handler(void *addr) {
-  unsigned long pfn;
   struct thread *t = self();
+  int rc;
 
   if (!t->tib) return -EFAULT;
   
   if (addr < t->tib->stacklimit || addr >= t->tib->stacktop) return -EFAULT;
   if (t->tib->stacklimit <= t->tib->stackbase) return -EFAULT;
 
-  pfn = alloc_pageframe('STK');
-  if (pfn == 0xFFFFFFFF) return -ENOMEM;
-
+  rc = alloc_zeroed_page((char *) t->tib->stacklimit - PAGESIZE, PT_GUARD | PT_WRITABLE, 'STK');
+  if (rc < 0) return rc;
   t->tib->stacklimit = (char *) t->tib->stacklimit - PAGESIZE;
-  map_page(t->tib->stacklimit, pfn, PT_GUARD | PT_WRITABLE | PT_PRESENT);
-  memset(t->tib->stacklimit, 0, PAGESIZE);
 
   return 0;
 }
 
+int demand_page(void *addr) {
+  unsigned long flags;
+  unsigned long tag;
+
+  addr = (void *) PAGEADDR(addr);
+  if (!demand_mapped(addr)) return -EFAULT;
+
+  flags = get_page_flags(addr) & ~PT_DEMAND;
+  tag = demand_tags[virt2pfn(addr)];
+  return alloc_zeroed_page(addr, flags, tag);
+}
+
 int fetch_page(void *addr) {
   struct filemap *fm;
   int rc;
@@ -486,21 +635,91 @@ int fetch_page(void *addr) {
 }
 
 int vmem_proc(struct proc_file *pf, void *arg) {
-  return list_memmap(pf, vmap, BTOP(VMEM_START));
+  struct vmregion *r;
+  struct vmregion *next;
+  unsigned long start;
+  unsigned long total = 0;
+  struct pdirstat stat;
+
+  pprintf(pf, "   start      end      size committed  readonly       gap\n");
+  pprintf(pf, "-------- -------- --------- --------- --------- ---------\n");
+
+  r = vmspace_first(&vmspace);
+  while (r) {
+    if (r->state == VMREGION_FREE) {
+      r = vmspace_next(r);
+      continue;
+    }
+
+    // Adjacent reserved regions are listed as one range
+    start = r->start;
+    while ((next = vmspace_next(r)) != NULL && next->state != VMREGION_FREE) r = next;
+
+    pdir_stat((void *) PTOB(start), PTOB(r->start + r->pages - start), &stat);
+    pprintf(pf, "%08X %08X %8dK %8dK %8dK %8dK\n", 
+            PTOB(start), 
+            PTOB(r->start + r->pages) - 1, 
+            (r->start + r->pages - start) * (PAGESIZE / 1024), 
+            stat.present * (PAGESIZE / 1024), 
+            stat.readonly * (PAGESIZE / 1024), 
+            next ? next->pages * (PAGESIZE / 1024) : 0);
+
+    total += r->start + r->pages - start;
+    r = next;
+  }
+  pprintf(pf, "Total: %dK\n", total * PAGESIZE / 1024);
+  return 0;
 }
 
-int mem_sysinfo(struct meminfo *info) {
-  struct rmap *r;
-  struct rmap *rlim;
-  unsigned int free = 0;
+static char *protect_name(int protect) {
+  switch (protect & ~PAGE_GUARD) {
+    case PAGE_NOACCESS: return "---";
+    case PAGE_READONLY: return "r--";
+    case PAGE_READWRITE: return "rw-";
+    case PAGE_EXECUTE: return "--x";
+    case PAGE_EXECUTE_READ: return "r-x";
+    case PAGE_EXECUTE_READWRITE: return "rwx";
+  }
+  return "???";
+}
 
-  rlim = &vmap[vmap->offset];
-  for (r = &vmap[1]; r <= rlim; r++) free += r->size;
+int vmmaps_proc(struct proc_file *pf, void *arg) {
+  struct vmregion *r;
+  struct pdirstat stat;
+  struct file *filp;
+  char tagname[5];
+
+  pprintf(pf, "   start      end      size committed tag  prot file\n");
+  pprintf(pf, "-------- -------- --------- --------- ---- ---- --------------------\n");
+
+  for (r = vmspace_first(&vmspace); r; r = vmspace_next(r)) {
+    if (r->state == VMREGION_FREE) continue;
+
+    pdir_stat((void *) PTOB(r->start), PTOB(r->pages), &stat);
+    tag2str(r->tag, tagname);
+    pprintf(pf, "%08X %08X %8dK %8dK %-4s %s%c",
+            PTOB(r->start),
+            PTOB(r->start + r->pages) - 1,
+            r->pages * (PAGESIZE / 1024),
+            stat.present * (PAGESIZE / 1024),
+            tagname,
+            protect_name(r->protect),
+            (r->protect & PAGE_GUARD) ? 'g' : ' ');
+
+    filp = r->filemap ? (struct file *) hlookup(r->filemap->file) : NULL;
+    if (filp && filp->path) pprintf(pf, " %s", filp->path);
+    pprintf(pf, "\n");
+  }
+
+  pprintf(pf, "Regions: %d Free: %dK\n", vmspace.regions, vmspace.freepages * (PAGESIZE / 1024));
+  return 0;
+}
 
+int mem_sysinfo(struct meminfo *info) {
   info->physmem_total = totalmem * PAGESIZE;
   info->physmem_avail = freemem * PAGESIZE;
   info->virtmem_total = OSBASE - VMEM_START;
-  info->virtmem_avail = free * PAGESIZE;
+  info->virtmem_avail = vmspace.freepages * PAGESIZE;
   info->pagesize = PAGESIZE;
 
   return 0;
@@ -0,0 +1,561 @@
+//
+// vmregion.c
+//
+// Virtual address space regions
+//
+// Copyright (C) 2013 Michael Ringgaard. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 
+// 1. Redistributions of source code must retain the above copyright 
+//    notice, this list of conditions and the following disclaimer.  
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.  
+// 3. Neither the name of the project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission. 
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+// 
+
+#include <os/krnl.h>
+
+#define ADDR_REGION(n) ((struct vmregion *) ((char *) (n) - offsetof(struct vmregion, addrnode)))
+#define SIZE_REGION(n) ((struct vmregion *) ((char *) (n) - offsetof(struct vmregion, sizenode)))
+
+//
+// Red-black tree
+//
+
+static void rotate_left(struct rbnode **root, struct rbnode *x) {
+  struct rbnode *y = x->right;
+
+  x->right = y->left;
+  if (y->left) y->left->parent = x;
+  y->parent = x->parent;
+  if (!x->parent) {
+    *root = y;
+  } else if (x == x->parent->left) {
+    x->parent->left = y;
+  } else {
+    x->parent->right = y;
+  }
+  y->left = x;
+  x->parent = y;
+}
+
+static void rotate_right(struct rbnode **root, struct rbnode *x) {
+  struct rbnode *y = x->left;
+
+  x->left = y->right;
+  if (y->right) y->right->parent = x;
+  y->parent = x->parent;
+  if (!x->parent) {
+    *root = y;
+  } else if (x == x->parent->right) {
+    x->parent->right = y;
+  } else {
+    x->parent->left = y;
+  }
+  y->right = x;
+  x->parent = y;
+}
+
+static void rb_insert(struct rbnode **root, struct rbnode *node, struct rbnode *parent, struct rbnode **link) {
+  struct rbnode *gparent, *uncle;
+
+  node->parent = parent;
+  node->left = node->right = NULL;
+  node->red = 1;
+  *link = node;
+
+  while ((parent = node->parent) != NULL && parent->red) {
+    gparent = parent->parent;
+    if (parent == gparent->left) {
+      uncle = gparent->right;
+      if (uncle && uncle->red) {
+        parent->red = 0;
+        uncle->red = 0;
+        gparent->red = 1;
+        node = gparent;
+      } else {
+        if (node == parent->right) {
+          node = parent;
+          rotate_left(root, node);
+          parent = node->parent;
+        }
+        parent->red = 0;
+        gparent->red = 1;
+        rotate_right(root, gparent);
+      }
+    } else {
+      uncle = gparent->left;
+      if (uncle && uncle->red) {
+        parent->red = 0;
+        uncle->red = 0;
+        gparent->red = 1;
+        node = gparent;
+      } else {
+        if (node == parent->left) {
+          node = parent;
+          rotate_right(root, node);
+          parent = node->parent;
+        }
+        parent->red = 0;
+        gparent->red = 1;
+        rotate_left(root, gparent);
+      }
+    }
+  }
+
+  (*root)->red = 0;
+}
+
+static void transplant(struct rbnode **root, struct rbnode *u, struct rbnode *v) {
+  if (!u->parent) {
+    *root = v;
+  } else if (u == u->parent->left) {
+    u->parent->left = v;
+  } else {
+    u->parent->right = v;
+  }
+  if (v) v->parent = u->parent;
+}
+
+static void erase_fixup(struct rbnode **root, struct rbnode *x, struct rbnode *parent) {
+  struct rbnode *w;
+
+  while (x != *root && (!x || !x->red)) {
+    if (x == parent->left) {
+      w = parent->right;
+      if (w->red) {
+        w->red = 0;
+        parent->red = 1;
+        rotate_left(root, parent);
+        w = parent->right;
+      }
+      if ((!w->left || !w->left->red) && (!w->right || !w->right->red)) {
+        w->red = 1;
+        x = parent;
+        parent = x->parent;
+      } else {
+        if (!w->right || !w->right->red) {
+          w->left->red = 0;
+          w->red = 1;
+          rotate_right(root, w);
+          w = parent->right;
+        }
+        w->red = parent->red;
+        parent->red = 0;
+        if (w->right) w->right->red = 0;
+        rotate_left(root, parent);
+        x = *root;
+      }
+    } else {
+      w = parent->left;
+      if (w->red) {
+        w->red = 0;
+        parent->red = 1;
+        rotate_right(root, parent);
+        w = parent->left;
+      }
+      if ((!w->left || !w->left->red) && (!w->right || !w->right->red)) {
+        w->red = 1;
+        x = parent;
+        parent = x->parent;
+      } else {
+        if (!w->left || !w->left->red) {
+          w->right->red = 0;
+          w->red = 1;
+          rotate_left(root, w);
+          w = parent->left;
+        }
+        w->red = parent->red;
+        parent->red = 0;
+        if (w->left) w->left->red = 0;
+        rotate_right(root, parent);
+        x = *root;
+      }
+    }
+  }
+
+  if (x) x->red = 0;
+}
+
+static void rb_erase(struct rbnode **root, struct rbnode *z) {
+  struct rbnode *x, *y, *parent;
+  int red;
+
+  if (!z->left || !z->right) {
+    x = z->left ? z->left : z->right;
+    parent = z->parent;
+    red = z->red;
+    transplant(root, z, x);
+  } else {
+    y = z->right;
+    while (y->left) y = y->left;
+    red = y->red;
+    x = y->right;
+    if (y->parent == z) {
+      parent = y;
+    } else {
+      parent = y->parent;
+      transplant(root, y, y->right);
+      y->right = z->right;
+      y->right->parent = y;
+    }
+    transplant(root, z, y);
+    y->left = z->left;
+    y->left->parent = y;
+    y->red = z->red;
+  }
+
+  if (!red) erase_fixup(root, x, parent);
+}
+
+static struct rbnode *rb_first(struct rbnode *n) {
+  if (!n) return NULL;
+  while (n->left) n = n->left;
+  return n;
+}
+
+static struct rbnode *rb_next(struct rbnode *n) {
+  if (n->right) return rb_first(n->right);
+  while (n->parent && n == n->parent->right) n = n->parent;
+  return n->parent;
+}
+
+static struct rbnode *rb_prev(struct rbnode *n) {
+  if (n->left) {
+    n = n->left;
+    while (n->right) n = n->right;
+    return n;
+  }
+  while (n->parent && n == n->parent->left) n = n->parent;
+  return n->parent;
+}
+
+//
+// Region trees
+//
+
+static void insert_addr(struct vmspace *vms, struct vmregion *r) {
+  struct rbnode **link = &vms->addrtree;
+  struct rbnode *parent = NULL;
+
+  while (*link) {
+    parent = *link;
+    if (r->start < ADDR_REGION(parent)->start) {
+      link = &parent->left;
+    } else {
+      link = &parent->right;
+    }
+  }
+
+  rb_insert(&vms->addrtree, &r->addrnode, parent, link);
+  vms->regions++;
+}
+
+static void insert_free(struct vmspace *vms, struct vmregion *r) {
+  struct rbnode **link = &vms->freetree;
+  struct rbnode *parent = NULL;
+  struct vmregion *p;
+
+  while (*link) {
+    parent = *link;
+    p = SIZE_REGION(parent);
+    if (r->pages < p->pages || (r->pages == p->pages && r->start < p->start)) {
+      link = &parent->left;
+    } else {
+      link = &parent->right;
+    }
+  }
+
+  rb_insert(&vms->freetree, &r->sizenode, parent, link);
+}
+
+static void remove_free(struct vmspace *vms, struct vmregion *r) {
+  rb_erase(&vms->freetree, &r->sizenode);
+}
+
+static void remove_region(struct vmspace *vms, struct vmregion *r) {
+  rb_erase(&vms->addrtree, &r->addrnode);
+  vms->regions--;
+  kfree(r);
+}
+
+//
+// Split region at page into two regions. The new region covers the upper
+// part and inherits the attributes of the region. Neither region is
+// inserted into the free tree.
+//
+
+static void split(struct vmspace *vms, struct vmregion *r, unsigned long page, struct vmregion *newr) {
+  newr->start = page;
+  newr->pages = r->start + r->pages - page;
+  newr->state = r->state;
+  newr->protect = r->protect;
+  newr->tag = r->tag;
+  newr->filemap = r->filemap;
+  r->pages = page - r->start;
+  insert_addr(vms, newr);
+}
+
+//
+// Merge free region with free neighbours and insert it into the free tree
+//
+
+static struct vmregion *coalesce(struct vmspace *vms, struct vmregion *r) {
+  struct rbnode *n;
+  struct vmregion *neighbour;
+
+  n = rb_prev(&r->addrnode);
+  if (n && ADDR_REGION(n)->state == VMREGION_FREE) {
+    neighbour = ADDR_REGION(n);
+    remove_free(vms, neighbour);
+    neighbour->pages += r->pages;
+    remove_region(vms, r);
+    r = neighbour;
+  }
+
+  n = rb_next(&r->addrnode);
+  if (n && ADDR_REGION(n)->state == VMREGION_FREE) {
+    neighbour = ADDR_REGION(n);
+    remove_free(vms, neighbour);
+    r->pages += neighbour->pages;
+    remove_region(vms, neighbour);
+  }
+
+  insert_free(vms, r);
+  return r;
+}
+
+//
+// Splitting a region needs at most two new regions. These are allocated
+// up front so an operation never fails halfway through.
+//
+
+static int get_spares(struct vmregion **spare) {
+  spare[0] = (struct vmregion *) kmalloc(sizeof(struct vmregion));
+  spare[1] = (struct vmregion *) kmalloc(sizeof(struct vmregion));
+  if (!spare[0] || !spare[1]) {
+    if (spare[0]) kfree(spare[0]);
+    if (spare[1]) kfree(spare[1]);
+    return -ENOMEM;
+  }
+  return 0;
+}
+
+static void release_spares(struct vmregion **spare) {
+  if (spare[0]) kfree(spare[0]);
+  if (spare[1]) kfree(spare[1]);
+}
+
+//
+// Reserve pages from a free region
+//
+
+static struct vmregion *carve(struct vmspace *vms, struct vmregion *r, unsigned long start, unsigned long pages, unsigned long tag, int protect) {
+  struct vmregion *spare[2];
+  struct vmregion *rest;
+
+  if (get_spares(spare) < 0) return NULL;
+
+  remove_free(vms, r);
+  if (start > r->start) {
+    rest = r;
+    r = spare[0];
+    spare[0] = NULL;
+    split(vms, rest, start, r);
+    insert_free(vms, rest);
+  }
+  if (r->start + r->pages > start + pages) {
+    rest = spare[1];
+    spare[1] = NULL;
+    split(vms, r, start + pages, rest);
+    insert_free(vms, rest);
+  }
+
+  r->state = VMREGION_RESERVED;
+  r->protect = protect;
+  r->tag = tag;
+  r->filemap = NULL;
+  vms->freepages -= pages;
+
+  release_spares(spare);
+  return r;
+}
+
+int vmspace_init(struct vmspace *vms, unsigned long start, unsigned long pages) {
+  struct vmregion *r;
+
+  memset(vms, 0, sizeof(struct vmspace));
+  vms->start = start;
+  vms->pages = pages;
+
+  r = (struct vmregion *) kmalloc(sizeof(struct vmregion));
+  if (!r) return -ENOMEM;
+  memset(r, 0, sizeof(struct vmregion));
+  r->start = start;
+  r->pages = pages;
+  r->state = VMREGION_FREE;
+
+  insert_addr(vms, r);
+  insert_free(vms, r);
+  vms->freepages = pages;
+
+  return 0;
+}
+
+//
+// Allocate pages from the smallest free region that can hold the
+// request at the requested alignment
+//
+
+struct vmregion *vmspace_alloc(struct vmspace *vms, unsigned long pages, unsigned long align, unsigned long tag, int protect) {
+  struct rbnode *n;
+  struct rbnode *best;
+  struct vmregion *r;
+  unsigned long start;
+
+  if (pages == 0) return NULL;
+  if (align == 0) align = 1;
+
+  // Find first free region large enough for the request
+  n = vms->freetree;
+  best = NULL;
+  while (n) {
+    if (SIZE_REGION(n)->pages >= pages) {
+      best = n;
+      n = n->left;
+    } else {
+      n = n->right;
+    }
+  }
+
+  // Skip regions that are too small after alignment. Any region with
+  // at least pages + align - 1 pages will do, so this stops early.
+  for (n = best; n; n = rb_next(n)) {
+    r = SIZE_REGION(n);
+    start = (r->start + align - 1) / align * align;
+    if (start + pages <= r->start + r->pages) return carve(vms, r, start, pages, tag, protect);
+  }
+
+  return NULL;
+}
+
+struct vmregion *vmspace_reserve(struct vmspace *vms, unsigned long start, unsigned long pages, unsigned long tag, int protect) {
+  struct vmregion *r;
+
+  if (pages == 0) return NULL;
+  r = vmspace_lookup(vms, start);
+  if (!r || r->state != VMREGION_FREE) return NULL;
+  if (start + pages > r->start + r->pages || start + pages < start) return NULL;
+
+  return carve(vms, r, start, pages, tag, protect);
+}
+
+int vmspace_free(struct vmspace *vms, unsigned long start, unsigned long pages) {
+  struct vmregion *spare[2];
+  struct vmregion *r;
+  struct vmregion *next;
+  unsigned long end = start + pages;
+  int last;
+
+  if (pages == 0) return 0;
+  if (vmspace_status(vms, start, pages) != 1) return -EINVAL;
+  if (get_spares(spare) < 0) return -ENOMEM;
+
+  r = vmspace_lookup(vms, start);
+  if (r->start < start) {
+    split(vms, r, start, spare[0]);
+    r = spare[0];
+    spare[0] = NULL;
+  }
+
+  for (;;) {
+    if (r->start + r->pages > end) {
+      split(vms, r, end, spare[1]);
+      spare[1] = NULL;
+    }
+
+    last = r->start + r->pages == end;
+    next = last ? NULL : vmspace_next(r);
+
+    vms->freepages += r->pages;
+    r->state = VMREGION_FREE;
+    r->protect = 0;
+    r->tag = 0;
+    r->filemap = NULL;
+    coalesce(vms, r);
+
+    if (last) break;
+    r = next;
+  }
+
+  release_spares(spare);
+  return 0;
+}
+
+//
+// Returns 0 if free, 1 if allocated, -1 if partially allocated or
+// outside the address space.
+//
+
+int vmspace_status(struct vmspace *vms, unsigned long start, unsigned long pages) {
+  struct vmregion *r;
+  int state;
+
+  if (start < vms->start || start + pages > vms->start + vms->pages || start + pages < start) return -1;
+
+  r = vmspace_lookup(vms, start);
+  if (!r) return -1;
+  state = r->state;
+  while (r && r->start < start + pages) {
+    if (r->state != state) return -1;
+    r = vmspace_next(r);
+  }
+
+  return state == VMREGION_RESERVED ? 1 : 0;
+}
+
+struct vmregion *vmspace_lookup(struct vmspace *vms, unsigned long page) {
+  struct rbnode *n = vms->addrtree;
+  struct vmregion *r;
+
+  while (n) {
+    r = ADDR_REGION(n);
+    if (page < r->start) {
+      n = n->left;
+    } else if (page >= r->start + r->pages) {
+      n = n->right;
+    } else {
+      return r;
+    }
+  }
+
+  return NULL;
+}
+
+struct vmregion *vmspace_first(struct vmspace *vms) {
+  struct rbnode *n = rb_first(vms->addrtree);
+  return n ? ADDR_REGION(n) : NULL;
+}
+
+struct vmregion *vmspace_next(struct vmregion *r) {
+  struct rbnode *n = rb_next(&r->addrnode);
+  return n ? ADDR_REGION(n) : NULL;
+}
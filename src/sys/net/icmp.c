@@ -45,6 +45,7 @@ err_t icmp_input(struct pbuf *p, struct netif *inp) {
   struct ip_hdr *iphdr;
   struct ip_addr tmpaddr;
   int hlen;
+  unsigned short oldval;
   
   stats.icmp.recv++;
 
@@ -91,14 +92,11 @@ err_t icmp_input(struct pbuf *p, struct netif *inp) {
       tmpaddr.addr = iphdr->src.addr;
       iphdr->src.addr = iphdr->dest.addr;
       iphdr->dest.addr = tmpaddr.addr;
+      oldval = iecho->_type_code;
       ICMPH_TYPE_SET(iecho, ICMP_ER);
       
       // Adjust the checksum
-      if (iecho->chksum >= htons(0xFFFF - (ICMP_ECHO << 8))) {
-        iecho->chksum += htons(ICMP_ECHO << 8) + 1;
-      } else {
-        iecho->chksum += htons(ICMP_ECHO << 8);
-      }
+      iecho->chksum = inet_chksum_adjust(iecho->chksum, oldval, iecho->_type_code);
       stats.icmp.xmit++;
       
       pbuf_header(p, hlen);
@@ -35,17 +35,18 @@
 
 #include <net/net.h>
 
+#define CHKSUM_SWAP(acc) ((((acc) & 0xFF) << 8) | (((acc) & 0xFF00) >> 8))
+
+#define CHKSUM_BENCH_ROUNDS 64
+
 //
-// chksum
+// chksum_generic
 //
 // Sums up all 16 bit words in a memory portion. Also includes any odd byte.
-// This function is used by the other checksum functions.
-//
-// For now, this is not optimized. Must be optimized for the particular processor
-// arcitecture on which it is to run. Preferebly coded in assembler.
+// This is the reference implementation for the optimized versions below.
 //
 
-static unsigned long chksum(void *dataptr, int len) {
+static unsigned long chksum_generic(void *dataptr, int len) {
   unsigned long acc;
     
   for (acc = 0; len > 1; len -= 2) acc += *((unsigned short *) dataptr)++;
@@ -59,6 +60,303 @@ static unsigned long chksum(void *dataptr, int len) {
   return acc;
 }
 
+//
+// chksum_unrolled
+//
+// Portable version that loads 32 bits at a time and processes 32 bytes per
+// loop iteration. The high and low halves of each word are added separately
+// so the accumulator can be folded lazily.
+//
+
+static unsigned long chksum_unrolled(void *dataptr, int len) {
+  unsigned long *p = (unsigned long *) dataptr;
+  unsigned long acc = 0;
+
+  while (len >= 32) {
+    acc += (p[0] & 0xFFFF) + (p[0] >> 16);
+    acc += (p[1] & 0xFFFF) + (p[1] >> 16);
+    acc += (p[2] & 0xFFFF) + (p[2] >> 16);
+    acc += (p[3] & 0xFFFF) + (p[3] >> 16);
+    acc += (p[4] & 0xFFFF) + (p[4] >> 16);
+    acc += (p[5] & 0xFFFF) + (p[5] >> 16);
+    acc += (p[6] & 0xFFFF) + (p[6] >> 16);
+    acc += (p[7] & 0xFFFF) + (p[7] >> 16);
+    if (acc & 0x80000000) acc = (acc & 0xFFFF) + (acc >> 16);
+    p += 8;
+    len -= 32;
+  }
+
+  while (len >= 4) {
+    acc += (*p & 0xFFFF) + (*p >> 16);
+    p++;
+    len -= 4;
+  }
+
+  if (len >= 2) {
+    acc += *(unsigned short *) p;
+    p = (unsigned long *) ((char *) p + 2);
+    len -= 2;
+  }
+
+  // Add up any odd byte
+  if (len == 1) acc += *(unsigned char *) p;
+
+  while (acc >> 16) acc = (acc & 0xFFFF) + (acc >> 16);
+
+  return acc;
+}
+
+//
+// chksum_x86
+//
+// Adds 32-bit words with carry, 32 bytes per loop iteration. The one's
+// complement sum of 32-bit words folds to the same value as the sum of
+// 16-bit words.
+//
+
+static unsigned long chksum_x86(void *dataptr, int len) {
+  unsigned long acc;
+
+  __asm {
+    push  esi
+    mov   esi, dataptr
+    mov   edx, len
+    mov   ecx, edx
+    shr   ecx, 5
+    xor   eax, eax
+    test  ecx, ecx
+    jz    cs_dwords
+
+cs_block:
+    adc   eax, [esi]
+    adc   eax, [esi + 4]
+    adc   eax, [esi + 8]
+    adc   eax, [esi + 12]
+    adc   eax, [esi + 16]
+    adc   eax, [esi + 20]
+    adc   eax, [esi + 24]
+    adc   eax, [esi + 28]
+    lea   esi, [esi + 32]
+    dec   ecx
+    jnz   cs_block
+    adc   eax, 0
+    adc   eax, 0
+
+cs_dwords:
+    mov   ecx, edx
+    and   ecx, 28
+    shr   ecx, 2
+    test  ecx, ecx
+    jz    cs_words
+
+cs_dword:
+    adc   eax, [esi]
+    lea   esi, [esi + 4]
+    dec   ecx
+    jnz   cs_dword
+    adc   eax, 0
+    adc   eax, 0
+
+cs_words:
+    test  edx, 2
+    jz    cs_byte
+    xor   ecx, ecx
+    mov   cx, word ptr [esi]
+    add   eax, ecx
+    adc   eax, 0
+    add   esi, 2
+
+cs_byte:
+    test  edx, 1
+    jz    cs_done
+    xor   ecx, ecx
+    mov   cl, byte ptr [esi]
+    add   eax, ecx
+    adc   eax, 0
+
+cs_done:
+    mov   acc, eax
+    pop   esi
+  }
+
+  acc = (acc & 0xFFFF) + (acc >> 16);
+  acc = (acc & 0xFFFF) + (acc >> 16);
+
+  return acc;
+}
+
+//
+// chksum_copy_x86
+//
+// Copies a memory block and calculates the checksum in the same pass.
+//
+
+static unsigned long chksum_copy_x86(void *dst, void *src, int len) {
+  unsigned long acc;
+
+  __asm {
+    push  esi
+    push  edi
+    push  ebx
+    mov   esi, src
+    mov   edi, dst
+    mov   edx, len
+    mov   ecx, edx
+    shr   ecx, 4
+    xor   eax, eax
+    test  ecx, ecx
+    jz    cc_dwords
+
+cc_block:
+    mov   ebx, [esi]
+    adc   eax, ebx
+    mov   [edi], ebx
+    mov   ebx, [esi + 4]
+    adc   eax, ebx
+    mov   [edi + 4], ebx
+    mov   ebx, [esi + 8]
+    adc   eax, ebx
+    mov   [edi + 8], ebx
+    mov   ebx, [esi + 12]
+    adc   eax, ebx
+    mov   [edi + 12], ebx
+    lea   esi, [esi + 16]
+    lea   edi, [edi + 16]
+    dec   ecx
+    jnz   cc_block
+    adc   eax, 0
+    adc   eax, 0
+
+cc_dwords:
+    mov   ecx, edx
+    and   ecx, 12
+    shr   ecx, 2
+    test  ecx, ecx
+    jz    cc_words
+
+cc_dword:
+    mov   ebx, [esi]
+    adc   eax, ebx
+    mov   [edi], ebx
+    lea   esi, [esi + 4]
+    lea   edi, [edi + 4]
+    dec   ecx
+    jnz   cc_dword
+    adc   eax, 0
+    adc   eax, 0
+
+cc_words:
+    test  edx, 2
+    jz    cc_byte
+    xor   ebx, ebx
+    mov   bx, word ptr [esi]
+    mov   [edi], bx
+    add   eax, ebx
+    adc   eax, 0
+    add   esi, 2
+    add   edi, 2
+
+cc_byte:
+    test  edx, 1
+    jz    cc_done
+    xor   ebx, ebx
+    mov   bl, byte ptr [esi]
+    mov   [edi], bl
+    add   eax, ebx
+    adc   eax, 0
+
+cc_done:
+    mov   acc, eax
+    pop   ebx
+    pop   edi
+    pop   esi
+  }
+
+  acc = (acc & 0xFFFF) + (acc >> 16);
+  acc = (acc & 0xFFFF) + (acc >> 16);
+
+  return acc;
+}
+
+static unsigned long chksum_copy_generic(void *dst, void *src, int len) {
+  memcpy(dst, src, len);
+  return chksum_generic(dst, len);
+}
+
+struct chksum_variant {
+  char *name;
+  unsigned long (*func)(void *dataptr, int len);
+};
+
+static struct chksum_variant chksum_variants[] = {
+  {"generic", chksum_generic},
+  {"unrolled", chksum_unrolled},
+  {"x86", chksum_x86},
+  {NULL, NULL}
+};
+
+static struct chksum_variant *chksum_selected = &chksum_variants[0];
+static unsigned long (*chksum)(void *dataptr, int len) = chksum_generic;
+static unsigned long (*chksum_copy)(void *dst, void *src, int len) = chksum_copy_generic;
+
+//
+// inet_chksum_add
+//
+// Adds two partial checksums. The second checksum covers data starting at
+// the given offset, and is byte swapped if the offset is odd.
+//
+
+unsigned long inet_chksum_add(unsigned long acc1, unsigned long acc2, int offset) {
+  unsigned long acc;
+
+  if (offset & 1) acc2 = CHKSUM_SWAP(acc2);
+  acc = acc1 + acc2;
+  while (acc >> 16) acc = (acc & 0xFFFF) + (acc >> 16);
+
+  return acc;
+}
+
+//
+// inet_chksum_copy
+//
+// Copies data and returns the partial (unfolded one's complement) checksum
+// for the data.
+//
+
+unsigned long inet_chksum_copy(void *dst, void *src, int len) {
+  return chksum_copy(dst, src, len);
+}
+
+//
+// inet_chksum_partial
+//
+// Returns the partial checksum for a memory block.
+//
+
+unsigned long inet_chksum_partial(void *dataptr, int len) {
+  return chksum(dataptr, len);
+}
+
+//
+// inet_chksum_pseudo_acc
+//
+// Adds the pseudo header to a partial checksum and returns the final checksum.
+//
+
+unsigned short inet_chksum_pseudo_acc(unsigned long acc, struct ip_addr *src, struct ip_addr *dest, 
+                                      unsigned char proto, unsigned short proto_len) {
+  acc += (src->addr & 0xFFFF);
+  acc += ((src->addr >> 16) & 0xFFFF);
+  acc += (dest->addr & 0xFFFF);
+  acc += ((dest->addr >> 16) & 0xFFFF);
+  acc += (unsigned long) htons((unsigned short) proto);
+  acc += (unsigned long) htons(proto_len);  
+  
+  while (acc >> 16) acc = (acc & 0xFFFF) + (acc >> 16);
+
+  return (unsigned short) ~(acc & 0xFFFF);
+}
+
 //
 // inet_chksum_pseudo
 //
@@ -79,22 +377,13 @@ unsigned short inet_chksum_pseudo(struct pbuf *p, struct ip_addr *src, struct ip
 
     if (q->len % 2 != 0) {
       swapped = 1 - swapped;
-      acc = ((acc & 0xFF) << 8) | ((acc & 0xFF00) >> 8);
+      acc = CHKSUM_SWAP(acc);
     }
   }
 
-  if (swapped) acc = ((acc & 0xFF) << 8) | ((acc & 0xFF00) >> 8);
-
-  acc += (src->addr & 0xFFFF);
-  acc += ((src->addr >> 16) & 0xFFFF);
-  acc += (dest->addr & 0xFFFF);
-  acc += ((dest->addr >> 16) & 0xFFFF);
-  acc += (unsigned long) htons((unsigned short) proto);
-  acc += (unsigned long) htons(proto_len);  
-  
-  while (acc >> 16) acc = (acc & 0xFFFF) + (acc >> 16);
+  if (swapped) acc = CHKSUM_SWAP(acc);
 
-  return (unsigned short) ~(acc & 0xFFFF);
+  return inet_chksum_pseudo_acc(acc, src, dest, proto, proto_len);
 }
 
 //
@@ -126,11 +415,157 @@ unsigned short inet_chksum_pbuf(struct pbuf *p) {
 
     if (q->len % 2 != 0) {
       swapped = 1 - swapped;
-      acc = ((acc & 0xFF) << 8) | ((acc & 0xFF00) >> 8);
+      acc = CHKSUM_SWAP(acc);
     }
   }
  
-  if (swapped) acc = ((acc & 0xFF) << 8) | ((acc & 0xFF00) >> 8);
+  if (swapped) acc = CHKSUM_SWAP(acc);
 
   return (unsigned short) ~(acc & 0xFFFF);
 }
+
+//
+// inet_chksum_adjust
+//
+// Incrementally updates a checksum when a 16-bit word in the checksummed
+// data changes from oldval to newval (RFC 1624, eqn. 3).
+//
+
+unsigned short inet_chksum_adjust(unsigned short chksum, unsigned short oldval, unsigned short newval) {
+  unsigned long acc;
+
+  acc = (unsigned short) ~chksum;
+  acc += (unsigned short) ~oldval;
+  acc += newval;
+  while (acc >> 16) acc = (acc & 0xFFFF) + (acc >> 16);
+
+  return (unsigned short) ~acc;
+}
+
+//
+// Checksum benchmark
+//
+// Times each checksum variant on buffers from 64 bytes to 64 KB. This is
+// used for selecting the fastest variant at boot and by /proc/chksum.
+//
+
+static unsigned long chksum_cycles(unsigned long (*func)(void *dataptr, int len), void *buf, int len, int rounds) {
+  unsigned __int64 start;
+  unsigned __int64 end;
+  int i;
+
+  start = rdtsc();
+  for (i = 0; i < rounds; i++) func(buf, len);
+  end = rdtsc();
+
+  return (unsigned long) ((end - start) / rounds);
+}
+
+static unsigned long chksum_copy_cycles(void *dst, void *src, int len, int rounds) {
+  unsigned __int64 start;
+  unsigned __int64 end;
+  int i;
+
+  start = rdtsc();
+  for (i = 0; i < rounds; i++) chksum_copy(dst, src, len);
+  end = rdtsc();
+
+  return (unsigned long) ((end - start) / rounds);
+}
+
+static void chksum_fill(unsigned char *buf, int len) {
+  int i;
+
+  for (i = 0; i < len; i++) buf[i] = (unsigned char) (i * 7 + (i >> 8));
+}
+
+static int chksum_proc(struct proc_file *pf, void *arg) {
+  unsigned char *buf;
+  unsigned char *dst;
+  struct chksum_variant *v;
+  unsigned long ref;
+  int len;
+  int ofs;
+
+  if ((cpu.features & CPU_FEATURE_TSC) == 0) return -ENOSYS;
+
+  buf = (unsigned char *) kmalloc(64 * 1024 + 1);
+  dst = (unsigned char *) kmalloc(64 * 1024 + 1);
+  if (!buf || !dst) {
+    kfree(buf);
+    kfree(dst);
+    return -ENOMEM;
+  }
+  chksum_fill(buf, 64 * 1024 + 1);
+
+  pprintf(pf, "selected: %s\n\n", chksum_selected->name);
+  pprintf(pf, "  size");
+  for (v = chksum_variants; v->name; v++) pprintf(pf, " %10s", v->name);
+  pprintf(pf, " %10s   (cycles)\n", "copy");
+  pprintf(pf, "------");
+  for (v = chksum_variants; v->name; v++) pprintf(pf, " ----------");
+  pprintf(pf, " ----------\n");
+
+  for (len = 64; len <= 64 * 1024; len *= 4) {
+    pprintf(pf, "%6d", len);
+    for (v = chksum_variants; v->name; v++) {
+      pprintf(pf, " %10d", chksum_cycles(v->func, buf, len, CHKSUM_BENCH_ROUNDS));
+    }
+    pprintf(pf, " %10d\n", chksum_copy_cycles(dst, buf, len, CHKSUM_BENCH_ROUNDS));
+  }
+
+  // Check that all variants agree with the reference implementation for
+  // odd and even lengths and alignments
+  for (ofs = 0; ofs < 2; ofs++) {
+    for (len = 0; len < 256; len++) {
+      ref = inet_chksum_add(0, chksum_generic(buf + ofs, len), 0);
+      for (v = chksum_variants; v->name; v++) {
+        if (inet_chksum_add(0, v->func(buf + ofs, len), 0) != ref) {
+          pprintf(pf, "%s: checksum mismatch for length %d offset %d\n", v->name, len, ofs);
+        }
+      }
+      if (inet_chksum_add(0, chksum_copy(dst, buf + ofs, len), 0) != ref || memcmp(dst, buf + ofs, len) != 0) {
+        pprintf(pf, "copy: checksum mismatch for length %d offset %d\n", len, ofs);
+      }
+    }
+  }
+
+  kfree(buf);
+  kfree(dst);
+  return 0;
+}
+
+//
+// inet_init
+//
+// Selects the fastest checksum routine for the processor.
+//
+
+void inet_init() {
+  unsigned char *buf;
+  struct chksum_variant *v;
+  unsigned long cycles;
+  unsigned long best;
+
+  chksum_selected = &chksum_variants[2];
+  if (cpu.features & CPU_FEATURE_TSC) {
+    buf = (unsigned char *) kmalloc(MTU);
+    if (buf) {
+      chksum_fill(buf, MTU);
+      best = 0xFFFFFFFF;
+      for (v = chksum_variants; v->name; v++) {
+        cycles = chksum_cycles(v->func, buf, MTU, CHKSUM_BENCH_ROUNDS);
+        if (cycles < best) {
+          best = cycles;
+          chksum_selected = v;
+        }
+      }
+      kfree(buf);
+    }
+  }
+
+  chksum = chksum_selected->func;
+  chksum_copy = chksum_copy_x86;
+
+  register_proc_inode("chksum", chksum_proc, NULL);
+}
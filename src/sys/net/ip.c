@@ -104,6 +104,7 @@ struct netif *ip_route(struct ip_addr *dest) {
 
 static err_t ip_forward(struct pbuf *p, struct ip_hdr *iphdr, struct netif *inp) {
   struct netif *netif;
+  unsigned short oldval;
 
   // Don't route broadcasts
   if (ip_addr_isbroadcast(&iphdr->dest, &inp->netmask)) {
@@ -124,6 +125,7 @@ static err_t ip_forward(struct pbuf *p, struct ip_hdr *iphdr, struct netif *inp)
   }
   
   // Decrement TTL and send ICMP if ttl == 0
+  oldval = iphdr->_ttl_proto;
   IPH_TTL_SET(iphdr, IPH_TTL(iphdr) - 1);
   if (IPH_TTL(iphdr) == 0) {
     // Don't send ICMP messages in response to ICMP messages
@@ -133,11 +135,7 @@ static err_t ip_forward(struct pbuf *p, struct ip_hdr *iphdr, struct netif *inp)
   }
   
   // Incremental update of the IP checksum
-  if (IPH_CHKSUM(iphdr) >= htons(0xffff - 0x100)) {
-    IPH_CHKSUM_SET(iphdr, IPH_CHKSUM(iphdr) + htons(0x100) + 1);
-  } else {
-    IPH_CHKSUM_SET(iphdr, (unsigned short) (IPH_CHKSUM(iphdr) + htons(0x100)));
-  }
+  IPH_CHKSUM_SET(iphdr, inet_chksum_adjust(IPH_CHKSUM(iphdr), oldval, iphdr->_ttl_proto));
   kprintf("ip_forward: forwarding packet to %a\n", &iphdr->dest);
 
   stats.ip.fw++;
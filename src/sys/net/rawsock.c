@@ -223,7 +223,7 @@ static int rawsock_recvmsg(struct socket *s, struct msghdr *msg, unsigned int fl
     msg->msg_namelen = sizeof(struct sockaddr_in);
 
     pbuf_free(p);
-  } else if (s->flags & SOCK_NBIO) {
+  } else if ((s->flags & SOCK_NBIO) || (flags & MSG_DONTWAIT)) {
     rc = -EAGAIN;
   } else {
     rc = submit_socket_request(s, &req, SOCKREQ_RECV, msg, s->rcvtimeo);
@@ -313,4 +313,5 @@ struct sockops rawops = {
   rawsock_setsockopt,
   rawsock_shutdown,
   rawsock_socket,
+  NULL,
 };
@@ -52,6 +52,7 @@ void cancel_socket_request(struct sockreq *req) {
     if (req == req->socket->waithead) req->socket->waithead = req->next;
     if (req == req->socket->waittail) req->socket->waittail = req->prev;
   }
+  req->next = req->prev = NULL;
 }
 
 void release_socket_request(struct sockreq *req, int rc) {
@@ -95,6 +96,10 @@ err_t submit_socket_request(struct socket *s, struct sockreq *req, int type, str
   if (rc < 0) {
     cancel_socket_request(req);
     req->rc = rc;
+  } else if (type == SOCKREQ_RECVMMSG) {
+    // Batch requests are left on the wait queue after the thread has been
+    // woken up so more datagrams can be delivered until the thread runs
+    cancel_socket_request(req);
   }
 
   if (timeout != INFINITE) del_timer(&timer);
@@ -177,15 +182,81 @@ int recvmsg(struct socket *s, struct msghdr *msg, unsigned int flags) {
   m.msg_namelen = msg->msg_namelen;
   m.msg_iov = dup_iovec(msg->msg_iov, msg->msg_iovlen);
   m.msg_iovlen = msg->msg_iovlen;
+  m.msg_flags = 0;
   if (!m.msg_iov) return -ENOMEM;
 
   rc = sockops[s->type]->recvmsg(s, &m, flags);
   msg->msg_namelen = m.msg_namelen;
+  msg->msg_flags = m.msg_flags;
   kfree(m.msg_iov);
 
   return rc;
 }
 
+static void free_mmsg(struct mmsghdr *m, unsigned int vlen) {
+  unsigned int i;
+
+  for (i = 0; i < vlen; i++) kfree(m[i].msg_hdr.msg_iov);
+  kfree(m);
+}
+
+static struct mmsghdr *dup_mmsg(struct mmsghdr *msgvec, unsigned int vlen) {
+  struct mmsghdr *m;
+  unsigned int i;
+
+  m = (struct mmsghdr *) kmalloc(vlen * sizeof(struct mmsghdr));
+  if (!m) return NULL;
+
+  for (i = 0; i < vlen; i++) {
+    m[i].msg_hdr.msg_name = msgvec[i].msg_hdr.msg_name;
+    m[i].msg_hdr.msg_namelen = msgvec[i].msg_hdr.msg_namelen;
+    m[i].msg_hdr.msg_iov = dup_iovec(msgvec[i].msg_hdr.msg_iov, msgvec[i].msg_hdr.msg_iovlen);
+    m[i].msg_hdr.msg_iovlen = msgvec[i].msg_hdr.msg_iovlen;
+    m[i].msg_hdr.msg_flags = 0;
+    m[i].msg_len = 0;
+    if (!m[i].msg_hdr.msg_iov) {
+      free_mmsg(m, i);
+      return NULL;
+    }
+  }
+
+  return m;
+}
+
+int recvmmsg(struct socket *s, struct mmsghdr *msgvec, unsigned int vlen, unsigned int flags) {
+  struct mmsghdr *m;
+  unsigned int i;
+  int rc;
+
+  if (!msgvec) return -EINVAL;
+  if (vlen == 0) return 0;
+  if (vlen > SOCK_MAXMMSG) vlen = SOCK_MAXMMSG;
+
+  m = dup_mmsg(msgvec, vlen);
+  if (!m) return -ENOMEM;
+
+  if (sockops[s->type]->recvmmsg) {
+    rc = sockops[s->type]->recvmmsg(s, m, vlen, flags);
+  } else {
+    // Only wait for the first message, then return what is available
+    for (i = 0; i < vlen; i++) {
+      rc = sockops[s->type]->recvmsg(s, &m[i].msg_hdr, i == 0 ? flags : flags | MSG_DONTWAIT);
+      if (rc < 0) break;
+      m[i].msg_len = rc;
+    }
+    if (i > 0) rc = i;
+  }
+
+  for (i = 0; rc > 0 && i < (unsigned int) rc; i++) {
+    msgvec[i].msg_hdr.msg_namelen = m[i].msg_hdr.msg_namelen;
+    msgvec[i].msg_hdr.msg_flags = m[i].msg_hdr.msg_flags;
+    msgvec[i].msg_len = m[i].msg_len;
+  }
+  free_mmsg(m, vlen);
+
+  return rc;
+}
+
 int recvv(struct socket *s, struct iovec *iov, int count) {
   struct msghdr msg;
   int rc;
@@ -260,6 +331,30 @@ int sendmsg(struct socket *s, struct msghdr *msg, unsigned int flags) {
   return rc;
 }
 
+int sendmmsg(struct socket *s, struct mmsghdr *msgvec, unsigned int vlen, unsigned int flags) {
+  struct mmsghdr *m;
+  unsigned int i;
+  int rc;
+
+  if (!msgvec) return -EINVAL;
+  if (vlen == 0) return 0;
+  if (vlen > SOCK_MAXMMSG) vlen = SOCK_MAXMMSG;
+
+  m = dup_mmsg(msgvec, vlen);
+  if (!m) return -ENOMEM;
+
+  // Only the first message is allowed to block
+  for (i = 0; i < vlen; i++) {
+    rc = sockops[s->type]->sendmsg(s, &m[i].msg_hdr, i == 0 ? flags : flags | MSG_DONTWAIT);
+    if (rc < 0) break;
+    msgvec[i].msg_len = rc;
+  }
+  if (i > 0) rc = i;
+  free_mmsg(m, vlen);
+
+  return rc;
+}
+
 int sendto(struct socket *s, void *data, int size, unsigned int flags, struct sockaddr *to, int tolen) {
   struct msghdr msg;
   struct iovec iov;
@@ -137,17 +137,17 @@ err_t tcp_close(struct tcp_pcb *pcb) {
 
     case SYN_RCVD:
       err = tcp_send_ctrl(pcb, TCP_FIN);
-      if (err == 0) pcb->state = FIN_WAIT_1;
+      if (err == 0) TCP_SET_STATE(pcb, FIN_WAIT_1);
       break;
 
     case ESTABLISHED:
       err = tcp_send_ctrl(pcb, TCP_FIN);
-      if (err == 0) pcb->state = FIN_WAIT_1;
+      if (err == 0) TCP_SET_STATE(pcb, FIN_WAIT_1);
       break;
 
     case CLOSE_WAIT:
       err = tcp_send_ctrl(pcb, TCP_FIN);
-      if (err == 0) pcb->state = LAST_ACK;
+      if (err == 0) TCP_SET_STATE(pcb, LAST_ACK);
       break;
 
     default:
@@ -262,7 +262,7 @@ err_t tcp_bind(struct tcp_pcb *pcb, struct ip_addr *ipaddr, unsigned short port)
 
 struct tcp_pcb *tcp_listen(struct tcp_pcb *pcb) {
   if (pcb->state == LISTEN) return pcb;
-  pcb->state = LISTEN;
+  TCP_SET_STATE(pcb, LISTEN);
   TCP_REG((struct tcp_pcb **) &tcp_listen_pcbs, pcb);
   return pcb;
 }
@@ -316,7 +316,7 @@ err_t tcp_connect(struct tcp_pcb *pcb, struct ip_addr *ipaddr, unsigned short po
   pcb->mss = TCP_MSS;
   pcb->cwnd = 1;
   pcb->ssthresh = pcb->mss * 10;
-  pcb->state = SYN_SENT;
+  TCP_SET_STATE(pcb, SYN_SENT);
   pcb->connected = connected;
   TCP_REG(&tcp_active_pcbs, pcb);
   
@@ -736,7 +736,7 @@ void tcp_pcb_remove(struct tcp_pcb **pcblist, struct tcp_pcb *pcb) {
     tcp_output(pcb);
   }  
 
-  pcb->state = CLOSED;
+  TCP_SET_STATE(pcb, CLOSED);
 }
 
 //
@@ -331,7 +331,7 @@ static err_t tcp_process(struct tcp_seg *seg, struct tcp_pcb *pcb) {
         npcb->local_port = pcb->local_port;
         ip_addr_set(&npcb->remote_ip, &iphdr->src);
         npcb->remote_port = tcphdr->src;
-        npcb->state = SYN_RCVD;
+        TCP_SET_STATE(npcb, SYN_RCVD);
         npcb->rcv_nxt = seqno + 1;
         npcb->snd_wnd = tcphdr->wnd;
         npcb->ssthresh = npcb->snd_wnd;
@@ -364,7 +364,7 @@ static err_t tcp_process(struct tcp_seg *seg, struct tcp_pcb *pcb) {
         pcb->lastack = ackno;
         pcb->snd_wnd = tcphdr->wnd;
         pcb->snd_wl1 = seqno - 1;
-        pcb->state = ESTABLISHED;
+        TCP_SET_STATE(pcb, ESTABLISHED);
         pcb->cwnd = pcb->mss;
         pcb->snd_queuelen--;
         rseg = pcb->unacked;
@@ -385,7 +385,7 @@ static err_t tcp_process(struct tcp_seg *seg, struct tcp_pcb *pcb) {
     case SYN_RCVD:
       if (flags & TCP_ACK && !(flags & TCP_RST)) {
         if (TCP_SEQ_LT(pcb->lastack, ackno) && TCP_SEQ_LEQ(ackno, pcb->snd_nxt)) {
-          pcb->state = ESTABLISHED;
+          TCP_SET_STATE(pcb, ESTABLISHED);
           //kprintf("TCP connection established %d -> %d.\n", seg->tcphdr->src, seg->tcphdr->dest);
 
           // Call the accept function
@@ -418,7 +418,7 @@ static err_t tcp_process(struct tcp_seg *seg, struct tcp_pcb *pcb) {
       tcp_receive(seg, pcb);
       if (flags & TCP_FIN) {
         pcb->flags |= TF_ACK_NOW;
-        pcb->state = CLOSE_WAIT;
+        TCP_SET_STATE(pcb, CLOSE_WAIT);
       }
       break;
 
@@ -430,14 +430,14 @@ static err_t tcp_process(struct tcp_seg *seg, struct tcp_pcb *pcb) {
           pcb->flags |= TF_ACK_NOW;
           tcp_pcb_purge(pcb);
           TCP_RMV(&tcp_active_pcbs, pcb);
-          pcb->state = TIME_WAIT;
+          TCP_SET_STATE(pcb, TIME_WAIT);
           TCP_REG(&tcp_tw_pcbs, pcb);
         } else {
           pcb->flags |= TF_ACK_NOW;
-          pcb->state = CLOSING;
+          TCP_SET_STATE(pcb, CLOSING);
         }
       } else if ((flags & TCP_ACK) && ackno == pcb->snd_nxt) {
-        pcb->state = FIN_WAIT_2;
+        TCP_SET_STATE(pcb, FIN_WAIT_2);
       }
       break;
 
@@ -448,7 +448,7 @@ static err_t tcp_process(struct tcp_seg *seg, struct tcp_pcb *pcb) {
         pcb->flags |= TF_ACK_NOW;
         tcp_pcb_purge(pcb);
         TCP_RMV(&tcp_active_pcbs, pcb);
-        pcb->state = TIME_WAIT;
+        TCP_SET_STATE(pcb, TIME_WAIT);
         TCP_REG(&tcp_tw_pcbs, pcb);
       }
       break;
@@ -460,7 +460,7 @@ static err_t tcp_process(struct tcp_seg *seg, struct tcp_pcb *pcb) {
         pcb->flags |= TF_ACK_NOW;
         tcp_pcb_purge(pcb);
         TCP_RMV(&tcp_active_pcbs, pcb);
-        pcb->state = TIME_WAIT;
+        TCP_SET_STATE(pcb, TIME_WAIT);
         TCP_REG(&tcp_tw_pcbs, pcb);
       }
       break;
@@ -469,7 +469,7 @@ static err_t tcp_process(struct tcp_seg *seg, struct tcp_pcb *pcb) {
       tcp_receive(seg, pcb);
       if (flags & TCP_ACK && ackno == pcb->snd_nxt) {
         //kprintf("TCP connection closed %d -> %d.\n", seg->tcphdr->src, seg->tcphdr->dest);
-        pcb->state = CLOSED;
+        TCP_SET_STATE(pcb, CLOSED);
         pcb->flags |= TF_CLOSED;
       }
       break;
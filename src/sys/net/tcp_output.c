@@ -82,6 +82,7 @@ err_t tcp_enqueue(struct tcp_pcb *pcb, void *data, int len, int flags, unsigned
   int size;
   void *ptr;
   int queuelen;
+  unsigned long acc;
 
   left = len;
   ptr = data;
@@ -119,7 +120,8 @@ err_t tcp_enqueue(struct tcp_pcb *pcb, void *data, int len, int flags, unsigned
 
       if (buflen > 0) {
         //kprintf("tcp_enqueue: add %d bytes to segment\n", buflen);
-        memcpy((char *) p->payload + p->len, ptr, buflen);
+        acc = inet_chksum_copy((char *) p->payload + p->len, ptr, buflen);
+        useg->chksum = (unsigned short) inet_chksum_add(useg->chksum, acc, useg->len);
         p->len += buflen;
         useg->p->tot_len += buflen;
         useg->len += buflen;
@@ -145,6 +147,7 @@ err_t tcp_enqueue(struct tcp_pcb *pcb, void *data, int len, int flags, unsigned
       }
       seg->next = NULL;
       seg->p = NULL;
+      seg->chksum = 0;
 
       if (queue == NULL) {
         queue = seg;
@@ -179,7 +182,11 @@ err_t tcp_enqueue(struct tcp_pcb *pcb, void *data, int len, int flags, unsigned
 
         queuelen++;
 
-        if (data != NULL) memcpy(seg->p->payload, ptr, seglen);
+        if (data != NULL) {
+          seg->chksum = (unsigned short) inet_chksum_copy(seg->p->payload, ptr, seglen);
+        } else {
+          seg->chksum = (unsigned short) inet_chksum_partial(seg->p->payload, seglen);
+        }
         seg->dataptr = seg->p->payload;
       } 
 
@@ -241,6 +248,7 @@ err_t tcp_enqueue(struct tcp_pcb *pcb, void *data, int len, int flags, unsigned
       // Remove TCP header from first segment
       pbuf_header(queue->p, -TCP_HLEN);
       pbuf_chain(useg->p, queue->p);
+      useg->chksum = (unsigned short) inet_chksum_add(useg->chksum, queue->chksum, useg->len);
       useg->len += queue->len;
       useg->next = queue->next;
     
@@ -376,6 +384,8 @@ static err_t tcp_send_ack(struct tcp_pcb *pcb) {
 
 static void tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb) {
   struct netif *netif;
+  unsigned long acc;
+  int hdrlen;
 
   if (seg->p->ref > 1) {
     kprintf(KERN_ERR "tcp_output_segment: packet not transmitted, already in tx queue\n");
@@ -428,7 +438,11 @@ static void tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb) {
 
   seg->tcphdr->chksum = 0;
   if ((netif->flags & NETIF_TCP_TX_CHECKSUM_OFFLOAD) == 0) {
-    seg->tcphdr->chksum = inet_chksum_pseudo(seg->p, &pcb->local_ip, &pcb->remote_ip, IP_PROTO_TCP, seg->p->tot_len);
+    // The data checksum was computed when the data was copied into the segment,
+    // so only the TCP header needs to be summed here
+    hdrlen = (TCPH_OFFSET(seg->tcphdr) >> 4) * 4;
+    acc = inet_chksum_add(inet_chksum_partial(seg->tcphdr, hdrlen), seg->chksum, hdrlen);
+    seg->tcphdr->chksum = inet_chksum_pseudo_acc(acc, &pcb->local_ip, &pcb->remote_ip, IP_PROTO_TCP, seg->p->tot_len);
   }
   stats.tcp.xmit++;
 
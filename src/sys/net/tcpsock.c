@@ -37,7 +37,14 @@ static err_t recv_tcp(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
 static err_t sent_tcp(void *arg, struct tcp_pcb *pcb, unsigned short len);
 static void err_tcp(void *arg, err_t err);
 
-static int fill_sndbuf(struct socket *s, struct iovec *iov, int iovlen) {
+static int push_mode(struct socket *s, int more, int room) {
+  // Hold back partial segments while the socket is corked or the caller
+  // has more data coming, unless the send buffer has been filled up
+  if (((s->flags & SOCK_CORK) || more) && room > 0) return TCP_WRITE_NOFLUSH;
+  return (s->flags & SOCK_NODELAY) ? TCP_WRITE_FLUSH : TCP_WRITE_NAGLE;
+}
+
+static int fill_sndbuf(struct socket *s, struct iovec *iov, int iovlen, int more) {
   int left;
   int bytes;
   int len;
@@ -51,7 +58,7 @@ static int fill_sndbuf(struct socket *s, struct iovec *iov, int iovlen) {
     len = iov->iov_len;
     if (len > left) len = left;
 
-    rc = tcp_write(s->tcp.pcb, iov->iov_base, len, (s->flags & SOCK_NODELAY) ? TCP_WRITE_FLUSH : TCP_WRITE_NAGLE);
+    rc = tcp_write(s->tcp.pcb, iov->iov_base, len, push_mode(s, more, left - len));
     if (rc < 0) return rc;
 
     (char *) iov->iov_base += len;
@@ -79,7 +86,7 @@ static int fill_sndbuf(struct socket *s, struct iovec *iov, int iovlen) {
       iovlen--;
     }
 
-    rc = tcp_write(s->tcp.pcb, NULL, 0, (s->flags & SOCK_NODELAY) ? TCP_WRITE_FLUSH : TCP_WRITE_NAGLE);
+    rc = tcp_write(s->tcp.pcb, NULL, 0, push_mode(s, more, left));
     if (rc < 0) return rc;
 
     return bytes;
@@ -297,7 +304,7 @@ static err_t sent_tcp(void *arg, struct tcp_pcb *pcb, unsigned short len) {
 
     if (!req) break;
 
-    rc = fill_sndbuf(s, req->msg->msg_iov, req->msg->msg_iovlen);
+    rc = fill_sndbuf(s, req->msg->msg_iov, req->msg->msg_iovlen, 0);
     if (rc < 0) {
       release_socket_request(req, rc);
       return rc;
@@ -605,7 +612,7 @@ static int tcpsock_recvmsg(struct socket *s, struct msghdr *msg, unsigned int fl
   }
  
   if (s->state == SOCKSTATE_CLOSING) return 0;
-  if (s->flags & SOCK_NBIO) return -EAGAIN;
+  if ((s->flags & SOCK_NBIO) || (flags & MSG_DONTWAIT)) return -EAGAIN;
 
   rc = submit_socket_request(s, &req, SOCKREQ_RECV, msg, s->rcvtimeo);
   if (rc < 0) return rc;
@@ -625,13 +632,13 @@ static int tcpsock_sendmsg(struct socket *s, struct msghdr *msg, unsigned int fl
   size = get_iovec_size(msg->msg_iov, msg->msg_iovlen);
   if (size == 0) return 0;
 
-  rc = fill_sndbuf(s, msg->msg_iov, msg->msg_iovlen);
+  rc = fill_sndbuf(s, msg->msg_iov, msg->msg_iovlen, flags & MSG_MORE);
   if (rc < 0) return rc;
   bytes = rc;
 
   if (tcp_sndbuf(s->tcp.pcb) == 0) clear_io_event(&s->iob, IOEVT_WRITE);
 
-  if (bytes < size && (s->flags & SOCK_NBIO) == 0) {
+  if (bytes < size && (s->flags & SOCK_NBIO) == 0 && (flags & MSG_DONTWAIT) == 0) {
     rc = submit_socket_request(s, &req, SOCKREQ_SEND, msg, s->sndtimeo);
     if (rc < 0) return rc;
 
@@ -690,6 +697,18 @@ static int tcpsock_setsockopt(struct socket *s, int level, int optname, const vo
         }
         break;
 
+      case TCP_CORK:
+        if (!optval || optlen != 4) return -EFAULT;
+        if (*(int *) optval) {
+          s->flags |= SOCK_CORK;
+        } else {
+          s->flags &= ~SOCK_CORK;
+
+          // Push out any data held back while the socket was corked
+          if (s->tcp.pcb) tcp_write(s->tcp.pcb, NULL, 0, TCP_WRITE_FLUSH);
+        }
+        break;
+
       default:
         return -ENOPROTOOPT;
     }
@@ -723,4 +742,5 @@ struct sockops tcpops = {
   tcpsock_setsockopt,
   tcpsock_shutdown,
   tcpsock_socket,
+  NULL,
 };
@@ -33,28 +33,55 @@
 
 #include <net/net.h>
 
+static int copy_datagram(struct msghdr *msg, struct pbuf *p, struct ip_addr *addr, unsigned short port) {
+  struct sockaddr_in *sin;
+  int rc;
+
+  rc = write_iovec(msg->msg_iov, msg->msg_iovlen, p->payload, p->len);
+  msg->msg_flags = rc < p->len ? MSG_TRUNC : 0;
+
+  if (msg->msg_name) {
+    if (msg->msg_namelen < sizeof(struct sockaddr_in)) {
+      rc = -EFAULT;
+    } else {
+      sin = (struct sockaddr_in *) msg->msg_name;
+      sin->sin_family = AF_INET;
+      sin->sin_port = htons(port);
+      sin->sin_addr.s_addr = addr->addr;
+    }
+  }
+  msg->msg_namelen = sizeof(struct sockaddr_in);
+
+  return rc;
+}
+
 static err_t recv_udp(void *arg, struct udp_pcb *pcb, struct pbuf *p, struct ip_addr *addr, unsigned short port) {
   struct socket *s = arg;
   struct sockreq *req = s->waithead;
-  struct sockaddr_in *sin;
+  struct mmsghdr *m;
   int rc;
 
-  if (req) {
-    rc = write_iovec(req->msg->msg_iov, req->msg->msg_iovlen, p->payload, p->len);
-    if (rc < p->len) rc = -EMSGSIZE;
+  if (req && req->type == SOCKREQ_RECVMMSG) {
+    // Copy datagram directly into the next entry of the waiting batch. The
+    // thread is woken up on the first datagram, but the request stays on the
+    // wait queue and keeps absorbing datagrams until the thread runs or the
+    // message vector is full.
+    m = &req->msgvec[req->count];
+    rc = copy_datagram(&m->msg_hdr, p, addr, port);
+    pbuf_free(p);
 
-    if (req->msg->msg_name) {
-      if (req->msg->msg_namelen < sizeof(struct sockaddr_in)) {
-        rc = -EFAULT;
-      } else {
-        sin = (struct sockaddr_in *) req->msg->msg_name;
-        sin->sin_family = AF_INET;
-        sin->sin_port = htons(port);
-        sin->sin_addr.s_addr = addr->addr;
-      }
+    if (rc < 0 && req->count == 0) {
+      release_socket_request(req, rc);
+      return 0;
     }
-    req->msg->msg_namelen = sizeof(struct sockaddr_in);
-
+    m->msg_len = rc < 0 ? 0 : rc;
+
+    req->rc = ++req->count;
+    if (req->count == 1) mark_thread_ready(req->thread, 1, 2);
+    if (req->count == req->vlen) cancel_socket_request(req);
+  } else if (req) {
+    rc = copy_datagram(req->msg, p, addr, port);
+    if (rc >= 0 && (req->msg->msg_flags & MSG_TRUNC)) rc = -EMSGSIZE;
     pbuf_free(p);
 
     release_socket_request(req, rc);
@@ -64,6 +91,13 @@ static err_t recv_udp(void *arg, struct udp_pcb *pcb, struct pbuf *p, struct ip_
       return -EINVAL;
     }
 
+    if (s->udp.rcvqueued + p->len > s->udp.rcvbuf) {
+      s->udp.rcvdrops++;
+      stats.udp.drop++;
+      return -ENOBUFS;
+    }
+    s->udp.rcvqueued += p->len;
+
     if (s->udp.recvtail) {
       pbuf_chain(s->udp.recvtail, p);
       s->udp.recvtail = p;
@@ -113,7 +147,12 @@ static int udpsock_close(struct socket *s) {
   req = s->waithead;
   while (req) {
     next = req->next;
-    release_socket_request(req, -EABORT);
+    if (req->type == SOCKREQ_RECVMMSG && req->count > 0) {
+      // Thread has already been woken up with a partial batch
+      cancel_socket_request(req);
+    } else {
+      release_socket_request(req, -EABORT);
+    }
     req = next;
   }
 
@@ -123,6 +162,8 @@ static int udpsock_close(struct socket *s) {
   }
 
   if (s->udp.recvhead) pbuf_free(s->udp.recvhead);
+  s->udp.recvhead = s->udp.recvtail = NULL;
+  s->udp.rcvqueued = 0;
 
   return 0;
 }
@@ -184,7 +225,28 @@ static int udpsock_getsockname(struct socket *s, struct sockaddr *name, int *nam
 }
 
 static int udpsock_getsockopt(struct socket *s, int level, int optname, void *optval, int *optlen) {
-  return -ENOSYS;
+  if (level == SOL_SOCKET) {
+    switch (optname) {
+      case SO_RCVBUF:
+        if (*optlen < 4) return -EINVAL;
+        *(unsigned int *) optval = s->udp.rcvbuf;
+        *optlen = 4;
+        break;
+
+      case SO_RCVDROPS:
+        if (*optlen < 4) return -EINVAL;
+        *(unsigned long *) optval = s->udp.rcvdrops;
+        *optlen = 4;
+        break;
+
+      default:
+        return -ENOPROTOOPT;
+    }
+  } else {
+    return -ENOPROTOOPT;
+  }
+
+  return 0;
 }
 
 static int udpsock_ioctl(struct socket *s, int cmd, void *data, size_t size) {
@@ -209,7 +271,7 @@ static int udpsock_listen(struct socket *s, int backlog) {
   return -EINVAL;
 }
 
-static int udpsock_recvmsg(struct socket *s, struct msghdr *msg, unsigned int flags) {
+static int dequeue_datagram(struct socket *s, struct msghdr *msg) {
   struct pbuf *p;
   struct udp_hdr *udphdr;
   struct ip_hdr *iphdr;
@@ -217,40 +279,49 @@ static int udpsock_recvmsg(struct socket *s, struct msghdr *msg, unsigned int fl
   int len;
   int rc;
   struct sockaddr_in *sin;
-  struct sockreq req;
-
-  if (msg->msg_name && msg->msg_namelen < sizeof(struct sockaddr_in)) return -EFAULT;
-  if (!s->udp.pcb || s->udp.pcb->local_port == 0) return -EINVAL;
 
   p = s->udp.recvhead;
-  if (p) {
-    s->udp.recvhead = pbuf_dechain(p);
-    if (!s->udp.recvhead) s->udp.recvtail = NULL; 
-    if (!s->udp.recvhead) clear_io_event(&s->iob, IOEVT_READ);
+  s->udp.recvhead = pbuf_dechain(p);
+  if (!s->udp.recvhead) s->udp.recvtail = NULL; 
+  if (!s->udp.recvhead) clear_io_event(&s->iob, IOEVT_READ);
 
-    buf = p->payload;
-    len = p->len;
+  buf = p->payload;
+  len = p->len;
+  s->udp.rcvqueued -= len;
 
-    pbuf_header(p, UDP_HLEN);
-    udphdr = p->payload;
+  pbuf_header(p, UDP_HLEN);
+  udphdr = p->payload;
 
-    //FIXME: this does not work if there are options in the ip header
-    pbuf_header(p, IP_HLEN); 
-    iphdr = p->payload;
+  //FIXME: this does not work if there are options in the ip header
+  pbuf_header(p, IP_HLEN); 
+  iphdr = p->payload;
 
-    rc = write_iovec(msg->msg_iov, msg->msg_iovlen, buf, len);
-    if (rc < len) rc = -EMSGSIZE;
+  rc = write_iovec(msg->msg_iov, msg->msg_iovlen, buf, len);
+  msg->msg_flags = rc < len ? MSG_TRUNC : 0;
 
-    if (msg->msg_name) {
-      sin = (struct sockaddr_in *) msg->msg_name;
-      sin->sin_family = AF_INET;
-      sin->sin_port = udphdr->src;
-      sin->sin_addr.s_addr = iphdr->src.addr;
-    }
-    msg->msg_namelen = sizeof(struct sockaddr_in);
+  if (msg->msg_name) {
+    sin = (struct sockaddr_in *) msg->msg_name;
+    sin->sin_family = AF_INET;
+    sin->sin_port = udphdr->src;
+    sin->sin_addr.s_addr = iphdr->src.addr;
+  }
+  msg->msg_namelen = sizeof(struct sockaddr_in);
 
-    pbuf_free(p);
-  } else if (s->flags & SOCK_NBIO) {
+  pbuf_free(p);
+  return rc;
+}
+
+static int udpsock_recvmsg(struct socket *s, struct msghdr *msg, unsigned int flags) {
+  int rc;
+  struct sockreq req;
+
+  if (msg->msg_name && msg->msg_namelen < sizeof(struct sockaddr_in)) return -EFAULT;
+  if (!s->udp.pcb || s->udp.pcb->local_port == 0) return -EINVAL;
+
+  if (s->udp.recvhead) {
+    rc = dequeue_datagram(s, msg);
+    if (rc >= 0 && (msg->msg_flags & MSG_TRUNC)) rc = -EMSGSIZE;
+  } else if ((s->flags & SOCK_NBIO) || (flags & MSG_DONTWAIT)) {
     rc = -EAGAIN;
   } else {
     rc = submit_socket_request(s, &req, SOCKREQ_RECV, msg, s->rcvtimeo);
@@ -259,6 +330,35 @@ static int udpsock_recvmsg(struct socket *s, struct msghdr *msg, unsigned int fl
   return rc;
 }
 
+static int udpsock_recvmmsg(struct socket *s, struct mmsghdr *msgvec, unsigned int vlen, unsigned int flags) {
+  unsigned int i;
+  unsigned int count;
+  int rc;
+  struct sockreq req;
+
+  for (i = 0; i < vlen; i++) {
+    if (msgvec[i].msg_hdr.msg_name && msgvec[i].msg_hdr.msg_namelen < sizeof(struct sockaddr_in)) return -EFAULT;
+  }
+  if (!s->udp.pcb || s->udp.pcb->local_port == 0) return -EINVAL;
+
+  // Return queued datagrams without waiting. Truncated datagrams are
+  // returned with MSG_TRUNC set in the entry flags.
+  count = 0;
+  while (count < vlen && s->udp.recvhead) {
+    rc = dequeue_datagram(s, &msgvec[count].msg_hdr);
+    msgvec[count++].msg_len = rc;
+  }
+  if (count > 0) return count;
+
+  if ((s->flags & SOCK_NBIO) || (flags & MSG_DONTWAIT)) return -EAGAIN;
+
+  // Wait for datagrams to be delivered directly into the message vector
+  req.msgvec = msgvec;
+  req.vlen = vlen;
+  req.count = 0;
+  return submit_socket_request(s, &req, SOCKREQ_RECVMMSG, &msgvec[0].msg_hdr, s->rcvtimeo);
+}
+
 static int udpsock_sendmsg(struct socket *s, struct msghdr *msg, unsigned int flags) {
   struct pbuf *p;
   int size;
@@ -323,6 +423,13 @@ static int udpsock_setsockopt(struct socket *s, int level, int optname, const vo
         s->rcvtimeo = *(unsigned int *) optval;
         break;
 
+      case SO_RCVBUF:
+        if (optlen != 4) return -EINVAL;
+        s->udp.rcvbuf = *(unsigned int *) optval;
+        if (s->udp.rcvbuf < UDP_MIN_RCVBUF) s->udp.rcvbuf = UDP_MIN_RCVBUF;
+        if (s->udp.rcvbuf > UDP_MAX_RCVBUF) s->udp.rcvbuf = UDP_MAX_RCVBUF;
+        break;
+
       default:
         return -ENOPROTOOPT;
     }
@@ -338,6 +445,7 @@ static int udpsock_shutdown(struct socket *s, int how) {
 }
 
 static int udpsock_socket(struct socket *s, int domain, int type, int protocol) {
+  s->udp.rcvbuf = UDP_RCVBUF;
   set_io_event(&s->iob, IOEVT_WRITE);
 
   return 0;
@@ -358,4 +466,5 @@ struct sockops udpops = {
   udpsock_setsockopt,
   udpsock_shutdown,
   udpsock_socket,
+  udpsock_recvmmsg,
 };
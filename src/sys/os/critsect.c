@@ -45,15 +45,20 @@ __inline tid_t threadid() {
   return tib->tid;
 }
 
+//
+// Critical sections are implemented on top of futexes. The lock word is 0
+// when the critical section is free, 1 when it is owned, and 2 when it is
+// owned and other threads may be waiting for it. Entering and leaving an
+// uncontended critical section does not call the kernel.
+//
+
 void mkcs(critsect_t cs) {
-  cs->count = -1;
+  cs->lock = 0;
   cs->recursion = 0;
   cs->owner = NOHANDLE;
-  cs->event = mkevent(0, 0);
 }
 
 void csfree(critsect_t cs) {
-  close(cs->event);
 }
 
 void enter(critsect_t cs) {
@@ -62,7 +67,9 @@ void enter(critsect_t cs) {
   if (cs->owner == tid) {
     cs->recursion++;
   } else {    
-    if (atomic_add(&cs->count, 1) > 0) while (waitone(cs->event, INFINITE) != 0);
+    if (atomic_compare_and_exchange(&cs->lock, 1, 0) != 0) {
+      while (atomic_exchange(&cs->lock, 2) != 0) futex_wait((int *) &cs->lock, 2, INFINITE);
+    }
     cs->owner = tid;
   }
 }
@@ -73,6 +80,6 @@ void leave(critsect_t cs) {
     cs->recursion--;
   } else {
     cs->owner = NOHANDLE;
-    if (atomic_add(&cs->count, -1) >= 0) eset(cs->event);
+    if (atomic_exchange(&cs->lock, 0) == 2) futex_wake((int *) &cs->lock, 1);
   }
 }
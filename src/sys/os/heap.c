@@ -520,6 +520,19 @@ typedef struct chunk *mfastbinptr;
   ((m)->max_fast &  NONCONTIGUOUS_BIT)
 
 
+//
+// Big chunks allocated directly from the system are linked into a list
+// in front of the chunk header so heap_destroy() can release them. The
+// chunk prev_size field holds the offset back to the start of the mapping.
+//
+
+struct mmapchunk {
+  struct mmapchunk *next;
+  struct mmapchunk *prev;
+};
+
+#define MMAP_OFFSET ((sizeof(struct mmapchunk) + ALIGNMASK) & ~ALIGNMASK)
+
 //
 // Internal heap state representation and initialization
 //
@@ -538,6 +551,7 @@ struct heap {
   size_t mmap_threshold;
 
   // Memory map support
+  struct mmapchunk *mmaps;
   int n_mmaps;
   int n_mmaps_max;
   int max_n_mmaps;
@@ -548,6 +562,7 @@ struct heap {
   char *heapend;
   size_t region_size;
   size_t group_size;
+  int growable;
 
   // Statistics
   size_t mmapped_mem;
@@ -695,17 +710,34 @@ static void *sysalloc(size_t nb, struct heap *av) {
   mchunkptr remainder;          // Remainder from allocation
   unsigned long remainder_size; // Its size
   size_t expand;
+  int full;
+
+  // Check if a growable heap has exhausted its region
+  full = 0;
+  if (av->growable && av->region) {
+    expand = (nb + MINSIZE - chunksize(av->top) + av->group_size - 1) & ~(av->group_size - 1);
+    full = av->wilderness + expand > av->heapend;
+  }
 
-  // Allocate big chunks directly from system
-  if (nb >= av->mmap_threshold && av->n_mmaps < av->n_mmaps_max) {
+  // Allocate big chunks directly from system. Growable heaps also get
+  // their memory this way when the region is exhausted.
+  if ((nb >= av->mmap_threshold || full) && av->n_mmaps < av->n_mmaps_max) {
     char *mem;
+    struct mmapchunk *m;
 
-    size = (nb + sizeof(size_t) + ALIGNMASK + PAGESIZE - 1) & ~(PAGESIZE - 1);
+    size = (nb + MMAP_OFFSET + sizeof(size_t) + ALIGNMASK + PAGESIZE - 1) & ~(PAGESIZE - 1);
 
     mem = (char *) vmalloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, 'MALL');
     if (mem != NULL) {
-      p = (mchunkptr) mem;
-      set_head(p, size | IS_MMAPPED);
+      m = (struct mmapchunk *) mem;
+      m->next = av->mmaps;
+      m->prev = NULL;
+      if (av->mmaps) av->mmaps->prev = m;
+      av->mmaps = m;
+
+      p = (mchunkptr) (mem + MMAP_OFFSET);
+      p->prev_size = MMAP_OFFSET;
+      set_head(p, (size - MMAP_OFFSET) | IS_MMAPPED);
       //syslog(LOG_DEBUG | LOG_HEAP, "Big allocation %dK", size / 1024);
 
       // Update statistics
@@ -721,7 +753,7 @@ static void *sysalloc(size_t nb, struct heap *av) {
   // Allocate memory from the system
   if (av->region == NULL) {
     av->region = (char *) vmalloc(NULL, av->region_size, MEM_RESERVE, 0, 'MALL');
-    if (!av->region) panic("unable to reserve heap region");
+    if (!av->region) return NULL;
     //syslog(LOG_HEAP | LOG_DEBUG, "Reserve heap %p", region);
     av->wilderness = av->region;
     av->heapend = av->region + av->region_size;
@@ -733,9 +765,9 @@ static void *sysalloc(size_t nb, struct heap *av) {
   // Commit one or more groups from region
   expand = (nb + MINSIZE - size + av->group_size - 1)  & ~(av->group_size - 1);
   //syslog(LOG_HEAP | LOG_DEBUG, "Expand heap: request = %d, remaining = %d, expansion = %d", nb, size, expand);
-  if (av->wilderness + expand > av->heapend) panic("out of memory");
+  if (av->wilderness + expand > av->heapend) return NULL;
 
-  if (vmalloc(av->wilderness, expand, MEM_COMMIT, PAGE_READWRITE, 'MALL') == 0) panic("unable to expand heap");
+  if (vmalloc(av->wilderness, expand, MEM_COMMIT, PAGE_READWRITE, 'MALL') == 0) return NULL;
   av->wilderness += expand;
 
   if (size == 0) {
@@ -1186,12 +1218,20 @@ void heap_free(struct heap *av, void *mem) {
       // check_inuse_chunk (above) will have triggered error.
       int ret;
       size_t offset = p->prev_size;
+      struct mmapchunk *m = (struct mmapchunk *) ((char *) p - offset);
 
       av->n_mmaps--;
       av->mmapped_mem -= (size + offset);
 
+      if (m->next) m->next->prev = m->prev;
+      if (m->prev) {
+        m->prev->next = m->next;
+      } else {
+        av->mmaps = m->next;
+      }
+
       //syslog(LOG_DEBUG | LOG_HEAP, "Free big chunk %dK (%d)", size / 1024, offset);
-      ret = vmfree(p - offset, size + offset, MEM_RELEASE);
+      ret = vmfree(m, size + offset, MEM_RELEASE);
       // vmfree returns non-zero on failure
       assert(ret == 0);
     }
@@ -1435,7 +1475,7 @@ int heap_malloc_usable_size(void *mem) {
 // heap_create
 //
 
-struct heap *heap_create(size_t region_size, size_t group_size) {
+struct heap *heap_create(size_t region_size, size_t group_size, int growable) {
   struct heap *av;
 
   av = (struct heap *) vmalloc(NULL, sizeof(struct heap), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, 'HBLK');
@@ -1443,18 +1483,66 @@ struct heap *heap_create(size_t region_size, size_t group_size) {
 
   av->region_size = region_size;
   av->group_size = group_size;
+  av->growable = growable;
 
   return av;
 }
 
+//
+// heap_commit
+//
+// Reserves the heap region and commits the first size bytes of it, so
+// the initial allocations do not need to expand the heap.
+//
+
+int heap_commit(struct heap *av, size_t size) {
+  if (av->region) return 0;
+  if (av->max_fast == 0) heap_consolidate(av);
+
+  size = (size + av->group_size - 1) & ~(av->group_size - 1);
+  if (size > av->region_size) size = av->region_size;
+  if (size == 0) return 0;
+
+  av->region = (char *) vmalloc(NULL, av->region_size, MEM_RESERVE, 0, 'MALL');
+  if (!av->region) return -ENOMEM;
+  av->heapend = av->region + av->region_size;
+  if (vmalloc(av->region, size, MEM_COMMIT, PAGE_READWRITE, 'MALL') == 0) {
+    vmfree(av->region, av->region_size, MEM_RELEASE);
+    av->region = NULL;
+    return -ENOMEM;
+  }
+  av->wilderness = av->region + size;
+
+  av->top = (mchunkptr) av->region;
+  set_head(av->top, size | PREV_INUSE);
+
+  av->sbrked_mem += size;
+  if (av->sbrked_mem > av->max_sbrked_mem) av->max_sbrked_mem = av->sbrked_mem;
+  if (av->sbrked_mem + av->mmapped_mem > av->max_total_mem) av->max_total_mem = av->sbrked_mem + av->mmapped_mem;
+
+  return 0;
+}
+
 //
 // heap_destroy
 //
 
 int heap_destroy(struct heap *av)
 {
+  struct mmapchunk *m;
+  struct mmapchunk *next;
+  mchunkptr p;
+
+  // Release big chunks allocated directly from system
+  m = av->mmaps;
+  while (m) {
+    next = m->next;
+    p = (mchunkptr) ((char *) m + MMAP_OFFSET);
+    vmfree(m, chunksize(p) + MMAP_OFFSET, MEM_RELEASE);
+    m = next;
+  }
+
   if (av->region) vmfree(av->region, av->heapend - av->region, MEM_RELEASE);
-  // TODO release big chunks allocated directly from system
   vmfree(av, sizeof(struct heap), MEM_RELEASE);
   return 0;
 }
@@ -43,7 +43,8 @@ void heap_free(struct heap *av, void *p);
 struct mallinfo heap_mallinfo(struct heap *av);
 int heap_malloc_usable_size(void *p);
 
-struct heap *heap_create(size_t region_size, size_t group_size);
+struct heap *heap_create(size_t region_size, size_t group_size, int growable);
+int heap_commit(struct heap *av, size_t size);
 int heap_destroy(struct heap *av);
 
 #endif
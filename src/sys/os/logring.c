@@ -0,0 +1,280 @@
+//
+// logring.c
+//
+// Asynchronous buffered log writer
+//
+// Copyright (C) 2013 Michael Ringgaard. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 
+// 1. Redistributions of source code must retain the above copyright 
+//    notice, this list of conditions and the following disclaimer.  
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.  
+// 3. Neither the name of the project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission. 
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+// 
+
+#include <os.h>
+#include <string.h>
+#include <inifile.h>
+
+//
+// Each thread that logs gets its own ring buffer. The thread is the only
+// producer for its ring and the log writer thread is the only consumer, so
+// records can be added without locking. The log writer drains the rings
+// periodically, or when a ring gets half full, and combines consecutive
+// records for the same file into one writev() call.
+//
+
+#define LOGREC_ALIGN   16
+#define LOGREC_PAD     -1
+#define LOGIOV_MAX     32
+
+struct logrec {
+  handle_t f;
+  int size;
+  int flags;
+  int reserved;
+};
+
+struct logring {
+  struct logring *next;
+  char *buffer;
+  int size;
+  volatile int head;
+  volatile int tail;
+  int drops;
+  int reported;
+};
+
+static tls_t logtls = INVALID_TLS_INDEX;
+static struct critsect loglock;
+static struct logring *logrings;
+static handle_t logevent = NOHANDLE;
+static int logringsize;
+static int loginterval;
+
+static struct logring *attach_logring() {
+  struct logring *ring;
+
+  ring = (struct logring *) malloc(sizeof(struct logring));
+  if (!ring) return NULL;
+  memset(ring, 0, sizeof(struct logring));
+
+  ring->buffer = (char *) malloc(logringsize);
+  if (!ring->buffer) {
+    free(ring);
+    return NULL;
+  }
+  ring->size = logringsize;
+
+  enter(&loglock);
+  ring->next = logrings;
+  logrings = ring;
+  leave(&loglock);
+
+  tlsset(logtls, ring);
+  return ring;
+}
+
+static void drain_logring(struct logring *ring) {
+  struct iovec iov[LOGIOV_MAX];
+  struct logrec *rec;
+  handle_t f;
+  int head;
+  int tail;
+  int next;
+  int n;
+
+  head = ring->head;
+  tail = ring->tail;
+  while (tail != head) {
+    rec = (struct logrec *) (ring->buffer + tail);
+    if (rec->size == LOGREC_PAD) {
+      tail = 0;
+      ring->tail = tail;
+      continue;
+    }
+
+    // Gather consecutive records for the same file
+    f = rec->f;
+    n = 0;
+    next = tail;
+    while (next != head && n < LOGIOV_MAX) {
+      rec = (struct logrec *) (ring->buffer + next);
+      if (rec->size == LOGREC_PAD || rec->f != f) break;
+      if (n > 0 && (rec->flags & LOGWRITE_RECORD)) break;
+
+      iov[n].iov_base = (char *) (rec + 1);
+      iov[n].iov_len = rec->size;
+      n++;
+      next += (sizeof(struct logrec) + rec->size + LOGREC_ALIGN - 1) & ~(LOGREC_ALIGN - 1);
+      if (next == ring->size) next = 0;
+      if (rec->flags & LOGWRITE_RECORD) break;
+    }
+
+    writev(f, iov, n);
+    tail = next;
+    ring->tail = tail;
+  }
+}
+
+static void drain_logrings() {
+  struct logring *ring;
+  int total;
+  int drops;
+
+  total = 0;
+  for (ring = logrings; ring; ring = ring->next) {
+    drain_logring(ring);
+
+    // Records dropped while reporting are counted in the next round
+    drops = ring->drops;
+    total += drops - ring->reported;
+    ring->reported = drops;
+  }
+
+  if (total > 0) syslog(LOG_WARNING | LOG_SYSLOG, "%d log records dropped", total);
+}
+
+void detach_logring() {
+  struct logring *ring;
+  struct logring **pring;
+
+  if (logtls == INVALID_TLS_INDEX) return;
+  ring = (struct logring *) tlsget(logtls);
+  if (!ring) return;
+  tlsset(logtls, NULL);
+
+  // Write out the records of the terminating thread and release its ring
+  enter(&loglock);
+  drain_logring(ring);
+  for (pring = &logrings; *pring; pring = &(*pring)->next) {
+    if (*pring == ring) {
+      *pring = ring->next;
+      break;
+    }
+  }
+  leave(&loglock);
+
+  free(ring->buffer);
+  free(ring);
+}
+
+static void __stdcall logwriter(void *arg) {
+  while (1) {
+    waitone(logevent, loginterval);
+
+    enter(&loglock);
+    drain_logrings();
+    leave(&loglock);
+  }
+}
+
+int logwrite(handle_t f, const void *data, int size, int flags) {
+  struct logring *ring;
+  struct logrec *rec;
+  int head;
+  int tail;
+  int need;
+  int used;
+  int rc;
+
+  if (size < 0) return -EINVAL;
+  if (logtls == INVALID_TLS_INDEX) return write(f, data, size);
+
+  ring = (struct logring *) tlsget(logtls);
+
+  // Large records are written directly after the queued records
+  need = (sizeof(struct logrec) + size + LOGREC_ALIGN - 1) & ~(LOGREC_ALIGN - 1);
+  if (need > logringsize / 2) {
+    enter(&loglock);
+    if (ring) drain_logring(ring);
+    rc = write(f, data, size);
+    leave(&loglock);
+    return rc;
+  }
+
+  if (!ring) {
+    ring = attach_logring();
+    if (!ring) return write(f, data, size);
+  }
+
+  // The head must not catch up with the tail, since head == tail means
+  // the ring is empty
+  head = ring->head;
+  tail = ring->tail;
+  if (tail > head) {
+    if (need >= tail - head) goto full;
+  } else if (head + need > ring->size || (head + need == ring->size && tail == 0)) {
+    // Mark the rest of the ring as padding and wrap around
+    if (need >= tail) goto full;
+    rec = (struct logrec *) (ring->buffer + head);
+    rec->size = LOGREC_PAD;
+    head = 0;
+  }
+
+  rec = (struct logrec *) (ring->buffer + head);
+  rec->f = f;
+  rec->size = size;
+  rec->flags = flags;
+  memcpy(rec + 1, data, size);
+  head += need;
+  ring->head = head == ring->size ? 0 : head;
+
+  // Wake up the log writer if the ring is getting full
+  used = ring->head - tail;
+  if (used < 0) used += ring->size;
+  if (used > ring->size / 2) eset(logevent);
+
+  return size;
+
+full:
+  ring->drops++;
+  eset(logevent);
+  errno = EAGAIN;
+  return -1;
+}
+
+int logflush() {
+  if (logtls == INVALID_TLS_INDEX) return 0;
+
+  enter(&loglock);
+  drain_logrings();
+  leave(&loglock);
+
+  return 0;
+}
+
+void start_logwriter() {
+  logringsize = get_numeric_property(osconfig(), "os", "logbuffer", 16 * 1024);
+  loginterval = get_numeric_property(osconfig(), "os", "logflush", 1000);
+  if (logringsize <= 0) return;
+  logringsize = (logringsize + LOGREC_ALIGN - 1) & ~(LOGREC_ALIGN - 1);
+
+  mkcs(&loglock);
+  logevent = mkevent(0, 0);
+  if (logevent < 0) return;
+
+  logtls = tlsalloc();
+  if (logtls == INVALID_TLS_INDEX) return;
+
+  close(beginthread(logwriter, 0, NULL, 0, "logwriter", NULL));
+}
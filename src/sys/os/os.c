@@ -277,7 +277,7 @@ struct heap *create_module_heap(hmodule_t hmod) {
   if (region_size == 0) region_size = 64 * 1024 * 1024;
   if (group_size < 128 * 1024) group_size = 128 * 1024;
 
-  return heap_create(region_size, group_size);
+  return heap_create(region_size, group_size, 0);
 }
 
 void *malloc(size_t size) {
@@ -349,21 +349,78 @@ struct heap *get_local_heap() {
 }
 
 void *_lmalloc(size_t size) {
-  return heap_alloc(get_local_heap(), size);
+  void *p = heap_alloc(get_local_heap(), size);
+  if (!p && size) panic("malloc: out of memory");
+  return p;
 }
 
 void *_lrealloc(void *mem, size_t size) {
-  return heap_realloc(get_local_heap(), mem, size);
+  void *p = heap_realloc(get_local_heap(), mem, size);
+  if (!p && size) panic("realloc: out of memory");
+  return p;
 }
 
 void *_lcalloc(size_t num, size_t size) {
-  return heap_calloc(get_local_heap(), num, size);
+  void *p = heap_calloc(get_local_heap(), num, size);
+  if (!p && size * num != 0) panic("calloc: out of memory");
+  return p;
 }
 
 void _lfree(void *p) {
   heap_free(get_local_heap(), p);
 }
 
+//
+// Private heaps
+//
+// The caller is responsible for serializing access to a private heap.
+// If reserve is zero the heap is growable. Otherwise allocations return
+// NULL when the heap reservation is exhausted. The first commit bytes
+// of the heap are committed up front.
+//
+
+struct heap *mkheap(size_t reserve, size_t commit) {
+  struct heap *heap;
+  int growable;
+
+  reserve = (reserve + PAGESIZE - 1) & ~(PAGESIZE - 1);
+  commit = (commit + PAGESIZE - 1) & ~(PAGESIZE - 1);
+  growable = reserve == 0;
+  if (growable) reserve = 16 * 1024 * 1024;
+  if (commit > reserve) reserve = commit;
+
+  heap = heap_create(reserve, 64 * 1024, growable);
+  if (!heap) return NULL;
+
+  if (commit > 0 && heap_commit(heap, commit) < 0) {
+    heap_destroy(heap);
+    return NULL;
+  }
+
+  return heap;
+}
+
+int rmheap(struct heap *heap) {
+  if (!heap) return -EINVAL;
+  return heap_destroy(heap);
+}
+
+void *halloc(struct heap *heap, size_t size) {
+  return heap_alloc(heap, size);
+}
+
+void *hrealloc(struct heap *heap, void *mem, size_t size) {
+  return heap_realloc(heap, mem, size);
+}
+
+void *hcalloc(struct heap *heap, size_t num, size_t size) {
+  return heap_calloc(heap, num, size);
+}
+
+void hfree(struct heap *heap, void *p) {
+  heap_free(heap, p);
+}
+
 //
 // Module routines
 //
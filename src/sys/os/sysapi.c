@@ -434,6 +434,14 @@ int semrel(handle_t h, int count) {
   return syscall(SYSCALL_SEMREL, &h);
 }
 
+int futex_wait(int *addr, int value, unsigned int timeout) {
+  return syscall(SYSCALL_FUTEX_WAIT, (void *) &addr);
+}
+
+int futex_wake(int *addr, int count) {
+  return syscall(SYSCALL_FUTEX_WAKE, (void *) &addr);
+}
+
 int accept(int s, struct sockaddr *addr, int *addrlen) {
   return syscall(SYSCALL_ACCEPT, &s);
 }
@@ -502,6 +510,10 @@ int dispatch(handle_t iomux, handle_t h, int events, int context) {
   return syscall(SYSCALL_DISPATCH, (void *) &iomux);
 }
 
+int iopost(handle_t iomux, int context) {
+  return syscall(SYSCALL_IOPOST, (void *) &iomux);
+}
+
 int recvmsg(int s, struct msghdr *hdr, unsigned int flags) {
   return syscall(SYSCALL_RECVMSG, (void *) &s);
 }
@@ -510,6 +522,14 @@ int sendmsg(int s, struct msghdr *hdr, unsigned int flags) {
   return syscall(SYSCALL_SENDMSG, (void *) &s);
 }
 
+int recvmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, unsigned int flags) {
+  return syscall(SYSCALL_RECVMMSG, (void *) &s);
+}
+
+int sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, unsigned int flags) {
+  return syscall(SYSCALL_SENDMMSG, (void *) &s);
+}
+
 int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, const struct timeval *timeout) {
   return syscall(SYSCALL_SELECT, (void *) &nfds);
 }
@@ -518,6 +538,10 @@ int pipe(handle_t fildes[2]) {
   return syscall(SYSCALL_PIPE, (void *) &fildes);
 }
 
+int splice(handle_t in, handle_t out, size_t size, int flags) {
+  return syscall(SYSCALL_SPLICE, (void *) &in);
+}
+
 handle_t dup2(handle_t h1, handle_t h2) {
   return syscall(SYSCALL_DUP2, (void *) &h1);
 }
@@ -132,6 +132,8 @@ char *sys_errlist[] = {
   /* 87 ECHKSUM         */  "Checksum error",
   /* 88 EBADSLT         */  "Invalid slot",
   /* 89 EREMOTEIO       */  "Remote I/O error",
+  /* 90 ECANCELED       */  "Operation canceled",
+  /* 91 EPENDING        */  "I/O operation pending",
 };
 
 int sys_nerr = sizeof(sys_errlist) / sizeof(sys_errlist[0]);
@@ -42,6 +42,7 @@ extern const char *_months_abbrev[]; // in time.c
 
 int vsprintf(char *buf, const char *fmt, va_list args);
 int sprintf(char *buf, const char *fmt, ...);
+void start_logwriter();
 
 unsigned long logmask = LOG_UPTO(LOG_DEBUG);
 
@@ -76,13 +77,13 @@ int setlogmask(int mask) {
 
 static void add_to_syslog(int pri, char *msg, int msglen, char *ident, int id, int display) {
   struct peb *peb = getpeb();
-  char buffer[1024];
-  char pribuf[32];
+  char buffer[1280];
   char *bufend;
   char *hostname;
+  int prilen;
+  int len;
   time_t now;
   struct tm tm;
-  struct iovec iov[4];
 
   if ((logmask & LOG_MASK(LOG_PRI(pri))) == 0) return;
   
@@ -97,36 +98,33 @@ static void add_to_syslog(int pri, char *msg, int msglen, char *ident, int id, i
   now = time(NULL);
   localtime_r(&now, &tm);
 
-  sprintf(pribuf, "<%d>", pri);
+  sprintf(buffer, "<%d>", pri);
+  prilen = strlen(buffer);
 
-  sprintf(buffer, "%s %2d %02d:%02d:%02d %s ", _months_abbrev[tm.tm_mon], tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, hostname);
-  bufend = buffer + strlen(buffer);
+  bufend = buffer + prilen;
+  sprintf(bufend, "%s %2d %02d:%02d:%02d %.64s ", _months_abbrev[tm.tm_mon], tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, hostname);
+  bufend += strlen(bufend);
 
   if (ident) {
     if (id != -1) {
-      sprintf(bufend, "%s[%d]: ", ident, id);
+      sprintf(bufend, "%.64s[%d]: ", ident, id);
     } else {
-      sprintf(bufend, "%s: ", ident);
+      sprintf(bufend, "%.64s: ", ident);
     }
 
     bufend += strlen(bufend);
   }
 
-  iov[0].iov_base = pribuf;
-  iov[0].iov_len = strlen(pribuf);
-
-  iov[1].iov_base = buffer;
-  iov[1].iov_len = bufend - buffer;
-
-  iov[2].iov_base = msg;
-  iov[2].iov_len = msglen;
+  // Build the complete log line and hand it to the log writer
+  len = bufend - buffer;
+  if (msglen > sizeof(buffer) - len - 1) msglen = sizeof(buffer) - len - 1;
+  memcpy(bufend, msg, msglen);
+  len += msglen;
+  buffer[len++] = '\n';
 
-  iov[3].iov_base = "\n";
-  iov[3].iov_len = 1;
-
-  if (display) writev(syslogcons, iov + 1, 3);
-  if (syslogfd >= 0) writev(syslogfd, iov, 4);
-  if (syslogsock >= 0) writev(syslogsock, iov, 3);
+  if (display) logwrite(syslogcons, buffer + prilen, len - prilen, 0);
+  if (syslogfd >= 0) logwrite(syslogfd, buffer, len, 0);
+  if (syslogsock >= 0) logwrite(syslogsock, buffer, len - 1, LOGWRITE_RECORD);
 }
 
 void vsyslog(int pri, const char *fmt, va_list args) {
@@ -224,6 +222,8 @@ void start_syslog() {
   char *logfn;
   char *loghost;
 
+  start_logwriter();
+
   logmask = LOG_UPTO(get_numeric_property(osconfig(), "os", "loglevel", LOG_DEBUG));
   syslogcons = fderr;
 
@@ -257,6 +257,8 @@ void start_syslog() {
 }
 
 void stop_syslog() {
+  logflush();
+
   if (syslogfd >= 0) {
     close(syslogfd);
     syslogfd = -1;
@@ -48,6 +48,9 @@ char **initenv(struct section *sect);
 char **copyenv(char **env);
 void freeenv(char **env);
 
+// logring.c
+void detach_logring();
+
 struct critsect proc_lock;
 int nextprocid = 1;
 
@@ -242,6 +245,8 @@ void endproc(struct process *proc, int status) {
 void endthread(int status) {
   struct process *proc;
 
+  detach_logring();
+
   proc = gettib()->proc;
   if (atomic_add(&proc->threadcnt, -1) == 0) endproc(proc, status);
 
@@ -330,6 +330,7 @@ void doretr(struct ftpstate *fs, char *name) {
   clock_t ended;
   int ofs;
   int n;
+  int on = 1;
   char buf[4096];
   double t;
   double speed;
@@ -370,6 +371,9 @@ void doretr(struct ftpstate *fs, char *name) {
     return;
   }
 
+  // Cork the data connection so file blocks are sent in full-sized segments
+  setsockopt(sock, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+
   if (fs->restartat == st.st_size) {
     close(f);
     close(sock);
@@ -819,6 +823,7 @@ void donlist(struct ftpstate *fs, char *arg) {
   int sock;
   int matches;
   int opt_l = 0;
+  int on = 1;
   time_t now = time(NULL);
 
   while (isspace(*arg)) arg++;
@@ -852,6 +857,7 @@ void donlist(struct ftpstate *fs, char *arg) {
     closedir(dir);
     return;
   }
+  setsockopt(sock, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
   doreply(fs);
 
   matches = 0;
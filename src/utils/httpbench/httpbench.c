@@ -0,0 +1,523 @@
+//
+// httpbench.c
+//
+// HTTP load generator
+//
+// Copyright (C) 2013 Michael Ringgaard. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 
+// 1. Redistributions of source code must retain the above copyright 
+//    notice, this list of conditions and the following disclaimer.  
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.  
+// 3. Neither the name of the project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission. 
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+// 
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define RSPBUFSIZE (16 * 1024)
+
+struct target {
+  char host[256];
+  int port;
+  char path[1024];
+  struct sockaddr_in addr;
+  char request[2048];
+  int reqlen;
+};
+
+struct worker {
+  pthread_t thread;
+  int sock;
+  char buffer[RSPBUFSIZE];
+  int buflen;
+
+  int requests;
+  int errors;
+  int non2xx;
+  int connects;
+  double bytes;
+
+  int *latency;
+  int nlatency;
+  int maxlatency;
+};
+
+struct target target;
+int keepalive = 1;
+int verbose = 0;
+int duration = 0;
+
+pthread_mutex_t lock;
+int remaining;
+volatile int stop;
+
+double now() {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int parse_url(char *url, struct target *t) {
+  char *p;
+  char *q;
+  int n;
+
+  if (strncmp(url, "http://", 7) == 0) url += 7;
+  p = url;
+  while (*p && *p != ':' && *p != '/') p++;
+  n = p - url;
+  if (n == 0 || n >= (int) sizeof(t->host)) return -1;
+  memcpy(t->host, url, n);
+  t->host[n] = 0;
+
+  t->port = 80;
+  if (*p == ':') {
+    t->port = strtol(p + 1, &q, 10);
+    if (t->port <= 0 || t->port > 65535) return -1;
+    p = q;
+  }
+
+  if (*p == 0) p = "/";
+  if (*p != '/' || strlen(p) >= sizeof(t->path)) return -1;
+  strcpy(t->path, p);
+
+  return 0;
+}
+
+int resolve(struct target *t) {
+  struct hostent *hp;
+
+  memset(&t->addr, 0, sizeof(t->addr));
+  t->addr.sin_family = AF_INET;
+  t->addr.sin_port = htons(t->port);
+
+  hp = gethostbyname(t->host);
+  if (!hp) return -1;
+  memcpy(&t->addr.sin_addr, hp->h_addr_list[0], hp->h_length);
+
+  sprintf(t->request, "GET %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: httpbench\r\nConnection: %s\r\n\r\n",
+          t->path, t->host, keepalive ? "Keep-Alive" : "close");
+  t->reqlen = strlen(t->request);
+
+  return 0;
+}
+
+int next_request() {
+  int more;
+
+  if (stop) return 0;
+  if (duration) return 1;
+
+  pthread_mutex_lock(&lock);
+  more = remaining > 0;
+  if (more) remaining--;
+  pthread_mutex_unlock(&lock);
+
+  return more;
+}
+
+void disconnect(struct worker *w) {
+  if (w->sock >= 0) close(w->sock);
+  w->sock = -1;
+  w->buflen = 0;
+}
+
+int connect_target(struct worker *w) {
+  w->sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (w->sock < 0) return -1;
+
+  if (connect(w->sock, (struct sockaddr *) &target.addr, sizeof(target.addr)) < 0) {
+    disconnect(w);
+    return -1;
+  }
+
+  w->connects++;
+  return 0;
+}
+
+int send_request(struct worker *w) {
+  int left = target.reqlen;
+  char *p = target.request;
+  int rc;
+
+  while (left > 0) {
+    rc = send(w->sock, p, left, 0);
+    if (rc <= 0) return -1;
+    p += rc;
+    left -= rc;
+  }
+
+  return 0;
+}
+
+int fill_buffer(struct worker *w) {
+  int rc;
+
+  if (w->buflen == RSPBUFSIZE) return -1;
+  rc = recv(w->sock, w->buffer + w->buflen, RSPBUFSIZE - w->buflen, 0);
+  if (rc <= 0) return rc;
+  w->buflen += rc;
+
+  return rc;
+}
+
+char *find_header_end(char *buf, int len) {
+  int i;
+
+  for (i = 0; i + 3 < len; i++) {
+    if (buf[i] == '\r' && buf[i + 1] == '\n' && buf[i + 2] == '\r' && buf[i + 3] == '\n') return buf + i + 4;
+  }
+
+  return NULL;
+}
+
+int skip_bytes(struct worker *w, int n) {
+  int rc;
+
+  while (n > 0) {
+    if (w->buflen == 0) {
+      rc = fill_buffer(w);
+      if (rc <= 0) return -1;
+    }
+
+    rc = w->buflen < n ? w->buflen : n;
+    memmove(w->buffer, w->buffer + rc, w->buflen - rc);
+    w->buflen -= rc;
+    w->bytes += rc;
+    n -= rc;
+  }
+
+  return 0;
+}
+
+int read_line(struct worker *w, char *line, int size) {
+  int i, n, rc;
+
+  i = 0;
+  while (1) {
+    while (i + 1 < w->buflen && (w->buffer[i] != '\r' || w->buffer[i + 1] != '\n')) i++;
+    if (i + 1 < w->buflen) break;
+    rc = fill_buffer(w);
+    if (rc <= 0) return -1;
+  }
+
+  n = i < size - 1 ? i : size - 1;
+  memcpy(line, w->buffer, n);
+  line[n] = 0;
+
+  return skip_bytes(w, i + 2);
+}
+
+int skip_chunked_body(struct worker *w) {
+  char line[256];
+  char *end;
+  long size;
+
+  while (1) {
+    // Each chunk starts with its size in hex, optionally followed by extensions
+    if (read_line(w, line, sizeof(line)) < 0) return -1;
+    size = strtol(line, &end, 16);
+    if (end == line || size < 0) return -1;
+    if (size == 0) break;
+
+    if (skip_bytes(w, size) < 0) return -1;
+    if (read_line(w, line, sizeof(line)) < 0 || *line) return -1;
+  }
+
+  // Skip trailer fields up to the empty line
+  do {
+    if (read_line(w, line, sizeof(line)) < 0) return -1;
+  } while (*line);
+
+  return 0;
+}
+
+int read_response(struct worker *w, int *status, int *close_conn) {
+  char *end;
+  char *line;
+  char *eol;
+  char *value;
+  int hdrlen;
+  int length;
+  int chunked;
+  int rc;
+
+  // Read response header
+  while ((end = find_header_end(w->buffer, w->buflen)) == NULL) {
+    rc = fill_buffer(w);
+    if (rc <= 0) return -1;
+  }
+  hdrlen = end - w->buffer;
+
+  if (hdrlen < 12 || strncmp(w->buffer, "HTTP/1.", 7) != 0) return -1;
+  *status = atoi(w->buffer + 9);
+
+  // HTTP/1.1 connections are persistent unless the server says otherwise
+  *close_conn = w->buffer[7] == '0';
+  length = -1;
+  chunked = 0;
+
+  // Parse the header fields we need
+  line = w->buffer;
+  while (line < end - 2) {
+    eol = line;
+    while (eol < end && *eol != '\r') eol++;
+
+    if (strncasecmp(line, "Content-Length:", 15) == 0) {
+      length = atoi(line + 15);
+    } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+      value = line + 18;
+      while (*value == ' ') value++;
+      chunked = strncasecmp(value, "chunked", 7) == 0;
+    } else if (strncasecmp(line, "Connection:", 11) == 0) {
+      value = line + 11;
+      while (*value == ' ') value++;
+      if (strncasecmp(value, "close", 5) == 0) {
+        *close_conn = 1;
+      } else if (strncasecmp(value, "keep-alive", 10) == 0) {
+        *close_conn = 0;
+      }
+    }
+
+    line = eol + 2;
+  }
+  if (!keepalive) *close_conn = 1;
+
+  // Skip response body
+  w->bytes += hdrlen;
+  memmove(w->buffer, end, w->buflen - hdrlen);
+  w->buflen -= hdrlen;
+
+  if (*status == 204 || *status == 304 || *status / 100 == 1) return 0;
+  if (chunked) return skip_chunked_body(w);
+  if (length >= 0) return skip_bytes(w, length);
+
+  // No content length, read until connection is closed
+  while (1) {
+    w->bytes += w->buflen;
+    w->buflen = 0;
+    rc = fill_buffer(w);
+    if (rc < 0) return -1;
+    if (rc == 0) break;
+  }
+  *close_conn = 1;
+
+  return 0;
+}
+
+void add_latency(struct worker *w, int usecs) {
+  if (w->nlatency == w->maxlatency) {
+    int size = w->maxlatency ? w->maxlatency * 2 : 1024;
+    int *p = (int *) realloc(w->latency, size * sizeof(int));
+    if (!p) return;
+    w->latency = p;
+    w->maxlatency = size;
+  }
+
+  w->latency[w->nlatency++] = usecs;
+}
+
+void *run_worker(void *arg) {
+  struct worker *w = (struct worker *) arg;
+  double start;
+  int status;
+  int close_conn;
+
+  w->sock = -1;
+  while (next_request()) {
+    start = now();
+
+    if (w->sock < 0 && connect_target(w) < 0) {
+      w->errors++;
+      if (verbose) fprintf(stderr, "httpbench: unable to connect to %s:%d\n", target.host, target.port);
+      continue;
+    }
+
+    if (send_request(w) < 0 || read_response(w, &status, &close_conn) < 0) {
+      w->errors++;
+      disconnect(w);
+      continue;
+    }
+
+    w->requests++;
+    if (status < 200 || status > 299) w->non2xx++;
+    add_latency(w, (int) ((now() - start) * 1000000.0));
+
+    if (close_conn) disconnect(w);
+  }
+
+  disconnect(w);
+  return NULL;
+}
+
+int compare_int(const void *a, const void *b) {
+  return *(const int *) a - *(const int *) b;
+}
+
+double percentile(int *samples, int n, double pct) {
+  int i;
+
+  if (n == 0) return 0.0;
+  i = (int) (pct / 100.0 * n);
+  if (i >= n) i = n - 1;
+  return samples[i] / 1000.0;
+}
+
+void usage() {
+  fprintf(stderr, "usage: httpbench [options] URL\n\n");
+  fprintf(stderr, "  -c N   number of concurrent connections (default 1)\n");
+  fprintf(stderr, "  -n N   total number of requests (default 1000)\n");
+  fprintf(stderr, "  -t N   run for N seconds instead of a fixed number of requests\n");
+  fprintf(stderr, "  -K     disable keep-alive, use a new connection for each request\n");
+  fprintf(stderr, "  -v     report connection errors\n");
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  struct worker *workers;
+  int nworkers = 1;
+  int requests = 1000;
+  int *samples;
+  int nsamples;
+  double start;
+  double elapsed;
+  double bytes;
+  int total;
+  int errors;
+  int non2xx;
+  int connects;
+  int c;
+  int i;
+
+  while ((c = getopt(argc, argv, "c:n:t:Kv")) != EOF) {
+    switch (c) {
+      case 'c':
+        nworkers = atoi(optarg);
+        break;
+
+      case 'n':
+        requests = atoi(optarg);
+        break;
+
+      case 't':
+        duration = atoi(optarg);
+        break;
+
+      case 'K':
+        keepalive = 0;
+        break;
+
+      case 'v':
+        verbose = 1;
+        break;
+
+      default:
+        usage();
+    }
+  }
+
+  if (optind != argc - 1 || nworkers <= 0 || requests <= 0 || duration < 0) usage();
+  if (parse_url(argv[optind], &target) < 0) {
+    fprintf(stderr, "httpbench: invalid URL %s\n", argv[optind]);
+    return 1;
+  }
+  if (resolve(&target) < 0) {
+    fprintf(stderr, "httpbench: unknown host %s\n", target.host);
+    return 1;
+  }
+
+  workers = (struct worker *) calloc(nworkers, sizeof(struct worker));
+  if (!workers) {
+    fprintf(stderr, "httpbench: out of memory\n");
+    return 1;
+  }
+
+  pthread_mutex_init(&lock, NULL);
+  remaining = requests;
+
+  // Run workers
+  start = now();
+  for (i = 0; i < nworkers; i++) {
+    if (pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]) != 0) {
+      fprintf(stderr, "httpbench: unable to create thread\n");
+      return 1;
+    }
+  }
+
+  if (duration) {
+    sleep(duration);
+    stop = 1;
+  }
+
+  for (i = 0; i < nworkers; i++) pthread_join(workers[i].thread, NULL);
+  elapsed = now() - start;
+  if (elapsed <= 0.0) elapsed = 0.000001;
+
+  // Collect statistics
+  total = errors = non2xx = connects = nsamples = 0;
+  bytes = 0.0;
+  for (i = 0; i < nworkers; i++) {
+    total += workers[i].requests;
+    errors += workers[i].errors;
+    non2xx += workers[i].non2xx;
+    connects += workers[i].connects;
+    bytes += workers[i].bytes;
+    nsamples += workers[i].nlatency;
+  }
+
+  samples = (int *) malloc((nsamples + 1) * sizeof(int));
+  if (!samples) {
+    fprintf(stderr, "httpbench: out of memory\n");
+    return 1;
+  }
+  nsamples = 0;
+  for (i = 0; i < nworkers; i++) {
+    memcpy(samples + nsamples, workers[i].latency, workers[i].nlatency * sizeof(int));
+    nsamples += workers[i].nlatency;
+  }
+  qsort(samples, nsamples, sizeof(int), compare_int);
+
+  printf("URL:          http://%s:%d%s\n", target.host, target.port, target.path);
+  printf("Connections:  %d (%s), %d connects\n", nworkers, keepalive ? "keep-alive" : "close", connects);
+  printf("Requests:     %d completed, %d errors, %d non-2xx\n", total, errors, non2xx);
+  printf("Time:         %.3f s\n", elapsed);
+  printf("Throughput:   %.1f requests/s, %.1f KB/s\n", total / elapsed, bytes / elapsed / 1024.0);
+  if (nsamples > 0) {
+    printf("Latency (ms): min %.3f, p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n",
+           samples[0] / 1000.0, 
+           percentile(samples, nsamples, 50.0), 
+           percentile(samples, nsamples, 90.0),
+           percentile(samples, nsamples, 99.0),
+           samples[nsamples - 1] / 1000.0);
+  }
+
+  return errors > 0 ? 2 : 0;
+}
@@ -0,0 +1,59 @@
+#!/bin/sh
+#
+# Run HTTP benchmark scenarios against a Sanos web server
+#
+# Boot Sanos under qemu with user networking and forward a host port to
+# the web server, e.g.
+#
+#   qemu-system-i386 -hda sanos.vmdk -net nic,model=ne2k_pci \
+#     -net user,hostfwd=tcp::8080-:80
+#
+# or attach it to a tap bridge and use the address of the Sanos machine.
+# Build the host load generator with "make -f Makefile.linux bench-tools"
+# and run
+#
+#   src/utils/httpbench/scenarios.sh http://localhost:8080 [label]
+#
+# The results are written to the console and appended to
+# httpbench-<label>.log, so runs before and after a change can be compared.
+#
+
+: ${HTTPBENCH:="linux/tools/httpbench"}
+: ${DURATION:=10}
+: ${SMALLFILE:="/index.htm"}
+: ${LARGEFILE:="/large.bin"}
+: ${MISSINGFILE:="/missing.htm"}
+
+if [ -z "$1" ] ; then
+  echo "usage: scenarios.sh URL [label]"
+  exit 1
+fi
+
+BASEURL=$1
+LABEL=${2:-`date +%Y%m%d-%H%M%S`}
+LOGFILE=httpbench-${LABEL}.log
+
+run() {
+  NAME=$1
+  shift
+  echo "=== ${NAME}" | tee -a ${LOGFILE}
+  ${HTTPBENCH} -t ${DURATION} "$@" 2>&1 | tee -a ${LOGFILE}
+  echo | tee -a ${LOGFILE}
+}
+
+echo "# httpbench ${LABEL} `date`" >> ${LOGFILE}
+
+# Latency of a single keep-alive connection
+run "small file, 1 connection, keep-alive" -c 1 ${BASEURL}${SMALLFILE}
+
+# Throughput with many concurrent keep-alive connections
+run "small file, 16 connections, keep-alive" -c 16 ${BASEURL}${SMALLFILE}
+
+# Connection setup and teardown cost
+run "small file, 16 connections, no keep-alive" -c 16 -K ${BASEURL}${SMALLFILE}
+
+# Bulk transfer throughput
+run "large file, 4 connections, keep-alive" -c 4 ${BASEURL}${LARGEFILE}
+
+# Error path
+run "missing file, 8 connections, keep-alive" -c 8 ${BASEURL}${MISSINGFILE}
@@ -0,0 +1,437 @@
+//
+// hcache.c
+//
+// HTTP static file cache
+//
+// Copyright (C) 2013 Michael Ringgaard. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 
+// 1. Redistributions of source code must retain the above copyright 
+//    notice, this list of conditions and the following disclaimer.  
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.  
+// 3. Neither the name of the project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission. 
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+// 
+
+#include <os.h>
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <httpd.h>
+
+#define CACHE_HASHSIZE 256
+
+//
+// Cached file variant, i.e. the file itself or its precompressed .gz sibling.
+// The header block holds the Last-Modified, Content-Type, Content-Length and
+// optional Content-Encoding/Vary lines rendered when the file was cached.
+//
+
+struct httpd_cache_variant {
+  char *hdr;
+  int hdrlen;
+  char *body;
+  int bodylen;
+  time_t mtime;
+};
+
+struct httpd_cache_entry {
+  struct httpd_cache_entry *next;
+  struct httpd_cache_entry *lru_next;
+  struct httpd_cache_entry *lru_prev;
+
+  unsigned int hash;
+  char *path;
+  char *filename;
+  int dirindex;
+  char *content_type;
+  time_t checked;
+  int size;
+
+  struct httpd_cache_variant plain;
+  struct httpd_cache_variant gzip;
+};
+
+struct httpd_cache {
+  struct critsect lock;
+  struct httpd_cache_entry *table[CACHE_HASHSIZE];
+  struct httpd_cache_entry *mru;
+  struct httpd_cache_entry *lru;
+
+  int maxsize;
+  int maxfile;
+  int checkinterval;
+  int size;
+};
+
+unsigned int cache_hash(char *path) {
+  unsigned int h = 0;
+
+  while (*path) h = h * 31 + (unsigned char) *path++;
+  return h;
+}
+
+void unlink_lru(struct httpd_cache *cache, struct httpd_cache_entry *e) {
+  if (e->lru_prev) e->lru_prev->lru_next = e->lru_next;
+  if (e->lru_next) e->lru_next->lru_prev = e->lru_prev;
+  if (cache->mru == e) cache->mru = e->lru_next;
+  if (cache->lru == e) cache->lru = e->lru_prev;
+  e->lru_next = e->lru_prev = NULL;
+}
+
+void link_mru(struct httpd_cache *cache, struct httpd_cache_entry *e) {
+  e->lru_prev = NULL;
+  e->lru_next = cache->mru;
+  if (cache->mru) cache->mru->lru_prev = e;
+  cache->mru = e;
+  if (!cache->lru) cache->lru = e;
+}
+
+void free_variant(struct httpd_cache_variant *v) {
+  if (v->hdr) free(v->hdr);
+  if (v->body) free(v->body);
+}
+
+void free_entry(struct httpd_cache_entry *e) {
+  if (e->path) free(e->path);
+  if (e->filename) free(e->filename);
+  free_variant(&e->plain);
+  free_variant(&e->gzip);
+  free(e);
+}
+
+void remove_entry(struct httpd_cache *cache, struct httpd_cache_entry *e) {
+  struct httpd_cache_entry **pe;
+
+  pe = &cache->table[e->hash % CACHE_HASHSIZE];
+  while (*pe && *pe != e) pe = &(*pe)->next;
+  if (*pe) *pe = e->next;
+
+  unlink_lru(cache, e);
+  cache->size -= e->size;
+  free_entry(e);
+}
+
+struct httpd_cache_entry *find_entry(struct httpd_cache *cache, char *path, unsigned int hash) {
+  struct httpd_cache_entry *e;
+
+  e = cache->table[hash % CACHE_HASHSIZE];
+  while (e) {
+    if (e->hash == hash && strcmp(e->path, path) == 0) return e;
+    e = e->next;
+  }
+
+  return NULL;
+}
+
+char *read_file(char *filename, int size) {
+  int fd;
+  int bytes;
+  int left;
+  char *data;
+
+  fd = open(filename, O_RDONLY | O_BINARY);
+  if (fd < 0) return NULL;
+
+  data = (char *) malloc(size > 0 ? size : 1);
+  if (!data) {
+    close(fd);
+    return NULL;
+  }
+
+  left = size;
+  while (left > 0) {
+    bytes = read(fd, data + size - left, left);
+    if (bytes <= 0) break;
+    left -= bytes;
+  }
+
+  close(fd);
+  if (left > 0) {
+    free(data);
+    return NULL;
+  }
+
+  return data;
+}
+
+int render_variant(struct httpd_cache_variant *v, char *content_type, int gzip, int vary) {
+  char buf[512];
+  char datebuf[32];
+
+  sprintf(buf, "Last-Modified: %s\r\n", rfctime(v->mtime, datebuf));
+  if (content_type) {
+    if (strlen(content_type) > 256) return -1;
+    sprintf(buf + strlen(buf), "Content-Type: %s\r\n", content_type);
+  }
+  sprintf(buf + strlen(buf), "Content-Length: %d\r\n", v->bodylen);
+  if (gzip) strcat(buf, "Content-Encoding: gzip\r\n");
+  if (vary) strcat(buf, "Vary: Accept-Encoding\r\n");
+
+  v->hdrlen = strlen(buf);
+  v->hdr = strdup(buf);
+  if (!v->hdr) return -1;
+
+  return 0;
+}
+
+int accepts_gzip(char *encodings) {
+  char *s = encodings;
+  char *token;
+  int len;
+
+  if (!s) return 0;
+  while (*s) {
+    while (*s == ' ' || *s == ',') s++;
+    token = s;
+    while (*s && *s != ',' && *s != ';' && *s != ' ') s++;
+    len = s - token;
+    while (*s == ' ') s++;
+
+    if ((len == 4 && strnicmp(token, "gzip", 4) == 0) || (len == 6 && strnicmp(token, "x-gzip", 6) == 0)) {
+      // Honor an explicit q=0 which means the encoding is not acceptable
+      if (*s == ';') {
+        s++;
+        while (*s == ' ') s++;
+        if ((*s == 'q' || *s == 'Q') && s[1] == '=' && atof(s + 2) == 0.0) return 0;
+      }
+      return 1;
+    }
+
+    while (*s && *s != ',') s++;
+  }
+
+  return 0;
+}
+
+int send_entry(struct httpd_connection *conn, struct httpd_cache_entry *e) {
+  struct httpd_response *rsp = conn->rsp;
+  struct httpd_cache_variant *v;
+  int rc;
+  int head;
+  char buf[512];
+  char datebuf[32];
+
+  v = &e->plain;
+  if (e->gzip.body && accepts_gzip(conn->req->accept_encoding)) v = &e->gzip;
+  head = strcmp(conn->req->method, "HEAD") == 0;
+
+  rsp->content_type = e->content_type;
+  rsp->content_length = v->bodylen;
+  rsp->last_modified = e->plain.mtime;
+
+  if (rsp->last_modified <= conn->req->if_modified_since) {
+    return httpd_send_header(rsp, 304, "Not Modified", NULL);
+  }
+
+  // Build the complete response in the header buffer so it goes out in a single send
+  rsp->status = 200;
+  if (strlen(conn->server->swname) > 256) return -1;
+  sprintf(buf, "HTTP/%s 200 OK\r\nServer: %s\r\nDate: %s\r\n", 
+    conn->req->http11 ? "1.1" : "1.0",
+    conn->server->swname,
+    rfctime(time(0), datebuf));
+
+  rc = expand_buffer(&conn->rsphdr, strlen(buf) + v->hdrlen + 32 + (head ? 0 : v->bodylen));
+  if (rc < 0) return rc;
+
+  rc = bufcat(&conn->rsphdr, buf);
+  if (rc < 0) return rc;
+
+  rc = bufncat(&conn->rsphdr, v->hdr, v->hdrlen);
+  if (rc < 0) return rc;
+
+  if (rsp->keep_alive) {
+    rc = bufcat(&conn->rsphdr, "Connection: Keep-Alive\r\n");
+    if (rc < 0) return rc;
+  }
+
+  rc = bufcat(&conn->rsphdr, "\r\n");
+  if (rc < 0) return rc;
+
+  if (!head && v->bodylen > 0) {
+    rc = bufncat(&conn->rsphdr, v->body, v->bodylen);
+    if (rc < 0) return rc;
+  }
+
+  return 0;
+}
+
+int revalidate_entry(struct httpd_cache *cache, struct httpd_cache_entry *e, time_t now) {
+  struct stat64 statbuf;
+  char gzname[MAXPATH];
+
+  if (now - e->checked < cache->checkinterval) return 1;
+
+  if (stat64(e->filename, &statbuf) < 0) return 0;
+  if ((statbuf.st_mode & S_IFMT) != S_IFREG) return 0;
+  if (statbuf.st_mtime != e->plain.mtime || statbuf.st_size != e->plain.bodylen) return 0;
+
+  if (e->gzip.body) {
+    strcpy(gzname, e->filename);
+    strcat(gzname, ".gz");
+    if (stat64(gzname, &statbuf) < 0) return 0;
+    if (statbuf.st_mtime != e->gzip.mtime || statbuf.st_size != e->gzip.bodylen) return 0;
+  }
+
+  e->checked = now;
+  return 1;
+}
+
+struct httpd_cache *init_file_cache(struct section *cfg) {
+  struct httpd_cache *cache;
+  int maxsize;
+
+  maxsize = getnumconfig(cfg, "cachesize", 1024 * 1024);
+  if (maxsize <= 0) return NULL;
+
+  cache = (struct httpd_cache *) malloc(sizeof(struct httpd_cache));
+  if (!cache) return NULL;
+  memset(cache, 0, sizeof(struct httpd_cache));
+
+  mkcs(&cache->lock);
+  cache->maxsize = maxsize;
+  cache->maxfile = getnumconfig(cfg, "cachemaxfile", 64 * 1024);
+  cache->checkinterval = getnumconfig(cfg, "cachecheck", 1);
+  if (cache->maxfile > cache->maxsize) cache->maxfile = cache->maxsize;
+
+  return cache;
+}
+
+int serve_cached_file(struct httpd_connection *conn) {
+  struct httpd_cache *cache = conn->server->cache;
+  struct httpd_cache_entry *e;
+  char *path = conn->req->path_translated;
+  unsigned int hash;
+  int urllen;
+  int rc;
+
+  if (!cache) return 0;
+  hash = cache_hash(path);
+
+  enter(&cache->lock);
+  e = find_entry(cache, path, hash);
+  if (!e) {
+    leave(&cache->lock);
+    return 0;
+  }
+
+  // Directory index entries must only be used when the URL has a trailing slash
+  if (e->dirindex) {
+    urllen = strlen(conn->req->decoded_url);
+    if (urllen < 1 || conn->req->decoded_url[urllen - 1] != '/') {
+      leave(&cache->lock);
+      return 0;
+    }
+  }
+
+  if (!revalidate_entry(cache, e, time(0))) {
+    remove_entry(cache, e);
+    leave(&cache->lock);
+    return 0;
+  }
+
+  unlink_lru(cache, e);
+  link_mru(cache, e);
+
+  rc = send_entry(conn, e);
+  leave(&cache->lock);
+
+  if (rc < 0) return rc;
+  return 1;
+}
+
+int cache_file(struct httpd_connection *conn, char *filename, struct stat64 *statbuf, int dirindex) {
+  struct httpd_cache *cache = conn->server->cache;
+  struct httpd_cache_entry *e;
+  struct httpd_cache_entry *old;
+  struct stat64 gzstat;
+  char gzname[MAXPATH];
+  int rc;
+
+  if (!cache) return 0;
+  if (statbuf->st_size > cache->maxfile) return 0;
+  if (strlen(filename) + 4 > MAXPATH) return 0;
+
+  e = (struct httpd_cache_entry *) malloc(sizeof(struct httpd_cache_entry));
+  if (!e) return 0;
+  memset(e, 0, sizeof(struct httpd_cache_entry));
+
+  e->path = strdup(conn->req->path_translated);
+  e->filename = strdup(filename);
+  e->hash = cache_hash(e->path);
+  e->dirindex = dirindex;
+  e->content_type = httpd_get_mimetype(conn->server, get_extension(filename));
+  e->checked = time(0);
+  e->plain.mtime = statbuf->st_mtime;
+  e->plain.bodylen = (int) statbuf->st_size;
+  e->plain.body = read_file(filename, e->plain.bodylen);
+  if (!e->path || !e->filename || !e->plain.body) {
+    free_entry(e);
+    return 0;
+  }
+
+  // Pick up a precompressed sibling if it is at least as new as the file
+  strcpy(gzname, filename);
+  strcat(gzname, ".gz");
+  if (stat64(gzname, &gzstat) == 0 && 
+      (gzstat.st_mode & S_IFMT) == S_IFREG &&
+      gzstat.st_mtime >= statbuf->st_mtime &&
+      gzstat.st_size < statbuf->st_size) {
+    e->gzip.mtime = gzstat.st_mtime;
+    e->gzip.bodylen = (int) gzstat.st_size;
+    e->gzip.body = read_file(gzname, e->gzip.bodylen);
+  }
+
+  if (render_variant(&e->plain, e->content_type, 0, e->gzip.body != NULL) < 0 ||
+      (e->gzip.body && render_variant(&e->gzip, e->content_type, 1, 1) < 0)) {
+    free_entry(e);
+    return 0;
+  }
+
+  e->size = sizeof(struct httpd_cache_entry) + strlen(e->path) + strlen(e->filename) + 
+            e->plain.hdrlen + e->plain.bodylen + e->gzip.hdrlen + e->gzip.bodylen;
+  if (e->size > cache->maxsize) {
+    free_entry(e);
+    return 0;
+  }
+
+  enter(&cache->lock);
+
+  // Replace any stale entry for the same path and evict least recently used entries
+  old = find_entry(cache, e->path, e->hash);
+  if (old) remove_entry(cache, old);
+  while (cache->lru && cache->size + e->size > cache->maxsize) remove_entry(cache, cache->lru);
+
+  e->next = cache->table[e->hash % CACHE_HASHSIZE];
+  cache->table[e->hash % CACHE_HASHSIZE] = e;
+  link_mru(cache, e);
+  cache->size += e->size;
+
+  rc = send_entry(conn, e);
+  leave(&cache->lock);
+
+  if (rc < 0) return rc;
+  return 1;
+}
@@ -162,6 +162,7 @@ int ls(struct httpd_connection *conn) {
 int httpd_file_handler(struct httpd_connection *conn) {
   int rc;
   int fd;
+  int dirindex;
   struct stat64 statbuf;
   char *filename;
   char buf[MAXPATH];
@@ -170,7 +171,13 @@ int httpd_file_handler(struct httpd_connection *conn) {
     return httpd_send_error(conn->rsp, 405, "Method Not Allowed", NULL);
   }
 
+  // Try to serve the file from the static file cache
+  rc = serve_cached_file(conn);
+  if (rc < 0) return -1;
+  if (rc > 0) return 0;
+
   filename = conn->req->path_translated;
+  dirindex = 0;
   rc = stat64(filename, &statbuf);
   if (rc < 0) return httpd_return_file_error(conn, errno);
 
@@ -205,6 +212,7 @@ int httpd_file_handler(struct httpd_connection *conn) {
       } else {
         if ((statbuf.st_mode & S_IFMT) == S_IFDIR) return 500;
         filename = buf;
+        dirindex = 1;
       }
     }
   }
@@ -224,6 +232,13 @@ int httpd_file_handler(struct httpd_connection *conn) {
 
   if (strcmp(conn->req->method, "HEAD") == 0) return 0;
 
+  // Small files are read into the cache and served from memory
+  if ((statbuf.st_mode & S_IFMT) == S_IFREG) {
+    rc = cache_file(conn, filename, &statbuf, dirindex);
+    if (rc < 0) return -1;
+    if (rc > 0) return 0;
+  }
+
   fd = open(filename, O_RDONLY | O_BINARY);
   if (fd < 0) return httpd_return_file_error(conn, errno);
 
@@ -98,7 +98,10 @@ int write_log(struct httpd_server *server, char *data, int len, struct tm *tm) {
     char buf[1024];
     int n;
 
-    if (server->logfd >= 0) close(server->logfd);
+    if (server->logfd >= 0) {
+      logflush();
+      close(server->logfd);
+    }
 
     sprintf(logfn, "%s/web%04d%02d%02d.log", server->logdir, year, mon, day);
     server->logfd = open(logfn, O_CREAT | O_APPEND, S_IREAD | S_IWRITE);
@@ -122,7 +125,7 @@ int write_log(struct httpd_server *server, char *data, int len, struct tm *tm) {
     server->logday = day;
   }
 
-  return write(server->logfd, data, len);
+  return logwrite(server->logfd, data, len, 0);
 }
 
 int log_request(struct httpd_request *req) {
@@ -169,6 +169,7 @@ struct httpd_server *httpd_initialize(struct section *cfg) {
   server->indexname = getstrconfig(cfg, "indexname", "index.htm");
   server->swname = getstrconfig(cfg, "swname", gettib()->peb->osname);
   server->allowdirbrowse = getnumconfig(cfg, "allowdirbrowse", 1);
+  server->cache = init_file_cache(cfg);
 
   parse_log_columns(server, getstrconfig(cfg, "logcolumns", "date time c-ip cs-username s-ip s-port cs-method cs-uri-stem cs-uri-query sc-status cs(user-agent)"));
   server->logdir = getstrconfig(cfg, "logdir", NULL);
@@ -540,39 +541,40 @@ int httpd_send(struct httpd_response *rsp, char *data, int len) {
 }
 
 int httpd_flush(struct httpd_response *rsp) {
-  struct httpd_buffer *buf;
+  struct httpd_buffer *hdr = &rsp->conn->rsphdr;
+  struct httpd_buffer *body = &rsp->conn->rspbody;
+  struct iovec iov[2];
+  int n;
   int rc;
 
-  // Send response header if not already done
-  if (!rsp->conn->hdrsent) {
-    buf = &rsp->conn->rsphdr;
-
-    // Generate standard header
-    if (buf->start == buf->end) {
-      rc = httpd_send_header(rsp, 200, "OK", NULL);
-      if (rc < 0) return rc;
-    }
-
-    // Send header
-    if (buf->end != buf->start) {
-      rc = send(rsp->conn->sock, buf->start, buf->end - buf->start, 0);
-      if (rc < 0) return rc;
-
-      buf->start = buf->end;
-    }
+  // Generate standard header if not already done
+  if (!rsp->conn->hdrsent && hdr->start == hdr->end) {
+    rc = httpd_send_header(rsp, 200, "OK", NULL);
+    if (rc < 0) return rc;
+  }
 
-    rsp->conn->hdrsent = 1;
+  // Send response header and body together
+  n = 0;
+  if (!rsp->conn->hdrsent && hdr->end != hdr->start) {
+    iov[n].iov_base = hdr->start;
+    iov[n].iov_len = hdr->end - hdr->start;
+    n++;
+  }
+  if (body->end != body->start) {
+    iov[n].iov_base = body->start;
+    iov[n].iov_len = body->end - body->start;
+    n++;
   }
 
-  // Send response body
-  buf = &rsp->conn->rspbody;
-  if (buf->end != buf->start) {
-    rc = send(rsp->conn->sock, buf->start, buf->end - buf->start, 0);
+  if (n > 0) {
+    rc = writev(rsp->conn->sock, iov, n);
     if (rc < 0) return rc;
-
-    buf->start = buf->end = buf->floor;
   }
 
+  hdr->start = hdr->end;
+  body->start = body->end = body->floor;
+  rsp->conn->hdrsent = 1;
+
   return 0;
 }
 
@@ -825,6 +827,8 @@ int httpd_parse_request(struct httpd_request *req) {
       req->user_agent = s;
     } else if (stricmp(l, "Accept") == 0) {
       req->accept = s;
+    } else if (stricmp(l, "Accept-encoding") == 0) {
+      req->accept_encoding = s;
     } else if (stricmp(l, "Cookie") == 0) {
       req->cookie = s;
     } else if (stricmp(l, "Authorization") == 0) {
@@ -932,42 +936,16 @@ int httpd_translate_path(struct httpd_request *req) {
 }
 
 int httpd_write(struct httpd_connection *conn) {
-  int left;
+  struct iovec iov[3];
+  int n;
   int bytes;
+  int eof;
   int rc;
 
-  // Sent any remaining data in response header
-  left = conn->rsphdr.end - conn->rsphdr.start;
-  if (left > 0) {
-    bytes = send(conn->sock, conn->rsphdr.start, left, 0);
-    if (bytes < 0) return bytes;
-    conn->rsphdr.start += bytes;
-    if (bytes < left) return 1;
-  }
-
-  // Sent any remaining fixed response data
-  left = conn->fixed_rsp_len;
-  if (left > 0) {
-    bytes = send(conn->sock, conn->fixed_rsp_data, left, 0);
-    if (bytes < 0) return bytes;
-    conn->fixed_rsp_data += bytes;
-    conn->fixed_rsp_len -= bytes;
-    if (bytes < left) return 1;
-  }
-
-  // Send response body
   while (1) {
-    // Send any remaining data in response body buffer
-    left = conn->rspbody.end - conn->rspbody.start;
-    if (left > 0) {
-      bytes = send(conn->sock, conn->rspbody.start, left, 0);
-      if (bytes < 0) return bytes;
-      conn->rspbody.start += bytes;
-      if (bytes < left) return 1;
-    }
-
-    // Fill response buffer
-    if (conn->fd >= 0) {
+    // Fill response buffer from file, so the first block goes out with the header
+    eof = 0;
+    if (conn->fd >= 0 && conn->rspbody.end == conn->rspbody.start) {
       // Allocate response body buffer if not already done
       if (conn->rspbody.floor == NULL) {
         rc = allocate_buffer(&conn->rspbody, conn->server->rspbufsiz);
@@ -977,13 +955,54 @@ int httpd_write(struct httpd_connection *conn) {
       // Read from file
       bytes = read(conn->fd, conn->rspbody.floor, buffer_capacity(&conn->rspbody));
       if (bytes < 0) return bytes;
-      if (bytes == 0) return 0;
+      if (bytes == 0) eof = 1;
 
       conn->rspbody.start = conn->rspbody.floor;
       conn->rspbody.end = conn->rspbody.floor + bytes;
-    } else {
-      return 0;
     }
+
+    // Gather any remaining response header, fixed data and body into one write
+    n = 0;
+    if (conn->rsphdr.end != conn->rsphdr.start) {
+      iov[n].iov_base = conn->rsphdr.start;
+      iov[n].iov_len = conn->rsphdr.end - conn->rsphdr.start;
+      n++;
+    }
+    if (conn->fixed_rsp_len > 0) {
+      iov[n].iov_base = conn->fixed_rsp_data;
+      iov[n].iov_len = conn->fixed_rsp_len;
+      n++;
+    }
+    if (conn->rspbody.end != conn->rspbody.start) {
+      iov[n].iov_base = conn->rspbody.start;
+      iov[n].iov_len = conn->rspbody.end - conn->rspbody.start;
+      n++;
+    }
+
+    if (n > 0) {
+      bytes = writev(conn->sock, iov, n);
+      if (bytes < 0) return bytes;
+
+      // Advance past the data that was sent
+      rc = conn->rsphdr.end - conn->rsphdr.start;
+      if (rc > bytes) rc = bytes;
+      conn->rsphdr.start += rc;
+      bytes -= rc;
+
+      rc = conn->fixed_rsp_len;
+      if (rc > bytes) rc = bytes;
+      conn->fixed_rsp_data += rc;
+      conn->fixed_rsp_len -= rc;
+      bytes -= rc;
+
+      conn->rspbody.start += bytes;
+
+      if (conn->rsphdr.end != conn->rsphdr.start) return 1;
+      if (conn->fixed_rsp_len > 0) return 1;
+      if (conn->rspbody.end != conn->rspbody.start) return 1;
+    }
+
+    if (conn->fd < 0 || eof) return 0;
   }
 }
 
@@ -31,6 +31,7 @@
 // SUCH DAMAGE.
 // 
 
+#include <os.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -38,6 +39,11 @@
 #include <unistd.h>
 #include <sys/stat.h>
 
+#define SHELL "sh.exe"
+
+#define MAX_JOBS    16
+#define FILE_HASH_SIZE 256
+
 struct buffer {
   char *start;
   char *end;
@@ -58,6 +64,8 @@ struct list {
 #define PENDING     1
 #define CLEAN       2
 #define DIRTY       3
+#define BUILDING    4
+#define BUILT       5
 
 struct rule {
   char *target;
@@ -69,6 +77,20 @@ struct rule {
   struct rule *build_next;
 };
 
+struct file {
+  char *name;
+  time_t timestamp;
+  struct file *next;
+};
+
+struct job {
+  struct rule *rule;
+  struct item *command;
+  char *cmdline;
+  handle_t phndl;
+  FILE *output;
+};
+
 struct project {
   struct rule *rules_head;  
   struct rule *rules_tail;
@@ -78,8 +100,11 @@ struct project {
   int silent;
   int debug;
   int always_build;
+  int jobs;
   char oldcwd[FILENAME_MAX];
 
+  struct file *files[FILE_HASH_SIZE];
+
   struct rule *build_first;
   struct rule *build_last;
   struct rule *phony;
@@ -186,9 +211,19 @@ void project_init(struct project *prj) {
 
 void project_free(struct project *prj) {
   struct rule *r;
+  struct file *f;
+  int i;
   
   list_free(&prj->targets);
 
+  for (i = 0; i < FILE_HASH_SIZE; i++) {
+    while ((f = prj->files[i]) != NULL) {
+      prj->files[i] = f->next;
+      free(f->name);
+      free(f);
+    }
+  }
+
   r = prj->rules_head;
   while (r != NULL) {
     struct rule *next;
@@ -483,11 +518,26 @@ int parse_makefile(struct project *prj, FILE *f) {
   return 0;
 }
 
-time_t get_timestamp(char *filename) {
+time_t get_timestamp(struct project *prj, char *filename) {
   struct stat st;
-  
-  if (stat(filename, &st) < 0) return -1;
-  return st.st_mtime;
+  struct file *f;
+  unsigned int h;
+  char *p;
+
+  // Each file is only stat'ed once per build
+  h = 0;
+  for (p = filename; *p; p++) h = h * 31 + *p;
+  h %= FILE_HASH_SIZE;
+  for (f = prj->files[h]; f; f = f->next) {
+    if (strcmp(f->name, filename) == 0) return f->timestamp;
+  }
+
+  f = (struct file *) malloc(sizeof(struct file));
+  f->name = strdup(filename);
+  f->timestamp = stat(filename, &st) < 0 ? -1 : st.st_mtime;
+  f->next = prj->files[h];
+  prj->files[h] = f;
+  return f->timestamp;
 }
 
 void mark_for_build(struct project *prj, struct rule *rule) {
@@ -511,7 +561,7 @@ int check_rule(struct project *prj, struct rule *rule) {
   if (rule->status != UNCHECKED) return 0;
       
   // Get timestamp for target
-  rule->timestamp = get_timestamp(rule->target);
+  rule->timestamp = get_timestamp(prj, rule->target);
   
   // If this target does not exist we need to build this rule
   if (rule->timestamp == -1) {
@@ -543,7 +593,7 @@ int check_rule(struct project *prj, struct rule *rule) {
       }
     } else {
       // No rule for dependent, just check the timestamp.
-      time_t t = get_timestamp(item->value);
+      time_t t = get_timestamp(prj, item->value);
       if (rule->timestamp < t) {
         if (prj->debug)  printf("build %s because it is older than %s\n", rule->target, item->value);
         dirty = 1;
@@ -596,9 +646,153 @@ int check_targets(struct project *prj) {
   return 0;
 }
 
+int rule_ready(struct project *prj, struct rule *rule) {
+  struct item *item;
+  struct rule *dep;
+
+  // A rule can be built when all the rules it depends on have been built
+  item = rule->dependencies.head;
+  while (item) {
+    dep = find_rule(prj, item->value);
+    if (dep && (dep->status == DIRTY || dep->status == BUILDING)) return 0;
+    item = item->next;
+  }
+  return 1;
+}
+
+int start_command(struct project *prj, struct job *job) {
+  struct buffer *cmd = &prj->value;
+  struct tib *tib;
+  struct process *proc;
+  char *cmdline;
+  int fd;
+
+  // Expand macros in command.
+  if (expand_macros(job->command->value, prj, job->rule, cmd) < 0) return -1;
+  job->cmdline = strdup(cmd->start);
+
+  // Collect output from command in temporary file
+  job->output = tmpfile();
+  if (!job->output) {
+    perror("tmpfile");
+    return -1;
+  }
+
+  // Start shell for command with output redirected to temporary file
+  cmdline = (char *) malloc(strlen(SHELL) + 1 + strlen(cmd->start) + 1);
+  strcpy(cmdline, SHELL);
+  strcat(cmdline, " ");
+  strcat(cmdline, cmd->start);
+  job->phndl = spawn(P_SUSPEND, SHELL, cmdline, NULL, &tib);
+  free(cmdline);
+  if (job->phndl < 0) {
+    perror(SHELL);
+    fclose(job->output);
+    return -1;
+  }
+
+  proc = tib->proc;
+  fd = fileno(job->output);
+  if (proc->iob[1] != NOHANDLE) close(proc->iob[1]);
+  if (proc->iob[2] != NOHANDLE) close(proc->iob[2]);
+  proc->iob[1] = dup(fd);
+  proc->iob[2] = dup(fd);
+  resume(job->phndl);
+  return 0;
+}
+
+void end_command(struct project *prj, struct job *job) {
+  char buf[512];
+  int n;
+
+  // Output command and its output together
+  if (!prj->silent) printf("%s\n", job->cmdline);
+  fflush(stdout);
+  fseek(job->output, 0, SEEK_SET);
+  while ((n = fread(buf, 1, sizeof(buf), job->output)) > 0) {
+    fwrite(buf, 1, n, stdout);
+  }
+  fflush(stdout);
+
+  fclose(job->output);
+  close(job->phndl);
+  free(job->cmdline);
+}
+
+int build_parallel(struct project *prj) {
+  struct job jobs[MAX_JOBS];
+  handle_t hndls[MAX_JOBS];
+  struct job *job;
+  struct rule *r;
+  int njobs = 0;
+  int failed = 0;
+  int i, rc;
+
+  while (1) {
+    // Start jobs for rules that are ready to be built
+    r = prj->build_first;
+    while (r && !failed && njobs < prj->jobs) {
+      if (r->status == DIRTY && rule_ready(prj, r)) {
+        if (r->commands.head) {
+          job = &jobs[njobs];
+          job->rule = r;
+          job->command = r->commands.head;
+          if (start_command(prj, job) < 0) {
+            failed = 1;
+            break;
+          }
+          r->status = BUILDING;
+          njobs++;
+        } else {
+          r->status = BUILT;
+        }
+      }
+      r = r->build_next;
+    }
+    if (njobs == 0) break;
+
+    // Wait for one of the running commands to complete. The return value
+    // from waitany() is either the index or the exit code, so each job is
+    // checked for completion afterwards.
+    for (i = 0; i < njobs; i++) hndls[i] = jobs[i].phndl;
+    waitany(hndls, njobs, INFINITE);
+    i = 0;
+    while (i < njobs) {
+      job = &jobs[i];
+      rc = waitone(job->phndl, 0);
+      if (rc < 0 && errno == ETIMEOUT) {
+        i++;
+        continue;
+      }
+      end_command(prj, job);
+
+      if (rc != 0) {
+        fprintf(stderr, "make: %s failed with exit code %d\n", job->rule->target, rc);
+        failed = 1;
+      } else if (job->command->next && !failed) {
+        // Run next command in rule
+        job->command = job->command->next;
+        if (start_command(prj, job) == 0) {
+          i++;
+          continue;
+        }
+        failed = 1;
+      } else if (!failed) {
+        job->rule->status = BUILT;
+      }
+
+      // Remove job
+      jobs[i] = jobs[--njobs];
+    }
+  }
+
+  return failed ? -1 : 0;
+}
+
 int build_targets(struct project *prj) {
   struct buffer *cmd = &prj->value;
   struct rule *r = prj->build_first;
+  if (prj->jobs > 1 && !prj->dry_run) return build_parallel(prj);
   while (r) {
     // Run commands in rule.
     struct item *command = r->commands.head;
@@ -624,6 +818,7 @@ void usage() {
   fprintf(stderr, "  -d            Output debug messages.\n");
   fprintf(stderr, "  -f <file>     Read <file> as makefile.\n");
   fprintf(stderr, "  -h            Print this message.\n");
+  fprintf(stderr, "  -j <jobs>     Run up to <jobs> commands in parallel.\n");
   fprintf(stderr, "  -n            Display commands but do not build.\n");
   fprintf(stderr, "  -s            Do not print commands as they are executed.\n");
 }
@@ -643,7 +838,7 @@ int main(int argc, char *argv[]) {
   project_init(&prj);
     
   // Parse command line options
-  while ((c = getopt(argc, argv, "BC:df:hns")) != EOF) {
+  while ((c = getopt(argc, argv, "BC:df:hj:ns")) != EOF) {
     switch (c) {
       case 'B':
         prj.always_build = 1;
@@ -664,6 +859,12 @@ int main(int argc, char *argv[]) {
       case 'h':
         usage();
         return 1;
+
+      case 'j':
+        prj.jobs = atoi(optarg);
+        if (prj.jobs < 1) prj.jobs = 1;
+        if (prj.jobs > MAX_JOBS) prj.jobs = MAX_JOBS;
+        break;
         
       case 'n':
         prj.dry_run = 1;
@@ -760,6 +760,46 @@ int cmd_httpget(int argc, char *argv[]) {
   return 0;
 }
 
+int cmd_prof(int argc, char *argv[]) {
+  char *pargv[2];
+  int rate;
+  int prof;
+  int rc;
+
+  if (argc < 2) {
+    printf("usage: prof start [<rate>] | stop | reset | show | graph\n");
+    return -EINVAL;
+  }
+
+  if (strcmp(argv[1], "show") == 0 || strcmp(argv[1], "graph") == 0) {
+    pargv[0] = "cat";
+    pargv[1] = strcmp(argv[1], "show") == 0 ? "/proc/profile" : "/proc/callgraph";
+    return cmd_cat(2, pargv);
+  }
+
+  prof = open("/dev/prof", 0);
+  if (prof < 0) {
+    printf("/dev/prof: %s\n", strerror(prof));
+    return prof;
+  }
+
+  if (strcmp(argv[1], "start") == 0) {
+    rate = argc > 2 ? atoi(argv[2]) : 0;
+    rc = ioctl(prof, IOCTL_PROF_START, &rate, 4);
+  } else if (strcmp(argv[1], "stop") == 0) {
+    rc = ioctl(prof, IOCTL_PROF_STOP, NULL, 0);
+  } else if (strcmp(argv[1], "reset") == 0) {
+    rc = ioctl(prof, IOCTL_PROF_RESET, NULL, 0);
+  } else {
+    printf("prof: unknown command %s\n", argv[1]);
+    rc = -EINVAL;
+  }
+  close(prof);
+
+  if (rc < 0) printf("prof: %s\n", strerror(errno));
+  return rc;
+}
+
 int cmd_ps(int argc, char *argv[]) {
   struct peb *peb = gettib()->peb;
   struct process *proc = peb->firstproc;
@@ -1530,6 +1570,7 @@ struct command cmdtab[] = {
   {"mv",       cmd_mv,       "Move file"},
   {"nslookup", cmd_nslookup, "Lookup hostname or IP address using DNS"},
   {"play",     cmd_play,     "Play RTTTL file in speaker"},
+  {"prof",     cmd_prof,     "Control sampling profiler"},
   {"ps",       cmd_ps,       "Display process list"},
   {"read",     cmd_read,     "Read file from disk"},
   {"reboot",   cmd_reboot,   "Reboot computer"},
@@ -0,0 +1,137 @@
+//
+// ccbench.c
+//
+// Benchmark for the code generated by cc. The kernels are small integer
+// loops where register variables and the peephole optimizations matter.
+// Build it with and without -O and compare, e.g. with "make ccbench" in
+// this directory. The checksum must be the same for both builds.
+//
+
+#include <os.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CRCSIZE   65536
+#define SIEVESIZE (1 << 20)
+#define SORTSIZE  5000
+
+unsigned char crcbuf[CRCSIZE];
+char sievebuf[SIEVESIZE];
+int sortbuf[SORTSIZE];
+
+unsigned int crc32(unsigned char *p, int n) {
+  unsigned int crc = 0xFFFFFFFF;
+  int k;
+
+  while (n--) {
+    crc ^= *p++;
+    for (k = 0; k < 8; k++) crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+  }
+  return ~crc;
+}
+
+int sieve(char *p, int n) {
+  int i, j, count;
+
+  for (i = 0; i < n; i++) p[i] = 1;
+  for (i = 2; i * i < n; i++) {
+    if (p[i]) {
+      for (j = i * i; j < n; j += i) p[j] = 0;
+    }
+  }
+
+  count = 0;
+  for (i = 2; i < n; i++) count += p[i];
+  return count;
+}
+
+void isort(int *a, int n) {
+  int i, j, t;
+
+  for (i = 1; i < n; i++) {
+    t = a[i];
+    for (j = i - 1; j >= 0 && a[j] > t; j--) a[j + 1] = a[j];
+    a[j + 1] = t;
+  }
+}
+
+int fib(int n) {
+  return n < 2 ? n : fib(n - 1) + fib(n - 2);
+}
+
+unsigned int bench_crc(int rounds) {
+  unsigned int sum = 0;
+  int i;
+
+  for (i = 0; i < CRCSIZE; i++) crcbuf[i] = (unsigned char) (i * 7);
+  for (i = 0; i < rounds; i++) sum += crc32(crcbuf, CRCSIZE);
+  return sum;
+}
+
+unsigned int bench_sieve(int rounds) {
+  unsigned int sum = 0;
+  int i;
+
+  for (i = 0; i < rounds; i++) sum += sieve(sievebuf, SIEVESIZE);
+  return sum;
+}
+
+unsigned int bench_sort(int rounds) {
+  unsigned int seed = 1;
+  unsigned int sum = 0;
+  int i, j;
+
+  for (i = 0; i < rounds; i++) {
+    for (j = 0; j < SORTSIZE; j++) {
+      seed = seed * 1103515245 + 12345;
+      sortbuf[j] = seed >> 8;
+    }
+    isort(sortbuf, SORTSIZE);
+    sum += sortbuf[i % SORTSIZE];
+  }
+  return sum;
+}
+
+unsigned int bench_fib(int rounds) {
+  unsigned int sum = 0;
+  int i;
+
+  for (i = 0; i < rounds; i++) sum += fib(27);
+  return sum;
+}
+
+int bench(char *name, int rounds, unsigned int (*func)(int rounds), unsigned int *checksum) {
+  clock_t start, elapsed;
+  int ms;
+
+  start = clock();
+  *checksum = *checksum * 31 + func(rounds);
+  elapsed = clock() - start;
+  ms = (int) ((double) elapsed * 1000 / CLOCKS_PER_SEC);
+
+  printf("  %-6s %4d rounds in %6d ms\n", name, rounds, ms);
+  return ms;
+}
+
+int main(int argc, char *argv[]) {
+  int scale = 1;
+  int total = 0;
+  unsigned int checksum = 0;
+
+  if (argc > 1) scale = atoi(argv[1]);
+  if (scale <= 0) {
+    fprintf(stderr, "usage: ccbench [scale]\n");
+    return 1;
+  }
+
+  printf("%s:\n", argv[0]);
+  total += bench("crc32", 40 * scale, bench_crc, &checksum);
+  total += bench("sieve", 40 * scale, bench_sieve, &checksum);
+  total += bench("isort", 4 * scale, bench_sort, &checksum);
+  total += bench("fib", 100 * scale, bench_fib, &checksum);
+  printf("  total  %18d ms, checksum %08x\n", total, checksum);
+
+  return 0;
+}
@@ -0,0 +1,368 @@
+//
+// fmtbench.c
+//
+// Accuracy check and benchmark for formatted output. The accuracy check
+// verifies the floating point conversions exactly using big integers, so
+// it does not depend on strtod(). Run with -a for only the accuracy check
+// or -b for only the benchmark.
+//
+
+#include <os.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//
+// Big integers for exact comparisons
+//
+
+#define BIGWORDS 48
+
+struct bignum {
+  int n;
+  unsigned int w[BIGWORDS];
+};
+
+void big_init(struct bignum *b, unsigned __int64 v) {
+  b->w[0] = (unsigned int) v;
+  b->w[1] = (unsigned int) (v >> 32);
+  b->n = b->w[1] ? 2 : 1;
+}
+
+void big_mul(struct bignum *b, unsigned int m) {
+  unsigned __int64 carry = 0;
+  int i;
+
+  for (i = 0; i < b->n; i++) {
+    carry += (unsigned __int64) b->w[i] * m;
+    b->w[i] = (unsigned int) carry;
+    carry >>= 32;
+  }
+  if (carry) b->w[b->n++] = (unsigned int) carry;
+}
+
+void big_shl(struct bignum *b, int bits) {
+  while (bits >= 16) {
+    big_mul(b, 1 << 16);
+    bits -= 16;
+  }
+  if (bits > 0) big_mul(b, 1 << bits);
+}
+
+void big_pow10(struct bignum *b, int n) {
+  while (n >= 9) {
+    big_mul(b, 1000000000);
+    n -= 9;
+  }
+  while (n-- > 0) big_mul(b, 10);
+}
+
+int big_cmp(struct bignum *a, struct bignum *b) {
+  int i;
+
+  while (a->n > 1 && a->w[a->n - 1] == 0) a->n--;
+  while (b->n > 1 && b->w[b->n - 1] == 0) b->n--;
+  if (a->n != b->n) return a->n < b->n ? -1 : 1;
+  for (i = a->n - 1; i >= 0; i--) {
+    if (a->w[i] != b->w[i]) return a->w[i] < b->w[i] ? -1 : 1;
+  }
+  return 0;
+}
+
+// Compare m2 * 2^e2 with m10 * 10^e10
+int cmpexact(unsigned __int64 m2, int e2, unsigned __int64 m10, int e10) {
+  struct bignum a, b;
+
+  big_init(&a, m2);
+  big_init(&b, m10);
+  if (e2 > 0) big_shl(&a, e2); else big_shl(&b, -e2);
+  if (e10 > 0) big_pow10(&b, e10); else big_pow10(&a, -e10);
+  return big_cmp(&a, &b);
+}
+
+//
+// Accuracy check
+//
+
+union dblbits {
+  double d;
+  unsigned __int64 u;
+};
+
+unsigned __int64 rand64() {
+  unsigned __int64 r = 0;
+  int i;
+
+  for (i = 0; i < 5; i++) r = (r << 15) ^ rand();
+  return r;
+}
+
+double randdbl(int i) {
+  union dblbits b;
+
+  switch (i % 3) {
+    case 0:
+      // Random bit pattern
+      do b.u = rand64(); while (((b.u >> 52) & 0x7FF) == 0x7FF);
+      b.u &= 0x7FFFFFFFFFFFFFFFui64;
+      return b.d;
+
+    case 1:
+      // Short decimal fractions
+      return (double) (rand() % 100000) / (double) (rand() % 1000 + 1);
+
+    default:
+      // Values with few significant bits
+      return (double) (rand() % 4096) / (double) (1 << (rand() % 16));
+  }
+}
+
+void decompose(double value, unsigned __int64 *f, int *e) {
+  union dblbits b;
+  int biased_e;
+
+  b.d = value;
+  biased_e = (int) (b.u >> 52) & 0x7FF;
+  *f = b.u & 0x000FFFFFFFFFFFFFui64;
+  if (biased_e) {
+    *f += 0x0010000000000000ui64;
+    *e = biased_e - 1075;
+  } else {
+    *e = -1074;
+  }
+}
+
+unsigned __int64 digitval(char *digits, int n) {
+  unsigned __int64 m = 0;
+  int i;
+
+  for (i = 0; i < n; i++) m = m * 10 + (digits[i] ? digits[i] - '0' : 0);
+  return m;
+}
+
+// Check that the shortest digits convert back to the same value
+int check_shortest(double value) {
+  char buf[32];
+  int decpt, sign, len;
+  unsigned __int64 f, d;
+  int e;
+
+  scvtbuf(value, &decpt, &sign, buf);
+  len = strlen(buf);
+  if (len > 17) return 0;
+  d = digitval(buf, len);
+  decompose(value, &f, &e);
+
+  // The digits must lie strictly between the midpoints to the neighbors
+  if (cmpexact(2 * f + 1, e - 1, d, decpt - len) <= 0) return 0;
+  if (f == 0x0010000000000000ui64 && e > -1074) {
+    if (cmpexact(4 * f - 1, e - 2, d, decpt - len) >= 0) return 0;
+  } else {
+    if (cmpexact(2 * f - 1, e - 1, d, decpt - len) >= 0) return 0;
+  }
+
+  return 1;
+}
+
+// Check that ecvtbuf() rounds correctly (half up) to ndigits
+int check_ecvt(double value, int ndigits) {
+  char buf[CVTBUFSIZE];
+  int decpt, sign;
+  unsigned __int64 f, r;
+  int e;
+
+  ecvtbuf(value, ndigits, &decpt, &sign, buf);
+  if ((int) strlen(buf) != ndigits) return 0;
+  r = digitval(buf, ndigits);
+  decompose(value, &f, &e);
+
+  // (r - 1/2) * 10^k <= value < (r + 1/2) * 10^k
+  if (cmpexact(2 * f, e, 2 * r - 1, decpt - ndigits) < 0) return 0;
+  if (cmpexact(2 * f, e, 2 * r + 1, decpt - ndigits) >= 0) return 0;
+
+  return 1;
+}
+
+// Check that fcvtbuf() rounds correctly (half up) to ndigits decimals
+int check_fcvt(double value, int ndigits) {
+  char buf[CVTBUFSIZE];
+  int decpt, sign, len;
+  unsigned __int64 f, r;
+  int e;
+
+  fcvtbuf(value, ndigits, &decpt, &sign, buf);
+  len = strlen(buf);
+  if (len > 17) return 1;
+  if (len > 0 && decpt - len != -ndigits) return 0;
+  r = digitval(buf, len);
+  decompose(value, &f, &e);
+
+  // (r - 1/2) * 10^-ndigits <= value < (r + 1/2) * 10^-ndigits
+  if (r > 0 && cmpexact(2 * f, e, 2 * r - 1, -ndigits) < 0) return 0;
+  if (cmpexact(2 * f, e, 2 * r + 1, -ndigits) >= 0) return 0;
+
+  return 1;
+}
+
+// Reference integer conversion
+char *refconv(char *buf, unsigned int n, int radix, int neg) {
+  char tmp[40];
+  int i = 0;
+
+  do {
+    tmp[i++] = "0123456789abcdef"[n % radix];
+    n /= radix;
+  } while (n);
+  if (neg) *buf++ = '-';
+  while (i > 0) *buf++ = tmp[--i];
+  *buf = 0;
+  return buf;
+}
+
+int accuracy(int iterations) {
+  char buf[64], ref[64];
+  double value;
+  int i, n, failures;
+  unsigned int u;
+
+  printf("accuracy: %d values\n", iterations);
+
+  failures = 0;
+  for (i = 0; i < iterations; i++) {
+    value = randdbl(i);
+    if (value == 0.0) continue;
+    if (!check_shortest(value)) {
+      if (failures++ < 10) printf("  shortest failed for %.17g\n", value);
+    }
+  }
+  printf("  shortest round-trip: %d failures\n", failures);
+
+  n = failures;
+  failures = 0;
+  for (i = 0; i < iterations; i++) {
+    value = randdbl(i);
+    if (value == 0.0) continue;
+    if (!check_ecvt(value, i % 17 + 1)) {
+      if (failures++ < 10) printf("  ecvt failed for %.17g with %d digits\n", value, i % 17 + 1);
+    }
+  }
+  printf("  ecvt rounding: %d failures\n", failures);
+
+  n += failures;
+  failures = 0;
+  for (i = 0; i < iterations; i++) {
+    value = randdbl(i);
+    if (value == 0.0) continue;
+    if (!check_fcvt(value, i % 20)) {
+      if (failures++ < 10) printf("  fcvt failed for %.17g with %d decimals\n", value, i % 20);
+    }
+  }
+  printf("  fcvt rounding: %d failures\n", failures);
+
+  n += failures;
+  failures = 0;
+  for (i = 0; i < iterations; i++) {
+    u = (unsigned int) rand64();
+    if (i & 1) u >>= rand() % 32;
+
+    sprintf(buf, "%d", (int) u);
+    refconv(ref, (int) u < 0 ? -(int) u : u, 10, (int) u < 0);
+    if (strcmp(buf, ref) != 0) failures++;
+
+    sprintf(buf, "%u", u);
+    refconv(ref, u, 10, 0);
+    if (strcmp(buf, ref) != 0) failures++;
+
+    sprintf(buf, "%x", u);
+    refconv(ref, u, 16, 0);
+    if (strcmp(buf, ref) != 0) failures++;
+
+    sprintf(buf, "%o", u);
+    refconv(ref, u, 8, 0);
+    if (strcmp(buf, ref) != 0) failures++;
+  }
+  printf("  integer conversion: %d failures\n", failures);
+
+  return n + failures;
+}
+
+//
+// Benchmark
+//
+
+void bench(char *name, int iterations, int (*func)(char *buf, int i)) {
+  char buf[256];
+  clock_t start, elapsed;
+  int i;
+
+  start = clock();
+  for (i = 0; i < iterations; i++) func(buf, i);
+  elapsed = clock() - start;
+  if (elapsed <= 0) elapsed = 1;
+
+  printf("  %-10s %8d calls in %6d ms, %9d calls/s\n", name, iterations,
+         (int) ((double) elapsed * 1000 / CLOCKS_PER_SEC),
+         (int) ((double) iterations * CLOCKS_PER_SEC / elapsed));
+}
+
+int bench_int(char *buf, int i) {
+  return sprintf(buf, "%d", i * 7919);
+}
+
+int bench_str(char *buf, int i) {
+  return sprintf(buf, "%s %s", "GET", "/index.html");
+}
+
+int bench_log(char *buf, int i) {
+  return sprintf(buf, "%s - - [%s] \"%s %s HTTP/1.1\" %d %d", "10.0.2.2",
+                 "18/Oct/2026:12:00:00 +0000", "GET", "/index.html", 200, i);
+}
+
+int bench_hex(char *buf, int i) {
+  return sprintf(buf, "%08X %5u %-6d|", i, i, -i);
+}
+
+int bench_flt(char *buf, int i) {
+  return sprintf(buf, "%f %e", i * 0.37, i * 1234.5678);
+}
+
+int bench_gfmt(char *buf, int i) {
+  return sprintf(buf, "%g", 1.0 / (i + 1));
+}
+
+void benchmark(int iterations) {
+  printf("benchmark:\n");
+  bench("%d", iterations, bench_int);
+  bench("%s", iterations, bench_str);
+  bench("log line", iterations, bench_log);
+  bench("hex/width", iterations, bench_hex);
+  bench("%f %e", iterations / 10, bench_flt);
+  bench("%g", iterations / 10, bench_gfmt);
+}
+
+int main(int argc, char *argv[]) {
+  int iterations = 100000;
+  int check = 1;
+  int perf = 1;
+  int failures = 0;
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-a") == 0) {
+      perf = 0;
+    } else if (strcmp(argv[i], "-b") == 0) {
+      check = 0;
+    } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      iterations = atoi(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: fmtbench [-a] [-b] [-n iterations]\n");
+      return 1;
+    }
+  }
+
+  if (check) failures = accuracy(iterations);
+  if (perf) benchmark(iterations);
+
+  return failures ? 1 : 0;
+}
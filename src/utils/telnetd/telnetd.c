@@ -117,8 +117,10 @@ int state = STOPPED;
 int off = 0;
 int on = 1;
 
+#define BUFSIZE 4096
+
 struct buffer {
-  unsigned char data[4096];
+  unsigned char data[BUFSIZE];
   unsigned char *start;
   unsigned char *end;
 };
@@ -129,18 +131,25 @@ struct termstate {
   int code;
   unsigned char optdata[256];
   int optlen;
+  unsigned char optout[64];
+  int optoutlen;
   struct term term;
   struct buffer bi;
-  struct buffer bo;
 };
 
-void sendopt(struct termstate *ts, int code, int option) {
-  unsigned char buf[3];
+void flushopts(struct termstate *ts) {
+  if (ts->optoutlen > 0) {
+    write(ts->sock, ts->optout, ts->optoutlen);
+    ts->optoutlen = 0;
+  }
+}
 
-  buf[0] = TELNET_IAC;
-  buf[1] = (unsigned char) code;
-  buf[2] = (unsigned char) option;
-  write(ts->sock, buf, 3);
+void sendopt(struct termstate *ts, int code, int option) {
+  // Options are queued and sent together by flushopts()
+  if (ts->optoutlen + 3 > sizeof(ts->optout)) flushopts(ts);
+  ts->optout[ts->optoutlen++] = TELNET_IAC;
+  ts->optout[ts->optoutlen++] = (unsigned char) code;
+  ts->optout[ts->optoutlen++] = (unsigned char) option;
 }
 
 void parseopt(struct termstate *ts, int code, int option)
@@ -280,6 +289,7 @@ void __stdcall telnet_task(void *arg) {
   int mux;
   int n;
   int last_was_cr;
+  int pending;
   struct termstate ts;
 
   // Set process identifer
@@ -338,6 +348,7 @@ void __stdcall telnet_task(void *arg) {
   sendopt(&ts, TELNET_WILL, TELOPT_SUPPRESS_GO_AHEAD);
   sendopt(&ts, TELNET_WONT, TELOPT_LINEMODE);
   sendopt(&ts, TELNET_DO, TELOPT_NAWS);
+  flushopts(&ts);
 
   last_was_cr = 0;
   for (;;) {
@@ -371,6 +382,7 @@ void __stdcall telnet_task(void *arg) {
 
         // Parse user input for telnet options
         parse(&ts);
+        flushopts(&ts);
 
         // Fall through
 
@@ -391,30 +403,19 @@ void __stdcall telnet_task(void *arg) {
         break;
 
       case APPATT:
-        // Data arrived from application
-        if (ts.bo.start == ts.bo.end) {
-          // Read data from application
-          n = read(pout[0], ts.bo.data, sizeof ts.bo.data);
-          if (n < 0) goto done;
-          ts.bo.start = ts.bo.data;
-          ts.bo.end = ts.bo.data + n;
-        }
-
-        // Fall through
-
       case USRRDY:
-        // User ready to receive
-        if (ts.bo.start != ts.bo.end) {
-          // Write data to user
-          n = write(s, ts.bo.start, ts.bo.end - ts.bo.start);
-          if (n < 0) goto done;
-          ts.bo.start += n;
-        }
-
-        if (ts.bo.start == ts.bo.end) {
-          dispatch(mux, pout[0], IOEVT_READ | IOEVT_ERROR | IOEVT_CLOSE, APPATT);
-        } else {
+        // Data arrived from application or user ready to receive. Move
+        // application output directly from the pipe to the user.
+        n = splice(pout[0], s, BUFSIZE, SPLICE_F_NONBLOCK);
+        if (n < 0 && errno != EAGAIN) goto done;
+
+        // Wait for the user if output is still pending, otherwise wait for
+        // more output from the application
+        if (ioctl(pout[0], FIONREAD, &pending, sizeof(pending)) < 0) goto done;
+        if (pending > 0) {
           dispatch(mux, s, IOEVT_WRITE | IOEVT_ERROR | IOEVT_CLOSE, USRRDY);
+        } else {
+          dispatch(mux, pout[0], IOEVT_READ | IOEVT_ERROR | IOEVT_CLOSE, APPATT);
         }
         break;
 
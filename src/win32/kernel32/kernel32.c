@@ -426,9 +426,476 @@ void win32_globalhandler(struct siginfo *info) {
   sigexit(info, 0);
 }
 
+//
+// Heaps
+//
+// Private heaps are backed by os.dll heaps and are serialized with a
+// critical section unless created with HEAP_NO_SERIALIZE. When the
+// low-fragmentation front end is enabled with HeapSetInformation(),
+// requests up to LFH_MAX bytes are served from per-size free lists of
+// blocks carved out of larger spans. Each front end block is preceded by
+// a tag word with the LFH_BLOCK bit set. The size word in front of a block
+// from the back end heap is always a multiple of 8, so this bit tells the
+// two kinds of blocks apart. Spans are only returned to the back end heap
+// when the heap is destroyed.
+//
+
+#define HEAP_MAGIC        0x50414548
+#define LFH_BLOCK         4
+#define LFH_MAX           256
+#define LFH_SPANSIZE      (16 * 1024)
+
+#define LFH_CLASS(size)   (((size) + sizeof(size_t) + 7) >> 3)
+#define LFH_CLASSES       (LFH_CLASS(LFH_MAX) + 1)
+
+#define BLOCKTAG(p)       (((size_t *) (p))[-1])
+
+struct win32heap {
+  int magic;
+  struct heap *heap;
+  DWORD flags;
+  int lfh;
+  struct critsect lock;
+  void *freelist[LFH_CLASSES];
+};
+
+static struct win32heap *get_heap(HANDLE hHeap) {
+  struct win32heap *wh = (struct win32heap *) hHeap;
+
+  if (!wh || wh->magic != HEAP_MAGIC) {
+    errno = EINVAL;
+    return NULL;
+  }
+  return wh;
+}
+
+static __inline void lock_heap(struct win32heap *wh, DWORD flags) {
+  if (!((wh->flags | flags) & HEAP_NO_SERIALIZE)) enter(&wh->lock);
+}
+
+static __inline void unlock_heap(struct win32heap *wh, DWORD flags) {
+  if (!((wh->flags | flags) & HEAP_NO_SERIALIZE)) leave(&wh->lock);
+}
+
+static void *lfh_alloc(struct win32heap *wh, SIZE_T size) {
+  int cls = LFH_CLASS(size);
+  int stride = cls << 3;
+  char *span;
+  char *block;
+  void **p;
+  int n;
+
+  p = wh->freelist[cls];
+  if (!p) {
+    // Carve a new span into blocks. The first tag is placed one word into
+    // the span so the blocks are aligned like the back end blocks.
+    span = halloc(wh->heap, LFH_SPANSIZE);
+    if (!span) return NULL;
+
+    n = (LFH_SPANSIZE - sizeof(size_t)) / stride;
+    block = span + 2 * sizeof(size_t) + (n - 1) * stride;
+    while (n-- > 0) {
+      p = (void **) block;
+      BLOCKTAG(p) = (cls << 3) | LFH_BLOCK;
+      *p = wh->freelist[cls];
+      wh->freelist[cls] = p;
+      block -= stride;
+    }
+  }
+
+  wh->freelist[cls] = *p;
+  return p;
+}
+
+static void *alloc_block(struct win32heap *wh, SIZE_T size) {
+  if (wh->lfh && size <= LFH_MAX) return lfh_alloc(wh, size);
+  return halloc(wh->heap, size);
+}
+
+static void free_block(struct win32heap *wh, void *p) {
+  size_t tag = BLOCKTAG(p);
+  int cls;
+
+  if (tag & LFH_BLOCK) {
+    cls = tag >> 3;
+    *(void **) p = wh->freelist[cls];
+    wh->freelist[cls] = p;
+  } else {
+    hfree(wh->heap, p);
+  }
+}
+
+static SIZE_T block_size(void *p) {
+  size_t tag = BLOCKTAG(p);
+
+  if (tag & LFH_BLOCK) return (tag & ~7) - sizeof(size_t);
+  return malloc_usable_size(p);
+}
+
+//
+// Overlapped I/O
+//
+// A completion port is an iomux. Pending socket requests are queued on an
+// aiohandle for the socket, and the socket is dispatched to the iomux of
+// its completion port. The thread that receives the ready socket from the
+// iomux runs the queued requests without blocking and posts a completion
+// packet to the iomux for each request that finishes. Sockets that are
+// not associated with a completion port are dispatched to an internal
+// iomux served by a single background thread, which only signals the
+// event in the OVERLAPPED structure.
+//
+
+#define AIO_HASHSIZE      256
+#define AIO_PORT          1
+
+#define AIO_READY(h)      (((h) << 1) | 1)
+
+struct aioreq {
+  struct aioreq *next;
+  LPOVERLAPPED overlapped;
+  int op;
+  unsigned int flags;
+  int size;
+  int bytes;
+  int *addrlen;
+  struct msghdr msg;
+  struct iovec iov[1];
+};
+
+struct aiohandle {
+  struct aiohandle *next;
+  handle_t h;
+  int flags;
+  HANDLE port;
+  ULONG_PTR key;
+  struct aioreq *recvq;
+  struct aioreq *sendq;
+};
+
+struct aiopacket {
+  DWORD bytes;
+  ULONG_PTR key;
+  LPOVERLAPPED overlapped;
+};
+
+static struct critsect aio_lock;
+static struct aiohandle *aio_handles[AIO_HASHSIZE];
+static handle_t aio_iomux = NOHANDLE;
+
+static struct aiohandle *get_aiohandle(handle_t h, int create) {
+  struct aiohandle *ah;
+  int bucket = h & (AIO_HASHSIZE - 1);
+
+  for (ah = aio_handles[bucket]; ah; ah = ah->next) {
+    if (ah->h == h) return ah;
+  }
+  if (!create) return NULL;
+
+  ah = (struct aiohandle *) malloc(sizeof(struct aiohandle));
+  if (!ah) return NULL;
+  memset(ah, 0, sizeof(struct aiohandle));
+  ah->h = h;
+  ah->next = aio_handles[bucket];
+  aio_handles[bucket] = ah;
+  return ah;
+}
+
+static void free_aiohandle(struct aiohandle *ah) {
+  struct aiohandle **pah = &aio_handles[ah->h & (AIO_HASHSIZE - 1)];
+
+  while (*pah != ah) pah = &(*pah)->next;
+  *pah = ah->next;
+  free(ah);
+}
+
+static void complete_aio(struct aiohandle *ah, LPOVERLAPPED overlapped, int rc, int err) {
+  struct aiopacket *pkt;
+  HANDLE event = (HANDLE) ((ULONG_PTR) overlapped->hEvent & ~1);
+
+  if (rc < 0) {
+    overlapped->InternalHigh = 0;
+    overlapped->Internal = err;
+  } else {
+    overlapped->InternalHigh = rc;
+    overlapped->Internal = 0;
+  }
+
+  // Setting the low-order bit of hEvent suppresses the completion packet
+  if (ah && ah->port && ((ULONG_PTR) overlapped->hEvent & 1) == 0) {
+    pkt = (struct aiopacket *) malloc(sizeof(struct aiopacket));
+    if (pkt) {
+      pkt->bytes = overlapped->InternalHigh;
+      pkt->key = ah->key;
+      pkt->overlapped = overlapped;
+      if (iopost((handle_t) ah->port, (int) pkt) < 0) free(pkt);
+    }
+  }
+
+  if (event) eset((handle_t) event);
+}
+
+//
+// Skip past data that has already been sent. sendmsg() does not update
+// the caller's iovecs, so this is needed before a partially sent request
+// is retried.
+//
+
+static void advance_iovec(struct msghdr *msg, int bytes) {
+  while (bytes > 0 && msg->msg_iovlen > 0) {
+    if ((unsigned int) bytes < msg->msg_iov->iov_len) {
+      msg->msg_iov->iov_base = (char *) msg->msg_iov->iov_base + bytes;
+      msg->msg_iov->iov_len -= bytes;
+      return;
+    }
+    bytes -= msg->msg_iov->iov_len;
+    msg->msg_iov++;
+    msg->msg_iovlen--;
+  }
+}
+
+//
+// Try to run a queued socket request without blocking. Returns 1 and
+// completes the request when it has finished, or 0 if it would block.
+// A partially sent request is advanced past the data sent, so the next
+// attempt continues where it left off.
+//
+
+static int run_aioreq(struct aiohandle *ah, struct aioreq *req, int *result) {
+  int rc;
+
+  if (req->op == AIO_RECV) {
+    rc = recvmsg(ah->h, &req->msg, req->flags | MSG_DONTWAIT);
+    if (rc < 0 && errno == EAGAIN) return 0;
+    if (rc >= 0 && req->addrlen) *req->addrlen = req->msg.msg_namelen;
+  } else {
+    for (;;) {
+      rc = sendmsg(ah->h, &req->msg, req->flags | MSG_DONTWAIT);
+      if (rc < 0) {
+        if (errno == EAGAIN) return 0;
+        break;
+      }
+      req->bytes += rc;
+      if (req->bytes >= req->size) {
+        rc = req->bytes;
+        break;
+      }
+      if (rc == 0) return 0;
+      advance_iovec(&req->msg, rc);
+    }
+  }
+
+  *result = rc < 0 ? -errno : rc;
+  complete_aio(ah, req->overlapped, rc, errno);
+  return 1;
+}
+
+static void __stdcall aio_thread(void *arg);
+
+static void cancel_aioreqs(struct aiohandle *ah, int err) {
+  struct aioreq *req;
+
+  while (ah->recvq || ah->sendq) {
+    if (ah->recvq) {
+      req = ah->recvq;
+      ah->recvq = req->next;
+    } else {
+      req = ah->sendq;
+      ah->sendq = req->next;
+    }
+    complete_aio(ah, req->overlapped, -1, err);
+    free(req);
+  }
+}
+
+static void arm_aiohandle(struct aiohandle *ah) {
+  int events = 0;
+  handle_t iomux;
+
+  if (ah->recvq) events |= IOEVT_READ | IOEVT_CLOSE | IOEVT_ERROR;
+  if (ah->sendq) events |= IOEVT_WRITE | IOEVT_CLOSE | IOEVT_ERROR;
+  if (!events) return;
+
+  if (ah->port) {
+    iomux = (handle_t) ah->port;
+  } else {
+    if (aio_iomux == NOHANDLE) {
+      aio_iomux = mkiomux(0);
+      if (aio_iomux != NOHANDLE) {
+        close(beginthread(aio_thread, 0, NULL, 0, "aio", NULL));
+      }
+    }
+    iomux = aio_iomux;
+  }
+
+  if (iomux == NOHANDLE || dispatch(iomux, ah->h, events, AIO_READY(ah->h)) < 0) {
+    cancel_aioreqs(ah, errno);
+  }
+}
+
+static void process_ready_handle(handle_t h) {
+  struct aiohandle *ah;
+  struct aioreq *req;
+  int result;
+
+  enter(&aio_lock);
+  ah = get_aiohandle(h, 0);
+  if (ah) {
+    while ((req = ah->recvq) != NULL && run_aioreq(ah, req, &result)) {
+      ah->recvq = req->next;
+      free(req);
+    }
+    while ((req = ah->sendq) != NULL && run_aioreq(ah, req, &result)) {
+      ah->sendq = req->next;
+      free(req);
+    }
+    arm_aiohandle(ah);
+  }
+  leave(&aio_lock);
+}
+
+static void __stdcall aio_thread(void *arg) {
+  int context;
+
+  while ((context = waitone(aio_iomux, INFINITE)) >= 0) {
+    if (context & 1) process_ready_handle(context >> 1);
+  }
+}
+
+int __stdcall submit_socket_io(HANDLE s, int op, struct iovec *bufs, int count, unsigned int flags, struct sockaddr *addr, int *addrlen, LPOVERLAPPED overlapped) {
+  struct aiohandle *ah;
+  struct aioreq *req;
+  struct aioreq **queue;
+  int result;
+  int i;
+
+  req = (struct aioreq *) malloc(sizeof(struct aioreq) + (count - 1) * sizeof(struct iovec));
+  if (!req) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  memset(req, 0, sizeof(struct aioreq));
+  req->overlapped = overlapped;
+  req->op = op;
+  req->flags = flags;
+  for (i = 0; i < count; i++) {
+    req->iov[i] = bufs[i];
+    req->size += bufs[i].iov_len;
+  }
+  req->msg.msg_iov = req->iov;
+  req->msg.msg_iovlen = count;
+  req->msg.msg_name = addr;
+  req->msg.msg_namelen = addrlen ? *addrlen : 0;
+  if (op == AIO_RECV) req->addrlen = addrlen;
+
+  overlapped->Internal = STATUS_PENDING;
+  overlapped->InternalHigh = 0;
+  if (overlapped->hEvent) ereset((handle_t) ((ULONG_PTR) overlapped->hEvent & ~1));
+
+  enter(&aio_lock);
+  ah = get_aiohandle((handle_t) s, 1);
+  if (!ah) {
+    leave(&aio_lock);
+    free(req);
+    errno = ENOMEM;
+    return -1;
+  }
+
+  // Requests complete at once if there is nothing queued ahead of them
+  // and the socket is ready. The completion packet is still posted.
+  queue = op == AIO_RECV ? &ah->recvq : &ah->sendq;
+  if (!*queue && run_aioreq(ah, req, &result)) {
+    leave(&aio_lock);
+    free(req);
+    if (result < 0) {
+      errno = -result;
+      return -1;
+    }
+    return result;
+  }
+
+  while (*queue) queue = &(*queue)->next;
+  *queue = req;
+  arm_aiohandle(ah);
+  leave(&aio_lock);
+
+  errno = EPENDING;
+  return -1;
+}
+
+static BOOL overlapped_file_io(HANDLE hFile, int op, void *buffer, DWORD size, LPDWORD transferred, LPOVERLAPPED overlapped) {
+  struct stat64 st;
+  struct iovec iov;
+  off64_t offset;
+  int rc;
+
+  // Only file handles can be stat'ed, anything else is treated as a socket
+  if (fstat64((handle_t) hFile, &st) < 0) {
+    iov.iov_base = buffer;
+    iov.iov_len = size;
+    rc = submit_socket_io(hFile, op, &iov, 1, 0, NULL, NULL, overlapped);
+  } else {
+    // File I/O is done synchronously and then completed as overlapped I/O
+    overlapped->Internal = STATUS_PENDING;
+    if (overlapped->hEvent) ereset((handle_t) ((ULONG_PTR) overlapped->hEvent & ~1));
+
+    offset = ((off64_t) overlapped->OffsetHigh << 32) | overlapped->Offset;
+    if (S_ISREG(st.st_mode)) {
+      rc = op == AIO_RECV ? pread((handle_t) hFile, buffer, size, offset) : pwrite((handle_t) hFile, buffer, size, offset);
+    } else {
+      rc = op == AIO_RECV ? read((handle_t) hFile, buffer, size) : write((handle_t) hFile, buffer, size);
+    }
+
+    enter(&aio_lock);
+    complete_aio(get_aiohandle((handle_t) hFile, 0), overlapped, rc, errno);
+    leave(&aio_lock);
+  }
+
+  if (rc < 0) return FALSE;
+  if (transferred) *transferred = rc;
+  return TRUE;
+}
+
+BOOL WINAPI CancelIo(
+    HANDLE hFile) {
+  struct aiohandle *ah;
+
+  TRACE("CancelIo");
+  enter(&aio_lock);
+  ah = get_aiohandle((handle_t) hFile, 0);
+  if (ah) cancel_aioreqs(ah, ECANCELED);
+  leave(&aio_lock);
+  return TRUE;
+}
+
 BOOL WINAPI CloseHandle(
     HANDLE hObject) {
+  struct aiohandle *ah;
+  int context;
+  int i;
+
   TRACE("CloseHandle");
+  enter(&aio_lock);
+  ah = get_aiohandle((handle_t) hObject, 0);
+  if (ah) {
+    if (ah->flags & AIO_PORT) {
+      // Discard queued completion packets and detach handles from the port
+      while ((context = waitone((handle_t) hObject, 0)) >= 0) {
+        if ((context & 1) == 0) free((void *) context);
+      }
+      for (i = 0; i < AIO_HASHSIZE; i++) {
+        struct aiohandle *a;
+        for (a = aio_handles[i]; a; a = a->next) {
+          if (a->port == hObject) a->port = NULL;
+        }
+      }
+    } else {
+      cancel_aioreqs(ah, ECANCELED);
+    }
+    free_aiohandle(ah);
+  }
+  leave(&aio_lock);
+
   if (close((handle_t) hObject) < 0) return FALSE;
   return TRUE;
 }
@@ -605,6 +1072,48 @@ HANDLE WINAPI CreateFileW(
   return CreateFileA(fn, dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);
 }
 
+HANDLE WINAPI CreateIoCompletionPort(
+    HANDLE FileHandle,
+    HANDLE ExistingCompletionPort,
+    ULONG_PTR CompletionKey,
+    DWORD NumberOfConcurrentThreads) {
+  struct aiohandle *ah;
+  HANDLE port;
+
+  TRACE("CreateIoCompletionPort");
+  enter(&aio_lock);
+  port = ExistingCompletionPort;
+  if (!port) {
+    port = (HANDLE) mkiomux(0);
+    if (port == (HANDLE) NOHANDLE) {
+      leave(&aio_lock);
+      return NULL;
+    }
+    ah = get_aiohandle((handle_t) port, 1);
+    if (!ah) {
+      leave(&aio_lock);
+      close((handle_t) port);
+      errno = ENOMEM;
+      return NULL;
+    }
+    ah->flags |= AIO_PORT;
+  }
+
+  if (FileHandle != INVALID_HANDLE_VALUE) {
+    ah = get_aiohandle((handle_t) FileHandle, 1);
+    if (!ah) {
+      leave(&aio_lock);
+      errno = ENOMEM;
+      return NULL;
+    }
+    ah->port = port;
+    ah->key = CompletionKey;
+  }
+  leave(&aio_lock);
+
+  return port;
+}
+
 BOOL WINAPI CreatePipe(
     PHANDLE hReadPipe, 
     PHANDLE hWritePipe, 
@@ -1205,6 +1714,10 @@ DWORD WINAPI GetLastError(VOID) {
   if (errno == 0) return 0;
   if (errno == ENOENT) return ERROR_FILE_NOT_FOUND;
   if (errno == ESRCH) return ERROR_NO_MORE_FILES;
+  if (errno == EPENDING) return ERROR_IO_PENDING;
+  if (errno == EINPROGRESS) return ERROR_IO_INCOMPLETE;
+  if (errno == ECANCELED) return ERROR_OPERATION_ABORTED;
+  if (errno == ETIMEOUT) return WAIT_TIMEOUT;
   return 0x80040000 | errno;
 }
 
@@ -1259,9 +1772,29 @@ BOOL WINAPI GetOverlappedResult(
     LPOVERLAPPED lpOverlapped,
     LPDWORD lpNumberOfBytesTransferred,
     BOOL bWait) {
+  HANDLE event = (HANDLE) ((ULONG_PTR) lpOverlapped->hEvent & ~1);
+
   TRACE("GetOverlappedResult");
-  panic("GetOverlappedResult not implemented");
-  return FALSE;
+  while (lpOverlapped->Internal == STATUS_PENDING) {
+    if (!bWait) {
+      errno = EINPROGRESS;
+      return FALSE;
+    }
+
+    if (event) {
+      waitone((handle_t) event, INFINITE);
+    } else {
+      msleep(1);
+    }
+  }
+
+  *lpNumberOfBytesTransferred = lpOverlapped->InternalHigh;
+  if (lpOverlapped->Internal != 0) {
+    errno = lpOverlapped->Internal;
+    return FALSE;
+  }
+
+  return TRUE;
 }
 
 FARPROC WINAPI GetProcAddress(
@@ -1286,6 +1819,54 @@ HANDLE WINAPI GetProcessHeap(VOID) {
   return PROCESSHEAP;
 }
 
+BOOL WINAPI GetQueuedCompletionStatus(
+    HANDLE CompletionPort,
+    LPDWORD lpNumberOfBytes,
+    PULONG_PTR lpCompletionKey,
+    LPOVERLAPPED *lpOverlapped,
+    DWORD dwMilliseconds) {
+  struct aiopacket *pkt;
+  LPOVERLAPPED overlapped;
+  clock_t start;
+  int timeout;
+  int context;
+
+  TRACE("GetQueuedCompletionStatus");
+  start = clock();
+  timeout = dwMilliseconds;
+  for (;;) {
+    context = waitone((handle_t) CompletionPort, timeout);
+    if (context < 0) {
+      *lpOverlapped = NULL;
+      return FALSE;
+    }
+
+    if ((context & 1) == 0) break;
+
+    // A socket with queued requests is ready, run the requests and wait
+    // for the completion packets they post
+    process_ready_handle(context >> 1);
+    if (dwMilliseconds != INFINITE) {
+      timeout = dwMilliseconds - (clock() - start);
+      if (timeout < 0) timeout = 0;
+    }
+  }
+
+  pkt = (struct aiopacket *) context;
+  overlapped = pkt->overlapped;
+  *lpNumberOfBytes = pkt->bytes;
+  *lpCompletionKey = pkt->key;
+  *lpOverlapped = overlapped;
+  free(pkt);
+
+  if (overlapped && overlapped->Internal != 0) {
+    errno = overlapped->Internal;
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 HANDLE WINAPI GetStdHandle(
     DWORD nStdHandle) {
   TRACE("GetStdHandle");
@@ -1507,29 +2088,249 @@ LPVOID WINAPI HeapAlloc(
     HANDLE hHeap,
     DWORD dwFlags,
     SIZE_T dwBytes) {
+  struct win32heap *wh;
+  void *p;
+
   TRACE("HeapAlloc");
-  if (hHeap != PROCESSHEAP) {
-    syslog(LOG_DEBUG, "warning: HeapAlloc only supported for process heap");
+  if (hHeap == PROCESSHEAP) {
+    if (dwFlags & HEAP_ZERO_MEMORY) return calloc(1, dwBytes);
+    return malloc(dwBytes);
+  }
+
+  wh = get_heap(hHeap);
+  if (!wh) return NULL;
+
+  lock_heap(wh, dwFlags);
+  p = alloc_block(wh, dwBytes);
+  unlock_heap(wh, dwFlags);
+
+  if (!p) {
+    errno = ENOMEM;
     return NULL;
   }
 
-  return malloc(dwBytes);
+  if (dwFlags & HEAP_ZERO_MEMORY) memset(p, 0, block_size(p));
+  return p;
+}
+
+HANDLE WINAPI HeapCreate(
+    DWORD flOptions,
+    SIZE_T dwInitialSize,
+    SIZE_T dwMaximumSize) {
+  struct win32heap *wh;
+
+  TRACE("HeapCreate");
+  if (dwMaximumSize != 0 && dwInitialSize > dwMaximumSize) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  wh = (struct win32heap *) malloc(sizeof(struct win32heap));
+  memset(wh, 0, sizeof(struct win32heap));
+
+  // A maximum size of zero makes a growable heap. The initial size is
+  // committed when the heap is created.
+  wh->heap = mkheap(dwMaximumSize, dwInitialSize);
+  if (!wh->heap) {
+    free(wh);
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  wh->flags = flOptions & HEAP_NO_SERIALIZE;
+  if (!(wh->flags & HEAP_NO_SERIALIZE)) mkcs(&wh->lock);
+  wh->magic = HEAP_MAGIC;
+
+  return (HANDLE) wh;
+}
+
+BOOL WINAPI HeapDestroy(
+    HANDLE hHeap) {
+  struct win32heap *wh;
+
+  TRACE("HeapDestroy");
+  if (hHeap == PROCESSHEAP) {
+    errno = EINVAL;
+    return FALSE;
+  }
+
+  wh = get_heap(hHeap);
+  if (!wh) return FALSE;
+
+  wh->magic = 0;
+  rmheap(wh->heap);
+  if (!(wh->flags & HEAP_NO_SERIALIZE)) csfree(&wh->lock);
+  free(wh);
+
+  return TRUE;
 }
 
 BOOL WINAPI HeapFree(
     HANDLE hHeap,
     DWORD dwFlags,
     LPVOID lpMem) {
+  struct win32heap *wh;
+
   TRACE("HeapFree");
-  if (hHeap != PROCESSHEAP) {
-    syslog(LOG_DEBUG, "warning: HeapFree only supported for process heap");
+  if (hHeap == PROCESSHEAP) {
+    free(lpMem);
+    return TRUE;
+  }
+
+  wh = get_heap(hHeap);
+  if (!wh) return FALSE;
+  if (!lpMem) return TRUE;
+
+  lock_heap(wh, dwFlags);
+  free_block(wh, lpMem);
+  unlock_heap(wh, dwFlags);
+
+  return TRUE;
+}
+
+BOOL WINAPI HeapQueryInformation(
+    HANDLE HeapHandle,
+    HEAP_INFORMATION_CLASS HeapInformationClass,
+    PVOID HeapInformation,
+    SIZE_T HeapInformationLength,
+    PSIZE_T ReturnLength) {
+  struct win32heap *wh;
+  ULONG mode;
+
+  TRACE("HeapQueryInformation");
+  if (HeapInformationClass != HeapCompatibilityInformation) {
+    errno = EINVAL;
     return FALSE;
   }
 
-  free(lpMem);
+  if (HeapHandle == PROCESSHEAP) {
+    mode = 0;
+  } else {
+    wh = get_heap(HeapHandle);
+    if (!wh) return FALSE;
+    mode = wh->lfh ? 2 : 0;
+  }
+
+  if (ReturnLength) *ReturnLength = sizeof(ULONG);
+  if (!HeapInformation || HeapInformationLength < sizeof(ULONG)) {
+    errno = EINVAL;
+    return FALSE;
+  }
+
+  *(ULONG *) HeapInformation = mode;
   return TRUE;
 }
 
+LPVOID WINAPI HeapReAlloc(
+    HANDLE hHeap,
+    DWORD dwFlags,
+    LPVOID lpMem,
+    SIZE_T dwBytes) {
+  struct win32heap *wh;
+  SIZE_T oldsize;
+  void *p;
+
+  TRACE("HeapReAlloc");
+  if (!lpMem) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if (hHeap == PROCESSHEAP) {
+    oldsize = malloc_usable_size(lpMem);
+    if (dwFlags & HEAP_REALLOC_IN_PLACE_ONLY) {
+      p = dwBytes <= oldsize ? lpMem : NULL;
+    } else {
+      p = realloc(lpMem, dwBytes);
+    }
+  } else {
+    wh = get_heap(hHeap);
+    if (!wh) return NULL;
+
+    lock_heap(wh, dwFlags);
+    oldsize = block_size(lpMem);
+    if (dwBytes <= oldsize && ((BLOCKTAG(lpMem) & LFH_BLOCK) || (dwFlags & HEAP_REALLOC_IN_PLACE_ONLY))) {
+      p = lpMem;
+    } else if (dwFlags & HEAP_REALLOC_IN_PLACE_ONLY) {
+      p = NULL;
+    } else if ((BLOCKTAG(lpMem) & LFH_BLOCK) || (wh->lfh && dwBytes <= LFH_MAX)) {
+      p = alloc_block(wh, dwBytes);
+      if (p) {
+        memcpy(p, lpMem, oldsize < dwBytes ? oldsize : dwBytes);
+        free_block(wh, lpMem);
+      }
+    } else {
+      p = hrealloc(wh->heap, lpMem, dwBytes);
+    }
+    unlock_heap(wh, dwFlags);
+  }
+
+  if (!p) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  if ((dwFlags & HEAP_ZERO_MEMORY) && dwBytes > oldsize) {
+    memset((char *) p + oldsize, 0, dwBytes - oldsize);
+  }
+
+  return p;
+}
+
+BOOL WINAPI HeapSetInformation(
+    HANDLE HeapHandle,
+    HEAP_INFORMATION_CLASS HeapInformationClass,
+    PVOID HeapInformation,
+    SIZE_T HeapInformationLength) {
+  struct win32heap *wh;
+  ULONG mode;
+
+  TRACE("HeapSetInformation");
+  if (HeapInformationClass == HeapEnableTerminationOnCorruption) return TRUE;
+  if (HeapInformationClass != HeapCompatibilityInformation || !HeapInformation || HeapInformationLength < sizeof(ULONG)) {
+    errno = EINVAL;
+    return FALSE;
+  }
+
+  mode = *(ULONG *) HeapInformation;
+  if (mode != 0 && mode != 2) {
+    errno = EINVAL;
+    return FALSE;
+  }
+
+  // The process heap already has its own small block bins
+  if (HeapHandle == PROCESSHEAP) return TRUE;
+
+  wh = get_heap(HeapHandle);
+  if (!wh) return FALSE;
+
+  // The front end cannot be disabled once blocks have been handed out
+  if (mode == 0 && wh->lfh) {
+    errno = EINVAL;
+    return FALSE;
+  }
+
+  lock_heap(wh, 0);
+  if (mode == 2) wh->lfh = 1;
+  unlock_heap(wh, 0);
+
+  return TRUE;
+}
+
+SIZE_T WINAPI HeapSize(
+    HANDLE hHeap,
+    DWORD dwFlags,
+    LPCVOID lpMem) {
+  TRACE("HeapSize");
+  if (!lpMem) {
+    errno = EINVAL;
+    return (SIZE_T) -1;
+  }
+
+  if (hHeap == PROCESSHEAP) return malloc_usable_size((void *) lpMem);
+  if (!get_heap(hHeap)) return (SIZE_T) -1;
+  return block_size((void *) lpMem);
+}
 
 VOID WINAPI InitializeCriticalSection(
     LPCRITICAL_SECTION lpCriticalSection) {
@@ -1716,6 +2517,31 @@ BOOL WINAPI PeekNamedPipe(
   return FALSE;
 }
 
+BOOL WINAPI PostQueuedCompletionStatus(
+    HANDLE CompletionPort,
+    DWORD dwNumberOfBytesTransferred,
+    ULONG_PTR dwCompletionKey,
+    LPOVERLAPPED lpOverlapped) {
+  struct aiopacket *pkt;
+
+  TRACE("PostQueuedCompletionStatus");
+  pkt = (struct aiopacket *) malloc(sizeof(struct aiopacket));
+  if (!pkt) {
+    errno = ENOMEM;
+    return FALSE;
+  }
+
+  pkt->bytes = dwNumberOfBytesTransferred;
+  pkt->key = dwCompletionKey;
+  pkt->overlapped = lpOverlapped;
+  if (iopost((handle_t) CompletionPort, (int) pkt) < 0) {
+    free(pkt);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 BOOL WINAPI QueryPerformanceCounter(
     LARGE_INTEGER *lpPerformanceCount) {
   TRACEX("QueryPerformanceCounter");
@@ -1744,7 +2570,7 @@ BOOL WINAPI ReadFile(
   int rc;
 
   TRACE("ReadFile");
-  if (lpOverlapped) panic("Overlapped I/O not implemented in ReadFile");
+  if (lpOverlapped) return overlapped_file_io(hFile, AIO_RECV, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, lpOverlapped);
 
   rc = read((handle_t) hFile, lpBuffer, nNumberOfBytesToRead);
   if (rc < 0) return FALSE;
@@ -2294,7 +3120,7 @@ BOOL WINAPI WriteFile(
   int rc;
 
   TRACE("WriteFile");
-  if (lpOverlapped) panic("Overlapped I/O not implemented in WriteFile");
+  if (lpOverlapped) return overlapped_file_io(hFile, AIO_SEND, (void *) lpBuffer, nNumberOfBytesToWrite, lpNumberOfBytesWritten, lpOverlapped);
 
   rc = write((handle_t) hFile, lpBuffer, nNumberOfBytesToWrite);
   if (rc < 0) return FALSE;
@@ -2305,6 +3131,9 @@ BOOL WINAPI WriteFile(
 
 int __stdcall DllMain(handle_t hmod, int reason, void *reserved) {
   if (reason == DLL_PROCESS_ATTACH) {
+    // Initialize overlapped I/O lock
+    mkcs(&aio_lock);
+
     // Register global WIN32 handler for all signals
     struct peb *peb = gettib()->peb;
     old_globalhandler = peb->globalhandler;
@@ -49,6 +49,11 @@
 
 #define WSAERRBASE              10000
 
+#define WSA_IO_PENDING          ERROR_IO_PENDING
+#define WSA_OPERATION_ABORTED   ERROR_OPERATION_ABORTED
+
+BOOL __stdcall CloseHandle(HANDLE hObject);
+
 typedef handle_t SOCKET;
 typedef handle_t WSAEVENT;
 typedef struct iovec WSABUF;
@@ -152,7 +157,9 @@ sockapi int __stdcall winsock_connect(SOCKET s, const struct sockaddr *name, int
 
 sockapi int __stdcall winsock_closesocket(SOCKET s) {
   TRACE("closesocket");
-  return close(s);
+
+  // Close through kernel32 to cancel pending overlapped I/O
+  return CloseHandle((HANDLE) s) ? 0 : -1;
 }
 
 sockapi int __stdcall winsock_shutdown(SOCKET s, int how) {
@@ -251,6 +258,8 @@ sockapi int __stdcall WSAGetLastError() {
   
   if (err == 0) return 0;
   if (err == EAGAIN) return EWOULDBLOCK + WSAERRBASE;
+  if (err == EPENDING) return WSA_IO_PENDING;
+  if (err == ECANCELED) return WSA_OPERATION_ABORTED;
   if (err == EBADF) return ENOTSOCK + WSAERRBASE;
   if (err < 45) return err + WSAERRBASE;
   if (err < 82) return (err - 10) + WSAERRBASE;
@@ -282,9 +291,17 @@ sockapi int __stdcall WSARecvFrom(
 
   TRACE("WSARecvFrom");
   
-  if (lpOverlapped != NULL) panic("Overlapped I/O not implemented in WSARecvFrom");
   if (lpCompletionRoutine != NULL) panic("Completion routines not implemented in WSARecvFrom");
 
+  if (lpOverlapped != NULL) {
+    rc = submit_socket_io((HANDLE) s, AIO_RECV, lpBuffers, dwBufferCount, lpFlags ? *lpFlags : 0, lpFrom, lpFromlen, lpOverlapped);
+    if (rc < 0) return -1;
+
+    if (lpNumberOfBytesRecvd) *lpNumberOfBytesRecvd = rc;
+    if (lpFlags) *lpFlags = 0;
+    return 0;
+  }
+
   msg.msg_iov = lpBuffers;
   msg.msg_iovlen = dwBufferCount;
   msg.msg_name = lpFrom;
@@ -313,9 +330,16 @@ sockapi int __stdcall WSASendTo(
 
   TRACE("WSASendTo");
   
-  if (lpOverlapped != NULL) panic("Overlapped I/O not implemented in WSASendTo");
   if (lpCompletionRoutine != NULL) panic("Completion routines not implemented in WSASendTo");
 
+  if (lpOverlapped != NULL) {
+    rc = submit_socket_io((HANDLE) s, AIO_SEND, lpBuffers, dwBufferCount, dwFlags, (struct sockaddr *) lpTo, &iToLen, lpOverlapped);
+    if (rc < 0) return -1;
+
+    if (lpNumberOfBytesSent) *lpNumberOfBytesSent = rc;
+    return 0;
+  }
+
   msg.msg_iov = lpBuffers;
   msg.msg_iovlen = dwBufferCount;
   msg.msg_name = (struct sockaddr *) lpTo;
@@ -414,9 +438,17 @@ sockapi int __stdcall WSARecv(
 
   TRACE("WSARecv");
 
-  if (lpOverlapped != NULL) panic("Overlapped I/O not implemented in WSARecv");
   if (lpCompletionRoutine != NULL) panic("Completion routines not implemented in WSARecv");
 
+  if (lpOverlapped != NULL) {
+    rc = submit_socket_io((HANDLE) s, AIO_RECV, lpBuffers, dwBufferCount, lpFlags ? *lpFlags : 0, NULL, NULL, lpOverlapped);
+    if (rc < 0) return -1;
+
+    if (lpNumberOfBytesRecvd) *lpNumberOfBytesRecvd = rc;
+    if (lpFlags) *lpFlags = 0;
+    return 0;
+  }
+
   rc = readv(s, lpBuffers, dwBufferCount);
   if (rc < 0) return -1;
 
@@ -436,9 +468,16 @@ sockapi int __stdcall WSASend(
 
   TRACE("WSASend");
 
-  if (lpOverlapped != NULL) panic("Overlapped I/O not implemented in WSASend");
   if (lpCompletionRoutine != NULL) panic("Completion routines not implemented in WSASend");
 
+  if (lpOverlapped != NULL) {
+    rc = submit_socket_io((HANDLE) s, AIO_SEND, lpBuffers, dwBufferCount, dwFlags, NULL, NULL, lpOverlapped);
+    if (rc < 0) return -1;
+
+    if (lpNumberOfBytesSent) *lpNumberOfBytesSent = rc;
+    return 0;
+  }
+
   rc = writev(s, lpBuffers, dwBufferCount);
   if (rc < 0) return -1;
 
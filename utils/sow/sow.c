@@ -1272,6 +1272,10 @@ int pipe(handle_t fildes[2]) {
   return 0;
 }
 
+int splice(handle_t in, handle_t out, size_t size, int flags) {
+  return notimpl("splice");
+}
+
 int __getstdhndl(int n) {
   return n;
 }
@@ -1422,6 +1426,10 @@ int dispatch(handle_t iomux, handle_t h, int events, int context) {
   return notimpl("dispatch");
 }
 
+int iopost(handle_t iomux, int context) {
+  return notimpl("iopost");
+}
+
 int sysinfo(int cmd, void *data, size_t size) {
   return notimpl("sysinfo");
 }
@@ -1966,15 +1974,32 @@ int canonicalize(const char *filename, char *buffer, int size) {
   return 0;
 }
 
+int futex_wait(int *addr, int value, unsigned int timeout) {
+  unsigned int start = GetTickCount();
+
+  // No keyed wait in Win32, so poll the futex until it changes
+  while (*addr == value) {
+    if (timeout != INFINITE && GetTickCount() - start >= timeout) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+    Sleep(1);
+  }
+
+  return 0;
+}
+
+int futex_wake(int *addr, int count) {
+  return 0;
+}
+
 void mkcs(critsect_t cs) {
-  cs->count = -1;
+  cs->lock = 0;
   cs->recursion = 0;
   cs->owner = NOHANDLE;
-  cs->event = mkevent(0, 0);
 }
 
 void csfree(critsect_t cs) {
-  close(cs->event);
 }
 
 void enter(critsect_t cs) {
@@ -1983,7 +2008,9 @@ void enter(critsect_t cs) {
   if (cs->owner == tid) {
     cs->recursion++;
   } else {   
-    if (atomic_add(&cs->count, 1) > 0) waitone(cs->event, INFINITE);
+    if (atomic_compare_and_exchange(&cs->lock, 1, 0) != 0) {
+      while (atomic_exchange(&cs->lock, 2) != 0) futex_wait(&cs->lock, 2, INFINITE);
+    }
     cs->owner = tid;
   }
 }
@@ -1994,7 +2021,7 @@ void leave(critsect_t cs) {
     cs->recursion--;
   } else {
     cs->owner = NOHANDLE;
-    if (atomic_add(&cs->count, -1) >= 0) eset(cs->event);
+    if (atomic_exchange(&cs->lock, 0) == 2) futex_wake(&cs->lock, 1);
   }
 }
 
@@ -2041,6 +2068,30 @@ void _lfree(void *p) {
   free(p);
 }
 
+struct heap *mkheap(size_t reserve, size_t commit) {
+  return (struct heap *) HeapCreate(HEAP_NO_SERIALIZE, commit, reserve);
+}
+
+int rmheap(struct heap *heap) {
+  return HeapDestroy((HANDLE) heap) ? 0 : -EINVAL;
+}
+
+void *halloc(struct heap *heap, size_t size) {
+  return HeapAlloc((HANDLE) heap, 0, size);
+}
+
+void *hrealloc(struct heap *heap, void *mem, size_t size) {
+  return mem ? HeapReAlloc((HANDLE) heap, 0, mem, size) : HeapAlloc((HANDLE) heap, 0, size);
+}
+
+void *hcalloc(struct heap *heap, size_t num, size_t size) {
+  return HeapAlloc((HANDLE) heap, HEAP_ZERO_MEMORY, size * num);
+}
+
+void hfree(struct heap *heap, void *p) {
+  if (p) HeapFree((HANDLE) heap, 0, p);
+}
+
 hmodule_t dlopen(const char *name, int mode) {
   char fn[MAXPATH];
 
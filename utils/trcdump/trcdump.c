@@ -0,0 +1,243 @@
+//
+// trcdump.c
+//
+// Kernel trace decoder
+//
+// Copyright (C) 2013 Michael Ringgaard. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 
+// 1. Redistributions of source code must retain the above copyright 
+//    notice, this list of conditions and the following disclaimer.  
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.  
+// 3. Neither the name of the project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission. 
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+// OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+// SUCH DAMAGE.
+// 
+
+//
+// Decodes a copy of /proc/trace into a timeline. Usage:
+//
+//   trcdump [-s] [-l usecs] tracefile
+//
+//   -s        print per-event counts and system call latency summary
+//   -l usecs  only show system calls that took longer than usecs,
+//             together with everything that happened meanwhile
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#define __int64 long long
+#endif
+
+#define krnlapi
+#include "trace.h"
+
+#define MAX_TIDS   4096
+#define MAX_EVENTS 32
+#define MAX_SYSCALLS 256
+
+static char *tcp_states[] = {
+  "CLOSED", "LISTEN", "SYN_SENT", "SYN_RCVD", "ESTABLISHED", "FIN_WAIT_1",
+  "FIN_WAIT_2", "CLOSE_WAIT", "CLOSING", "LAST_ACK", "TIME_WAIT"
+};
+
+struct sysstat {
+  unsigned long count;
+  double total;
+  double max;
+};
+
+static struct trace_header hdr;
+static struct trace_record *recs;
+static double mhz;
+
+static int entered[MAX_TIDS];            // Record index of pending syscall entry + 1
+static unsigned long evcount[MAX_EVENTS];
+static struct sysstat sysstat[MAX_SYSCALLS];
+
+static char *event_name(int event) {
+  switch (event) {
+    case TRACE_SWITCH: return "switch";
+    case TRACE_SYSCALL_ENTER: return "syscall";
+    case TRACE_SYSCALL_EXIT: return "sysret";
+    case TRACE_BUF_MISS: return "bufmiss";
+    case TRACE_DEV_SUBMIT: return "devio";
+    case TRACE_DEV_COMPLETE: return "devdone";
+    case TRACE_TCP_STATE: return "tcpstate";
+  }
+  return "user";
+}
+
+static char *tcp_state_name(unsigned long state) {
+  if (state < sizeof(tcp_states) / sizeof(char *)) return tcp_states[state];
+  return "?";
+}
+
+static double usecs(unsigned __int64 cycles) {
+  return (double) (__int64) cycles / mhz;
+}
+
+static void print_record(int i) {
+  struct trace_record *rec = &recs[i];
+  double t = usecs(rec->tsc - recs[0].tsc);
+  double delta = i > 0 ? usecs(rec->tsc - recs[i - 1].tsc) : 0.0;
+
+  printf("%12.3f %+9.3f %4u %-9s", t, delta, rec->tid, event_name(rec->event));
+  switch (rec->event) {
+    case TRACE_SWITCH:
+      printf("%u -> %u", rec->arg1, rec->arg2);
+      break;
+
+    case TRACE_SYSCALL_ENTER:
+      printf("#%u", rec->arg1);
+      break;
+
+    case TRACE_SYSCALL_EXIT:
+      printf("#%u rc=%ld", rec->arg1, (long) rec->arg2);
+      break;
+
+    case TRACE_BUF_MISS:
+      printf("dev %u blk %u", rec->arg1, rec->arg2);
+      break;
+
+    case TRACE_DEV_SUBMIT:
+      printf("dev %u %s blk %u", rec->arg1 >> 1, rec->arg1 & 1 ? "write" : "read", rec->arg2);
+      break;
+
+    case TRACE_DEV_COMPLETE:
+      printf("dev %u %s rc=%ld", rec->arg1 >> 1, rec->arg1 & 1 ? "write" : "read", (long) rec->arg2);
+      break;
+
+    case TRACE_TCP_STATE:
+      printf("pcb %08x %s -> %s", rec->arg1, tcp_state_name(rec->arg2 >> 16), tcp_state_name(rec->arg2 & 0xFFFF));
+      break;
+
+    default:
+      printf("event %d %08x %08x", rec->event, rec->arg1, rec->arg2);
+  }
+  printf("\n");
+}
+
+static void usage() {
+  fprintf(stderr, "usage: trcdump [-s] [-l usecs] tracefile\n");
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  FILE *f;
+  char *filename = NULL;
+  int summary = 0;
+  double threshold = -1.0;
+  unsigned int n;
+  int i, j;
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-s") == 0) {
+      summary = 1;
+    } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+      threshold = atof(argv[++i]);
+    } else if (argv[i][0] == '-' || filename) {
+      usage();
+    } else {
+      filename = argv[i];
+    }
+  }
+  if (!filename) usage();
+
+  // Read trace header and records
+  f = fopen(filename, "rb");
+  if (!f) {
+    perror(filename);
+    return 1;
+  }
+  if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != TRACE_MAGIC) {
+    fprintf(stderr, "%s: not a kernel trace\n", filename);
+    return 1;
+  }
+  if (hdr.version != TRACE_VERSION) {
+    fprintf(stderr, "%s: unsupported trace version %u\n", filename, hdr.version);
+    return 1;
+  }
+  recs = (struct trace_record *) malloc((hdr.records + 1) * sizeof(struct trace_record));
+  if (!recs) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  n = fread(recs, sizeof(struct trace_record), hdr.records, f);
+  fclose(f);
+  if (n != hdr.records) fprintf(stderr, "%s: truncated, %u of %u records\n", filename, n, hdr.records);
+  mhz = hdr.cpu_mhz ? hdr.cpu_mhz : 1;
+
+  printf("%u records, %u lost, %u MHz, event mask %08x\n\n", n, hdr.lost, hdr.cpu_mhz, hdr.mask);
+  if (threshold < 0.0 && !summary) {
+    printf("        time     delta  tid event    details\n");
+    printf("------------ --------- ---- -------- ------------------------------\n");
+  }
+
+  // Decode records
+  for (i = 0; i < (int) n; i++) {
+    struct trace_record *rec = &recs[i];
+    unsigned long tid = rec->tid % MAX_TIDS;
+
+    if (rec->event < MAX_EVENTS) evcount[rec->event]++;
+
+    if (rec->event == TRACE_SYSCALL_ENTER) {
+      entered[tid] = i + 1;
+    } else if (rec->event == TRACE_SYSCALL_EXIT && entered[tid]) {
+      int start = entered[tid] - 1;
+      double latency = usecs(rec->tsc - recs[start].tsc);
+      struct sysstat *ss = &sysstat[rec->arg1 % MAX_SYSCALLS];
+
+      ss->count++;
+      ss->total += latency;
+      if (latency > ss->max) ss->max = latency;
+      entered[tid] = 0;
+
+      if (threshold >= 0.0 && latency > threshold && !summary) {
+        printf("syscall #%u in thread %u took %.3f us:\n", rec->arg1, rec->tid, latency);
+        for (j = start; j <= i; j++) print_record(j);
+        printf("\n");
+      }
+    }
+
+    if (threshold < 0.0 && !summary) print_record(i);
+  }
+
+  if (summary) {
+    printf("event     count\n");
+    printf("-------- --------\n");
+    for (i = 0; i < MAX_EVENTS; i++) {
+      if (evcount[i]) printf("%-8s %8lu\n", event_name(i), evcount[i]);
+    }
+
+    printf("\nsyscall    calls    avg us    max us\n");
+    printf("------- -------- --------- ---------\n");
+    for (i = 0; i < MAX_SYSCALLS; i++) {
+      struct sysstat *ss = &sysstat[i];
+      if (ss->count) printf("%7d %8lu %9.3f %9.3f\n", i, ss->count, ss->total / ss->count, ss->max);
+    }
+  }
+
+  free(recs);
+  return 0;
+}